@@ -242,6 +242,34 @@
 #define LWS_SERVER_OPTION_DISABLE_TLS_SESSION_CACHE		 (1ll << 39)
 	/**< (VHOST) Disallow use of client tls caching (on by default) */
 
+#define LWS_SERVER_OPTION_EPOLL					 (1ll << 40)
+	/**< (CTX) Use the native Linux epoll() event loop instead of poll() */
+
+#define LWS_SERVER_OPTION_EPOLL_EDGE_TRIGGERED			 (1ll << 41)
+	/**< (CTX) With LWS_SERVER_OPTION_EPOLL, register plain connected
+	 * sockets edge-triggered */
+
+#define LWS_SERVER_OPTION_IO_URING				 (1ll << 42)
+	/**< (CTX) Use the native Linux io_uring event loop.  Plain h1 and raw
+	 * server sockets also accept, read and write on the ring if the kernel
+	 * can do it, others are polled through it.  Falls back to poll() if
+	 * the kernel doesn't support io_uring */
+
+#define LWS_SERVER_OPTION_LISTEN_PER_THREAD			 (1ll << 43)
+	/**< (VH) On linux with more than one service thread, each thread
+	 * already listens on its own SO_REUSEPORT socket.  With this, a
+	 * connection stays on the thread whose socket accepted it, instead of
+	 * being handed to the least busy thread, so the kernel's spreading of
+	 * connections across the sockets does the load balancing.  A thread
+	 * that is full still hands new connections off. */
+
+#define LWS_SERVER_OPTION_LISTEN_CPU_STEERING			 (1ll << 44)
+	/**< (VH) With LWS_SERVER_OPTION_LISTEN_PER_THREAD, also attach a
+	 * classic BPF program to the listen sockets that picks the socket of
+	 * service thread (cpu % threads) for each connection, by the cpu that
+	 * handles it in the kernel.  It helps when the service threads are
+	 * pinned to cpus matching the nic queue irq affinity. */
+
 
 	/****** add new things just above ---^ ******/
 
@@ -972,6 +1000,51 @@ struct lws_context_creation_info {
 	/**< CONTEXT: NULL, or interface name to bind outgoing WOL packet to */
 #endif
 
+#if defined(LWS_WITH_SYS_ASYNC_DNS)
+	unsigned int		async_dns_cache_max;
+	/**< CONTEXT: 0 for the default of 10, or the max number of resolved
+	 * names to keep in the async dns cache before dropping the lru ones */
+#endif
+
+	unsigned int		http_header_data_inline;
+	/**< CONTEXT: 0 for the default of 1024, or how many bytes of header
+	 * data an ah holds before it needs more.  Headers that don't fit spill
+	 * into a second buffer of max_http_header_data, which is given back
+	 * when the ah is detached.  Set it to max_http_header_data or more to
+	 * never spill. */
+	unsigned int		max_http_header_pool_spare;
+	/**< CONTEXT: 0 for the default of 4, or how many detached ahs (and
+	 * spill buffers) each service thread keeps to reuse instead of freeing.
+	 * The pool grows up to max_http_header_pool ahs in use and shrinks
+	 * back to this many idle ones as they are detached. */
+
+	uint32_t		h2_rx_window_max;
+	/**< VHOST: 0 for the default of 16MiB, or the most an h2 stream's
+	 * receive window may grow to.  lws grows the windows it gives the peer
+	 * to match the bandwidth-delay product it measures on the connection,
+	 * so one stream can fill a fast link with a long rtt, but it won't
+	 * let it go over this. */
+
+	unsigned int		buflist_pool_spare;
+	/**< CONTEXT: 0 for the default of 8, or how many used-up buflist
+	 * segments of each size class each service thread keeps to reuse,
+	 * for buffering partial writes and rx flow control, instead of
+	 * freeing them. */
+
+	size_t			pmd_mem_budget;
+	/**< CONTEXT: 0 for no limit, or roughly how many bytes of zlib state
+	 * permessage-deflate may have allocated, split evenly between the
+	 * service threads.  Once a thread has used its share, new server
+	 * connections on it offer a smaller server_max_window_bits and
+	 * compress using less memory, and idle z_streams are freed instead of
+	 * pooled.  Connections that negotiated no_context_takeover only hold
+	 * z_streams while a message is in flight, whatever the budget. */
+
+	const char		*async_dns_hosts_path;
+	/**< CONTEXT: NULL for the platform hosts file, eg, /etc/hosts, or the
+	 * path of a hosts file for async dns to look in instead.  It's parsed
+	 * again whenever its mtime or size changes. */
+
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
 	 *
@@ -1380,6 +1453,7 @@ struct lws_http_mount {
 	unsigned int cache_revalidate:1; /**< set if client cache should revalidate on use */
 	unsigned int cache_intermediaries:1; /**< set if intermediaries are allowed to cache */
 	unsigned int cache_no:1; /**< set if client should check cache always*/
+	unsigned int zero_copy:1; /**< set to allow sending files with sendfile() when possible */
 
 	unsigned char origin_protocol; /**< one of enum lws_mount_protocols */
 	unsigned char mountpoint_len; /**< length of mountpoint string */
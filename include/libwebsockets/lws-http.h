@@ -337,6 +337,9 @@ enum lws_token_indexes {
 #endif
 	WSI_TOKEN_X_AUTH_TOKEN,
 	WSI_TOKEN_DSS_SIGNATURE,
+#if defined(LWS_ROLE_H2) || defined(LWS_HTTP_HEADERS_ALL)
+	WSI_TOKEN_HTTP_PRIORITY, /* RFC9218 */
+#endif
 
 	/****** add new things just above ---^ ******/
 
@@ -515,6 +518,36 @@ typedef void (*lws_hdr_custom_fe_cb_t)(const char *name, int nlen, void *opaque)
 LWS_VISIBLE LWS_EXTERN int
 lws_hdr_custom_name_foreach(struct lws *wsi, lws_hdr_custom_fe_cb_t cb, void *opaque);
 
+struct lws_hdr_custom_get {
+	const char	*name;	/**< header name (including terminating :) */
+	int		nlen;	/**< length of name */
+	const char	*value;	/**< set to NUL-terminated copy of value, or NULL */
+	int		vlen;	/**< set to length of value, or -1 if absent */
+};
+
+/**
+ * lws_hdr_custom_copy_multi() - copy value parts of several custom headers
+ *
+ * \param wsi: websocket connection
+ * \param g: array of custom headers to look for
+ * \param count: number of entries in g
+ * \param buf: buffer to receive the copies
+ * \param len: number of bytes available at buf
+ *
+ * Looks up each header named in g[], and if it exists, copies its value into
+ * buf followed by a terminating NUL and points g[].value at the copy.  Names
+ * are matched without regard to case, and each lookup costs about the same
+ * whatever the number of custom headers on the connection.
+ *
+ * This api returns -1 if there is no header information on the connection or
+ * buf was too small to hold all the values, otherwise the number of headers
+ * that were found.  Lws must be built with LWS_WITH_CUSTOM_HEADERS (on by
+ * default) to use this api.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_hdr_custom_copy_multi(struct lws *wsi, struct lws_hdr_custom_get *g,
+			  int count, char *buf, int len);
+
 /**
  * lws_get_urlarg_by_name_safe() - get copy and return length of y for x=y urlargs
  *
@@ -1025,5 +1058,77 @@ lws_h2_update_peer_txcredit(struct lws *wsi, unsigned int sid, int bump);
 LWS_VISIBLE LWS_EXTERN int
 lws_h2_get_peer_txcredit_estimate(struct lws *wsi);
 
+/**
+ * lws_h2_get_hpack_tx_stats() - return header compression stats for connection
+ *
+ * \param wsi: the h2 network connection, or any of its child streams
+ * \param raw: set to the header bytes sent if they were all plain literals
+ * \param wire: set to the header bytes actually sent
+ *
+ * lws compresses the headers it sends on h2 using the HPACK static and dynamic
+ * tables and Huffman coding, this lets you see how much it saved on the
+ * connection so far: the compression ratio is wire / raw.
+ *
+ * Returns 0 for success or nonzero if wsi is not h2.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_h2_get_hpack_tx_stats(struct lws *wsi, uint64_t *raw, uint64_t *wire);
+
+#define LWS_H2_URGENCY_LEVELS		8
+#define LWS_H2_URGENCY_DEFAULT		3
+
+/**
+ * lws_h2_set_priority() - set the RFC9218 priority of an h2 stream
+ *
+ * \param wsi: the h2 child stream
+ * \param urgency: 0 (most urgent) to 7, the default is 3
+ * \param incremental: 0 if the stream's data is only useful once all of it
+ *		       arrives, 1 if it can share the connection with others
+ *
+ * When several streams on a connection want to send, lws sends on the ones
+ * with the lowest urgency first.  At the same urgency, non-incremental streams
+ * are sent one at a time, and incremental streams take turns.
+ *
+ * Server streams normally get the priority the client gave in the "priority"
+ * header, or later in a PRIORITY_UPDATE frame; this lets user code override
+ * that, until the next PRIORITY_UPDATE from the client.
+ *
+ * Returns 0 for success or nonzero if wsi is not an h2 stream or the urgency is
+ * out of range.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_h2_set_priority(struct lws *wsi, int urgency, int incremental);
+
+/**
+ * lws_h2_get_urgency_tx_stats() - return DATA sent per urgency for connection
+ *
+ * \param wsi: the h2 network connection, or any of its child streams
+ * \param counts: array of LWS_H2_URGENCY_LEVELS to set to the DATA payload bytes
+ *		  sent at each urgency so far
+ *
+ * Returns 0 for success or nonzero if wsi is not h2.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_h2_get_urgency_tx_stats(struct lws *wsi, uint64_t *counts);
+
+/**
+ * lws_h2_get_rx_window_stats() - return rx window autotuning state
+ *
+ * \param wsi: the h2 network connection, or any of its child streams
+ * \param window: set to the rx window lws currently gives each stream
+ * \param srtt: set to the smoothed rtt measured on the connection in us, or 0
+ *		if it hasn't been measured yet
+ *
+ * lws keeps the peer's credit for sending to us topped up to a window that
+ * starts at 128KiB, and grows to the bandwidth-delay product it measures while
+ * DATA is arriving, up to the vhost's .h2_rx_window_max.  If received data is
+ * left buffered instead of consumed, the window shrinks again.
+ *
+ * Returns 0 for success or nonzero if wsi is not h2.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_h2_get_rx_window_stats(struct lws *wsi, uint32_t *window,
+			   lws_usec_t *srtt);
+
 ///@}
 
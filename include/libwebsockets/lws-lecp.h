@@ -48,6 +48,10 @@
 /* must be >= 30 to assemble floats */
 #define LECP_STRING_CHUNK		254
 #endif
+#ifndef LECP_MATCH_CACHE_DEPTH
+/* path prefixes we remember which paths can still match, 0 disables */
+#define LECP_MATCH_CACHE_DEPTH		4
+#endif
 
 #define LECP_FLAG_CB_IS_VALUE 64
 
@@ -242,6 +246,18 @@ struct _lecp_parsing_stack {
 	uint8_t			path_match;
 };
 
+/*
+ * For a prefix of the current path, bitmaps of the paths (by index) that the
+ * path could still match when more is appended to it, and of the ones among
+ * them that matched the prefix literally, as in lejp
+ */
+
+struct _lecp_match_cache {
+	uint8_t			viable[32]; /* count_paths can't exceed 255 */
+	uint8_t			lit[32];
+	uint8_t			len; /* path length this applies to */
+};
+
 struct lecp_ctx {
 
 	/* sorted by type for most compact alignment
@@ -259,6 +275,9 @@ struct lecp_ctx {
 	uint16_t		wild[LECP_MAX_INDEX_DEPTH]; /* index array */
 	char			path[LECP_MAX_PATH];
 	uint8_t			cbor[64]; /* literal cbor capture */
+#if LECP_MATCH_CACHE_DEPTH
+	struct _lecp_match_cache mc[LECP_MATCH_CACHE_DEPTH];
+#endif
 
 	struct lecp_item	item;
 
@@ -294,6 +313,7 @@ struct lecp_ctx {
 	char			present; /* temp for cb reason to use */
 
 	uint8_t			be; /* big endian */
+	uint8_t			mc_count; /* valid mc[] entries */
 
 	/* at end so we can memset the rest of it */
 
@@ -193,6 +193,10 @@ typedef signed char (*lejp_callback)(struct lejp_ctx *ctx, char reason);
 /* must be >= 30 to assemble floats */
 #define LEJP_STRING_CHUNK 254
 #endif
+#ifndef LEJP_MATCH_CACHE_DEPTH
+/* path prefixes we remember which paths can still match, 0 disables */
+#define LEJP_MATCH_CACHE_DEPTH 8
+#endif
 
 enum num_flags {
 	LEJP_SEEN_MINUS		= (1 << 0),
@@ -217,6 +221,19 @@ struct _lejp_parsing_stack {
 	uint8_t			path_match;
 };
 
+/*
+ * For a prefix of the current path, bitmaps of the paths (by index) that the
+ * path could still match when more is appended to it, so matching further
+ * down the tree only has to look at those, and of the ones among them that
+ * matched the prefix literally, so they can be compared from the end of it
+ */
+
+struct _lejp_match_cache {
+	uint8_t			viable[32]; /* count_paths can't exceed 255 */
+	uint8_t			lit[32];
+	uint8_t			len; /* path length this applies to */
+};
+
 struct lejp_ctx {
 
 	/* sorted by type for most compact alignment
@@ -233,6 +250,9 @@ struct lejp_ctx {
 	uint16_t wild[LEJP_MAX_INDEX_DEPTH]; /* index array */
 	char path[LEJP_MAX_PATH];
 	char buf[LEJP_STRING_CHUNK + 1];
+#if LEJP_MATCH_CACHE_DEPTH
+	struct _lejp_match_cache mc[LEJP_MATCH_CACHE_DEPTH];
+#endif
 
 	/* size_t */
 
@@ -265,6 +285,7 @@ struct lejp_ctx {
 	uint8_t wildcount;
 	uint8_t pst_sp; /* parsing stack head */
 	uint8_t outer_array;
+	uint8_t mc_count; /* valid mc[] entries, zero if you change path[] */
 };
 
 LWS_VISIBLE LWS_EXTERN void
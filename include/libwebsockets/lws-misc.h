@@ -57,6 +57,89 @@ struct lws_buflist;
 LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
 			   size_t len);
+typedef void (*lws_buflist_release_cb)(void *opaque);
+
+/**
+ * lws_buflist_append_ref(): add a reference to caller's buffer to buflist
+ *
+ * \param head: list head
+ * \param buf: buffer to reference
+ * \param len: length of buffer to reference
+ * \param release: NULL, or called with \p opaque when the segment is used up
+ *		    or destroyed
+ * \param opaque: passed to \p release
+ *
+ * Like lws_buflist_append_segment(), but the data is not copied: the segment
+ * points into \p buf, which must stay valid and unchanged until \p release
+ * is called.  Since segments are used up in order, for several segments
+ * referencing the same storage it's enough to give \p release on the last.
+ *
+ * Unlike copied segments, there's no LWS_PRE available before the data.
+ *
+ * Returns -1 on OOM, 1 if this was the first segment on the list, and 0 if
+ * it was a subsequent segment.
+ */
+LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
+lws_buflist_append_ref(struct lws_buflist **head, const uint8_t *buf,
+		       size_t len, lws_buflist_release_cb release,
+		       void *opaque);
+
+typedef struct lws_buflist_pool lws_buflist_pool_t;
+
+/**
+ * lws_buflist_pool_create(): create a pool of reusable buflist segments
+ *
+ * \param spare: how many freed segments of each size class to keep for reuse
+ *
+ * Segments appended with lws_buflist_append_segment_pool() are allocated in a
+ * few size classes, up to 16KiB, and when they're used up they go back on the
+ * pool's freelist for their class instead of being freed, until it holds
+ * \p spare of them.  Larger segments are allocated and freed as usual.
+ *
+ * The pool is not threadsafe: buflists using it must only be appended to
+ * and consumed from one thread at a time.
+ *
+ * Returns NULL on OOM.
+ */
+LWS_VISIBLE LWS_EXTERN lws_buflist_pool_t *
+lws_buflist_pool_create(unsigned int spare);
+
+/**
+ * lws_buflist_pool_destroy(): destroy a buflist segment pool
+ *
+ * \param pool: pointer to the pool pointer, set to NULL
+ *
+ * Frees the pool's spare segments.  Segments from the pool still on some
+ * buflist stay valid, and are freed as usual when they're used up or their
+ * buflist destroyed; the pool itself goes when the last one does.
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_buflist_pool_destroy(lws_buflist_pool_t **pool);
+
+/**
+ * lws_buflist_append_segment_pool(): add buffer to buflist using a pool
+ *
+ * \param pool: NULL, or the pool to get the segment from
+ * \param head: list head
+ * \param buf: buffer to stash
+ * \param len: length of buffer to stash
+ * \param coalesce: 0, or 1 to allow appending to the last segment
+ *
+ * Like lws_buflist_append_segment(), but takes segments from \p pool.
+ *
+ * If \p coalesce is set and the last segment on the list, other than the
+ * first, has enough unused space left over from its size class, the data is
+ * copied on to the end of it instead of creating a new segment.  Only allow that for a byte stream:
+ * where the segments are datagrams or messages, their boundaries are lost.
+ *
+ * Returns -1 on OOM, 1 if this was the first segment on the list, and 0 if
+ * it was a subsequent segment or coalesced.
+ */
+LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
+lws_buflist_append_segment_pool(lws_buflist_pool_t *pool,
+				struct lws_buflist **head, const uint8_t *buf,
+				size_t len, int coalesce);
+
 /**
  * lws_buflist_next_segment_len(): number of bytes left in current segment
  *
@@ -160,7 +243,7 @@ lws_buflist_fragment_use(struct lws_buflist **head, uint8_t *buf,
  * \param head: list head
  *
  * This frees everything on the list unconditionally.  *head is always
- * NULL after this.
+ * NULL after this.  Release callbacks of referencing segments are called.
  */
 LWS_VISIBLE LWS_EXTERN void
 lws_buflist_destroy_all_segments(struct lws_buflist **head);
@@ -312,6 +312,81 @@ lws_mqtt_str_advance(lws_mqtt_str_t *s, int n);
 LWS_VISIBLE LWS_EXTERN void
 lws_mqtt_str_free(lws_mqtt_str_t **s);
 
+/*
+ * MQTT topic filter trie
+ *
+ * Indexes topic filters, which may contain '+' and '#' wildcards, so that all
+ * the filters matching a topic can be found in time that depends on how many
+ * levels the topic has, not on how many filters there are.  Each filter is
+ * added with an opaque pointer, which is what is given back on a match.  The
+ * same filter may be added more than once with different opaques.
+ */
+
+typedef struct lws_mqtt_topic_trie lws_mqtt_topic_trie_t;
+
+/* return nonzero to stop the match walk */
+typedef int (*lws_mqtt_topic_trie_cb_t)(void *opaque, void *user);
+
+LWS_VISIBLE LWS_EXTERN lws_mqtt_topic_trie_t *
+lws_mqtt_topic_trie_create(void);
+
+LWS_VISIBLE LWS_EXTERN void
+lws_mqtt_topic_trie_destroy(lws_mqtt_topic_trie_t **pt);
+
+/**
+ * lws_mqtt_topic_trie_add() - index a topic filter
+ *
+ * \param t: the trie
+ * \param filter: the topic filter, eg, "dev/+/temp" or "dev/12/#"
+ * \param opaque: pointer to give back when a topic matches this filter
+ *
+ * Returns 0 if added, or nonzero for OOM or a '#' that isn't the last level.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_mqtt_topic_trie_add(lws_mqtt_topic_trie_t *t, const char *filter,
+			void *opaque);
+
+/**
+ * lws_mqtt_topic_trie_remove() - remove a topic filter
+ *
+ * \param t: the trie
+ * \param filter: the topic filter as it was added
+ * \param opaque: the opaque it was added with
+ *
+ * Returns 0 if removed, or nonzero if that filter and opaque weren't there.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_mqtt_topic_trie_remove(lws_mqtt_topic_trie_t *t, const char *filter,
+			   void *opaque);
+
+/**
+ * lws_mqtt_topic_trie_find() - find a topic filter itself
+ *
+ * \param t: the trie
+ * \param filter: the topic filter
+ *
+ * Returns the opaque most recently added with exactly this filter, with any
+ * wildcards in \p filter compared as they are, or NULL if none.
+ */
+LWS_VISIBLE LWS_EXTERN void *
+lws_mqtt_topic_trie_find(lws_mqtt_topic_trie_t *t, const char *filter);
+
+/**
+ * lws_mqtt_topic_trie_match() - find the filters matching a topic
+ *
+ * \param t: the trie
+ * \param topic: the topic, eg, from a PUBLISH, without wildcards
+ * \param cb: called with the opaque of each matching filter
+ * \param user: passed to \p cb
+ *
+ * Calls \p cb for each filter that matches \p topic, until \p cb returns
+ * nonzero.  As with MQTT, "a/#" also matches "a".  Returns the number of
+ * times \p cb was called.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_mqtt_topic_trie_match(lws_mqtt_topic_trie_t *t, const char *topic,
+			  lws_mqtt_topic_trie_cb_t cb, void *user);
+
 
 /**
  * lws_mqtt_client_send_publish() - lws_write a publish packet
@@ -68,6 +68,10 @@ enum lws_threadpool_task_return {
 struct lws_threadpool_create_args {
 	int threads;
 	int max_queue_depth;
+	int cpu_base;		/**< with pin_cpus, worker n is pinned to cpu
+				     (cpu_base + n) % online cpus */
+	char pin_cpus;		/**< nonzero to pin each worker thread to one
+				     cpu (linux only, ignored elsewhere) */
 };
 
 struct lws_threadpool_task_args {
@@ -106,6 +110,11 @@ struct lws_threadpool_task_args {
  * Creates a pool of worker threads with \p threads and a queue of up to
  * \p max_queue_depth waiting tasks if all the threads are busy.
  *
+ * Each worker has its own queue of waiting tasks, new tasks are queued on the
+ * workers in turn, and a worker with nothing left on its own queue takes the
+ * oldest task waiting on another worker's queue.  Finished tasks are handed
+ * back to the service thread without the workers taking a shared lock.
+ *
  * Returns NULL if OOM, or a struct lws_threadpool pointer that must be
  * destroyed by lws_threadpool_destroy().
  */
@@ -108,7 +108,7 @@ typedef struct lws_tokenize {
 	lws_tokenize_state state;
 
 	int line;
-	int effline;
+	int effline; /**< the line the last token started on */
 
 	uint16_t flags;	/**< optional LWS_TOKENIZE_F_ flags, or 0 */
 	uint8_t delim;
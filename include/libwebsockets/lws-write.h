@@ -213,6 +213,121 @@ lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 #define lws_write_http(wsi, buf, len) \
 	lws_write(wsi, (unsigned char *)(buf), len, LWS_WRITE_HTTP)
 
+#define LWS_WRITE_IOV_MAX 16
+
+struct lws_write_iov {
+	const uint8_t		*buf;
+	size_t			len;
+};
+
+/**
+ * lws_write_iov() - write several buffers to the connection as one
+ *
+ * \param wsi: the struct lws to operate on
+ * \param iov: array of buffers to send, in order
+ * \param count: number of buffers in \p iov, 1 .. LWS_WRITE_IOV_MAX
+ * \param release: NULL, or called with \p opaque when lws is done with the
+ *		    buffers
+ * \param opaque: passed to \p release
+ *
+ * This sends the buffers' contents as raw bytes, like lws_write() with
+ * LWS_WRITE_RAW, without having to copy them together first, eg, headers and
+ * body that were prepared in different places.  No protocol framing is added,
+ * so it's not for use on ws connections (see lws_ws_bcast_write() for ws) or
+ * h2 streams (it fails on mux streams), nor with http compression; h1 header
+ * and body data or raw connections are fine.
+ *
+ * On plain sockets the buffers go to the kernel in one sendmsg().  On tls,
+ * they're gathered so they go out in one tls record.
+ *
+ * If it can't all be sent now, the unsent remainder is not copied: lws keeps
+ * pointers into your buffers and sends from them as the connection becomes
+ * writeable.  So the buffers must stay valid and unchanged until \p release
+ * is called, which may be before this returns if everything went out (or
+ * on error), or later when the remainder has been sent or the connection
+ * closed.  If \p release is NULL, the buffers must stay valid until the next
+ * WRITEABLE callback.
+ *
+ * Like lws_write(), returns the total length, or -1 if the connection should
+ * be closed.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_write_iov(struct lws *wsi, const struct lws_write_iov *iov, int count,
+	      lws_buflist_release_cb release, void *opaque);
+
+typedef struct lws_ws_bcast lws_ws_bcast_t;
+
+/**
+ * lws_ws_bcast_create() - prepare a ws message for sending to many connections
+ *
+ * \param cx: the lws context
+ * \param buf: the message payload
+ * \param len: length of the payload
+ * \param wp: LWS_WRITE_TEXT or LWS_WRITE_BINARY
+ *
+ * For fan-out, where the same message goes to many ws server connections,
+ * this copies the payload once and frames it once, so lws_ws_bcast_write()
+ * can send it on each connection without copying or framing it again.
+ *
+ * Where connections negotiated permessage-deflate, the message is compressed
+ * once for each different set of deflate parameters that's in use, the first
+ * time one of them is sent it, and that frame is shared by all of them.
+ *
+ * The object starts with one reference, owned by the caller, which must be
+ * dropped with lws_ws_bcast_unref() when the caller won't send it any more,
+ * eg, when it's removed from an lws_ring.  Each send holds a reference until
+ * that connection has finished with it, so it's freed when the caller and
+ * the last connection it was sent on are both done with it.
+ *
+ * Returns NULL on OOM or bad \p wp.
+ */
+LWS_VISIBLE LWS_EXTERN lws_ws_bcast_t *
+lws_ws_bcast_create(struct lws_context *cx, const uint8_t *buf, size_t len,
+		    enum lws_write_protocol wp);
+
+/**
+ * lws_ws_bcast_write() - send a broadcast message on a ws connection
+ *
+ * \param wsi: the ws connection, normally in its WRITEABLE callback
+ * \param b: the broadcast message
+ *
+ * Sends \p b as one complete ws message, referencing the shared frame rather
+ * than copying it; any part the connection can't take now is sent from the
+ * shared frame as it becomes writeable.  So, like lws_write(), call it once
+ * per WRITEABLE callback and not while partway through sending a fragmented
+ * message.
+ *
+ * Server connections without permessage-deflate, or with it, use a shared
+ * frame.  Client connections (whose frames must be masked differently each
+ * time) and ws-over-h2 streams fall back to a copy sent by lws_write().
+ *
+ * Returns the payload length, or -1 if the connection should be closed, like
+ * lws_write().
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_ws_bcast_write(struct lws *wsi, lws_ws_bcast_t *b);
+
+/**
+ * lws_ws_bcast_ref() - take another reference on a broadcast message
+ *
+ * \param b: the broadcast message
+ *
+ * For when the caller keeps \p b in more than one place.  Each reference
+ * must be dropped with lws_ws_bcast_unref().
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_ws_bcast_ref(lws_ws_bcast_t *b);
+
+/**
+ * lws_ws_bcast_unref() - drop a reference on a broadcast message
+ *
+ * \param b: the broadcast message
+ *
+ * The message is freed when the last reference is dropped.
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_ws_bcast_unref(lws_ws_bcast_t *b);
+
 /**
  * lws_write_ws_flags() - Helper for multi-frame ws message flags
  *
@@ -256,4 +371,47 @@ lws_write_ws_flags(int initial, int is_start, int is_end)
 LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_raw_transaction_completed(struct lws *wsi);
 
+/**
+ * lws_raw_splice() - relay a raw connection's rx to another one in the kernel
+ *
+ * \param wsi: the raw connection whose rx should be relayed
+ * \param to: the raw connection it should be sent out on
+ *
+ * For proxies, where everything received on one raw connection is sent out
+ * on another.  Where the platform has splice(), rx on \p wsi is moved from
+ * its socket into a pipe and from there to \p to's socket, without being
+ * copied into userland.  Call it for each direction you want relayed, once
+ * both connections are connected, eg, from the ADOPT callback of the second.
+ *
+ * The RX callback for \p wsi then comes with a NULL \p in, and \p len is
+ * how much was moved into the pipe.  The user code sends it on from the pipe
+ * with lws_raw_splice_send() on \p to, and uses lws_rx_flow_control() to
+ * stop \p wsi's rx while the pipe still has data waiting, as it would while
+ * its own buffers were full.
+ *
+ * The pipe stays with \p to if \p wsi closes, so the rest can be sent.  If
+ * \p to closes, rx on \p wsi goes back to the normal RX callback.
+ *
+ * Either connection having tls, or the platform not having splice(), means
+ * it returns nonzero and the user code should keep relaying rx itself.
+ * Returns 0 if the rx will be spliced.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_raw_splice(struct lws *wsi, struct lws *to);
+
+/**
+ * lws_raw_splice_send() - send what is waiting in the pipe spliced to wsi
+ *
+ * \param wsi: the \p to connection from lws_raw_splice()
+ *
+ * Sends what it can from the pipe toward \p wsi, without blocking.  Call it
+ * from the source's RX callback when \p in is NULL, and from \p wsi's
+ * WRITEABLE callback while there's still some waiting.
+ *
+ * Returns how much is still waiting in the pipe, 0 if it's empty, or -1 if
+ * \p wsi should be closed.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_raw_splice_send(struct lws *wsi);
+
 ///@}
@@ -47,6 +47,7 @@ enum lws_extension_callback_reasons {
 	LWS_EXT_CB_OPTION_SET				= 24,
 	LWS_EXT_CB_OPTION_CONFIRM			= 25,
 	LWS_EXT_CB_NAMED_OPTION_SET			= 26,
+	LWS_EXT_CB_SERVER_RESPONSE_ARGS			= 27,
 
 	/****** add new things just above ---^ ******/
 };
@@ -127,6 +128,13 @@ struct lws_ext_option_arg {
  *		buffer safely, it should copy the data into its own buffer and
  *		set the lws_tokens token pointer to it.
  *
+ *	LWS_EXT_CB_SERVER_RESPONSE_ARGS: called on the server after the
+ *		client's options have been applied, so the extension can add
+ *		any of its own to the handshake response, eg,
+ *		"; server_max_window_bits=10".  in points to where to write
+ *		them and len is the space there.  Return how many chars were
+ *		written.
+ *
  *	LWS_EXT_CB_ARGS_VALIDATE:
  */
 typedef int
@@ -97,4 +97,19 @@ lws_partial_buffered(struct lws *wsi);
  */
 LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_frame_is_binary(struct lws *wsi);
+
+/**
+ * lws_ws_mask(): apply a ws 4-byte mask to a buffer in place
+ *
+ * \param buf: the buffer to mask or unmask
+ * \param len: the number of bytes in buf
+ * \param mask: the 4-byte ws frame mask
+ * \param idx: the index into the mask for the first byte of buf
+ *
+ * Returns the mask index for the byte following buf, so a payload can be
+ * masked in pieces.  This is what lws uses internally for ws payload masking,
+ * it's vectorized where the platform supports it.
+ */
+LWS_VISIBLE LWS_EXTERN unsigned int
+lws_ws_mask(uint8_t *buf, size_t len, const uint8_t *mask, unsigned int idx);
 ///@}
@@ -119,7 +119,7 @@ lws_create_new_server_wsi(struct lws_vhost *vhost, int fixed_tsi, int group,
 static struct lws *
 __lws_adopt_descriptor_vhost1(struct lws_vhost *vh, lws_adoption_type type,
 			    const char *vh_prot_name, struct lws *parent,
-			    void *opaque, const char *fi_wsi_name)
+			    void *opaque, const char *fi_wsi_name, int tsi)
 {
 	struct lws_context *context;
 	struct lws_context_per_thread *pt;
@@ -139,7 +139,7 @@ __lws_adopt_descriptor_vhost1(struct lws_vhost *vh, lws_adoption_type type,
 
 	lws_context_assert_lock_held(vh->context);
 
-	n = -1;
+	n = tsi;
 	if (parent)
 		n = parent->tsi;
 	new_wsi = lws_create_new_server_wsi(vh, n, LWSLCG_WSI_SERVER, fi_wsi_name);
@@ -514,6 +514,16 @@ lws_adopt_descriptor_vhost(struct lws_vhost *vh, lws_adoption_type type,
 
 struct lws *
 lws_adopt_descriptor_vhost_via_info(const lws_adopt_desc_t *info)
+{
+	return lws_adopt_descriptor_vhost_via_info_tsi(info, -1);
+}
+
+/*
+ * tsi -1 puts the new wsi on the same pt as any parent, or the least busy pt
+ */
+
+struct lws *
+lws_adopt_descriptor_vhost_via_info_tsi(const lws_adopt_desc_t *info, int tsi)
 {
 	socklen_t slen = sizeof(lws_sockaddr46);
 	struct lws *new_wsi;
@@ -543,7 +553,8 @@ lws_adopt_descriptor_vhost_via_info(const lws_adopt_desc_t *info)
 
 	new_wsi = __lws_adopt_descriptor_vhost1(info->vh, info->type,
 					      info->vh_prot_name, info->parent,
-					      info->opaque, info->fi_wsi_name);
+					      info->opaque, info->fi_wsi_name,
+					      tsi);
 	if (!new_wsi) {
 		if (info->type & LWS_ADOPT_SOCKET)
 			compatible_close(info->fd.sockfd);
@@ -603,8 +614,8 @@ adopt_socket_readbuf(struct lws *wsi, const char *readbuf, size_t len)
 
 	pt = &wsi->a.context->pt[(int)wsi->tsi];
 
-	n = lws_buflist_append_segment(&wsi->buflist, (const uint8_t *)readbuf,
-				       len);
+	n = lws_wsi_buflist_append(wsi, &wsi->buflist, (const uint8_t *)readbuf,
+				   len);
 	if (n < 0)
 		goto bail;
 	if (n)
@@ -835,7 +846,7 @@ lws_create_adopt_udp(struct lws_vhost *vhost, const char *ads, int port,
 	wsi = __lws_adopt_descriptor_vhost1(vhost, LWS_ADOPT_SOCKET |
 						 LWS_ADOPT_RAW_SOCKET_UDP,
 					  protocol_name, parent_wsi, opaque,
-					  fi_wsi_name);
+					  fi_wsi_name, -1);
 
 	lws_context_unlock(vhost->context);
 	if (!wsi) {
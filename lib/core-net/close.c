@@ -111,6 +111,9 @@ __lws_reset_wsi(struct lws *wsi)
 	lws_buflist_destroy_all_segments(&wsi->buflist);
 	lws_dll2_remove(&wsi->dll_buflist);
 	lws_buflist_destroy_all_segments(&wsi->buflist_out);
+#if defined(LWS_HAVE_SPLICE)
+	lws_raw_splice_detach(wsi);
+#endif
 #if defined(LWS_WITH_UDP)
 	if (wsi->udp) {
 		/* confirm no sul left scheduled in wsi->udp itself */
@@ -519,6 +522,9 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status reason,
 #if defined(LWS_WITH_HTTP_STREAM_COMPRESSION)
 		    || wsi->http.comp_ctx.buflist_comp ||
 		    wsi->http.comp_ctx.may_have_more
+#endif
+#if defined(LWS_WITH_IO_URING)
+		    || lws_io_uring_tx_pending(wsi)
 #endif
 		 ) {
 			lws_callback_on_writable(wsi);
@@ -531,6 +537,9 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status reason,
 #if defined(LWS_WITH_HTTP_STREAM_COMPRESSION)
 				|| wsi->http.comp_ctx.buflist_comp ||
 		    wsi->http.comp_ctx.may_have_more
+#endif
+#if defined(LWS_WITH_IO_URING)
+		    || lws_io_uring_tx_pending(wsi)
 #endif
 		) {
 			lwsl_wsi_info(wsi, "LRS_FLUSHING_BEFORE_CLOSE");
@@ -694,6 +703,10 @@ just_kill_connection:
 			if (!wsi->socket_is_permanently_unusable &&
 			    lws_socket_is_valid(wsi->desc.sockfd)) {
 				wsi->socket_is_permanently_unusable = 1;
+#if defined(LWS_WITH_IO_URING)
+				/* done when tx queued on the ring has gone */
+				if (!lws_io_uring_shutdown_wr(wsi))
+#endif
 				n = shutdown(wsi->desc.sockfd, SHUT_WR);
 			}
 		}
@@ -24,13 +24,42 @@
 
 #include "private-lib-core.h"
 
+#if defined(LWS_PLAT_UNIX) && defined(LWS_HAVE_SYS_UIO_H)
+#include <sys/uio.h>
+#endif
+
+/* the most we will gather into one tls record */
+#define LWS_WRITE_IOV_GATHER 16384
+
+/*
+ * The most lws_issue_raw() will try to write from the head of buflist_out at
+ * once.  A tls write that couldn't complete must be retried with the same
+ * length, so anything going on buflist_out after one must have been tried
+ * with no more than this.
+ */
+
+static size_t
+lws_write_limit(struct lws *wsi)
+{
+	size_t n;
+
+	if (wsi->a.protocol->tx_packet_size)
+		n = wsi->a.protocol->tx_packet_size;
+	else {
+		n = wsi->a.protocol->rx_buffer_size;
+		if (!n)
+			n = wsi->a.context->pt_serv_buf_size;
+	}
+
+	return n + LWS_PRE + 4;
+}
+
 /*
  * notice this returns number of bytes consumed, or -1
  */
 int
 lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 {
-	struct lws_context *context = lws_get_context(wsi);
 	size_t real_len = len;
 	unsigned int n, m;
 
@@ -63,7 +92,7 @@ lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 		 * the buflist...
 		 */
 
-		if (lws_buflist_append_segment(&wsi->buflist_out, buf, len))
+		if (lws_wsi_buflist_append(wsi, &wsi->buflist_out, buf, len) < 0)
 			return -1;
 
 		buf = NULL;
@@ -86,14 +115,7 @@ lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 		lwsl_wsi_err(wsi, "invalid sock");
 
 	/* limit sending */
-	if (wsi->a.protocol->tx_packet_size)
-		n = (unsigned int)wsi->a.protocol->tx_packet_size;
-	else {
-		n = (unsigned int)wsi->a.protocol->rx_buffer_size;
-		if (!n)
-			n = context->pt_serv_buf_size;
-	}
-	n += LWS_PRE + 4;
+	n = (unsigned int)lws_write_limit(wsi);
 	if (n > len)
 		n = (unsigned int)len;
 
@@ -194,8 +216,8 @@ lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 	lwsl_wsi_debug(wsi, "new partial sent %d from %lu total",
 			    m, (unsigned long)real_len);
 
-	if (lws_buflist_append_segment(&wsi->buflist_out, buf + m,
-				       real_len - m) < 0)
+	if (lws_wsi_buflist_append(wsi, &wsi->buflist_out, buf + m,
+				   real_len - m) < 0)
 		return -1;
 
 #if defined(LWS_WITH_UDP)
@@ -210,6 +232,219 @@ lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 	return (int)real_len;
 }
 
+/*
+ * Returns bytes sent, or taken onto buflist_out, from the start of the iovs,
+ * or one of the LWS_SSL_CAPABLE_ codes
+ */
+
+static int
+lws_write_iov_capable(struct lws *wsi, const struct lws_write_iov *iov,
+		      int count, size_t total)
+{
+	uint8_t *gather, *p;
+	size_t s;
+	int n;
+
+#if defined(LWS_PLAT_UNIX) && defined(LWS_HAVE_SYS_UIO_H)
+	if (
+#if defined(LWS_WITH_TLS)
+	    !wsi->tls.ssl &&
+#endif
+#if defined(LWS_WITH_UDP)
+	    !lws_wsi_is_udp(wsi) &&
+#endif
+	    !wsi->role_ops->file_handle) {
+		struct iovec v[LWS_WRITE_IOV_MAX];
+		struct msghdr msg;
+
+		/* plain socket: the kernel can gather it for us */
+
+		for (n = 0; n < count; n++) {
+			v[n].iov_base = (void *)iov[n].buf;
+			v[n].iov_len = iov[n].len;
+		}
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = v;
+		msg.msg_iovlen = (unsigned int)count;
+
+#if defined(LWS_WITH_IO_URING)
+		if (lws_io_uring_async(wsi))
+			n = lws_io_uring_send(wsi, v, count);
+		else
+#endif
+		n = (int)sendmsg(wsi->desc.sockfd, &msg, MSG_NOSIGNAL);
+		if (n >= 0)
+			return n;
+
+		if (LWS_ERRNO == LWS_EAGAIN ||
+		    LWS_ERRNO == LWS_EWOULDBLOCK ||
+		    LWS_ERRNO == LWS_EINTR)
+			return LWS_SSL_CAPABLE_MORE_SERVICE;
+
+		lwsl_wsi_debug(wsi, "sendmsg %d failed, errno %d",
+				    (int)total, LWS_ERRNO);
+
+		return LWS_SSL_CAPABLE_ERROR;
+	}
+#endif
+
+	/*
+	 * If the tls write can't complete, it's retried from buflist_out with
+	 * the same length, so don't try more than lws_issue_raw() will
+	 */
+
+	s = lws_write_limit(wsi);
+
+	if (count == 1)
+		return lws_ssl_capable_write(wsi, (unsigned char *)iov[0].buf,
+					     iov[0].len < s ? iov[0].len : s);
+
+	/*
+	 * tls (or no sendmsg): gather what we can into one buffer so it goes
+	 * as one record, the rest stays referenced for later
+	 */
+
+	if (s > total)
+		s = total;
+	if (s > LWS_WRITE_IOV_GATHER)
+		s = LWS_WRITE_IOV_GATHER;
+
+	gather = lws_malloc(s, __func__);
+	if (!gather)
+		return LWS_SSL_CAPABLE_ERROR;
+
+	p = gather;
+	for (n = 0; n < count && lws_ptr_diff_size_t(p, gather) < s; n++) {
+		size_t m = s - lws_ptr_diff_size_t(p, gather);
+
+		if (m > iov[n].len)
+			m = iov[n].len;
+		memcpy(p, iov[n].buf, m);
+		p += m;
+	}
+
+	n = lws_ssl_capable_write(wsi, gather, s);
+	if (n == LWS_SSL_CAPABLE_MORE_SERVICE) {
+		/*
+		 * The retry must be this same record, so the gathered copy
+		 * goes on buflist_out as its first segment, exactly as tried
+		 */
+		if (lws_wsi_buflist_append(wsi, &wsi->buflist_out, gather,
+					   s) < 0)
+			n = LWS_SSL_CAPABLE_ERROR;
+		else {
+			lws_callback_on_writable(wsi);
+			n = (int)s;
+		}
+	}
+	lws_free(gather);
+
+	return n;
+}
+
+int
+lws_write_iov(struct lws *wsi, const struct lws_write_iov *iov, int count,
+	      lws_buflist_release_cb release, void *opaque)
+{
+	size_t total = 0, skip;
+	int n, m = 0, last = -1;
+
+	if (count <= 0 || count > LWS_WRITE_IOV_MAX || wsi->mux_substream) {
+		lwsl_wsi_err(wsi, "bad count %d or mux stream", count);
+		m = -1;
+		goto bail;
+	}
+
+	for (n = 0; n < count; n++) {
+		total += iov[n].len;
+		if (iov[n].len)
+			last = n;
+	}
+
+	if ((int)total < 0) {
+		lwsl_wsi_err(wsi, "suspicious total %lu", (unsigned long)total);
+		total = 0;
+		m = -1;
+		goto bail;
+	}
+
+	/* just ignore sends after we cleared the truncation buffer */
+	if (!total || (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE &&
+		       !lws_has_buffered_out(wsi)))
+		goto done;
+
+	if (!lws_has_buffered_out(wsi)) {
+		if (lws_fi(&wsi->fic, "sendfail"))
+			m = LWS_SSL_CAPABLE_ERROR;
+		else
+			m = lws_write_iov_capable(wsi, iov, count, total);
+
+		lwsl_wsi_info(wsi, "%d iovs (%d) says %d", count, (int)total, m);
+
+		wsi->could_have_pending = 1;
+
+		switch (m) {
+		case LWS_SSL_CAPABLE_ERROR:
+			wsi->socket_is_permanently_unusable = 1;
+			m = -1;
+			goto bail;
+		case LWS_SSL_CAPABLE_MORE_SERVICE:
+			m = 0;
+			break;
+		}
+
+		if (m < 0)
+			m = 0;
+
+		if ((size_t)m == total)
+			goto done;
+	}
+
+	/*
+	 * Whatever didn't go out waits on buflist_out, referencing the
+	 * caller's buffers rather than copying them.  Only the last segment
+	 * gets the release callback, it's used up after all the others.
+	 */
+
+	skip = (size_t)m;
+	for (n = 0; n < count; n++) {
+		if (skip >= iov[n].len) {
+			skip -= iov[n].len;
+			continue;
+		}
+
+		if (lws_buflist_append_ref(&wsi->buflist_out,
+					   iov[n].buf + skip,
+					   iov[n].len - skip,
+					   n == last ? release : NULL,
+					   opaque) < 0) {
+			/* he's going to close, don't try to send any of it */
+			wsi->socket_is_permanently_unusable = 1;
+			m = -1;
+			goto bail;
+		}
+		skip = 0;
+	}
+
+	lws_callback_on_writable(wsi);
+	release = NULL;
+
+done:
+	m = (int)total;
+
+bail:
+#if defined(LWS_WITH_SYS_METRICS)
+	if (total && wsi->a.vhost)
+		lws_metric_event(wsi->a.vhost->mt_traffic_tx, (char)
+				 (m < 0 ? METRES_NOGO : METRES_GO), total);
+#endif
+	if (release)
+		release(opaque);
+
+	return m;
+}
+
 int
 lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 	  enum lws_write_protocol wp)
@@ -260,6 +495,12 @@ lws_ssl_capable_read_no_ssl(struct lws *wsi, unsigned char *buf, size_t len)
 				len, 0,
 				sa46_sockaddr(&wsi->udp->sa46), &slt);
 	} else
+#endif
+#if defined(LWS_WITH_IO_URING)
+	if (lws_io_uring_async(wsi))
+		/* the kernel already read it into our rx buffer */
+		n = lws_io_uring_recv(wsi, buf, len);
+	else
 #endif
 		n = (int)recv(wsi->desc.sockfd, (char *)buf,
 #if defined(WIN32)
@@ -284,14 +525,21 @@ lws_ssl_capable_read_no_ssl(struct lws *wsi, unsigned char *buf, size_t len)
 			lws_metric_event(wsi->a.vhost->mt_traffic_rx,
 					 METRES_GO /* rx */, (unsigned int)n);
 #endif
+		/* a short read means we took everything the kernel had */
+		if ((size_t)n < len)
+			wsi->sock_rx_drained = 1;
 
 		return n;
 	}
 
 	if (en == LWS_EAGAIN ||
 	    en == LWS_EWOULDBLOCK ||
-	    en == LWS_EINTR)
+	    en == LWS_EINTR) {
+		if (en != LWS_EINTR)
+			wsi->sock_rx_drained = 1;
+
 		return LWS_SSL_CAPABLE_MORE_SERVICE;
+	}
 
 do_err:
 #if defined(LWS_WITH_SYS_METRICS) && defined(LWS_WITH_SERVER)
@@ -344,6 +592,14 @@ lws_ssl_capable_write_no_ssl(struct lws *wsi, unsigned char *buf, size_t len)
 #endif
 					len);
 		else
+#if defined(LWS_WITH_IO_URING)
+		if (lws_io_uring_async(wsi)) {
+			struct iovec v = { buf, len };
+
+			/* queued to go out from the ring */
+			n = lws_io_uring_send(wsi, &v, 1);
+		} else
+#endif
 			n = (int)send(wsi->desc.sockfd, (char *)buf,
 #if defined(WIN32)
 				(int)
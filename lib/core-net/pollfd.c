@@ -224,7 +224,8 @@ bail:
 #if defined(LWS_WITH_SERVER)
 /*
  * Enable or disable listen sockets on this pt globally...
- * it's modulated according to the pt having space for a new accept.
+ * it's modulated according to the pt having space for a new accept.  Every
+ * close asks to allow accepts, so only walk the vhosts when it changes.
  */
 static void
 lws_accept_modulation(struct lws_context *context,
@@ -233,6 +234,11 @@ lws_accept_modulation(struct lws_context *context,
 	struct lws_vhost *vh = context->vhost_list;
 	struct lws_pollargs pa1;
 
+	if (pt->accepts_defeated == !allow)
+		return;
+
+	pt->accepts_defeated = !allow;
+
 	while (vh) {
 		lws_start_foreach_dll(struct lws_dll2 *, d,
 				      lws_dll2_get_head(&vh->listen_wsi)) {
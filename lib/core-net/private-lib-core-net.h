@@ -52,9 +52,42 @@ struct lws_muxable {
 extern "C" {
 #endif
 
-#define __lws_sul_insert_us(owner, sul, _us) \
+#define __lws_sul_insert_us(_pt, _n, sul, _us) \
 		(sul)->us = lws_now_usecs() + (lws_usec_t)(_us); \
-		__lws_sul_insert(owner, sul)
+		__lws_sul_pt_insert(_pt, _n, sul)
+
+#if defined(LWS_WITH_SUL_WHEEL)
+
+/*
+ * Hierarchical timing wheel for the pt sul, there's one behind each
+ * pt_sul_owner.  Level 0 has a slot per tick, kept sorted, the upper levels
+ * each cover 64x the span of the one below and are unsorted until they are
+ * cascaded down.  Once a level 0 slot becomes due, its sul move on to the
+ * sorted pt_sul_owner list in order.
+ *
+ * With 1.024ms ticks, level 0 covers 262ms, and the four upper levels take it
+ * to ~50 days; anything later waits at the far end and is placed again when
+ * it's cascaded.
+ */
+
+#define LWS_SUL_WHEEL_TICK_BITS		10
+#define LWS_SUL_WHEEL_L0_BITS		8
+#define LWS_SUL_WHEEL_LN_BITS		6
+#define LWS_SUL_WHEEL_LN_COUNT		4
+
+#define LWS_SUL_WHEEL_L0_SLOTS		(1 << LWS_SUL_WHEEL_L0_BITS)
+#define LWS_SUL_WHEEL_LN_SLOTS		(1 << LWS_SUL_WHEEL_LN_BITS)
+
+typedef struct lws_sul_wheel {
+	lws_dll2_owner_t	l0[LWS_SUL_WHEEL_L0_SLOTS];
+	lws_dll2_owner_t	ln[LWS_SUL_WHEEL_LN_COUNT][LWS_SUL_WHEEL_LN_SLOTS];
+	/* slots that may be occupied... cancel doesn't clear these */
+	uint64_t		l0_map[LWS_SUL_WHEEL_L0_SLOTS / 64];
+	uint64_t		ln_map[LWS_SUL_WHEEL_LN_COUNT];
+	uint64_t		cur; /* first tick not moved to the list yet */
+} lws_sul_wheel_t;
+
+#endif
 
 
 /*
@@ -243,6 +276,10 @@ struct client_info_stash {
 lws_usec_t
 __lws_sul_service_ripe(lws_dll2_owner_t *own, int num_own, lws_usec_t usnow);
 
+void
+__lws_sul_pt_insert(struct lws_context_per_thread *pt, int n,
+		    lws_sorted_usec_list_t *sul);
+
 /*
  * lws_async_dns
  */
@@ -261,11 +298,19 @@ typedef struct lws_async_dns_server {
 	uint8_t			dns_server_connected:1;
 } lws_async_dns_server_t;
 
+struct lws_adns_hosts;
+
 typedef struct lws_async_dns {
 	lws_dll2_owner_t	nameservers; /* lws_async_dns_server_t */
-	lws_dll2_owner_t	cached;
+	lws_dll2_owner_t	cached; /* lru order */
+	lws_dll2_owner_t	*cache_hash; /* cached, by name hash */
+	struct lws_adns_hosts	*hosts; /* parsed hosts file */
+	const char		*hosts_path; /* NULL for the platform one */
 
 	struct lws_context	*cx;
+
+	unsigned int		cache_hash_elements;
+	unsigned int		cache_max;
 } lws_async_dns_t;
 
 #define lws_async_dns_from_server(_s) ((lws_async_dns_t *)_s->list.owner)
@@ -299,6 +344,7 @@ struct lws_context_per_thread {
 	pthread_t self;
 #endif
 	struct lws_dll2_owner dll_buflist_owner;  /* guys with pending rxflow */
+	lws_buflist_pool_t *bl_pool; /* spare buflist segments */
 	lws_dll2_owner_t      attach_owner;	/* pending lws_attach */
 
 #if defined(LWS_WITH_SECURE_STREAMS)
@@ -311,6 +357,9 @@ struct lws_context_per_thread {
 #endif
 
 	struct lws_dll2_owner pt_sul_owner[LWS_COUNT_PT_SUL_OWNERS];
+#if defined(LWS_WITH_SUL_WHEEL)
+	lws_sul_wheel_t pt_sul_wheel[LWS_COUNT_PT_SUL_OWNERS];
+#endif
 
 	lws_dll2_owner_t pre_natal_wsi_owner; /* allocated wsi not yet bound to vh
 						 are kept on here until bound, so
@@ -402,6 +451,7 @@ struct lws_context_per_thread {
 	unsigned char event_loop_pt_unused:1;
 	unsigned char destroy_self:1;
 	unsigned char is_destroyed:1;
+	unsigned char accepts_defeated:1; /* pt fds full, listeners off */
 };
 
 /*
@@ -471,6 +521,10 @@ struct lws_vhost {
 
 	struct lws_context *context;
 	struct lws_vhost *vhost_next;
+#if defined(LWS_WITH_SERVER)
+	struct lws_vhost *vh_hash_next;
+	uint32_t list_seq;
+#endif
 
 	const lws_retry_bo_t *retry_policy;
 
@@ -549,6 +603,7 @@ struct lws_vhost {
 	uint8_t created_vhost_protocols:1;
 	uint8_t being_destroyed:1;
 	uint8_t from_ss_policy:1;
+	uint8_t listen_per_thread:1; /* pts keep what their listener accepts */
 #if defined(LWS_WITH_TLS_JIT_TRUST)
 	uint8_t 		grace_after_unref:1;
 	/* grace time / autodelete aoplies to us */
@@ -750,6 +805,10 @@ struct lws {
 
 	struct lws_buflist		*buflist; /* input-side buflist */
 	struct lws_buflist		*buflist_out; /* output-side buflist */
+#if defined(LWS_HAVE_SPLICE)
+	struct lws_splice		*splice_rx; /* our rx goes to another wsi */
+	struct lws_splice		*splice_tx; /* another wsi's rx comes to us */
+#endif
 
 #if defined(LWS_WITH_TLS)
 	struct lws_lws_tls		tls;
@@ -821,6 +880,7 @@ struct lws {
 	unsigned int			mount_hit:1;
 
 	unsigned int			could_have_pending:1; /* detect back-to-back writes */
+	unsigned int			sock_rx_drained:1; /* last read hit EAGAIN or was short */
 	unsigned int			outer_will_close:1;
 	unsigned int			shadow:1; /* we do not control fd lifecycle at all */
 #if defined(LWS_WITH_SECURE_STREAMS)
@@ -1171,6 +1231,13 @@ lws_change_pollfd(struct lws *wsi, int _and, int _or);
 			      struct lws_vhost *vhost);
 struct lws_vhost *
  lws_select_vhost(struct lws_context *context, int port, const char *servername);
+void
+ __lws_vhost_hash_insert(struct lws_vhost *vh);
+void
+ __lws_vhost_hash_remove(struct lws_vhost *vh);
+struct lws_vhost *
+ __lws_vhost_hash_find(struct lws_context *cx, const char *name, size_t len,
+		       int port);
 int LWS_WARN_UNUSED_RESULT
  lws_parse_ws(struct lws *wsi, unsigned char **buf, size_t len);
 void
@@ -1180,6 +1247,8 @@ void
  #define _lws_vhost_init_server(_a, _b) (0)
  #define lws_parse_ws(_a, _b, _c) (0)
  #define lws_server_get_canonical_hostname(_a, _b)
+ #define __lws_vhost_hash_insert(_a)
+ #define __lws_vhost_hash_remove(_a)
 #endif
 
 int
@@ -1202,9 +1271,19 @@ lws_rxflow_cache(struct lws *wsi, unsigned char *buf, size_t n, size_t len);
 int
 lws_service_flag_pending(struct lws_context *context, int tsi);
 
+int
+lws_service_pending_fds(struct lws_context_per_thread *pt, int *fds, int max);
+
 int
 lws_has_buffered_out(struct lws *wsi);
 
+#if defined(LWS_HAVE_SPLICE)
+int
+lws_raw_splice_rx(struct lws *wsi);
+void
+lws_raw_splice_detach(struct lws *wsi);
+#endif
+
 lws_handling_result_t LWS_WARN_UNUSED_RESULT
 lws_ws_client_rx_sm(struct lws *wsi, unsigned char c);
 
@@ -1304,6 +1383,9 @@ struct lws * LWS_WARN_UNUSED_RESULT
 lws_create_new_server_wsi(struct lws_vhost *vhost, int fixed_tsi,
 				int group, const char *desc);
 
+struct lws *
+lws_adopt_descriptor_vhost_via_info_tsi(const lws_adopt_desc_t *info, int tsi);
+
 char * LWS_WARN_UNUSED_RESULT
 lws_generate_client_handshake(struct lws *wsi, char *pkt, size_t pkt_len);
 
@@ -1542,6 +1624,11 @@ lws_seq_pt_init(struct lws_context_per_thread *pt);
 int
 lws_buflist_aware_read(struct lws_context_per_thread *pt, struct lws *wsi,
 		       struct lws_tokens *ebuf, char fr, const char *hint);
+
+int
+lws_wsi_buflist_append(struct lws *wsi, struct lws_buflist **head,
+		       const uint8_t *buf, size_t len);
+
 int
 lws_buflist_aware_finished_consuming(struct lws *wsi, struct lws_tokens *ebuf,
 				     int used, int buffered, const char *hint);
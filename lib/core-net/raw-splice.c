@@ -0,0 +1,235 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Kernel-side relaying between two plaintext raw connections.
+ *
+ * Each direction has a pipe: rx on the source connection is splice()d from
+ * its socket into the pipe, and from there into the sink connection's socket,
+ * so the data is never copied into userland.  The pipe lives until the sink
+ * closes, so whatever the source sent before it closed can still go out on
+ * the sink.
+ */
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "private-lib-core.h"
+
+#if defined(LWS_HAVE_SPLICE)
+
+#include <fcntl.h>
+
+struct lws_splice {
+	struct lws		*from;		/* NULL once it closed */
+	size_t			pending;	/* bytes waiting in the pipe */
+	size_t			size;		/* capacity of the pipe */
+	int			fd[2];
+};
+
+/*
+ * The raw client connection is still in LRS_WAITING_CONNECT when its ADOPT
+ * callback comes, so we can't insist on LRS_ESTABLISHED... but the socket has
+ * to be connected, and must not be (about to be) doing tls
+ */
+
+static int
+lws_raw_splice_capable(struct lws *wsi)
+{
+	return (wsi->role_ops == &role_ops_raw_skt ||
+		lwsi_role_raw_proxy(wsi)) &&
+	       lws_socket_is_valid(wsi->desc.sockfd) &&
+#if defined(LWS_WITH_TLS)
+	       !wsi->tls.ssl && !(wsi->tls.use_ssl & LCCSCF_USE_SSL) &&
+	       lwsi_state(wsi) != LRS_SSL_INIT &&
+	       lwsi_state(wsi) != LRS_SSL_ACK_PENDING &&
+#endif
+#if defined(LWS_WITH_UDP)
+	       !wsi->udp &&
+#endif
+#if defined(LWS_WITH_IO_URING)
+	       /* the ring owns its socket io */
+	       !lws_io_uring_async(wsi) &&
+#endif
+	       !wsi->mux_substream;
+}
+
+static void
+lws_raw_splice_destroy(struct lws_splice *sp)
+{
+	close(sp->fd[0]);
+	close(sp->fd[1]);
+	lws_free(sp);
+}
+
+void
+lws_raw_splice_detach(struct lws *wsi)
+{
+	struct lws_splice *sp;
+
+	/* the sink may still have to send what we left in the pipe */
+
+	sp = wsi->splice_rx;
+	if (sp) {
+		wsi->splice_rx = NULL;
+		sp->from = NULL;
+	}
+
+	/* without the sink, the pipe is no use, the source reads normally */
+
+	sp = wsi->splice_tx;
+	if (sp) {
+		wsi->splice_tx = NULL;
+		if (sp->from)
+			sp->from->splice_rx = NULL;
+		lws_raw_splice_destroy(sp);
+	}
+}
+
+/*
+ * Called instead of reading from the socket when wsi's rx is being spliced,
+ * returns the amount moved into the pipe, 0 if the peer closed, or one of the
+ * LWS_SSL_CAPABLE_ codes
+ */
+
+int
+lws_raw_splice_rx(struct lws *wsi)
+{
+	struct lws_splice *sp = wsi->splice_rx;
+	ssize_t n;
+
+	/* the user code is meant to stop rx while the pipe is full */
+
+	if (sp->pending >= sp->size)
+		return LWS_SSL_CAPABLE_MORE_SERVICE;
+
+	n = splice(wsi->desc.sockfd, NULL, sp->fd[1], NULL,
+		   sp->size - sp->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n < 0) {
+		if (LWS_ERRNO == LWS_EAGAIN || LWS_ERRNO == LWS_EWOULDBLOCK ||
+		    LWS_ERRNO == LWS_EINTR)
+			return LWS_SSL_CAPABLE_MORE_SERVICE;
+
+		lwsl_wsi_info(wsi, "splice in failed, errno %d", LWS_ERRNO);
+
+		return LWS_SSL_CAPABLE_ERROR;
+	}
+
+	sp->pending += (size_t)n;
+
+#if defined(LWS_WITH_SYS_METRICS) && defined(LWS_WITH_SERVER)
+	if (n && wsi->a.vhost)
+		lws_metric_event(wsi->a.vhost->mt_traffic_rx, METRES_GO,
+				 (u_mt_t)n);
+#endif
+
+	return (int)n;
+}
+
+#endif
+
+int
+lws_raw_splice(struct lws *wsi, struct lws *to)
+{
+#if defined(LWS_HAVE_SPLICE)
+	struct lws_splice *sp;
+	int n;
+
+	if (wsi == to || wsi->splice_rx || to->splice_tx ||
+	    !lws_raw_splice_capable(wsi) || !lws_raw_splice_capable(to))
+		return 1;
+
+	sp = lws_zalloc(sizeof(*sp), __func__);
+	if (!sp)
+		return 1;
+
+	if (pipe2(sp->fd, O_NONBLOCK | O_CLOEXEC)) {
+		lwsl_wsi_warn(wsi, "pipe2 failed, errno %d", LWS_ERRNO);
+		lws_free(sp);
+		return 1;
+	}
+
+	n = 0;
+#if defined(F_GETPIPE_SZ)
+	n = fcntl(sp->fd[1], F_GETPIPE_SZ);
+#endif
+	sp->size = n > 0 ? (size_t)n : 65536;
+
+	sp->from = wsi;
+	wsi->splice_rx = sp;
+	to->splice_tx = sp;
+
+	lwsl_wsi_info(wsi, "splicing rx to %s", lws_wsi_tag(to));
+
+	return 0;
+#else
+	(void)wsi;
+	(void)to;
+
+	return 1;
+#endif
+}
+
+int
+lws_raw_splice_send(struct lws *wsi)
+{
+#if defined(LWS_HAVE_SPLICE)
+	struct lws_splice *sp = wsi->splice_tx;
+	ssize_t n;
+
+	if (!sp)
+		return 0;
+
+	/* anything sent with lws_write() before has to go first */
+
+	if (!sp->pending || lws_has_buffered_out(wsi))
+		return (int)sp->pending;
+
+	n = splice(sp->fd[0], NULL, wsi->desc.sockfd, NULL, sp->pending,
+		   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n < 0) {
+		if (LWS_ERRNO != LWS_EAGAIN && LWS_ERRNO != LWS_EWOULDBLOCK &&
+		    LWS_ERRNO != LWS_EINTR) {
+			lwsl_wsi_info(wsi, "splice out failed, errno %d",
+				      LWS_ERRNO);
+			wsi->socket_is_permanently_unusable = 1;
+
+			return -1;
+		}
+		n = 0;
+	}
+
+	sp->pending -= (size_t)n;
+
+#if defined(LWS_WITH_SYS_METRICS)
+	if (n && wsi->a.vhost)
+		lws_metric_event(wsi->a.vhost->mt_traffic_tx, METRES_GO,
+				 (u_mt_t)n);
+#endif
+
+	return (int)sp->pending;
+#else
+	(void)wsi;
+
+	return 0;
+#endif
+}
@@ -245,6 +245,26 @@ bail_die:
 	return -1;
 }
 
+/*
+ * Buffer on one of the wsi's buflists, using the pt's pool of segments.
+ * Unless it's udp, it's a byte stream and can be coalesced onto the tail.
+ */
+
+int
+lws_wsi_buflist_append(struct lws *wsi, struct lws_buflist **head,
+		       const uint8_t *buf, size_t len)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+
+	return lws_buflist_append_segment_pool(pt->bl_pool, head, buf, len,
+#if defined(LWS_WITH_UDP)
+					       !lws_wsi_is_udp(wsi)
+#else
+					       1
+#endif
+					       );
+}
+
 int
 lws_rxflow_cache(struct lws *wsi, unsigned char *buf, size_t n, size_t len)
 {
@@ -277,7 +297,7 @@ lws_rxflow_cache(struct lws *wsi, unsigned char *buf, size_t n, size_t len)
 	/* a new rxflow, buffer it and warn caller */
 
 	lwsl_wsi_debug(wsi, "rxflow append %d", (int)(len - n));
-	m = lws_buflist_append_segment(&wsi->buflist, buf + n, len - n);
+	m = lws_wsi_buflist_append(wsi, &wsi->buflist, buf + n, len - n);
 
 	if (m < 0)
 		return LWSRXFC_ERROR;
@@ -414,6 +434,18 @@ lws_buflist_aware_read(struct lws_context_per_thread *pt, struct lws *wsi,
 	if (!fr && bns)
 		goto buflist_material;
 
+#if defined(LWS_HAVE_SPLICE)
+	if (!bns && wsi->splice_rx) {
+		/* the rx goes straight into the splice pipe, not to ep */
+		ebuf->token = NULL;
+		ebuf->len = lws_raw_splice_rx(wsi);
+		if (ebuf->len == LWS_SSL_CAPABLE_ERROR)
+			return -1;
+
+		return 0;
+	}
+#endif
+
 	/* we're going to read something */
 
 	ebuf->token = ep;
@@ -441,7 +473,8 @@ lws_buflist_aware_read(struct lws_context_per_thread *pt, struct lws *wsi,
 		 * Stash what we read, since there's earlier buflist material
 		 */
 
-		n = lws_buflist_append_segment(&wsi->buflist, ebuf->token, (size_t)ebuf->len);
+		n = lws_wsi_buflist_append(wsi, &wsi->buflist, ebuf->token,
+					   (size_t)ebuf->len);
 		if (n < 0)
 			return -1;
 		if (n && lws_dll2_is_detached(&wsi->dll_buflist))
@@ -498,9 +531,9 @@ lws_buflist_aware_finished_consuming(struct lws *wsi, struct lws_tokens *ebuf,
 	/* any remainder goes on the buflist */
 
 	if (used < ebuf->len && ebuf->len >= 0 && used >= 0) {
-		m = lws_buflist_append_segment(&wsi->buflist,
-					       ebuf->token + used,
-					       (unsigned int)(ebuf->len - used));
+		m = lws_wsi_buflist_append(wsi, &wsi->buflist,
+					   ebuf->token + used,
+					   (unsigned int)(ebuf->len - used));
 		if (m < 0)
 			return 1; /* OOM */
 		if (m) {
@@ -635,6 +668,38 @@ lws_service_flag_pending(struct lws_context *context, int tsi)
 	return forced;
 }
 
+/*
+ * For evlibs that only service the ready set, collect the fds of guys that
+ * lws_service_flag_pending() may have faked POLLIN for, so they can be
+ * serviced by fd afterwards.  Returns the count collected.
+ */
+int
+lws_service_pending_fds(struct lws_context_per_thread *pt, int *fds, int max)
+{
+	int c = 0;
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	struct lws *wsi;
+#endif
+
+#if defined(LWS_WITH_TLS)
+	lws_start_foreach_dll(struct lws_dll2 *, p,
+			lws_dll2_get_head(&pt->tls.dll_pending_tls_owner)) {
+		struct lws *w = lws_container_of(p, struct lws,
+						 tls.dll_pending_tls);
+
+		if (c < max)
+			fds[c++] = w->desc.sockfd;
+	} lws_end_foreach_dll(p);
+#endif
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	for (wsi = pt->ws.rx_draining_ext_list; wsi && c < max;
+	     wsi = wsi->ws->rx_draining_ext_list)
+		fds[c++] = wsi->desc.sockfd;
+#endif
+
+	return c;
+}
+
 int
 lws_service_fd_tsi(struct lws_context *context, struct lws_pollfd *pollfd,
 		   int tsi)
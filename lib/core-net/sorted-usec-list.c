@@ -43,6 +43,366 @@ sul_compare(const lws_dll2_t *d, const lws_dll2_t *i)
 	return 0;
 }
 
+#if defined(LWS_WITH_SUL_WHEEL)
+
+#define SUL_TICK(_us)		((uint64_t)(_us) >> LWS_SUL_WHEEL_TICK_BITS)
+#define SUL_L0_MASK		((unsigned int)LWS_SUL_WHEEL_L0_SLOTS - 1)
+#define SUL_LN_MASK		((unsigned int)LWS_SUL_WHEEL_LN_SLOTS - 1)
+/* tick shift for the slots of upper level _l (0 is the one above level 0) */
+#define SUL_LN_SHIFT(_l)	((unsigned int)LWS_SUL_WHEEL_L0_BITS + \
+				 ((unsigned int)(_l) * LWS_SUL_WHEEL_LN_BITS))
+
+/*
+ * Sorted insert that looks from the tail, since new sul are usually for
+ * later than anything already listed... equal us go after existing ones,
+ * the same as lws_dll2_add_sorted()
+ */
+
+static void
+sul_add_sorted_from_tail(lws_dll2_owner_t *own, lws_sorted_usec_list_t *sul)
+{
+	lws_dll2_t *p = lws_dll2_get_tail(own);
+
+	while (p && ((lws_sorted_usec_list_t *)p)->us > sul->us)
+		p = p->prev;
+
+	if (p)
+		lws_dll2_add_insert(&sul->list, p);
+	else
+		lws_dll2_add_head(&sul->list, own);
+}
+
+/*
+ * Find the next set bit in a map of bits entries, starting at from and
+ * wrapping around, or -1 if none
+ */
+
+static int
+sul_map_next(const uint64_t *map, unsigned int bits, unsigned int from)
+{
+	unsigned int i = from, c = 0, k;
+	uint64_t m;
+
+	while (c < bits + 64) {
+		m = map[i >> 6] >> (i & 63);
+		if (m) {
+			k = 0;
+			while (!(m & 1)) {
+				m >>= 1;
+				k++;
+			}
+
+			return (int)((i + k) % bits);
+		}
+
+		c += 64 - (i & 63);
+		i = (i + 64 - (i & 63)) % bits;
+	}
+
+	return -1;
+}
+
+static int
+sul_wheel_empty(const lws_sul_wheel_t *w)
+{
+	unsigned int n;
+
+	for (n = 0; n < LWS_ARRAY_SIZE(w->l0_map); n++)
+		if (w->l0_map[n])
+			return 0;
+
+	for (n = 0; n < LWS_ARRAY_SIZE(w->ln_map); n++)
+		if (w->ln_map[n])
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Put the sul in the right place for its time, relative to where the wheel
+ * has got to.  Anything already due goes straight on the sorted list.
+ */
+
+static void
+sul_wheel_place(lws_dll2_owner_t *own, lws_sul_wheel_t *w,
+		lws_sorted_usec_list_t *sul)
+{
+	uint64_t tick = SUL_TICK(sul->us), delta;
+	unsigned int idx;
+	int l;
+
+	if (sul->us <= 0 || tick < w->cur) {
+		sul_add_sorted_from_tail(own, sul);
+		return;
+	}
+
+	delta = tick - w->cur;
+	if (delta < LWS_SUL_WHEEL_L0_SLOTS) {
+		idx = (unsigned int)tick & SUL_L0_MASK;
+		sul_add_sorted_from_tail(&w->l0[idx], sul);
+		w->l0_map[idx >> 6] |= 1ull << (idx & 63);
+		return;
+	}
+
+	for (l = 0; l < LWS_SUL_WHEEL_LN_COUNT - 1; l++)
+		if (delta < (1ull << (SUL_LN_SHIFT(l) + LWS_SUL_WHEEL_LN_BITS)))
+			break;
+
+	if (delta >= (1ull << (SUL_LN_SHIFT(l) + LWS_SUL_WHEEL_LN_BITS)))
+		/* beyond the wheel, park it at the far end for now */
+		tick = w->cur +
+		       (1ull << (SUL_LN_SHIFT(l) + LWS_SUL_WHEEL_LN_BITS)) - 1;
+
+	idx = (unsigned int)(tick >> SUL_LN_SHIFT(l)) & SUL_LN_MASK;
+	lws_dll2_add_tail(&sul->list, &w->ln[l][idx]);
+	w->ln_map[l] |= 1ull << idx;
+}
+
+/*
+ * Level 0 just wrapped... the upper level slot covering the next span comes
+ * down and is placed again, and so on up while the levels wrap too
+ */
+
+static void
+sul_wheel_cascade(lws_dll2_owner_t *own, lws_sul_wheel_t *w)
+{
+	lws_sorted_usec_list_t *sul;
+	lws_dll2_owner_t *o;
+	unsigned int idx;
+	uint32_t c;
+	int l;
+
+	for (l = 0; l < LWS_SUL_WHEEL_LN_COUNT; l++) {
+		idx = (unsigned int)(w->cur >> SUL_LN_SHIFT(l)) & SUL_LN_MASK;
+		o = &w->ln[l][idx];
+
+		w->ln_map[l] &= ~(1ull << idx);
+
+		/* parked sul may come back on the same slot, at the tail */
+		c = (uint32_t)o->count;
+		while (c--) {
+			sul = (lws_sorted_usec_list_t *)lws_dll2_get_head(o);
+			lws_dll2_remove(&sul->list);
+			sul_wheel_place(own, w, sul);
+		}
+
+		if (idx)
+			break;
+	}
+}
+
+/*
+ * Move everything due up to and including now_tick from the wheel on to the
+ * sorted list, in order
+ */
+
+static void
+sul_wheel_catch_up(lws_dll2_owner_t *own, lws_sul_wheel_t *w,
+		   uint64_t now_tick)
+{
+	lws_sorted_usec_list_t *sul;
+	unsigned int idx;
+	uint64_t base;
+	int n;
+
+	if (sul_wheel_empty(w)) {
+		if (w->cur <= now_tick)
+			w->cur = now_tick + 1;
+		return;
+	}
+
+	while (w->cur <= now_tick) {
+		idx = (unsigned int)w->cur & SUL_L0_MASK;
+		base = w->cur - idx;
+
+		if (!idx)
+			sul_wheel_cascade(own, w);
+
+		n = sul_map_next(w->l0_map, LWS_SUL_WHEEL_L0_SLOTS, idx);
+		if (n < (int)idx) {
+			/* nothing else in this span, skip to the next */
+			w->cur = base + LWS_SUL_WHEEL_L0_SLOTS;
+			if (w->cur > now_tick + 1)
+				w->cur = now_tick + 1;
+			continue;
+		}
+
+		if (base + (unsigned int)n > now_tick) {
+			w->cur = now_tick + 1;
+			break;
+		}
+
+		/* the slot's time has come, it's already sorted */
+
+		w->l0_map[n >> 6] &= ~(1ull << (n & 63));
+		while (w->l0[n].head) {
+			sul = (lws_sorted_usec_list_t *)w->l0[n].head;
+			lws_dll2_remove(&sul->list);
+			sul_add_sorted_from_tail(own, sul);
+		}
+
+		w->cur = base + (unsigned int)n + 1;
+	}
+}
+
+/*
+ * Earliest time anything on the wheel may become due.  Level 0 slots are
+ * sorted so that's exact, for the upper levels it's the start of the span of
+ * the first occupied slot, which may be early but is never late.
+ */
+
+static int
+sul_wheel_next(lws_sul_wheel_t *w, lws_usec_t *next)
+{
+	unsigned int sh, k;
+	int n, l, found = 0;
+	lws_usec_t t;
+	uint64_t c;
+
+	while ((n = sul_map_next(w->l0_map, LWS_SUL_WHEEL_L0_SLOTS,
+				 (unsigned int)w->cur & SUL_L0_MASK)) >= 0) {
+		if (w->l0[n].head) {
+			*next = ((lws_sorted_usec_list_t *)w->l0[n].head)->us;
+			found = 1;
+			break;
+		}
+		/* everybody on it was cancelled */
+		w->l0_map[n >> 6] &= ~(1ull << (n & 63));
+	}
+
+	for (l = 0; l < LWS_SUL_WHEEL_LN_COUNT; l++) {
+		sh = SUL_LN_SHIFT(l);
+		c = w->cur >> sh;
+
+		while ((n = sul_map_next(&w->ln_map[l], LWS_SUL_WHEEL_LN_SLOTS,
+				  (unsigned int)(c + 1) & SUL_LN_MASK)) >= 0) {
+			if (!w->ln[l][n].count) {
+				w->ln_map[l] &= ~(1ull << n);
+				continue;
+			}
+
+			k = ((unsigned int)n - (unsigned int)c) & SUL_LN_MASK;
+			if (!k)
+				k = LWS_SUL_WHEEL_LN_SLOTS;
+
+			t = (lws_usec_t)((c + k) << (sh + LWS_SUL_WHEEL_TICK_BITS));
+			if (!found || t < *next) {
+				*next = t;
+				found = 1;
+			}
+			break;
+		}
+	}
+
+	return found;
+}
+
+static int
+sul_pt_next(struct lws_context_per_thread *pt, int n, lws_usec_t *next)
+{
+	int found = sul_wheel_next(&pt->pt_sul_wheel[n], next);
+
+	if (pt->pt_sul_owner[n].count) {
+		lws_sorted_usec_list_t *sul = (lws_sorted_usec_list_t *)
+					lws_dll2_get_head(&pt->pt_sul_owner[n]);
+
+		if (!found || sul->us < *next) {
+			*next = sul->us;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+#if defined(LWS_WITH_SUL_DEBUGGING)
+/*
+ * Everything on the wheel and the list, for the rare cases we need to walk
+ * them all
+ */
+
+static void
+sul_pt_foreach(struct lws_context_per_thread *pt, int n, void *user,
+	       int (*cb)(struct lws_dll2 *d, void *user))
+{
+	lws_sul_wheel_t *w = &pt->pt_sul_wheel[n];
+	unsigned int m, l;
+
+	lws_dll2_foreach_safe(&pt->pt_sul_owner[n], user, cb);
+	for (m = 0; m < LWS_SUL_WHEEL_L0_SLOTS; m++)
+		lws_dll2_foreach_safe(&w->l0[m], user, cb);
+	for (l = 0; l < LWS_SUL_WHEEL_LN_COUNT; l++)
+		for (m = 0; m < LWS_SUL_WHEEL_LN_SLOTS; m++)
+			lws_dll2_foreach_safe(&w->ln[l][m], user, cb);
+}
+#endif
+
+/*
+ * The clock is being stepped... step everything on the wheel and place it
+ * again relative to where the new clock is
+ */
+
+static void
+sul_wheel_step(struct lws_context_per_thread *pt, int n, int64_t step_us)
+{
+	lws_sul_wheel_t *w = &pt->pt_sul_wheel[n];
+	lws_sorted_usec_list_t *sul;
+	lws_dll2_owner_t tmp, *o;
+	unsigned int m;
+
+	memset(&tmp, 0, sizeof(tmp));
+
+	for (m = 0; m < LWS_SUL_WHEEL_L0_SLOTS +
+		    LWS_SUL_WHEEL_LN_COUNT * LWS_SUL_WHEEL_LN_SLOTS; m++) {
+		o = m < LWS_SUL_WHEEL_L0_SLOTS ? &w->l0[m] :
+			&w->ln[(m - LWS_SUL_WHEEL_L0_SLOTS) /
+						LWS_SUL_WHEEL_LN_SLOTS]
+			      [(m - LWS_SUL_WHEEL_L0_SLOTS) &
+						SUL_LN_MASK];
+		while (o->head) {
+			sul = (lws_sorted_usec_list_t *)o->head;
+			lws_dll2_remove(&sul->list);
+			lws_dll2_add_tail(&sul->list, &tmp);
+		}
+	}
+
+	memset(w->l0_map, 0, sizeof(w->l0_map));
+	memset(w->ln_map, 0, sizeof(w->ln_map));
+	w->cur = SUL_TICK(lws_now_usecs() + step_us);
+
+	while (tmp.head) {
+		sul = (lws_sorted_usec_list_t *)tmp.head;
+		lws_dll2_remove(&sul->list);
+		sul->us += step_us;
+		sul_wheel_place(&pt->pt_sul_owner[n], w, sul);
+	}
+}
+
+#else
+
+static int
+sul_pt_next(struct lws_context_per_thread *pt, int n, lws_usec_t *next)
+{
+	if (!pt->pt_sul_owner[n].count)
+		return 0;
+
+	*next = ((lws_sorted_usec_list_t *)
+			lws_dll2_get_head(&pt->pt_sul_owner[n]))->us;
+
+	return 1;
+}
+
+#if defined(LWS_WITH_SUL_DEBUGGING)
+static void
+sul_pt_foreach(struct lws_context_per_thread *pt, int n, void *user,
+	       int (*cb)(struct lws_dll2 *d, void *user))
+{
+	lws_dll2_foreach_safe(&pt->pt_sul_owner[n], user, cb);
+}
+#endif
+
+#endif
+
 /*
  * notice owner was chosen already, and sul->us was already computed
  */
@@ -56,7 +416,12 @@ __lws_sul_insert(lws_dll2_owner_t *own, lws_sorted_usec_list_t *sul)
 
 	/*
 	 * we sort the pt's list of sequencers with pending timeouts, so it's
-	 * cheap to check it every poll wait
+	 * cheap to check it every poll wait.
+	 *
+	 * With LWS_WITH_SUL_WHEEL, we don't know which wheel belongs to the
+	 * owner here, but the list is still walked in order so it's correct
+	 * to put the sul directly on it.  lws itself uses
+	 * __lws_sul_pt_insert() which can use the wheel.
 	 */
 
 	lws_dll2_add_sorted(&sul->list, own, sul_compare);
@@ -64,6 +429,34 @@ __lws_sul_insert(lws_dll2_owner_t *own, lws_sorted_usec_list_t *sul)
 	return 0;
 }
 
+void
+__lws_sul_pt_insert(struct lws_context_per_thread *pt, int n,
+		    lws_sorted_usec_list_t *sul)
+{
+#if defined(LWS_WITH_SUL_WHEEL)
+	lws_sul_wheel_t *w = &pt->pt_sul_wheel[n];
+	uint64_t now_tick;
+
+	lws_dll2_remove(&sul->list);
+
+	assert(sul->cb);
+
+	if (sul_wheel_empty(w)) {
+		/*
+		 * Nothing is relying on where the wheel got to, bring it up
+		 * to date so the sul lands as low on it as possible
+		 */
+		now_tick = SUL_TICK(lws_now_usecs());
+		if (w->cur < now_tick)
+			w->cur = now_tick;
+	}
+
+	sul_wheel_place(&pt->pt_sul_owner[n], w, sul);
+#else
+	__lws_sul_insert(&pt->pt_sul_owner[n], sul);
+#endif
+}
+
 void
 lws_sul_cancel(lws_sorted_usec_list_t *sul)
 {
@@ -83,8 +476,7 @@ lws_sul2_schedule(struct lws_context *context, int tsi, int flags,
 
 	assert(sul->cb);
 
-	__lws_sul_insert(
-		&pt->pt_sul_owner[!!(flags & LWSSULLI_WAKE_IF_SUSPENDED)], sul);
+	__lws_sul_pt_insert(pt, !!(flags & LWSSULLI_WAKE_IF_SUSPENDED), sul);
 }
 
 /*
@@ -111,6 +503,18 @@ __lws_sul_service_ripe(lws_dll2_owner_t *own, int own_len, lws_usec_t usnow)
 	/* must be at least 1 */
 	assert(own_len > 0);
 
+#if defined(LWS_WITH_SUL_WHEEL)
+	{
+		int n;
+
+		/* bring everybody due from the wheels on to the sorted lists */
+
+		for (n = 0; n < own_len; n++)
+			sul_wheel_catch_up(&own[n], &pt->pt_sul_wheel[n],
+					   SUL_TICK(usnow));
+	}
+#endif
+
 	/*
 	 * Of the own_len sul owning lists, the earliest next sul could be on
 	 * any of them.  We have to find it and handle each in turn until no
@@ -138,6 +542,29 @@ __lws_sul_service_ripe(lws_dll2_owner_t *own, int own_len, lws_usec_t usnow)
 			}
 		}
 
+#if defined(LWS_WITH_SUL_WHEEL)
+		{
+			lws_usec_t next, wnext = 0;
+
+			/*
+			 * Only already-due sul are on the lists, but the next
+			 * one may still be on a wheel
+			 */
+
+			for (n = 0; n < own_len; n++)
+				if (sul_wheel_next(&pt->pt_sul_wheel[n], &next) &&
+				    (!wnext || next < wnext))
+					wnext = next;
+
+			if (wnext && wnext <= usnow)
+				/* can't be due, it'd be on the list by now */
+				wnext = usnow + 1;
+
+			if (wnext && (!hit || (lowest > usnow && wnext < lowest)))
+				return wnext - usnow;
+		}
+#endif
+
 		if (!hit)
 			return 0;
 
@@ -204,9 +631,6 @@ lws_sul_nonmonotonic_adjust(struct lws_context *ctx, int64_t step_us)
 
 		for (n = 0; n < LWS_COUNT_PT_SUL_OWNERS; n++) {
 
-			if (!pt->pt_sul_owner[n].count)
-				continue;
-
 			/* ... and for every existing sul on a list... */
 
 			lws_start_foreach_dll(struct lws_dll2 *, p,
@@ -224,6 +648,11 @@ lws_sul_nonmonotonic_adjust(struct lws_context *ctx, int64_t step_us)
 				sul->us += step_us;
 
 			} lws_end_foreach_dll(p);
+
+#if defined(LWS_WITH_SUL_WHEEL)
+			/* ... and on the wheel, where it must be placed again */
+			sul_wheel_step(pt, n, step_us);
+#endif
 		}
 
 		lws_pt_unlock(pt);
@@ -243,22 +672,17 @@ lws_sul_earliest_wakeable_event(struct lws_context *ctx, lws_usec_t *pearliest)
 {
 	struct lws_context_per_thread *pt;
 	int n = 0, hit = -1;
-	lws_usec_t lowest = 0;
+	lws_usec_t lowest = 0, next;
 
 	for (n = 0; n < ctx->count_threads; n++) {
 		pt = &ctx->pt[n];
 
 		lws_pt_lock(pt, __func__);
 
-		if (pt->pt_sul_owner[LWSSULLI_WAKE_IF_SUSPENDED].count) {
-			lws_sorted_usec_list_t *sul = (lws_sorted_usec_list_t *)
-					lws_dll2_get_head(&pt->pt_sul_owner[
-					           LWSSULLI_WAKE_IF_SUSPENDED]);
-
-			if (hit == -1 || sul->us < lowest) {
-				hit = n;
-				lowest = sul->us;
-			}
+		if (sul_pt_next(pt, LWSSULLI_WAKE_IF_SUSPENDED, &next) &&
+		    (hit == -1 || next < lowest)) {
+			hit = n;
+			lowest = next;
 		}
 
 		lws_pt_unlock(pt);
@@ -326,65 +750,80 @@ lws_sul_schedule_wakesuspend(struct lws_context *ctx, int tsi,
  * being destroyed, there is no live sul scheduled from inside the object.
  */
 
+struct sul_zombie_args {
+	struct lws_context	*ctx;
+	void			*po;
+	size_t			len;
+	const char		*destroy_description;
+	int			list;
+};
+
+static int
+sul_zombie_check(struct lws_dll2 *p, void *user)
+{
+	struct sul_zombie_args *a = (struct sul_zombie_args *)user;
+	lws_sorted_usec_list_t *sul = lws_container_of(p,
+					lws_sorted_usec_list_t, list);
+
+	if (!a->po) {
+		lwsl_cx_err(a->ctx, "%s", a->destroy_description);
+		/* just sanity check the list */
+		assert(sul->cb);
+	}
+
+	/*
+	 * Is the sul resident inside the object that is
+	 * indicated as being deleted?
+	 */
+
+	if (a->po &&
+	    (void *)sul >= a->po &&
+	    (size_t)lws_ptr_diff(sul, a->po) < a->len) {
+		lwsl_cx_err(a->ctx, "ERROR: Zombie Sul "
+			 "(on list %d) %s, cb %p\n", a->list,
+			 a->destroy_description, sul->cb);
+		/*
+		 * This assert fires if you have left
+		 * a sul scheduled to fire later, but
+		 * are about to destroy the object the
+		 * sul lives in.  You must take care to
+		 * do lws_sul_cancel(&sul) on any suls
+		 * that may be scheduled before
+		 * destroying the object the sul lives
+		 * inside.
+		 *
+		 * You can look up the cb pointer in
+		 * your mapfile to find out which
+		 * callback function the sul was using
+		 * which usually tells you which sul
+		 * it is.
+		 */
+		assert(0);
+	}
+
+	return 0;
+}
+
 void
 lws_sul_debug_zombies(struct lws_context *ctx, void *po, size_t len,
 		      const char *destroy_description)
 {
 	struct lws_context_per_thread *pt;
-	int n, m;
+	struct sul_zombie_args a;
+	int n;
+
+	a.ctx = ctx;
+	a.po = po;
+	a.len = len;
+	a.destroy_description = destroy_description;
 
 	for (n = 0; n < ctx->count_threads; n++) {
 		pt = &ctx->pt[n];
 
 		lws_pt_lock(pt, __func__);
 
-		for (m = 0; m < LWS_COUNT_PT_SUL_OWNERS; m++) {
-
-			lws_start_foreach_dll(struct lws_dll2 *, p,
-				      lws_dll2_get_head(&pt->pt_sul_owner[m])) {
-				lws_sorted_usec_list_t *sul =
-					lws_container_of(p,
-						lws_sorted_usec_list_t, list);
-
-				if (!po) {
-					lwsl_cx_err(ctx, "%s",
-							 destroy_description);
-					/* just sanity check the list */
-					assert(sul->cb);
-				}
-
-				/*
-				 * Is the sul resident inside the object that is
-				 * indicated as being deleted?
-				 */
-
-				if (po &&
-				    (void *)sul >= po &&
-				    (size_t)lws_ptr_diff(sul, po) < len) {
-					lwsl_cx_err(ctx, "ERROR: Zombie Sul "
-						 "(on list %d) %s, cb %p\n", m,
-						 destroy_description, sul->cb);
-					/*
-					 * This assert fires if you have left
-					 * a sul scheduled to fire later, but
-					 * are about to destroy the object the
-					 * sul lives in.  You must take care to
-					 * do lws_sul_cancel(&sul) on any suls
-					 * that may be scheduled before
-					 * destroying the object the sul lives
-					 * inside.
-					 *
-					 * You can look up the cb pointer in
-					 * your mapfile to find out which
-					 * callback function the sul was using
-					 * which usually tells you which sul
-					 * it is.
-					 */
-					assert(0);
-				}
-
-			} lws_end_foreach_dll(p);
-		}
+		for (a.list = 0; a.list < LWS_COUNT_PT_SUL_OWNERS; a.list++)
+			sul_pt_foreach(pt, a.list, &a, sul_zombie_check);
 
 		lws_pt_unlock(pt);
 	}
@@ -891,6 +891,9 @@ lws_create_vhost(struct lws_context *context,
 				   (unsigned int)vh->count_protocols, "same vh list");
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 	vh->http.mount_list = info->mounts;
+#if defined(LWS_WITH_SERVER)
+	lws_vhost_mounts_compile(vh);
+#endif
 #endif
 
 #if defined(LWS_WITH_SYS_METRICS) && defined(LWS_WITH_SERVER)
@@ -1039,6 +1042,10 @@ lws_create_vhost(struct lws_context *context,
 	n = !!context->vhost_list;
 #endif
 
+	/* lws_select_vhost() on another thread may be looking in the hash */
+
+	lws_context_lock(context, __func__); /* ------------------- context { */
+
 	while (1) {
 		if (!(*vh1)) {
 			*vh1 = vh;
@@ -1047,6 +1054,10 @@ lws_create_vhost(struct lws_context *context,
 		vh1 = &(*vh1)->vhost_next;
 	};
 
+	__lws_vhost_hash_insert(vh);
+
+	lws_context_unlock(context); /* ---------------------------- context } */
+
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
 	if (!n)
 		lws_async_dns_init(context);
@@ -1084,6 +1095,9 @@ lws_vhost_set_mounts(struct lws_vhost *vh, const struct lws_http_mount *mounts)
 {
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
         vh->http.mount_list = mounts;
+#if defined(LWS_WITH_SERVER)
+	lws_vhost_mounts_compile(vh);
+#endif
 #endif
 }
 
@@ -1509,6 +1523,7 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 	lws_start_foreach_llp(struct lws_vhost **, pv, context->vhost_list) {
 		if (*pv == vh) {
 			*pv = vh->vhost_next;
+			__lws_vhost_hash_remove(vh);
 			break;
 		}
 	} lws_end_foreach_llp(pv, vhost_next);
@@ -1553,6 +1568,9 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 		lws_free(vh->protocol_vh_privs);
 	lws_ssl_SSL_CTX_destroy(vh);
 	lws_free(vh->same_vh_protocol_owner);
+#if (defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)) && defined(LWS_WITH_SERVER)
+	lws_vhost_mounts_destroy(vh);
+#endif
 
 	if (
 #if defined(LWS_WITH_PLUGINS)
@@ -1746,6 +1764,127 @@ lws_context_deprecate(struct lws_context *cx, lws_reload_func cb)
 
 #if defined(LWS_WITH_NETWORK)
 
+#if defined(LWS_WITH_SERVER)
+
+/*
+ * Vhosts are also hashed by name, so selecting one by SNI or Host: header
+ * doesn't need to look at every vhost.  Each hash chain is kept in vhost list
+ * order, so the first match on a chain is also the first one in the list.
+ */
+
+static uint32_t
+lws_vhost_name_hash(const char *name, size_t len)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (len--)
+		h = (h ^ (uint8_t)*name++) * 0x01000193;
+
+	return h;
+}
+
+static void
+__lws_vhost_hash_add(struct lws_context *cx, struct lws_vhost *vh)
+{
+	struct lws_vhost **pv = &cx->vh_hash_table[
+			lws_vhost_name_hash(vh->name, strlen(vh->name)) &
+			(cx->vh_hash_elements - 1)];
+
+	while (*pv)
+		pv = &(*pv)->vh_hash_next;
+
+	vh->vh_hash_next = NULL;
+	*pv = vh;
+}
+
+void
+__lws_vhost_hash_insert(struct lws_vhost *vh)
+{
+	struct lws_context *cx = vh->context;
+	struct lws_vhost **t, *v;
+	uint32_t n;
+
+	lws_context_assert_lock_held(cx);
+
+	vh->list_seq = cx->vh_list_seq++;
+	cx->count_vh_hashed++;
+
+	if (cx->vh_hash_table && cx->count_vh_hashed <= cx->vh_hash_elements) {
+		__lws_vhost_hash_add(cx, vh);
+		return;
+	}
+
+	/* grow the table and rehash everything from the list */
+
+	n = cx->vh_hash_elements ? cx->vh_hash_elements * 4 : 16;
+	t = lws_zalloc(sizeof(*t) * n, "vhost hash");
+	if (!t) {
+		/* we can keep using a smaller table, or the list */
+		if (cx->vh_hash_table)
+			__lws_vhost_hash_add(cx, vh);
+		return;
+	}
+
+	lws_free(cx->vh_hash_table);
+	cx->vh_hash_table = t;
+	cx->vh_hash_elements = n;
+
+	for (v = cx->vhost_list; v; v = v->vhost_next)
+		__lws_vhost_hash_add(cx, v);
+}
+
+void
+__lws_vhost_hash_remove(struct lws_vhost *vh)
+{
+	struct lws_context *cx = vh->context;
+
+	cx->count_vh_hashed--;
+
+	if (!cx->vh_hash_table)
+		return;
+
+	lws_start_foreach_llp(struct lws_vhost **, pv, cx->vh_hash_table[
+			lws_vhost_name_hash(vh->name, strlen(vh->name)) &
+			(cx->vh_hash_elements - 1)]) {
+		if (*pv == vh) {
+			*pv = vh->vh_hash_next;
+			break;
+		}
+	} lws_end_foreach_llp(pv, vh_hash_next);
+}
+
+/*
+ * Returns the first vhost in the list listening on port with exactly the
+ * name given by name / len, or NULL.  The caller must hold the context lock,
+ * since a vhost being created may grow the table and free the old one.
+ */
+
+struct lws_vhost *
+__lws_vhost_hash_find(struct lws_context *cx, const char *name, size_t len,
+		      int port)
+{
+	struct lws_vhost *v;
+
+	lws_context_assert_lock_held(cx);
+
+	v = cx->vh_hash_table ?
+		cx->vh_hash_table[lws_vhost_name_hash(name, len) &
+				  (cx->vh_hash_elements - 1)] :
+		cx->vhost_list;
+
+	while (v) {
+		if (v->listen_port == port && !strncmp(v->name, name, len) &&
+		    !v->name[len])
+			return v;
+
+		v = cx->vh_hash_table ? v->vh_hash_next : v->vhost_next;
+	}
+
+	return NULL;
+}
+
+#endif
+
 struct lws_vhost *
 lws_get_vhost_by_name(struct lws_context *context, const char *name)
 {
@@ -27,14 +27,120 @@
 #ifdef LWS_HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
+#if defined(LWS_HAVE_SYS_UIO_H)
+#include <sys/uio.h>
+#endif
 
 /* lws_buflist */
 
+/* the data capacity of pooled segments in each size class */
+static const uint32_t bl_class_cap[] = { 256, 1024, 4096, 16384 };
+
+lws_buflist_pool_t *
+lws_buflist_pool_create(unsigned int spare)
+{
+	lws_buflist_pool_t *pool = lws_zalloc(sizeof(*pool), __func__);
+
+	if (!pool)
+		return NULL;
+
+	pool->max_spare = (uint16_t)(spare > 0xffff ? 0xffff : spare);
+
+	return pool;
+}
+
+void
+lws_buflist_pool_destroy(lws_buflist_pool_t **ppool)
+{
+	lws_buflist_pool_t *pool = *ppool;
+	struct lws_buflist *b;
+	int n;
+
+	if (!pool)
+		return;
+
+	*ppool = NULL;
+
+	for (n = 0; n < LWS_BUFLIST_POOL_CLASSES; n++)
+		while (pool->spare[n]) {
+			b = pool->spare[n];
+			pool->spare[n] = b->next;
+			lws_free(b);
+		}
+
+	if (pool->in_use) {
+		/* the last segment to come back frees the pool */
+		pool->destroyed = 1;
+		return;
+	}
+
+	lws_free(pool);
+}
+
+static struct lws_buflist *
+lws_buflist_seg_alloc(lws_buflist_pool_t *pool, size_t len)
+{
+	int c = LWS_BUFLIST_POOL_CLASSES;
+	struct lws_buflist *b;
+	size_t cap = len;
+
+	if (pool && !pool->destroyed) {
+		for (c = 0; c < LWS_BUFLIST_POOL_CLASSES; c++)
+			if (len <= bl_class_cap[c]) {
+				cap = bl_class_cap[c];
+				break;
+			}
+
+		if (c < LWS_BUFLIST_POOL_CLASSES && pool->spare[c]) {
+			b = pool->spare[c];
+			pool->spare[c] = b->next;
+			pool->count_spare[c]--;
+#if defined(LWS_WITH_SYS_METRICS)
+			if (pool->mth)
+				lws_metrics_hist_bump_priv(pool->mth, "reuse");
+#endif
+			goto init;
+		}
+	}
+
+	b = (struct lws_buflist *)lws_malloc(sizeof(*b) + LWS_PRE + cap + 1,
+					     __func__);
+	if (!b)
+		return NULL;
+
+#if defined(LWS_WITH_SYS_METRICS)
+	if (pool && pool->mth)
+		lws_metrics_hist_bump_priv(pool->mth,
+				c < LWS_BUFLIST_POOL_CLASSES ? "alloc" : "large");
+#endif
+
+init:
+	b->next = NULL;
+	b->len = len;
+	b->pos = 0;
+	b->ref = NULL;
+	b->release = NULL;
+	b->opaque = NULL;
+	b->pool = pool;
+	b->cap = cap;
+	b->cls = (uint8_t)c;
+
+	if (pool) {
+		pool->in_use++;
+#if defined(LWS_WITH_SYS_METRICS)
+		lws_metric_event(pool->mt_use, METRES_GO, pool->in_use);
+#endif
+	}
+
+	return b;
+}
+
 int
-lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
-			   size_t len)
+lws_buflist_append_segment_pool(lws_buflist_pool_t *pool,
+				struct lws_buflist **head, const uint8_t *buf,
+				size_t len, int coalesce)
 {
-	struct lws_buflist *nbuf;
+	struct lws_buflist *nbuf, *tail = NULL;
 	int first = !*head;
 	void *p = *head;
 	int sanity = 1024;
@@ -54,24 +160,38 @@ lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
 			lwsl_err("%s: corrupt list points to self\n", __func__);
 			return -1;
 		}
+		tail = *head;
 		head = &((*head)->next);
 	}
 
+	/*
+	 * If it fits in the spare space at the end of the tail, put it there.
+	 * The first segment is never grown, it may be partway through being
+	 * consumed, eg, a tls write that must be retried with the same length.
+	 */
+
+	if (coalesce && tail && tail != p && !tail->ref &&
+	    tail->cap - tail->len >= len) {
+		memcpy((uint8_t *)&tail[1] + LWS_PRE + tail->len, buf, len);
+		tail->len += len;
+#if defined(LWS_WITH_SYS_METRICS)
+		if (tail->pool && tail->pool->mth)
+			lws_metrics_hist_bump_priv(tail->pool->mth, "coalesce");
+#endif
+
+		return 0;
+	}
+
 	(void)p;
 	lwsl_info("%s: len %u first %d %p\n", __func__, (unsigned int)len,
 					      first, p);
 
-	nbuf = (struct lws_buflist *)lws_malloc(sizeof(struct lws_buflist) +
-						len + LWS_PRE + 1, __func__);
+	nbuf = lws_buflist_seg_alloc(pool, len);
 	if (!nbuf) {
 		lwsl_err("%s: OOM\n", __func__);
 		return -1;
 	}
 
-	nbuf->len = len;
-	nbuf->pos = 0;
-	nbuf->next = NULL;
-
 	/* whoever consumes this might need LWS_PRE from the start... */
 	p = (uint8_t *)nbuf + sizeof(*nbuf) + LWS_PRE;
 	memcpy(p, buf, len);
@@ -81,6 +201,97 @@ lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
 	return first; /* returns 1 if first segment just created */
 }
 
+int
+lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
+			   size_t len)
+{
+	return lws_buflist_append_segment_pool(NULL, head, buf, len, 0);
+}
+
+int
+lws_buflist_append_ref(struct lws_buflist **head, const uint8_t *buf,
+		       size_t len, lws_buflist_release_cb release,
+		       void *opaque)
+{
+	struct lws_buflist *nbuf;
+	int first = !*head;
+	int sanity = 1024;
+
+	if (!buf)
+		return -1;
+
+	assert(len);
+
+	while (*head) {
+		if (!--sanity) {
+			lwsl_err("%s: buflist reached sanity limit\n", __func__);
+			return -1;
+		}
+		head = &((*head)->next);
+	}
+
+	/* just the header, the data stays where the caller has it */
+
+	nbuf = (struct lws_buflist *)lws_malloc(sizeof(*nbuf), __func__);
+	if (!nbuf) {
+		lwsl_err("%s: OOM\n", __func__);
+		return -1;
+	}
+
+	nbuf->len = len;
+	nbuf->pos = 0;
+	nbuf->next = NULL;
+	nbuf->ref = buf;
+	nbuf->release = release;
+	nbuf->opaque = opaque;
+	nbuf->pool = NULL;
+	nbuf->cap = 0;
+	nbuf->cls = LWS_BUFLIST_POOL_CLASSES;
+
+	*head = nbuf;
+
+	return first;
+}
+
+static uint8_t *
+lws_buflist_seg_data(struct lws_buflist *b)
+{
+	if (b->ref)
+		return (uint8_t *)b->ref;
+
+	return ((uint8_t *)&b[1]) + LWS_PRE;
+}
+
+static void
+lws_buflist_free_segment(struct lws_buflist *b)
+{
+	lws_buflist_release_cb release = b->release;
+	lws_buflist_pool_t *pool = b->pool;
+	void *opaque = b->opaque;
+
+	if (pool) {
+		pool->in_use--;
+		if (!pool->destroyed && b->cls < LWS_BUFLIST_POOL_CLASSES &&
+		    pool->count_spare[b->cls] < pool->max_spare) {
+			/* keep it for reuse */
+			b->next = pool->spare[b->cls];
+			pool->spare[b->cls] = b;
+			pool->count_spare[b->cls]++;
+			b = NULL;
+		}
+	}
+
+	if (b)
+		lws_free(b);
+
+	if (pool && pool->destroyed && !pool->in_use)
+		lws_free(pool);
+
+	/* the caller's data we were referencing is done with */
+	if (release)
+		release(opaque);
+}
+
 static int
 lws_buflist_destroy_segment(struct lws_buflist **head)
 {
@@ -90,7 +301,7 @@ lws_buflist_destroy_segment(struct lws_buflist **head)
 	*head = old->next;
 	old->next = NULL;
 	old->pos = old->len = 0;
-	lws_free(old);
+	lws_buflist_free_segment(old);
 
 	return !*head; /* returns 1 if last segment just destroyed */
 }
@@ -100,14 +311,14 @@ lws_buflist_destroy_all_segments(struct lws_buflist **head)
 {
 	struct lws_buflist *p = *head, *p1;
 
+	*head = NULL;
+
 	while (p) {
 		p1 = p->next;
 		p->next = NULL;
-		lws_free(p);
+		lws_buflist_free_segment(p);
 		p = p1;
 	}
-
-	*head = NULL;
 }
 
 size_t
@@ -132,7 +343,7 @@ lws_buflist_next_segment_len(struct lws_buflist **head, uint8_t **buf)
 	assert(b->pos < b->len);
 
 	if (buf)
-		*buf = ((uint8_t *)b) + sizeof(*b) + b->pos + LWS_PRE;
+		*buf = lws_buflist_seg_data(b) + b->pos;
 
 	return b->len - b->pos;
 }
@@ -174,6 +385,26 @@ lws_buflist_total_len(struct lws_buflist **head)
 	return size;
 }
 
+#if defined(LWS_HAVE_SYS_UIO_H)
+int
+lws_buflist_iov(struct lws_buflist **head, struct iovec *iov, int max)
+{
+	struct lws_buflist *p = *head;
+	int n = 0;
+
+	while (p && n < max) {
+		if (p->len > p->pos) {
+			iov[n].iov_base = lws_buflist_seg_data(p) + p->pos;
+			iov[n].iov_len = p->len - p->pos;
+			n++;
+		}
+		p = p->next;
+	}
+
+	return n;
+}
+#endif
+
 int
 lws_buflist_linear_copy(struct lws_buflist **head, size_t ofs, uint8_t *buf,
 			size_t len)
@@ -187,7 +418,7 @@ lws_buflist_linear_copy(struct lws_buflist **head, size_t ofs, uint8_t *buf,
 			s = p->len - ofs;
 			if (s > len)
 				s = len;
-			memcpy(buf, ((uint8_t *)&p[1]) + LWS_PRE + ofs, s);
+			memcpy(buf, lws_buflist_seg_data(p) + ofs, s);
 			len -= s;
 			buf += s;
 			ofs = 0;
@@ -209,8 +440,7 @@ lws_buflist_linear_use(struct lws_buflist **head, uint8_t *buf, size_t len)
 		s = (*head)->len - (*head)->pos;
 		if (s > len)
 			s = len;
-		memcpy(buf, ((uint8_t *)((*head) + 1)) +
-			    LWS_PRE + (*head)->pos, s);
+		memcpy(buf, lws_buflist_seg_data(*head) + (*head)->pos, s);
 		len -= s;
 		buf += s;
 		lws_buflist_use_segment(head, s);
@@ -239,7 +469,7 @@ lws_buflist_fragment_use(struct lws_buflist **head, uint8_t *buf,
 	if (frag_fin)
 		*frag_fin = (*head)->pos + s == (*head)->len;
 
-	memcpy(buf, ((uint8_t *)((*head) + 1)) + LWS_PRE + (*head)->pos, s);
+	memcpy(buf, lws_buflist_seg_data(*head) + (*head)->pos, s);
 	len -= s;
 	buf += s;
 	lws_buflist_use_segment(head, s);
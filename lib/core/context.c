@@ -494,6 +494,43 @@ lws_create_context(const struct lws_context_creation_info *info)
 	}
 #endif
 
+#if defined(LWS_WITH_EPOLL)
+	if (!info->event_lib_custom &&
+	    lws_check_opt(info->options, LWS_SERVER_OPTION_EPOLL)) {
+		extern const lws_plugin_evlib_t evlib_epoll;
+		plev = &evlib_epoll;
+		/* epoll_wait() is also ms-resolution */
+		us_wait_resolution = 1000;
+	}
+#else
+	if (lws_check_opt(info->options, LWS_SERVER_OPTION_EPOLL)) {
+		lwsl_err("%s: Application wants epoll, but lws not built with it\n",
+			 __func__);
+		goto bail;
+	}
+#endif
+
+#if defined(LWS_WITH_IO_URING)
+	if (!info->event_lib_custom &&
+	    lws_check_opt(info->options, LWS_SERVER_OPTION_IO_URING)) {
+		extern const lws_plugin_evlib_t evlib_io_uring;
+
+		if (lws_io_uring_supported()) {
+			plev = &evlib_io_uring;
+			/* the enter timeout is ns, but keep to the same as poll */
+			us_wait_resolution = 1000;
+		} else
+			lwsl_notice("%s: kernel lacks io_uring, using poll\n",
+				    __func__);
+	}
+#else
+	if (lws_check_opt(info->options, LWS_SERVER_OPTION_IO_URING)) {
+		lwsl_err("%s: Application wants io_uring, but lws not built with it\n",
+			 __func__);
+		goto bail;
+	}
+#endif
+
 #if defined(LWS_WITH_EVLIB_PLUGINS) && defined(LWS_WITH_EVENT_LIBS)
 
 	/*
@@ -806,6 +843,9 @@ lws_create_context(const struct lws_context_creation_info *info)
 						   LWSMTFL_REPORT_MEAN |
 						   LWSMTFL_REPORT_DUTY_WALLCLOCK_US,
 						   "n.cn.adns");
+	context->mth_adns_cache = lws_metric_create(context,
+						    LWSMTFL_REPORT_HIST,
+						    "n.cn.adns.cache");
 #endif
 #if defined(LWS_WITH_SECURE_STREAMS)
 	context->mth_ss_conn = lws_metric_create(context, LWSMTFL_REPORT_HIST,
@@ -832,6 +872,32 @@ lws_create_context(const struct lws_context_creation_info *info)
 					     LWSMTFL_REPORT_HIST, "n.srv");
 #endif /* network + metrics + server */
 
+#if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
+	context->mt_ah_use = lws_metric_create(context, LWSMTFL_REPORT_MEAN |
+						   LWSMTFL_REPORT_ONLY_GO,
+					       "n.http.ah.use");
+	context->mt_ah_wait = lws_metric_create(context, LWSMTFL_REPORT_MEAN |
+						    LWSMTFL_REPORT_ONLY_GO,
+						"n.http.ah.wait");
+	context->mth_ah = lws_metric_create(context, LWSMTFL_REPORT_HIST,
+					    "n.http.ah");
+#endif /* network + metrics + http */
+
+	context->mt_buflist_use = lws_metric_create(context,
+						    LWSMTFL_REPORT_MEAN |
+						    LWSMTFL_REPORT_ONLY_GO,
+						    "n.buflist.use");
+	context->mth_buflist = lws_metric_create(context, LWSMTFL_REPORT_HIST,
+						 "n.buflist");
+
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	context->mth_pmd = lws_metric_create(context, LWSMTFL_REPORT_HIST,
+					     "n.ws.pmd");
+	context->mt_pmd_saved = lws_metric_create(context,
+						  LWSMTFL_REPORT_ONLY_GO,
+						  "n.ws.pmd.saved");
+#endif
+
 #endif /* network + metrics */
 
 #endif /* network */
@@ -1137,6 +1203,14 @@ lws_create_context(const struct lws_context_creation_info *info)
 					(unsigned short)info->max_http_header_pool2;
 		else
 			context->max_http_header_pool = context->max_fds;
+
+	context->http_header_data_inline = info->http_header_data_inline ?
+			info->http_header_data_inline : LWS_DEF_HEADER_INLINE;
+	if (context->http_header_data_inline > context->max_http_header_data)
+		context->http_header_data_inline = context->max_http_header_data;
+
+	context->max_http_header_pool_spare = info->max_http_header_pool_spare ?
+			info->max_http_header_pool_spare : LWS_DEF_HEADER_POOL_SPARE;
 #endif
 
 	if (info->fd_limit_per_thread)
@@ -1223,6 +1297,18 @@ lws_create_context(const struct lws_context_creation_info *info)
 #endif
 		lws_pt_mutex_init(&context->pt[n]);
 
+		/* if this fails, buflists just use the heap directly */
+		context->pt[n].bl_pool = lws_buflist_pool_create(
+				info->buflist_pool_spare ?
+				info->buflist_pool_spare :
+				LWS_DEF_BUFLIST_POOL_SPARE);
+#if defined(LWS_WITH_SYS_METRICS)
+		if (context->pt[n].bl_pool) {
+			context->pt[n].bl_pool->mth = context->mth_buflist;
+			context->pt[n].bl_pool->mt_use = context->mt_buflist_use;
+		}
+#endif
+
 #if defined(LWS_WITH_CGI)
 		if (lws_rops_fidx(&role_ops_cgi, LWS_ROPS_pt_init_destroy))
 			(lws_rops_func_fidx(&role_ops_cgi, LWS_ROPS_pt_init_destroy)).
@@ -1279,10 +1365,13 @@ lws_create_context(const struct lws_context_creation_info *info)
 		  context->fd_limit_per_thread);
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
-	lwsl_cx_info(context, " http: ah_data: %u, ah: %lu, max count %u",
+	lwsl_cx_info(context, " http: ah_data: %u (inline %u), ah: %lu, "
+			      "max count %u, spare %u",
 		    context->max_http_header_data,
+		    context->http_header_data_inline,
 		    (long)sizeof(struct allocated_headers),
-		    context->max_http_header_pool);
+		    context->max_http_header_pool,
+		    context->max_http_header_pool_spare);
 #endif
 
 #if defined(LWS_WITH_SERVER)
@@ -1502,6 +1591,8 @@ lws_create_context(const struct lws_context_creation_info *info)
 #endif
 
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
+	context->async_dns.cache_max = info->async_dns_cache_max;
+	context->async_dns.hosts_path = info->async_dns_hosts_path;
 	if (info->async_dns_servers) {
 		const char **dsrv = info->async_dns_servers;
 		while (*dsrv) {
@@ -1875,10 +1966,16 @@ lws_pt_destroy(struct lws_context_per_thread *pt)
 #endif
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
-		while (pt->http.ah_list)
-			_lws_destroy_ah(pt, pt->http.ah_list);
+		_lws_header_table_pool_destroy(pt);
 #endif
 
+#endif
+
+	/* any segments still on a buflist take the pool with the last one */
+	lws_buflist_pool_destroy(&pt->bl_pool);
+
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	lws_pmd_pool_destroy(pt);
 #endif
 
 	lws_pt_unlock(pt);
@@ -2201,6 +2298,9 @@ next:
 			}
 		lws_free(context->pl_hash_table);
 #endif
+#if defined(LWS_WITH_SERVER)
+		lws_free_set_NULL(context->vh_hash_table);
+#endif
 
 #if defined(LWS_WITH_NETWORK)
 
@@ -2223,8 +2323,7 @@ next:
 #endif
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
-			while (pt->http.ah_list)
-				_lws_destroy_ah(pt, pt->http.ah_list);
+			_lws_header_table_pool_destroy(pt);
 #endif
 			lwsl_cx_info(context, "pt destroy %d", n);
 			lws_pt_destroy(pt);
@@ -2345,6 +2444,10 @@ next:
 			lws_system_blob_destroy(
 					lws_system_get_blob(context, (lws_system_blob_item_t)n, 0));
 
+#if defined(LWS_WITH_NETWORK) && defined(LWS_WITH_SECURE_STREAMS)
+		lws_ss_policy_index_destroy(context);
+#endif
+
 #if defined(LWS_WITH_NETWORK) && defined(LWS_WITH_SECURE_STREAMS) && \
 	!defined(LWS_WITH_SECURE_STREAMS_STATIC_POLICY_ONLY)
 
@@ -980,6 +980,9 @@ lws_tokenize(struct lws_tokenize *ts)
 			}
 			switch (ts->state) {
 			case LWS_TOKZS_LEADING_WHITESPACE:
+				/* the token will start on a later line */
+				ts->effline = ts->line;
+				continue;
 			case LWS_TOKZS_TOKEN_POST_TERMINAL:
 				continue;
 			case LWS_TOKZS_QUOTED_STRING:
@@ -85,6 +85,15 @@
 #ifndef LWS_DEF_HEADER_POOL
 #define LWS_DEF_HEADER_POOL 4
 #endif
+#ifndef LWS_DEF_HEADER_INLINE
+#define LWS_DEF_HEADER_INLINE 1024
+#endif
+#ifndef LWS_DEF_HEADER_POOL_SPARE
+#define LWS_DEF_HEADER_POOL_SPARE 4
+#endif
+#ifndef LWS_DEF_BUFLIST_POOL_SPARE
+#define LWS_DEF_BUFLIST_POOL_SPARE 8
+#endif
 #ifndef LWS_MAX_PROTOCOLS
 #define LWS_MAX_PROTOCOLS 5
 #endif
@@ -533,6 +542,7 @@ struct lws_context {
 #endif
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
 	lws_metric_t			*mt_adns_cache; /* async dns lookup lat */
+	lws_metric_t			*mth_adns_cache; /* adns cache hit / neg / miss */
 #endif
 #if defined(LWS_WITH_SECURE_STREAMS)
 	lws_metric_t			*mth_ss_conn; /* SS connection outcomes */
@@ -547,6 +557,17 @@ struct lws_context {
 #if defined(LWS_WITH_SERVER)
 	lws_metric_t			*mth_srv;
 #endif
+#if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
+	lws_metric_t			*mt_ah_use; /* ahs in use at attach */
+	lws_metric_t			*mt_ah_wait; /* us waiting for an ah */
+	lws_metric_t			*mth_ah; /* ah reuse / alloc / wait / spill */
+#endif
+	lws_metric_t			*mt_buflist_use; /* segs in use at alloc */
+	lws_metric_t			*mth_buflist; /* seg reuse / alloc / large / coalesce */
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	lws_metric_t			*mth_pmd; /* pmd z_stream hit / miss / limited */
+	lws_metric_t			*mt_pmd_saved; /* bytes pmd kept off the wire */
+#endif
 
 #if defined(LWS_WITH_EVENT_LIBS)
 	struct lws_plugin		*evlib_plugin_list;
@@ -678,6 +699,11 @@ struct lws_context {
 	struct lws_threadpool *tp_list_head;
 #endif
 
+#if defined(LWS_WITH_SERVER)
+	struct lws_vhost		**vh_hash_table;
+	/**< vhosts by name, for selecting one by SNI or Host: */
+#endif
+
 #if defined(LWS_WITH_PEER_LIMITS)
 	struct lws_peer			**pl_hash_table;
 	struct lws_peer			*peer_wait_list;
@@ -694,6 +720,7 @@ struct lws_context {
 	void				*pol_args;
 #endif
 	const lws_ss_policy_t		*pss_policies;
+	struct lws_ss_pidx		*ss_pidx; /* hash index of policy */
 	const lws_ss_auth_t		*pss_auths;
 #if defined(LWS_WITH_SERVER)
 	lws_dll2_owner_t		sinks;
@@ -755,6 +782,11 @@ struct lws_context {
 	unsigned int pt_serv_buf_size;
 	unsigned int max_http_header_data;
 	unsigned int max_http_header_pool;
+	unsigned int http_header_data_inline;
+	unsigned int max_http_header_pool_spare;
+#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
+	size_t pmd_mem_budget; /* per service thread */
+#endif
 	int simultaneous_ssl_restriction;
 	int simultaneous_ssl;
 	int simultaneous_ssl_handshake_restriction;
@@ -762,6 +794,11 @@ struct lws_context {
 #if defined(LWS_WITH_TLS_JIT_TRUST)
 	int		vh_idle_grace_ms;
 #endif
+#if defined(LWS_WITH_SERVER)
+	uint32_t vh_hash_elements;	/* power of 2 */
+	uint32_t count_vh_hashed;
+	uint32_t vh_list_seq;		/* list position of next vhost */
+#endif
 #if defined(LWS_WITH_PEER_LIMITS)
 	uint32_t pl_hash_elements;	/* protected by context->lock */
 	uint32_t count_peers;		/* protected by context->lock */
@@ -844,12 +881,42 @@ int
 lws_system_do_attach(struct lws_context_per_thread *pt);
 #endif
 
+#define LWS_BUFLIST_POOL_CLASSES 4
+
 struct lws_buflist {
 	struct lws_buflist *next;
 	size_t len;
 	size_t pos;
+	const uint8_t *ref;	/* NULL, or caller's data instead of ours */
+	lws_buflist_release_cb release;
+	void *opaque;
+	struct lws_buflist_pool *pool; /* NULL, or the pool we go back to */
+	size_t cap;		/* space for data after LWS_PRE */
+	uint8_t cls;		/* size class, or LWS_BUFLIST_POOL_CLASSES */
+};
+
+struct lws_buflist_pool {
+	struct lws_buflist *spare[LWS_BUFLIST_POOL_CLASSES];
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_metric_t *mth;	/* reuse / alloc / large / coalesce */
+	lws_metric_t *mt_use;	/* segments in use, at each alloc */
+#endif
+	uint32_t in_use;
+	uint16_t count_spare[LWS_BUFLIST_POOL_CLASSES];
+	uint16_t max_spare;
+	uint8_t destroyed;	/* free it when the last segment comes back */
 };
 
+#if defined(LWS_HAVE_SYS_UIO_H)
+struct iovec;
+/*
+ * Describes the unused data in up to max segments from the head, for a
+ * gathering write, returns the count of iovecs filled
+ */
+int
+lws_buflist_iov(struct lws_buflist **head, struct iovec *iov, int max);
+#endif
+
 char *
 lws_strdup(const char *s);
 
@@ -0,0 +1,462 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Native Linux epoll() support for the default lws service loop.
+ *
+ * The wsi fds are registered with the kernel once, and changes to the events
+ * we are interested in become a single epoll_ctl().  The service loop then
+ * only has to look at the ready set epoll_wait() hands back, instead of
+ * poll() walking the whole pt->fds array every time.
+ *
+ * pt->fds is still maintained by the core exactly as for poll(), it remains
+ * the canonical place lws keeps the events and revents for each wsi.
+ */
+
+#include "private-lib-core.h"
+
+#define pt_to_priv_epoll(_pt) ((struct lws_pt_eventlibs_epoll *)(_pt)->evlib_pt)
+#define wsi_to_priv_epoll(_w) ((struct lws_wsi_eventlibs_epoll *)(_w)->evlib_wsi)
+
+static int
+lws_epoll_fd(struct lws *wsi)
+{
+	if (wsi->role_ops && wsi->role_ops->file_handle)
+		return wsi->desc.filefd;
+
+	return wsi->desc.sockfd;
+}
+
+/*
+ * Edge-triggered registration is only used for plain connected sockets, where
+ * rx goes through lws_ssl_capable_read_no_ssl() and we can learn from that
+ * when the socket has been drained.  Listen sockets, tls, udp, pipes and files
+ * are always registered level-triggered.
+ */
+
+static int
+lws_epoll_wsi_can_et(struct lws *wsi)
+{
+	if (!lws_check_opt(wsi->a.context->options,
+			   LWS_SERVER_OPTION_EPOLL_EDGE_TRIGGERED))
+		return 0;
+
+	if (wsi->listener || wsi->event_pipe || wsi->file_desc ||
+	    !wsi->role_ops || wsi->role_ops->file_handle || lwsi_role_cgi(wsi))
+		return 0;
+
+#if defined(LWS_WITH_UDP)
+	if (lws_wsi_is_udp(wsi))
+		return 0;
+#endif
+#if defined(LWS_WITH_TLS)
+	if (wsi->tls.ssl)
+		return 0;
+#endif
+
+	return 1;
+}
+
+/*
+ * Unpollable fds are on the pt list, and so get faked revents every time
+ * around the loop, only while they want some event
+ */
+
+static void
+lws_epoll_unpollable_update(struct lws_pt_eventlibs_epoll *ptpr,
+			    struct lws_wsi_eventlibs_epoll *w)
+{
+	lws_dll2_remove(&w->unpollable_list);
+	if (w->events)
+		lws_dll2_add_tail(&w->unpollable_list, &ptpr->unpollable_owner);
+}
+
+/*
+ * Bring the kernel registration for the wsi in line with the events we want
+ */
+
+static int
+lws_epoll_apply(struct lws *wsi, uint32_t events)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	struct lws_wsi_eventlibs_epoll *w = wsi_to_priv_epoll(wsi);
+	int et = lws_epoll_wsi_can_et(wsi);
+	struct epoll_event ev;
+	int op;
+
+	if (w->registered && w->events == events && w->et == et)
+		return 0;
+
+	w->events = events;
+	w->fd = lws_epoll_fd(wsi);
+
+	if (w->unpollable) {
+		lws_epoll_unpollable_update(ptpr, w);
+
+		return 0;
+	}
+
+	if (ptpr->epfd < 0)
+		/* pt not up yet, init_pt registers everything in pt->fds */
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events | (et ? (uint32_t)EPOLLET : 0u);
+	ev.data.fd = lws_epoll_fd(wsi);
+
+	op = w->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl(ptpr->epfd, op, ev.data.fd, &ev) < 0) {
+		if (errno == EPERM) {
+			/*
+			 * Regular files can't go in an epoll set, but poll()
+			 * would always show them ready... act the same way
+			 */
+			lwsl_wsi_info(wsi, "fd %d unpollable", ev.data.fd);
+			w->unpollable = 1;
+			lws_epoll_unpollable_update(ptpr, w);
+
+			return 0;
+		}
+
+		op = op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl(ptpr->epfd, op, ev.data.fd, &ev) < 0) {
+			lwsl_wsi_err(wsi, "epoll_ctl fd %d failed: errno %d",
+				     ev.data.fd, errno);
+
+			return -1;
+		}
+	}
+
+	w->registered = 1;
+	w->et = !!et;
+
+	return 0;
+}
+
+static void
+lws_epoll_unregister(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	struct lws_wsi_eventlibs_epoll *w = wsi_to_priv_epoll(wsi);
+
+	if (w->unpollable) {
+		lws_dll2_remove(&w->unpollable_list);
+		w->unpollable = 0;
+	}
+
+	if (w->registered && ptpr->epfd >= 0)
+		/* the fd may already be closed, it doesn't matter */
+		epoll_ctl(ptpr->epfd, EPOLL_CTL_DEL, lws_epoll_fd(wsi), NULL);
+
+	w->registered = 0;
+	w->events = 0;
+}
+
+/*
+ * Service one fd from the ready set.  We look the wsi up by fd, since
+ * servicing an earlier fd in the same batch may have closed this one.
+ */
+
+static int
+lws_epoll_service_fd(struct lws_context_per_thread *pt, int fd,
+		     uint32_t events)
+{
+	struct lws_context *cx = pt->context;
+	struct lws_wsi_eventlibs_epoll *w;
+	struct lws_pollfd *pfd;
+	struct lws *wsi;
+	short revents = 0;
+	int et, m;
+
+	wsi = wsi_from_fd(cx, fd);
+	if (!wsi || wsi->position_in_fds_table == LWS_NO_FDS_POS)
+		return 0;
+
+	if (events & EPOLLIN)
+		revents |= LWS_POLLIN;
+	if (events & EPOLLOUT)
+		revents |= LWS_POLLOUT;
+	if (events & (EPOLLHUP | EPOLLERR))
+		revents |= LWS_POLLHUP;
+
+	pfd = &pt->fds[wsi->position_in_fds_table];
+	pfd->revents = (short)(pfd->revents | revents);
+	if (!pfd->revents)
+		return 0;
+
+	et = wsi_to_priv_epoll(wsi)->et && (pfd->revents & LWS_POLLIN);
+	if (et)
+		wsi->sock_rx_drained = 0;
+
+	m = lws_service_fd_tsi(cx, pfd, pt->tid);
+	if (m < 0) {
+		lwsl_cx_err(cx, "lws_service_fd_tsi returned %d", m);
+		return -1;
+	}
+
+	if (!wsi_to_priv_epoll(wsi)->et || m)
+		return 0;
+
+	/*
+	 * Edge-triggered: the kernel won't tell us again about anything that
+	 * was already waiting.  If we can't be sure lws consumed it all, or
+	 * lws left POLLOUT enabled, MOD the registration so the kernel looks
+	 * again and reports it if it's still ready, as level would have.
+	 */
+
+	wsi = wsi_from_fd(cx, fd);
+	if (!wsi || wsi->position_in_fds_table == LWS_NO_FDS_POS)
+		return 0;
+
+	w = wsi_to_priv_epoll(wsi);
+	pfd = &pt->fds[wsi->position_in_fds_table];
+
+	if (w->registered && w->et &&
+	    ((et && !wsi->sock_rx_drained && (pfd->events & LWS_POLLIN)) ||
+	     (pfd->events & LWS_POLLOUT))) {
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = w->events | (uint32_t)EPOLLET;
+		ev.data.fd = fd;
+		epoll_ctl(pt_to_priv_epoll(pt)->epfd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	return 0;
+}
+
+int
+lws_epoll_wait_pt(struct lws_context_per_thread *pt, int timeout_ms)
+{
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	int n;
+
+	ptpr->count_evs = 0;
+
+	if (ptpr->epfd < 0)
+		return 0;
+
+	if (ptpr->unpollable_owner.count)
+		/* we have something always ready, don't wait */
+		timeout_ms = 0;
+
+	n = epoll_wait(ptpr->epfd, ptpr->evs, LWS_EPOLL_MAX_EVENTS, timeout_ms);
+	if (n < 0)
+		/* eg, EINTR */
+		return 0;
+
+	ptpr->count_evs = n;
+
+	return n + (int)ptpr->unpollable_owner.count;
+}
+
+/*
+ * Service the ready set collected by lws_epoll_wait_pt(), then anybody we
+ * know has buffered rx pending.  Unlike the poll() flow, we never need to walk
+ * all of pt->fds.
+ */
+
+int
+lws_epoll_service_ready_pt(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	int fds[LWS_EPOLL_MAX_EVENTS], n, c = 0;
+	struct lws *wsi;
+
+	for (n = 0; n < ptpr->count_evs; n++)
+		if (lws_epoll_service_fd(pt, ptpr->evs[n].data.fd,
+					 ptpr->evs[n].events))
+			return -1;
+
+	ptpr->count_evs = 0;
+
+	/*
+	 * Collect the fds of guys that need service without network action
+	 * first, then service them by fd, since servicing one may close others
+	 */
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      lws_dll2_get_head(&ptpr->unpollable_owner)) {
+		struct lws_wsi_eventlibs_epoll *w = lws_container_of(d,
+				struct lws_wsi_eventlibs_epoll, unpollable_list);
+
+		if (c < (int)LWS_ARRAY_SIZE(fds))
+			fds[c++] = w->fd;
+	} lws_end_foreach_dll(d);
+
+	for (n = 0; n < c; n++) {
+		wsi = wsi_from_fd(pt->context, fds[n]);
+		if (wsi && wsi->position_in_fds_table != LWS_NO_FDS_POS &&
+		    lws_epoll_service_fd(pt, fds[n],
+				wsi_to_priv_epoll(wsi)->events))
+			return -1;
+	}
+
+	c = 0;
+	if (lws_service_flag_pending(pt->context, pt->tid))
+		c = lws_service_pending_fds(pt, fds, (int)LWS_ARRAY_SIZE(fds));
+
+	for (n = 0; n < c; n++)
+		/* revents already faked by lws_service_flag_pending() */
+		if (lws_epoll_service_fd(pt, fds[n], 0))
+			return -1;
+
+	lws_service_do_ripe_rxflow(pt);
+
+	return 0;
+}
+
+static int
+elops_foreign_thread_epoll(struct lws_context *cx, int tsi)
+{
+	volatile struct lws_context_per_thread *vpt =
+				(volatile struct lws_context_per_thread *)
+								&cx->pt[tsi];
+
+	/* as for poll(), see lib/event-libs/poll/poll.c */
+
+	return vpt->inside_poll;
+}
+
+static int
+elops_init_context_epoll(struct lws_context *context,
+			 const struct lws_context_creation_info *info)
+{
+	int n;
+
+	for (n = 0; n < context->count_threads; n++)
+		pt_to_priv_epoll(&context->pt[n])->epfd = -1;
+
+	return 0;
+}
+
+static int
+elops_init_pt_epoll(struct lws_context *context, void *_loop, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	unsigned int n;
+
+	if (_loop) {
+		lwsl_cx_err(context, "epoll can't use foreign loops");
+
+		return -1;
+	}
+
+	ptpr->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (ptpr->epfd < 0) {
+		lwsl_cx_err(context, "epoll_create1 failed: errno %d", errno);
+
+		return -1;
+	}
+
+	/* register anything that made it into pt->fds before us */
+
+	for (n = 0; n < pt->fds_count; n++) {
+		struct lws *wsi = wsi_from_fd(context, pt->fds[n].fd);
+
+		if (wsi && lws_epoll_apply(wsi, wsi_to_priv_epoll(wsi)->events))
+			return -1;
+	}
+
+	lwsl_cx_info(context, "pt %d: epfd %d", tsi, ptpr->epfd);
+
+	return 0;
+}
+
+static void
+elops_destroy_pt_epoll(struct lws_context *context, int tsi)
+{
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(&context->pt[tsi]);
+
+	if (ptpr->epfd >= 0) {
+		close(ptpr->epfd);
+		ptpr->epfd = -1;
+	}
+}
+
+static void
+elops_io_epoll(struct lws *wsi, unsigned int flags)
+{
+	struct lws_wsi_eventlibs_epoll *w = wsi_to_priv_epoll(wsi);
+	uint32_t events = w->events;
+
+	assert((flags & (LWS_EV_START | LWS_EV_STOP)) &&
+	       (flags & (LWS_EV_READ | LWS_EV_WRITE)));
+
+	if ((flags & (LWS_EV_STOP | LWS_EV_READ | LWS_EV_WRITE)) ==
+			(LWS_EV_STOP | LWS_EV_READ | LWS_EV_WRITE)) {
+		/* the wsi is being removed from pt->fds */
+		lws_epoll_unregister(wsi);
+
+		return;
+	}
+
+	if (flags & LWS_EV_START) {
+		if (flags & LWS_EV_READ)
+			events |= EPOLLIN;
+		if (flags & LWS_EV_WRITE)
+			events |= EPOLLOUT;
+	} else {
+		if (flags & LWS_EV_READ)
+			events &= ~(uint32_t)EPOLLIN;
+		if (flags & LWS_EV_WRITE)
+			events &= ~(uint32_t)EPOLLOUT;
+	}
+
+	lws_epoll_apply(wsi, events);
+}
+
+static void
+elops_destroy_wsi_epoll(struct lws *wsi)
+{
+	lws_epoll_unregister(wsi);
+}
+
+struct lws_event_loop_ops event_loop_ops_epoll = {
+	.name				= "epoll",
+
+	.init_context			= elops_init_context_epoll,
+	.init_pt			= elops_init_pt_epoll,
+	.io				= elops_io_epoll,
+	.destroy_pt			= elops_destroy_pt_epoll,
+	.destroy_wsi			= elops_destroy_wsi_epoll,
+	.foreign_thread			= elops_foreign_thread_epoll,
+
+	.flags				= LELOF_ISPOLL,
+
+	.evlib_size_pt			= sizeof(struct lws_pt_eventlibs_epoll),
+	.evlib_size_wsi			= sizeof(struct lws_wsi_eventlibs_epoll),
+};
+
+const lws_plugin_evlib_t evlib_epoll = {
+	.hdr = {
+		"epoll",
+		"lws_evlib_plugin",
+		"n/a",
+		LWS_PLUGIN_API_MAGIC
+	},
+
+	.ops	= &event_loop_ops_epoll
+};
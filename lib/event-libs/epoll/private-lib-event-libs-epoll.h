@@ -0,0 +1,59 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ *  This is included from private-lib-event-libs.h
+ */
+
+#include <sys/epoll.h>
+
+/*
+ * Max ready events collected per epoll_wait(), anything beyond this just
+ * stays ready in the kernel and is collected on the next pass
+ */
+#define LWS_EPOLL_MAX_EVENTS 128
+
+struct lws_pt_eventlibs_epoll {
+	struct epoll_event		evs[LWS_EPOLL_MAX_EVENTS];
+	lws_dll2_owner_t		unpollable_owner; /* eg, regular files */
+	int				epfd;
+	int				count_evs; /* from last epoll_wait() */
+};
+
+struct lws_wsi_eventlibs_epoll {
+	lws_dll2_t			unpollable_list;
+	uint32_t			events; /* EPOLL* we want */
+	int				fd;
+	uint8_t				registered:1;
+	uint8_t				et:1; /* registered edge-triggered */
+	uint8_t				unpollable:1; /* epoll_ctl() said EPERM */
+};
+
+extern struct lws_event_loop_ops event_loop_ops_epoll;
+
+struct lws_context_per_thread;
+
+int
+lws_epoll_wait_pt(struct lws_context_per_thread *pt, int timeout_ms);
+
+int
+lws_epoll_service_ready_pt(struct lws_context_per_thread *pt);
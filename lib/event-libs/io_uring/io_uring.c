@@ -0,0 +1,1587 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Native Linux io_uring support for the default lws service loop.
+ *
+ * Plain tcp connections accepted by a server, while they're h1 (and whatever
+ * that upgrades to) or raw, do their socket io on the ring:
+ *
+ *  - rx: a recv is kept in flight, and the kernel picks a buffer for the data
+ *    from the pt's provided buffer ring when it arrives.  The role's read in
+ *    lws_ssl_capable_read_no_ssl() copies it out, when it's all used the
+ *    buffer goes back on the ring and the recv is re-armed.
+ *
+ *  - tx: lws_ssl_capable_write_no_ssl() and lws_write_iov() queue the data on
+ *    a buflist on the wsi, it goes out by sendmsg, one in flight at a time
+ *    gathering what is queued.  The wsi is writeable while less than
+ *    LWS_IO_URING_TX_CHOKE is queued.
+ *
+ *  - listen sockets keep a multishot accept armed, the accept loop takes the
+ *    fds it queued instead of calling accept().
+ *
+ * POLLIN and POLLOUT for these are synthesized from that state, they don't
+ * have a poll armed at all.
+ *
+ * Everything else... tls, client connections, pipes, files, udp... uses the
+ * ring as a batched poll: an IORING_OP_POLL_ADD is armed for the events the
+ * wsi wants, and the role makes its own syscalls when it's ready.
+ *
+ * Either way, new sqes are only queued on the submission ring, and pushed to
+ * the kernel together with the wait in a single io_uring_enter() per service
+ * loop.
+ *
+ * If the provided buffer ring can't be registered (it needs 5.19+), every wsi
+ * uses the batched poll.  If the rings can't be set up for a pt, that pt just
+ * uses poll() on pt->fds.
+ *
+ * pt->fds is still maintained by the core exactly as for poll(), it remains
+ * the canonical place lws keeps the events and revents for each wsi.
+ *
+ * There's no dependency on liburing, the rings are set up directly.
+ */
+
+#include "private-lib-core.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define pt_to_priv_iou(_pt) ((struct lws_pt_eventlibs_io_uring *)(_pt)->evlib_pt)
+#define wsi_to_priv_iou(_w) ((struct lws_wsi_eventlibs_io_uring *)(_w)->evlib_wsi)
+
+/*
+ * The low 3 bits of the user_data tell us what completed.  Polls are matched
+ * by (gen << 32) | (fd << 3), the others carry the address of the io struct,
+ * which is allocated so those bits are free.  0 means we don't care.
+ */
+
+#define LWS_IOU_UD_POLL		1
+#define LWS_IOU_UD_RECV		2
+#define LWS_IOU_UD_SEND		3
+#define LWS_IOU_UD_ACCEPT	4
+#define LWS_IOU_UD_MASK		7
+
+#define iou_ud(_io, _tag) ((uint64_t)(uintptr_t)(_io) | (_tag))
+#define ud_to_io(_ud) ((struct lws_io_uring_io *)(uintptr_t) \
+				((_ud) & ~(uint64_t)LWS_IOU_UD_MASK))
+
+/* our only provided buffer group */
+#define LWS_IOU_BGID		0
+
+static int
+lws_iou_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+lws_iou_sys_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		  unsigned int flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, arg, argsz);
+}
+
+#if defined(LWS_IO_URING_ASYNC_IO)
+static int
+lws_iou_register(int fd, unsigned int opcode, void *arg, unsigned int nr)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+#endif
+
+/*
+ * We need the timeout on the wait to be passed in with the enter, and we
+ * don't want completions ever dropped if the cq ring fills
+ */
+
+#define LWS_IOU_REQUIRED_FEATURES (IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP)
+
+int
+lws_io_uring_supported(void)
+{
+	struct io_uring_params p;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = lws_iou_setup(2, &p);
+	if (fd < 0) {
+		/* eg, ENOSYS on old kernels, EPERM if disabled by sysctl */
+		lwsl_info("%s: io_uring_setup errno %d\n", __func__, errno);
+
+		return 0;
+	}
+
+	close(fd);
+
+	return (p.features & LWS_IOU_REQUIRED_FEATURES) ==
+					LWS_IOU_REQUIRED_FEATURES;
+}
+
+static int
+lws_iou_fd(struct lws *wsi)
+{
+	if (wsi->role_ops && wsi->role_ops->file_handle)
+		return wsi->desc.filefd;
+
+	return wsi->desc.sockfd;
+}
+
+/*
+ * Push whatever is queued on the sq to the kernel, optionally waiting up to
+ * timeout_ms for at least one completion
+ */
+
+static int
+lws_iou_enter(struct lws_pt_eventlibs_io_uring *ptpr, int wait, int timeout_ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	int n;
+
+	if (!wait) {
+		if (!ptpr->to_submit)
+			return 0;
+
+		n = lws_iou_sys_enter(ptpr->ring_fd, ptpr->to_submit, 0, 0,
+				      NULL, 0);
+	} else {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000ll;
+
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+
+		n = lws_iou_sys_enter(ptpr->ring_fd, ptpr->to_submit, 1,
+				      IORING_ENTER_GETEVENTS |
+				      IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	}
+
+	if (n < 0) {
+		if (errno == ETIME || errno == EINTR)
+			return 0;
+
+		lwsl_err("%s: io_uring_enter errno %d\n", __func__, errno);
+
+		return -1;
+	}
+
+	ptpr->to_submit = (unsigned int)n < ptpr->to_submit ?
+				ptpr->to_submit - (unsigned int)n : 0;
+
+	return 0;
+}
+
+static struct io_uring_sqe *
+lws_iou_get_sqe(struct lws_pt_eventlibs_io_uring *ptpr)
+{
+	unsigned int tail = *ptpr->sq_tail, idx;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(ptpr->sq_head, __ATOMIC_ACQUIRE) >=
+							ptpr->sq_entries) {
+		/* the sq is full, push what we have to the kernel early */
+		lws_iou_enter(ptpr, 0, 0);
+		if (tail - __atomic_load_n(ptpr->sq_head, __ATOMIC_ACQUIRE) >=
+							ptpr->sq_entries)
+			return NULL;
+	}
+
+	idx = tail & *ptpr->sq_mask;
+	sqe = &ptpr->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ptpr->sq_array[idx] = idx;
+
+	return sqe;
+}
+
+static void
+lws_iou_commit_sqe(struct lws_pt_eventlibs_io_uring *ptpr)
+{
+	__atomic_store_n(ptpr->sq_tail, *ptpr->sq_tail + 1, __ATOMIC_RELEASE);
+	ptpr->to_submit++;
+}
+
+/*
+ * Queue removal of the armed poll.  It's matched by user_data, so it doesn't
+ * matter if the fd was already closed, or reused, by the time it's submitted.
+ */
+
+static int
+lws_iou_disarm(struct lws_pt_eventlibs_io_uring *ptpr,
+	       struct lws_wsi_eventlibs_io_uring *w)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!w->armed)
+		return 0;
+
+	sqe = lws_iou_get_sqe(ptpr);
+	if (!sqe)
+		/* still armed, try again when the sq has room */
+		return 1;
+
+	w->armed = 0;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = w->user_data;
+	sqe->user_data = 0; /* we don't care about the result */
+	lws_iou_commit_sqe(ptpr);
+
+	return 0;
+}
+
+static void
+lws_iou_mark_dirty(struct lws_pt_eventlibs_io_uring *ptpr,
+		   struct lws_wsi_eventlibs_io_uring *w)
+{
+	if (!w->dirty_list.owner)
+		lws_dll2_add_tail(&w->dirty_list, &ptpr->dirty_owner);
+}
+
+static void
+lws_iou_ready(struct lws_pt_eventlibs_io_uring *ptpr,
+	      struct lws_wsi_eventlibs_io_uring *w)
+{
+	if (!w->ready_list.owner)
+		lws_dll2_add_tail(&w->ready_list, &ptpr->ready_owner);
+}
+
+/*
+ * Async io
+ */
+
+static void
+lws_iou_rx_buf_put(struct lws_pt_eventlibs_io_uring *ptpr, uint16_t bid)
+{
+#if defined(LWS_IO_URING_ASYNC_IO)
+	struct io_uring_buf *b = &ptpr->pbr->bufs[ptpr->pbr_tail &
+						  (LWS_IO_URING_RX_BUFS - 1)];
+
+	b->addr = (uint64_t)(uintptr_t)(ptpr->rx_bufs +
+					(size_t)bid * ptpr->rx_buf_size);
+	b->len = (uint32_t)ptpr->rx_buf_size;
+	b->bid = bid;
+
+	ptpr->pbr_tail++;
+	__atomic_store_n(&ptpr->pbr->tail, ptpr->pbr_tail, __ATOMIC_RELEASE);
+#endif
+}
+
+/* an rx buffer the kernel gave us goes back on the provided buffer ring */
+
+static void
+lws_iou_rx_buf_return(struct lws_pt_eventlibs_io_uring *ptpr, uint16_t bid)
+{
+	struct lws_io_uring_io *io;
+
+	lws_iou_rx_buf_put(ptpr, bid);
+	ptpr->rx_bufs_held--;
+
+	if (!ptpr->starved_owner.head)
+		return;
+
+	/* let somebody whose recv found the ring empty have another go */
+
+	io = lws_container_of(ptpr->starved_owner.head,
+			      struct lws_io_uring_io, list);
+	lws_dll2_remove(&io->list);
+	io->starved = 0;
+	lws_iou_mark_dirty(ptpr, wsi_to_priv_iou(io->wsi));
+}
+
+static void
+lws_iou_stash_done(struct lws_pt_eventlibs_io_uring *ptpr,
+		   struct lws_io_uring_io *io)
+{
+	io->stash = NULL;
+	io->stash_pos = 0;
+	io->stash_len = 0;
+	lws_iou_rx_buf_return(ptpr, io->stash_bid);
+}
+
+/*
+ * Only server connections whose role does all its socket io through
+ * lws_ssl_capable_read / write_no_ssl() can be async, and listen sockets
+ */
+
+static int
+lws_iou_can_async(struct lws *wsi)
+{
+	if (wsi->listener)
+#if defined(LWS_WITH_SERVER)
+		return wsi->role_ops == &role_ops_listen;
+#else
+		return 0;
+#endif
+
+	if (!lwsi_role_server(wsi) || wsi->role_ops->file_handle ||
+#if defined(LWS_WITH_UDP)
+	    lws_wsi_is_udp(wsi) ||
+#endif
+#if defined(LWS_WITH_TLS)
+	    LWS_SSL_ENABLED(wsi->a.vhost) || wsi->tls.ssl ||
+#endif
+#if defined(LWS_HAVE_SPLICE)
+	    /* splice reads and writes the socket itself */
+	    wsi->splice_rx || wsi->splice_tx ||
+#endif
+	    !lws_socket_is_valid(wsi->desc.sockfd))
+		return 0;
+
+	return
+#if defined(LWS_ROLE_H1)
+		wsi->role_ops == &role_ops_h1 ||
+#endif
+#if defined(LWS_ROLE_RAW)
+		wsi->role_ops == &role_ops_raw_skt ||
+#endif
+		0;
+}
+
+static int
+lws_iou_cancel(struct lws_pt_eventlibs_io_uring *ptpr, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = lws_iou_get_sqe(ptpr);
+
+	if (!sqe)
+		return 1;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = 0;
+	lws_iou_commit_sqe(ptpr);
+
+	return 0;
+}
+
+/*
+ * Queue whatever the io needs in flight... returns nonzero if the sq had no
+ * room, the caller leaves it on the dirty list to try again
+ */
+
+static int
+lws_iou_io_arm(struct lws_pt_eventlibs_io_uring *ptpr,
+	       struct lws_wsi_eventlibs_io_uring *w)
+{
+	struct lws_io_uring_io *io = w->io;
+	struct io_uring_sqe *sqe;
+	int n;
+
+	if (io->listen) {
+		if (!(w->events & POLLIN)) {
+			/* eg, we're full... stop taking connections */
+			if (io->accept_armed && !io->accept_cancel) {
+				if (lws_iou_cancel(ptpr, iou_ud(io,
+							LWS_IOU_UD_ACCEPT)))
+					return 1;
+				io->accept_cancel = 1;
+			}
+
+			return 0;
+		}
+
+		if (io->accept_armed)
+			/* if it's being cancelled, it's re-armed after */
+			return 0;
+
+		sqe = lws_iou_get_sqe(ptpr);
+		if (!sqe)
+			return 1;
+
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = io->fd;
+		sqe->accept_flags = (uint32_t)(SOCK_NONBLOCK | SOCK_CLOEXEC);
+#if defined(LWS_IO_URING_ASYNC_IO)
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+#endif
+		sqe->user_data = iou_ud(io, LWS_IOU_UD_ACCEPT);
+		lws_iou_commit_sqe(ptpr);
+
+		io->accept_armed = 1;
+		ptpr->inflight++;
+
+		return 0;
+	}
+
+	/*
+	 * The recv stays armed whatever the wanted events... if rx is flow-
+	 * controlled, what it gets waits in the stash until POLLIN is wanted
+	 */
+
+	if (!io->recv_armed && !io->stash && !io->starved && !io->rx_eof &&
+	    !io->rx_err) {
+		sqe = lws_iou_get_sqe(ptpr);
+		if (!sqe)
+			return 1;
+
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = io->fd;
+		sqe->len = (uint32_t)ptpr->rx_buf_size;
+		sqe->flags = (uint8_t)IOSQE_BUFFER_SELECT;
+		sqe->buf_group = LWS_IOU_BGID;
+		sqe->user_data = iou_ud(io, LWS_IOU_UD_RECV);
+		lws_iou_commit_sqe(ptpr);
+
+		io->recv_armed = 1;
+		ptpr->inflight++;
+	}
+
+	if (io->send_armed || !io->txq || io->tx_err)
+		return 0;
+
+	n = lws_buflist_iov(&io->txq, io->iov, LWS_IO_URING_TX_IOV);
+	if (!n)
+		return 0;
+
+	sqe = lws_iou_get_sqe(ptpr);
+	if (!sqe)
+		return 1;
+
+	memset(&io->msg, 0, sizeof(io->msg));
+	io->msg.msg_iov = io->iov;
+	io->msg.msg_iovlen = (size_t)n;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = io->fd;
+	sqe->addr = (uint64_t)(uintptr_t)&io->msg;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = iou_ud(io, LWS_IOU_UD_SEND);
+	lws_iou_commit_sqe(ptpr);
+
+	io->send_armed = 1;
+	ptpr->inflight++;
+
+	return 0;
+}
+
+static int
+lws_iou_orphan_cancel(struct lws_pt_eventlibs_io_uring *ptpr,
+		      struct lws_io_uring_io *io)
+{
+	/* a duplicate cancel from a retry after the sq filled is harmless */
+
+	if ((io->recv_armed &&
+	     lws_iou_cancel(ptpr, iou_ud(io, LWS_IOU_UD_RECV))) ||
+	    (io->send_armed &&
+	     lws_iou_cancel(ptpr, iou_ud(io, LWS_IOU_UD_SEND))) ||
+	    (io->accept_armed && !io->accept_cancel &&
+	     lws_iou_cancel(ptpr, iou_ud(io, LWS_IOU_UD_ACCEPT))))
+		return 1;
+
+	io->cancel = 0;
+
+	return 0;
+}
+
+static void
+lws_iou_io_free_if_idle(struct lws_pt_eventlibs_io_uring *ptpr,
+			struct lws_io_uring_io *io)
+{
+	if (io->wsi || io->recv_armed || io->send_armed || io->accept_armed)
+		return;
+
+	lws_dll2_remove(&io->list);
+	lws_buflist_destroy_all_segments(&io->txq);
+	lws_free(io);
+}
+
+/*
+ * The wsi is going away... the io has to stay until the kernel has finished
+ * with anything it has in flight, which we cancel.  Unsent tx only remains
+ * when the wsi is being closed abruptly, so it's dropped.
+ */
+
+static void
+lws_iou_io_detach(struct lws_pt_eventlibs_io_uring *ptpr,
+		  struct lws_io_uring_io *io)
+{
+	io->wsi = NULL;
+	lws_dll2_remove(&io->list);
+
+	if (io->stash)
+		lws_iou_stash_done(ptpr, io);
+
+	while (io->aq_count) {
+		close(io->acceptq[io->aq_head]);
+		io->aq_head = (uint8_t)((io->aq_head + 1) %
+						LWS_IO_URING_ACCEPTQ);
+		io->aq_count--;
+	}
+
+	if (!io->send_armed)
+		lws_buflist_destroy_all_segments(&io->txq);
+
+	if (!io->recv_armed && !io->send_armed && !io->accept_armed) {
+		lws_free(io);
+		return;
+	}
+
+	lws_dll2_add_tail(&io->list, &ptpr->orphan_owner);
+	io->cancel = 1;
+	if (ptpr->ring_fd >= 0)
+		lws_iou_orphan_cancel(ptpr, io);
+}
+
+static void
+lws_iou_recv_done(struct lws_pt_eventlibs_io_uring *ptpr,
+		  struct lws_io_uring_io *io, int32_t res, uint32_t flags)
+{
+	io->recv_armed = 0;
+	ptpr->inflight--;
+
+	if (flags & IORING_CQE_F_BUFFER) {
+		uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+		ptpr->rx_bufs_held++;
+
+		if (!io->wsi || res <= 0)
+			lws_iou_rx_buf_return(ptpr, bid);
+		else {
+			io->stash = ptpr->rx_bufs +
+					(size_t)bid * ptpr->rx_buf_size;
+			io->stash_bid = bid;
+			io->stash_pos = 0;
+			io->stash_len = (uint32_t)res;
+		}
+	}
+
+	if (!io->wsi)
+		return;
+
+	if (res == -ENOBUFS) {
+		if (ptpr->rx_bufs_held < LWS_IO_URING_RX_BUFS)
+			/* some came back since the kernel looked */
+			lws_iou_mark_dirty(ptpr, wsi_to_priv_iou(io->wsi));
+		else {
+			io->starved = 1;
+			lws_dll2_add_tail(&io->list, &ptpr->starved_owner);
+		}
+
+		return;
+	}
+
+	if (res == -EINTR || res == -EAGAIN) {
+		lws_iou_mark_dirty(ptpr, wsi_to_priv_iou(io->wsi));
+
+		return;
+	}
+
+	if (!res)
+		io->rx_eof = 1;
+	else
+		if (res < 0) {
+			io->rx_err = 1;
+			io->err = -res;
+		}
+
+	lws_iou_ready(ptpr, wsi_to_priv_iou(io->wsi));
+}
+
+static void
+lws_iou_send_done(struct lws_pt_eventlibs_io_uring *ptpr,
+		  struct lws_io_uring_io *io, int32_t res)
+{
+	struct lws_wsi_eventlibs_io_uring *w;
+	size_t left = res > 0 ? (size_t)res : 0, n;
+
+	io->send_armed = 0;
+	ptpr->inflight--;
+
+	while (left && io->txq) {
+		n = lws_buflist_next_segment_len(&io->txq, NULL);
+		if (!n)
+			break;
+		if (n > left)
+			n = left;
+		lws_buflist_use_segment(&io->txq, n);
+		io->txq_len -= n;
+		left -= n;
+	}
+
+	if (!io->wsi) {
+		/* nobody is interested in the rest any more */
+		lws_buflist_destroy_all_segments(&io->txq);
+
+		return;
+	}
+
+	w = wsi_to_priv_iou(io->wsi);
+
+	if (res < 0 && res != -EINTR && res != -EAGAIN) {
+		io->tx_err = 1;
+		io->err = -res;
+		lws_buflist_destroy_all_segments(&io->txq);
+		io->txq_len = 0;
+		lws_iou_ready(ptpr, w);
+
+		return;
+	}
+
+	if (io->txq)
+		/* send the rest */
+		lws_iou_mark_dirty(ptpr, w);
+	else
+		if (io->shut_wr) {
+			/* the close deferred this until we sent everything */
+			io->shut_wr = 0;
+			shutdown(io->fd, SHUT_WR);
+		}
+
+	if (w->events & POLLOUT)
+		/* it may be writeable again */
+		lws_iou_ready(ptpr, w);
+}
+
+static void
+lws_iou_accept_done(struct lws_pt_eventlibs_io_uring *ptpr,
+		    struct lws_io_uring_io *io, int32_t res, uint32_t flags)
+{
+	if (!(flags & IORING_CQE_F_MORE)) {
+		/* the multishot accept has finished, eg, we cancelled it */
+		io->accept_armed = 0;
+		io->accept_cancel = 0;
+		ptpr->inflight--;
+		if (io->wsi)
+			lws_iou_mark_dirty(ptpr, wsi_to_priv_iou(io->wsi));
+	}
+
+	if (res < 0) {
+		if (res != -ECANCELED)
+			lwsl_err("%s: accept: errno %d\n", __func__, -res);
+
+		return;
+	}
+
+	if (!io->wsi || io->aq_count == LWS_IO_URING_ACCEPTQ) {
+		if (io->wsi)
+			lwsl_warn("%s: accept queue full\n", __func__);
+		close(res);
+
+		return;
+	}
+
+	io->acceptq[(io->aq_head + io->aq_count) % LWS_IO_URING_ACCEPTQ] = res;
+	io->aq_count++;
+
+	lws_iou_ready(ptpr, wsi_to_priv_iou(io->wsi));
+}
+
+/* the POLL* the core should see for a wsi doing async io */
+
+static short
+lws_iou_io_revents(struct lws *wsi, struct lws_wsi_eventlibs_io_uring *w)
+{
+	struct lws_io_uring_io *io = w->io;
+	size_t limit = LWS_IO_URING_TX_CHOKE;
+	short r = 0;
+
+	if (io->listen)
+		return (short)((w->events & POLLIN) && io->aq_count ?
+							LWS_POLLIN : 0);
+
+	if ((w->events & POLLIN) &&
+	    (io->stash_len || io->rx_eof || io->rx_err))
+		r |= LWS_POLLIN;
+
+	/* when it's flushing to close, it must wait for everything to go */
+
+	if (lwsi_state(wsi) == LRS_FLUSHING_BEFORE_CLOSE)
+		limit = 1;
+
+	if ((w->events & POLLOUT) && !io->tx_err && io->txq_len < limit)
+		r |= LWS_POLLOUT;
+
+	if (io->rx_err || io->tx_err)
+		r |= LWS_POLLHUP;
+
+	return r;
+}
+
+int
+lws_io_uring_recv(struct lws *wsi, uint8_t *buf, size_t len)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct lws_wsi_eventlibs_io_uring *w = wsi_to_priv_iou(wsi);
+	struct lws_io_uring_io *io = w->io;
+	size_t n;
+
+	if (!io->stash_len) {
+		if (io->rx_eof)
+			return 0;
+
+		errno = io->rx_err ? io->err : EAGAIN;
+
+		return -1;
+	}
+
+	n = io->stash_len;
+	if (n > len)
+		n = len;
+
+	memcpy(buf, io->stash + io->stash_pos, n);
+	io->stash_pos += (uint32_t)n;
+	io->stash_len -= (uint32_t)n;
+
+	if (io->stash_len)
+		/* the rest is still waiting to be read */
+		lws_iou_ready(ptpr, w);
+	else {
+		lws_iou_stash_done(ptpr, io);
+		/* ... and the next recv can go */
+		lws_iou_mark_dirty(ptpr, w);
+	}
+
+	return (int)n;
+}
+
+/* everything is taken onto the txq, or it fails */
+
+int
+lws_io_uring_send(struct lws *wsi, const struct iovec *iov, int count)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_wsi_eventlibs_io_uring *w = wsi_to_priv_iou(wsi);
+	struct lws_io_uring_io *io = w->io;
+	size_t t = 0;
+	int n;
+
+	if (io->tx_err) {
+		errno = io->err;
+
+		return -1;
+	}
+
+	for (n = 0; n < count; n++) {
+		if (!iov[n].iov_len)
+			continue;
+
+		if (lws_wsi_buflist_append(wsi, &io->txq,
+				(const uint8_t *)iov[n].iov_base,
+				iov[n].iov_len) < 0) {
+			errno = ENOMEM;
+
+			return -1;
+		}
+		io->txq_len += iov[n].iov_len;
+		t += iov[n].iov_len;
+	}
+
+	if (!io->send_armed)
+		lws_iou_mark_dirty(pt_to_priv_iou(pt), w);
+
+	return (int)t;
+}
+
+int
+lws_io_uring_choked(struct lws *wsi)
+{
+	return wsi_to_priv_iou(wsi)->io->txq_len >= LWS_IO_URING_TX_CHOKE;
+}
+
+int
+lws_io_uring_tx_pending(struct lws *wsi)
+{
+	return lws_io_uring_async(wsi) && wsi_to_priv_iou(wsi)->io->txq;
+}
+
+/*
+ * If there's still tx queued, the shutdown(SHUT_WR) must wait until it went,
+ * returns nonzero if we took care of it
+ */
+
+int
+lws_io_uring_shutdown_wr(struct lws *wsi)
+{
+	if (!lws_io_uring_tx_pending(wsi))
+		return 0;
+
+	wsi_to_priv_iou(wsi)->io->shut_wr = 1;
+
+	return 1;
+}
+
+int
+lws_io_uring_accept(struct lws *wsi, struct sockaddr *sa, socklen_t *len)
+{
+	struct lws_io_uring_io *io = wsi_to_priv_iou(wsi)->io;
+	int fd;
+
+	if (!io->aq_count) {
+		errno = EAGAIN;
+
+		return -1;
+	}
+
+	fd = io->acceptq[io->aq_head];
+	io->aq_head = (uint8_t)((io->aq_head + 1) % LWS_IO_URING_ACCEPTQ);
+	io->aq_count--;
+
+	/* the multishot accept can't tell us the peer address */
+
+	if (getpeername(fd, sa, len)) {
+		lwsl_info("%s: getpeername errno %d\n", __func__, errno);
+		memset(sa, 0, *len);
+	}
+
+	return fd;
+}
+
+int
+lws_io_uring_accept_pending(struct lws *wsi)
+{
+	return !!wsi_to_priv_iou(wsi)->io->aq_count;
+}
+
+/*
+ * Returns nonzero if the sq had no room, the caller must leave the wsi on the
+ * dirty list so it's tried again after the kernel consumed some of the sq
+ */
+
+static int
+lws_iou_arm(struct lws_pt_eventlibs_io_uring *ptpr,
+	    struct lws_wsi_eventlibs_io_uring *w)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t ev;
+
+	if (!w->decided) {
+		/* it's settled in pt->fds by now, see what it can do */
+		w->decided = 1;
+		if (ptpr->async_io && lws_iou_can_async(w->wsi)) {
+			w->io = lws_zalloc(sizeof(*w->io), __func__);
+			if (w->io) {
+				w->io->wsi = w->wsi;
+				w->io->fd = w->fd;
+				w->io->listen = w->listener;
+				/* it may already want POLLOUT */
+				lws_iou_ready(ptpr, w);
+			}
+		}
+	}
+
+	if (w->io)
+		return lws_iou_io_arm(ptpr, w);
+
+	if (w->armed && w->armed_events == w->events)
+		return 0;
+
+	if (lws_iou_disarm(ptpr, w))
+		return 1;
+
+	if (!w->events)
+		return 0;
+
+	sqe = lws_iou_get_sqe(ptpr);
+	if (!sqe)
+		return 1;
+
+	/* the top half of user_data makes each armed request unique */
+
+	ptpr->gen++;
+	if (!ptpr->gen)
+		ptpr->gen++;
+	w->user_data = ((uint64_t)ptpr->gen << 32) |
+		       ((uint32_t)w->fd << 3) | LWS_IOU_UD_POLL;
+
+	ev = w->events;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	ev = (ev << 16) | (ev >> 16);
+#endif
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = w->fd;
+	sqe->poll32_events = ev;
+	sqe->user_data = w->user_data;
+
+	/*
+	 * The listen accept loop takes everything pending, so it's safe for
+	 * the poll on listen sockets to stay armed across completions
+	 */
+	w->multishot = w->listener && !ptpr->no_multishot;
+	if (w->multishot)
+		sqe->len = IORING_POLL_ADD_MULTI;
+
+	lws_iou_commit_sqe(ptpr);
+
+	w->armed = 1;
+	w->armed_events = w->events;
+
+	return 0;
+}
+
+static void
+lws_iou_unregister(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct lws_wsi_eventlibs_io_uring *w = wsi_to_priv_iou(wsi);
+
+	lws_dll2_remove(&w->dirty_list);
+	lws_dll2_remove(&w->ready_list);
+	w->revents = 0;
+
+	if (w->io) {
+		lws_iou_io_detach(ptpr, w->io);
+		w->io = NULL;
+	}
+	w->decided = 0;
+
+	if (ptpr->ring_fd >= 0 && lws_iou_disarm(ptpr, w))
+		/* any late completion is stale by user_data and ignored */
+		lwsl_warn("%s: sq full, poll left armed\n", __func__);
+	w->armed = 0;
+	w->events = 0;
+}
+
+/*
+ * A poll completed... we look the wsi up by fd, it's stale unless it's
+ * still armed with the same user_data
+ */
+
+static void
+lws_iou_reap_poll(struct lws_context_per_thread *pt,
+		  const struct io_uring_cqe *cqe)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct lws_wsi_eventlibs_io_uring *w;
+	int32_t res = cqe->res;
+	short revents = 0;
+	struct lws *wsi;
+
+	wsi = wsi_from_fd(pt->context, (int)((uint32_t)cqe->user_data >> 3));
+	if (!wsi || wsi->position_in_fds_table == LWS_NO_FDS_POS)
+		return;
+
+	w = wsi_to_priv_iou(wsi);
+	if (!w->armed || w->user_data != cqe->user_data)
+		/* stale, from before the wsi was re-armed */
+		return;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		/* the poll is finished with, it needs re-arming */
+		w->armed = 0;
+		lws_iou_mark_dirty(ptpr, w);
+	}
+
+	if (res < 0) {
+		if (res == -EINVAL && w->multishot) {
+			lwsl_cx_notice(pt->context, "no multishot poll");
+			ptpr->no_multishot = 1;
+		}
+		res = 0;
+	}
+
+	if (res & POLLIN)
+		revents |= LWS_POLLIN;
+	if (res & POLLOUT)
+		revents |= LWS_POLLOUT;
+	if (res & (POLLHUP | POLLERR))
+		revents |= LWS_POLLHUP;
+
+	if (revents) {
+		w->revents = (short)(w->revents | revents);
+		lws_iou_ready(ptpr, w);
+	}
+}
+
+/*
+ * Completions only update our state and note who needs service, nothing is
+ * serviced until they're all reaped
+ */
+
+static void
+lws_iou_reap(struct lws_context_per_thread *pt, const struct io_uring_cqe *cqe)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct lws_io_uring_io *io = ud_to_io(cqe->user_data);
+
+	switch (cqe->user_data & LWS_IOU_UD_MASK) {
+	case LWS_IOU_UD_POLL:
+		lws_iou_reap_poll(pt, cqe);
+		return;
+	case LWS_IOU_UD_RECV:
+		lws_iou_recv_done(ptpr, io, cqe->res, cqe->flags);
+		break;
+	case LWS_IOU_UD_SEND:
+		lws_iou_send_done(ptpr, io, cqe->res);
+		break;
+	case LWS_IOU_UD_ACCEPT:
+		lws_iou_accept_done(ptpr, io, cqe->res, cqe->flags);
+		break;
+	default:
+		/* eg, the result of a cancel */
+		return;
+	}
+
+	if (!io->wsi)
+		lws_iou_io_free_if_idle(ptpr, io);
+}
+
+static void
+lws_iou_reap_all(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	unsigned int head = *ptpr->cq_head,
+		     tail = __atomic_load_n(ptpr->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		lws_iou_reap(pt, &ptpr->cqes[head & *ptpr->cq_mask]);
+		head++;
+	}
+
+	__atomic_store_n(ptpr->cq_head, head, __ATOMIC_RELEASE);
+}
+
+int
+lws_io_uring_pt_active(struct lws_context_per_thread *pt)
+{
+	return pt_to_priv_iou(pt)->ring_fd >= 0;
+}
+
+/*
+ * Queue the (re-)arming of anybody whose wanted events changed, or who needs
+ * async io put in flight.  Returns nonzero if the sq filled and some are
+ * still waiting on the dirty list.
+ */
+
+static int
+lws_iou_arm_dirty(struct lws_pt_eventlibs_io_uring *ptpr)
+{
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&ptpr->orphan_owner)) {
+		struct lws_io_uring_io *io = lws_container_of(d,
+					struct lws_io_uring_io, list);
+
+		if (io->cancel && lws_iou_orphan_cancel(ptpr, io))
+			return 1;
+	} lws_end_foreach_dll_safe(d, d1);
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&ptpr->dirty_owner)) {
+		struct lws_wsi_eventlibs_io_uring *w = lws_container_of(d,
+				struct lws_wsi_eventlibs_io_uring, dirty_list);
+
+		if (lws_iou_arm(ptpr, w))
+			return 1;
+
+		lws_dll2_remove(&w->dirty_list);
+	} lws_end_foreach_dll_safe(d, d1);
+
+	return 0;
+}
+
+int
+lws_io_uring_wait_pt(struct lws_context_per_thread *pt, int timeout_ms)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	unsigned int head, tail;
+	int left;
+
+	if (ptpr->ring_fd < 0)
+		return 0;
+
+	left = lws_iou_arm_dirty(ptpr);
+
+	head = *ptpr->cq_head;
+	tail = __atomic_load_n(ptpr->cq_tail, __ATOMIC_ACQUIRE);
+
+	/*
+	 * Submit everything queued in the same syscall as the wait... don't
+	 * wait if there are completions left over from last time, if anybody
+	 * is still ready from last time, or if some fds couldn't be armed yet,
+	 * since they'd miss the wait
+	 */
+
+	if (lws_iou_enter(ptpr, timeout_ms && head == tail && !left &&
+				!ptpr->ready_owner.count, timeout_ms))
+		return 0;
+
+	lws_iou_reap_all(pt);
+
+	/*
+	 * If the sq was full, the kernel has consumed it now, and we reaped
+	 * the cq in case it was holding up submission... arm the rest
+	 */
+
+	if (left && !lws_iou_arm_dirty(ptpr))
+		lws_iou_enter(ptpr, 0, 0);
+
+	return (int)ptpr->ready_owner.count;
+}
+
+static int
+lws_iou_service_ready(struct lws_context_per_thread *pt,
+		      struct lws_wsi_eventlibs_io_uring *w)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct lws_context *cx = pt->context;
+	struct lws *wsi = w->wsi;
+	short revents = w->revents;
+	struct lws_pollfd *pfd;
+	int fd, m;
+
+	w->revents = 0;
+
+	if (wsi->position_in_fds_table == LWS_NO_FDS_POS)
+		return 0;
+
+	if (w->io)
+		revents = (short)(revents | lws_iou_io_revents(wsi, w));
+
+	pfd = &pt->fds[wsi->position_in_fds_table];
+	pfd->revents = (short)(pfd->revents | revents);
+	if (!pfd->revents)
+		return 0;
+
+	fd = pfd->fd;
+	m = lws_service_fd_tsi(cx, pfd, pt->tid);
+	if (m < 0) {
+		lwsl_cx_err(cx, "lws_service_fd_tsi returned %d", m);
+		return -1;
+	}
+
+	/*
+	 * Like poll(), async io readiness is level-triggered... if it's still
+	 * ready, eg, it didn't read everything, look at it again next time
+	 */
+
+	if (!m && wsi_from_fd(cx, fd) == wsi && w->io &&
+	    lws_iou_io_revents(wsi, w))
+		lws_iou_ready(ptpr, w);
+
+	return 0;
+}
+
+/*
+ * Service everybody our completions made ready, then anybody we know has
+ * buffered rx pending.  Unlike the poll() flow, we never need to walk all of
+ * pt->fds.
+ */
+
+int
+lws_io_uring_service_ready_pt(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	int fds[LWS_IO_URING_SQ_ENTRIES / 2], c = 0, n;
+	uint32_t count = ptpr->ready_owner.count;
+
+	/* anybody who becomes ready while we do this waits for next time */
+
+	while (count-- && ptpr->ready_owner.head) {
+		struct lws_wsi_eventlibs_io_uring *w = lws_container_of(
+					ptpr->ready_owner.head,
+					struct lws_wsi_eventlibs_io_uring,
+					ready_list);
+
+		lws_dll2_remove(&w->ready_list);
+		if (lws_iou_service_ready(pt, w))
+			return -1;
+	}
+
+	if (lws_service_flag_pending(pt->context, pt->tid))
+		c = lws_service_pending_fds(pt, fds, (int)LWS_ARRAY_SIZE(fds));
+
+	for (n = 0; n < c; n++) {
+		/* revents already faked by lws_service_flag_pending() */
+		struct lws *wsi = wsi_from_fd(pt->context, fds[n]);
+
+		if (!wsi || wsi->position_in_fds_table == LWS_NO_FDS_POS ||
+		    !pt->fds[wsi->position_in_fds_table].revents)
+			continue;
+
+		if (lws_service_fd_tsi(pt->context,
+				       &pt->fds[wsi->position_in_fds_table],
+				       pt->tid) < 0)
+			return -1;
+	}
+
+	lws_service_do_ripe_rxflow(pt);
+
+	return 0;
+}
+
+static int
+elops_foreign_thread_io_uring(struct lws_context *cx, int tsi)
+{
+	volatile struct lws_context_per_thread *vpt =
+				(volatile struct lws_context_per_thread *)
+								&cx->pt[tsi];
+
+	/* as for poll(), see lib/event-libs/poll/poll.c */
+
+	return vpt->inside_poll;
+}
+
+static int
+elops_init_context_io_uring(struct lws_context *context,
+			    const struct lws_context_creation_info *info)
+{
+	int n;
+
+	for (n = 0; n < context->count_threads; n++)
+		pt_to_priv_iou(&context->pt[n])->ring_fd = -1;
+
+	return 0;
+}
+
+/*
+ * Before the rx buffers and io structs can be freed, the kernel must be done
+ * with them... cancel anything in flight and collect the completions
+ */
+
+static void
+lws_iou_drain(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct io_uring_sqe *sqe;
+	int n;
+
+	if (!ptpr->inflight)
+		return;
+
+	sqe = lws_iou_get_sqe(ptpr);
+	if (sqe) {
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+#if defined(LWS_IO_URING_ASYNC_IO)
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL |
+				    IORING_ASYNC_CANCEL_ANY;
+#endif
+		lws_iou_commit_sqe(ptpr);
+	}
+
+	for (n = 0; ptpr->inflight && n < 50; n++) {
+		if (lws_iou_enter(ptpr, 1, 10))
+			break;
+		lws_iou_reap_all(pt);
+	}
+}
+
+static void
+elops_destroy_pt_io_uring(struct lws_context *context, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	int busy;
+
+	if (ptpr->ring_fd >= 0 && ptpr->sqes)
+		lws_iou_drain(pt);
+
+	busy = !!ptpr->inflight;
+
+	if (ptpr->sqes)
+		munmap(ptpr->sqes, ptpr->sqes_size);
+	if (ptpr->cq_ring && ptpr->cq_ring != ptpr->sq_ring)
+		munmap(ptpr->cq_ring, ptpr->cq_ring_size);
+	if (ptpr->sq_ring)
+		munmap(ptpr->sq_ring, ptpr->sq_ring_size);
+
+	ptpr->sqes = NULL;
+	ptpr->cq_ring = NULL;
+	ptpr->sq_ring = NULL;
+
+	if (ptpr->ring_fd >= 0) {
+		close(ptpr->ring_fd);
+		ptpr->ring_fd = -1;
+	}
+
+	if (busy) {
+		/* the kernel may still touch them, leak rather than corrupt */
+		lwsl_cx_err(context, "pt %d: %u async ops wouldn't complete",
+			    tsi, ptpr->inflight);
+
+		return;
+	}
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&ptpr->orphan_owner)) {
+		struct lws_io_uring_io *io = lws_container_of(d,
+					struct lws_io_uring_io, list);
+
+		lws_dll2_remove(&io->list);
+		lws_buflist_destroy_all_segments(&io->txq);
+		lws_free(io);
+	} lws_end_foreach_dll_safe(d, d1);
+
+	if (ptpr->pbr) {
+		munmap(ptpr->pbr, ptpr->pbr_size);
+		ptpr->pbr = NULL;
+	}
+	lws_free_set_NULL(ptpr->rx_bufs);
+	ptpr->async_io = 0;
+}
+
+/*
+ * Register the pt's provided buffer ring the recvs take their rx buffers
+ * from.  If the kernel can't do it, the pt only uses the batched poll.
+ */
+
+static int
+lws_iou_rx_bufs_init(struct lws_context *context,
+		     struct lws_pt_eventlibs_io_uring *ptpr)
+{
+#if defined(LWS_IO_URING_ASYNC_IO)
+	struct io_uring_buf_reg reg;
+	uint16_t n;
+
+	ptpr->rx_buf_size = context->pt_serv_buf_size;
+	ptpr->pbr_size = LWS_IO_URING_RX_BUFS * sizeof(struct io_uring_buf);
+	ptpr->pbr = mmap(NULL, ptpr->pbr_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptpr->pbr == MAP_FAILED) {
+		ptpr->pbr = NULL;
+		return 1;
+	}
+
+	ptpr->rx_bufs = lws_malloc(LWS_IO_URING_RX_BUFS * ptpr->rx_buf_size,
+				   __func__);
+	if (!ptpr->rx_bufs)
+		goto bail;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ptpr->pbr;
+	reg.ring_entries = LWS_IO_URING_RX_BUFS;
+	reg.bgid = LWS_IOU_BGID;
+
+	if (lws_iou_register(ptpr->ring_fd, IORING_REGISTER_PBUF_RING,
+			     &reg, 1) < 0) {
+		lwsl_cx_info(context, "no pbuf ring: errno %d", errno);
+		goto bail;
+	}
+
+	for (n = 0; n < LWS_IO_URING_RX_BUFS; n++)
+		lws_iou_rx_buf_put(ptpr, n);
+
+	return 0;
+
+bail:
+	lws_free_set_NULL(ptpr->rx_bufs);
+	munmap(ptpr->pbr, ptpr->pbr_size);
+	ptpr->pbr = NULL;
+#endif
+
+	return 1;
+}
+
+static int
+elops_init_pt_io_uring(struct lws_context *context, void *_loop, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	if (_loop) {
+		lwsl_cx_err(context, "io_uring can't use foreign loops");
+
+		return -1;
+	}
+
+	memset(&p, 0, sizeof(p));
+	/*
+	 * Every fd may complete in one go, size the cq so it normally won't
+	 * overflow into the kernel's backlog
+	 */
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = LWS_IO_URING_SQ_ENTRIES * 2;
+	while (p.cq_entries < context->fd_limit_per_thread * 2 &&
+	       p.cq_entries < 4096)
+		p.cq_entries <<= 1;
+
+	ptpr->ring_fd = lws_iou_setup(LWS_IO_URING_SQ_ENTRIES, &p);
+	if (ptpr->ring_fd < 0) {
+		/* eg, over RLIMIT_MEMLOCK on older kernels */
+		lwsl_cx_warn(context, "pt %d: io_uring_setup failed: errno %d, "
+			     "using poll", tsi, errno);
+
+		return 0;
+	}
+
+	ptpr->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ptpr->cq_ring_size = p.cq_off.cqes +
+				p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ptpr->cq_ring_size > ptpr->sq_ring_size)
+			ptpr->sq_ring_size = ptpr->cq_ring_size;
+		ptpr->cq_ring_size = ptpr->sq_ring_size;
+	}
+
+	ptpr->sq_ring = mmap(NULL, ptpr->sq_ring_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ptpr->ring_fd,
+			     IORING_OFF_SQ_RING);
+	if (ptpr->sq_ring == MAP_FAILED) {
+		ptpr->sq_ring = NULL;
+		goto bail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ptpr->cq_ring = ptpr->sq_ring;
+	else {
+		ptpr->cq_ring = mmap(NULL, ptpr->cq_ring_size,
+				     PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ptpr->ring_fd,
+				     IORING_OFF_CQ_RING);
+		if (ptpr->cq_ring == MAP_FAILED) {
+			ptpr->cq_ring = NULL;
+			goto bail;
+		}
+	}
+
+	ptpr->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ptpr->sqes = mmap(NULL, ptpr->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ptpr->ring_fd,
+			  IORING_OFF_SQES);
+	if (ptpr->sqes == MAP_FAILED) {
+		ptpr->sqes = NULL;
+		goto bail;
+	}
+
+	sq = (uint8_t *)ptpr->sq_ring;
+	cq = (uint8_t *)ptpr->cq_ring;
+
+	ptpr->sq_head	= (unsigned int *)(sq + p.sq_off.head);
+	ptpr->sq_tail	= (unsigned int *)(sq + p.sq_off.tail);
+	ptpr->sq_mask	= (unsigned int *)(sq + p.sq_off.ring_mask);
+	ptpr->sq_array	= (unsigned int *)(sq + p.sq_off.array);
+	ptpr->cq_head	= (unsigned int *)(cq + p.cq_off.head);
+	ptpr->cq_tail	= (unsigned int *)(cq + p.cq_off.tail);
+	ptpr->cq_mask	= (unsigned int *)(cq + p.cq_off.ring_mask);
+	ptpr->cqes	= (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ptpr->sq_entries = p.sq_entries;
+
+	/*
+	 * Without fast poll, the kernel would park every recv and send that
+	 * can't complete immediately on a worker thread
+	 */
+
+	ptpr->async_io = (p.features & IORING_FEAT_FAST_POLL) &&
+			 !lws_iou_rx_bufs_init(context, ptpr);
+
+	/*
+	 * Anything that made it into pt->fds before us is already on the
+	 * dirty list, and gets armed with the first wait
+	 */
+
+	lwsl_cx_info(context, "pt %d: ring fd %d, sq %u, cq %u, async io %d",
+		     tsi, ptpr->ring_fd, p.sq_entries, p.cq_entries,
+		     ptpr->async_io);
+
+	return 0;
+
+bail:
+	lwsl_cx_warn(context, "pt %d: io_uring mmap failed: errno %d, using poll",
+		     tsi, errno);
+	elops_destroy_pt_io_uring(context, tsi);
+
+	/* pt->fds is kept up to date anyway, so this pt can just poll() it */
+
+	return 0;
+}
+
+static void
+elops_io_io_uring(struct lws *wsi, unsigned int flags)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_iou(pt);
+	struct lws_wsi_eventlibs_io_uring *w = wsi_to_priv_iou(wsi);
+
+	assert((flags & (LWS_EV_START | LWS_EV_STOP)) &&
+	       (flags & (LWS_EV_READ | LWS_EV_WRITE)));
+
+	if ((flags & (LWS_EV_STOP | LWS_EV_READ | LWS_EV_WRITE)) ==
+			(LWS_EV_STOP | LWS_EV_READ | LWS_EV_WRITE)) {
+		/* the wsi is being removed from pt->fds */
+		lws_iou_unregister(wsi);
+
+		return;
+	}
+
+	w->wsi = wsi;
+	w->fd = lws_iou_fd(wsi);
+	w->listener = !!wsi->listener;
+
+	if (flags & LWS_EV_START) {
+		if (flags & LWS_EV_READ)
+			w->events |= POLLIN;
+		if (flags & LWS_EV_WRITE)
+			w->events |= POLLOUT;
+	} else {
+		if (flags & LWS_EV_READ)
+			w->events &= ~(uint32_t)POLLIN;
+		if (flags & LWS_EV_WRITE)
+			w->events &= ~(uint32_t)POLLOUT;
+	}
+
+	if (w->io) {
+		/* a listener may need its accept armed or cancelled */
+		if (w->io->listen)
+			lws_iou_mark_dirty(ptpr, w);
+		if (flags & LWS_EV_START)
+			/* what it wants may be pending already */
+			lws_iou_ready(ptpr, w);
+
+		return;
+	}
+
+	/* it's applied in one go with everything else before the next wait */
+
+	if (!w->decided || !w->armed || w->armed_events != w->events)
+		lws_iou_mark_dirty(ptpr, w);
+}
+
+static void
+elops_destroy_wsi_io_uring(struct lws *wsi)
+{
+	lws_iou_unregister(wsi);
+}
+
+struct lws_event_loop_ops event_loop_ops_io_uring = {
+	.name				= "io_uring",
+
+	.init_context			= elops_init_context_io_uring,
+	.init_pt			= elops_init_pt_io_uring,
+	.io				= elops_io_io_uring,
+	.destroy_pt			= elops_destroy_pt_io_uring,
+	.destroy_wsi			= elops_destroy_wsi_io_uring,
+	.foreign_thread			= elops_foreign_thread_io_uring,
+
+	.flags				= LELOF_ISPOLL,
+
+	.evlib_size_pt			= sizeof(struct lws_pt_eventlibs_io_uring),
+	.evlib_size_wsi			= sizeof(struct lws_wsi_eventlibs_io_uring),
+};
+
+const lws_plugin_evlib_t evlib_io_uring = {
+	.hdr = {
+		"io_uring",
+		"lws_evlib_plugin",
+		"n/a",
+		LWS_PLUGIN_API_MAGIC
+	},
+
+	.ops	= &event_loop_ops_io_uring
+};
@@ -0,0 +1,191 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ *
+ *  This is included from private-lib-event-libs.h
+ */
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/*
+ * The async recv / send / accept need the provided buffer ring and multishot
+ * accept, both from 5.19 uapi headers... without them, we only batch polls
+ */
+#if defined(IORING_ACCEPT_MULTISHOT)
+#define LWS_IO_URING_ASYNC_IO
+#endif
+
+/*
+ * Submission ring size... if more than this many sqes are queued in one
+ * service pass, the ring is flushed early with a submit-only enter
+ */
+#define LWS_IO_URING_SQ_ENTRIES 256
+/*
+ * Rx buffers in the pt's provided buffer ring, each pt_serv_buf_size.  A
+ * connection holds at most one, while its rx is waiting to be read... if
+ * they are all held, further recvs wait until one comes back.
+ */
+#define LWS_IO_URING_RX_BUFS 256
+/* while this much tx is queued on a connection, it isn't writeable */
+#define LWS_IO_URING_TX_CHOKE 65536
+/* max queued tx segments gathered into one sendmsg */
+#define LWS_IO_URING_TX_IOV 8
+/* accepted fds held on a listener until its accept loop takes them */
+#define LWS_IO_URING_ACCEPTQ 32
+
+/*
+ * Async io state for a wsi doing its recv / send / accept on the ring.  It's
+ * separate from the wsi so it can outlive it, until whatever it had in
+ * flight has completed.
+ */
+
+struct lws_io_uring_io {
+	lws_dll2_t			list; /* pt starved or orphan list */
+	struct msghdr			msg; /* of the sendmsg in flight */
+	struct iovec			iov[LWS_IO_URING_TX_IOV];
+	struct lws			*wsi; /* NULL once orphaned */
+	struct lws_buflist		*txq; /* head is what's being sent */
+	uint8_t				*stash; /* rx waiting to be read */
+	size_t				txq_len; /* unsent bytes on txq */
+	uint32_t			stash_pos;
+	uint32_t			stash_len;
+	int				fd;
+	int				err; /* errno of a failed recv / send */
+	int				acceptq[LWS_IO_URING_ACCEPTQ];
+	uint16_t			stash_bid;
+	uint8_t				aq_head;
+	uint8_t				aq_count;
+
+	uint8_t				listen:1; /* does accept, not recv / send */
+	uint8_t				recv_armed:1;
+	uint8_t				send_armed:1;
+	uint8_t				accept_armed:1;
+	uint8_t				accept_cancel:1; /* cancel is queued */
+	uint8_t				cancel:1; /* orphan cancels not queued yet */
+	uint8_t				rx_eof:1;
+	uint8_t				rx_err:1;
+	uint8_t				tx_err:1;
+	uint8_t				starved:1; /* recv got ENOBUFS */
+	uint8_t				shut_wr:1; /* shutdown when txq drains */
+};
+
+struct lws_pt_eventlibs_io_uring {
+	/* mmap'd ring state shared with the kernel */
+
+	unsigned int			*sq_head;
+	unsigned int			*sq_tail;
+	unsigned int			*sq_mask;
+	unsigned int			*sq_array;
+	unsigned int			*cq_head;
+	unsigned int			*cq_tail;
+	unsigned int			*cq_mask;
+	struct io_uring_cqe		*cqes;
+	struct io_uring_sqe		*sqes;
+
+	struct io_uring_buf_ring	*pbr; /* provided rx buffer ring */
+	uint8_t				*rx_bufs;
+
+	lws_dll2_owner_t		dirty_owner; /* wsi needing (re-)arming */
+	lws_dll2_owner_t		ready_owner; /* wsi needing service */
+	lws_dll2_owner_t		starved_owner; /* io waiting on rx buf */
+	lws_dll2_owner_t		orphan_owner; /* io that lost its wsi */
+
+	void				*sq_ring;
+	void				*cq_ring;
+	size_t				sq_ring_size;
+	size_t				cq_ring_size;
+	size_t				sqes_size;
+	size_t				pbr_size;
+	size_t				rx_buf_size;
+
+	unsigned int			sq_entries;
+	unsigned int			to_submit; /* queued, not yet entered */
+	unsigned int			inflight; /* recv / send / accept */
+	unsigned int			rx_bufs_held; /* taken off the pbr */
+	uint32_t			gen; /* makes armed user_data unique */
+	int				ring_fd;
+	uint16_t			pbr_tail;
+	uint8_t				no_multishot:1; /* kernel said EINVAL */
+	uint8_t				async_io:1; /* recv / send / accept usable */
+};
+
+struct lws_wsi_eventlibs_io_uring {
+	lws_dll2_t			dirty_list;
+	lws_dll2_t			ready_list;
+	struct lws			*wsi;
+	struct lws_io_uring_io		*io; /* NULL if it's only polled */
+	uint64_t			user_data; /* of the armed POLL_ADD */
+	uint32_t			events; /* POLL* we want */
+	uint32_t			armed_events; /* POLL* in the armed req */
+	int				fd;
+	short				revents; /* LWS_POLL* from completions */
+	uint8_t				armed:1;
+	uint8_t				listener:1; /* may use multishot */
+	uint8_t				multishot:1; /* armed req is multishot */
+	uint8_t				decided:1; /* io or poll was chosen */
+};
+
+extern struct lws_event_loop_ops event_loop_ops_io_uring;
+
+/* nonzero if the wsi does its socket io on the ring */
+
+#define lws_io_uring_async(_wsi) \
+	((_wsi)->a.context->event_loop_ops == &event_loop_ops_io_uring && \
+	 ((struct lws_wsi_eventlibs_io_uring *)(_wsi)->evlib_wsi)->io)
+
+struct lws_context_per_thread;
+
+int
+lws_io_uring_supported(void);
+
+int
+lws_io_uring_pt_active(struct lws_context_per_thread *pt);
+
+int
+lws_io_uring_wait_pt(struct lws_context_per_thread *pt, int timeout_ms);
+
+int
+lws_io_uring_service_ready_pt(struct lws_context_per_thread *pt);
+
+int
+lws_io_uring_recv(struct lws *wsi, uint8_t *buf, size_t len);
+
+int
+lws_io_uring_send(struct lws *wsi, const struct iovec *iov, int count);
+
+int
+lws_io_uring_choked(struct lws *wsi);
+
+int
+lws_io_uring_tx_pending(struct lws *wsi);
+
+int
+lws_io_uring_shutdown_wr(struct lws *wsi);
+
+int
+lws_io_uring_accept(struct lws *wsi, struct sockaddr *sa, socklen_t *len);
+
+int
+lws_io_uring_accept_pending(struct lws *wsi);
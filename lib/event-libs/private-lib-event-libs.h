@@ -24,4 +24,9 @@
  *  This is included from private-lib-core.h
  */
 
-
+#if defined(LWS_WITH_EPOLL)
+#include "private-lib-event-libs-epoll.h"
+#endif
+#if defined(LWS_WITH_IO_URING)
+#include "private-lib-event-libs-io_uring.h"
+#endif
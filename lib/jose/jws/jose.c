@@ -171,6 +171,7 @@ lws_jws_jose_cb(struct lejp_ctx *ctx, char reason)
 	if (args->is_jwe && !strncmp(ctx->path, "epk.", 4)) {
 		memcpy(args->jwk_jctx.path, ctx->path + 4,
 		       sizeof(ctx->path) - 4);
+		args->jwk_jctx.mc_count = 0;
 		memcpy(args->jwk_jctx.buf, ctx->buf, ctx->npos);
 		args->jwk_jctx.npos = ctx->npos;
 
@@ -29,27 +29,205 @@
 #undef write
 #endif
 
-static void
-update_sul(lws_cache_ttl_lru_t_heap_t *cache);
-
 static int
 lws_cache_heap_invalidate(struct lws_cache_ttl_lru *_c, const char *key);
 
+static uint32_t
+lws_cache_heap_hash(const char *s, size_t len)
+{
+	uint32_t h = 0x811c9dc5u;
+
+	while (len--)
+		h = (h ^ (uint8_t)*s++) * 0x01000193u;
+
+	return h;
+}
+
+static size_t
+lws_cache_heap_prefix_len(const char *key, size_t kl)
+{
+	const char *p = memchr(key, LWSCTAG_SEP, kl);
+
+	return p ? lws_ptr_diff_size_t(p, key) + 1 : kl;
+}
+
+static void
+lws_cache_heap_index_add(lws_cache_ttl_lru_t_heap_t *cache,
+			 lws_cache_ttl_item_heap_t *item)
+{
+	unsigned int mask = cache->hash_elements - 1;
+
+	lws_dll2_add_head(&item->list_hash, &cache->hash_key[item->hash & mask]);
+	lws_dll2_add_head(&item->list_prefix,
+			  &cache->hash_prefix[item->prefix_hash & mask]);
+}
+
+/*
+ * Keep the hash tables at least as big as the number of items.  If we can't
+ * get the memory, we carry on with longer buckets.
+ */
+
+static void
+lws_cache_heap_rehash(lws_cache_ttl_lru_t_heap_t *cache)
+{
+	lws_dll2_owner_t *hk, *hp, *ok = cache->hash_key,
+			 *op = cache->hash_prefix;
+	unsigned int n = cache->hash_elements * 4;
+	lws_dll2_t *d;
+
+	if (cache->items_lru.count < cache->hash_elements)
+		return;
+
+	hk = lws_zalloc(n * sizeof(*hk), __func__);
+	hp = lws_zalloc(n * sizeof(*hp), __func__);
+	if (!hk || !hp) {
+		lws_free(hk);
+		lws_free(hp);
+		return;
+	}
+
+	cache->hash_key = hk;
+	cache->hash_prefix = hp;
+	cache->hash_elements = n;
+
+	/* add them back from the lru tail, so the buckets stay in lru order */
+
+	d = cache->items_lru.tail;
+	while (d) {
+		lws_cache_ttl_item_heap_t *item = lws_container_of(d,
+						lws_cache_ttl_item_heap_t,
+						list_lru);
+
+		lws_dll2_remove(&item->list_hash);
+		lws_dll2_remove(&item->list_prefix);
+		lws_cache_heap_index_add(cache, item);
+
+		d = d->prev;
+	}
+
+	lws_free(ok);
+	lws_free(op);
+}
+
+/*
+ * The expiry heap is an array where each item's expiry is no later than the
+ * expiry of the two items at 2n + 1 and 2n + 2, so the earliest is always at
+ * [0].  Items know their index so they can be removed from the middle.
+ */
+
+static void
+lws_cache_heap_set(lws_cache_ttl_lru_t_heap_t *cache, unsigned int n,
+		   lws_cache_ttl_item_heap_t *item)
+{
+	cache->expiry_heap[n] = item;
+	item->heap_idx = (int)n;
+}
+
+static void
+lws_cache_heap_up(lws_cache_ttl_lru_t_heap_t *cache, unsigned int n)
+{
+	lws_cache_ttl_item_heap_t *item = cache->expiry_heap[n];
+
+	while (n && cache->expiry_heap[(n - 1) / 2]->expiry > item->expiry) {
+		lws_cache_heap_set(cache, n, cache->expiry_heap[(n - 1) / 2]);
+		n = (n - 1) / 2;
+	}
+
+	lws_cache_heap_set(cache, n, item);
+}
+
+static void
+lws_cache_heap_down(lws_cache_ttl_lru_t_heap_t *cache, unsigned int n)
+{
+	lws_cache_ttl_item_heap_t *item = cache->expiry_heap[n];
+	unsigned int c;
+
+	while ((c = (2 * n) + 1) < cache->expiry_heap_count) {
+		if (c + 1 < cache->expiry_heap_count &&
+		    cache->expiry_heap[c + 1]->expiry <
+					cache->expiry_heap[c]->expiry)
+			c++;
+
+		if (item->expiry <= cache->expiry_heap[c]->expiry)
+			break;
+
+		lws_cache_heap_set(cache, n, cache->expiry_heap[c]);
+		n = c;
+	}
+
+	lws_cache_heap_set(cache, n, item);
+}
+
 static int
-sort_expiry(const lws_dll2_t *a, const lws_dll2_t *b)
+lws_cache_heap_reserve(lws_cache_ttl_lru_t_heap_t *cache)
 {
-	const lws_cache_ttl_item_heap_t
-		*c = lws_container_of(a, lws_cache_ttl_item_heap_t, list_expiry),
-		*d = lws_container_of(b, lws_cache_ttl_item_heap_t, list_expiry);
+	lws_cache_ttl_item_heap_t **h;
+	unsigned int n;
+
+	if (cache->expiry_heap_count < cache->expiry_heap_size)
+		return 0;
 
-	if (c->expiry > d->expiry)
+	n = cache->expiry_heap_size ? cache->expiry_heap_size * 2 : 16;
+	h = lws_realloc(cache->expiry_heap, n * sizeof(*h), __func__);
+	if (!h)
 		return 1;
-	if (c->expiry < d->expiry)
-		return -1;
+
+	cache->expiry_heap = h;
+	cache->expiry_heap_size = n;
 
 	return 0;
 }
 
+static void
+lws_cache_heap_expiry_remove(lws_cache_ttl_lru_t_heap_t *cache,
+			     lws_cache_ttl_item_heap_t *item)
+{
+	lws_cache_ttl_item_heap_t *last;
+	unsigned int n;
+
+	if (item->heap_idx < 0)
+		return;
+
+	n = (unsigned int)item->heap_idx;
+	item->heap_idx = -1;
+	last = cache->expiry_heap[--cache->expiry_heap_count];
+	if (last == item)
+		return;
+
+	/* move the last one into the hole and let it find its level */
+
+	lws_cache_heap_set(cache, n, last);
+	if (n && cache->expiry_heap[(n - 1) / 2]->expiry > last->expiry)
+		lws_cache_heap_up(cache, n);
+	else
+		lws_cache_heap_down(cache, n);
+}
+
+static void
+expiry_cb(lws_sorted_usec_list_t *sul);
+
+/*
+ * Let's schedule the sul for the next soonest expiring item
+ */
+
+static void
+update_sul(lws_cache_ttl_lru_t_heap_t *cache)
+{
+	lws_usec_t earliest;
+
+	if (!cache->expiry_heap_count) {
+		lws_sul_cancel(&cache->cache.sul);
+		return;
+	}
+
+	earliest = cache->expiry_heap[0]->expiry;
+
+	lwsl_debug("%s: setting exp %llu\n", __func__,
+			(unsigned long long)earliest);
+
+	lws_cache_schedule(&cache->cache, expiry_cb, earliest);
+}
+
 static void
 _lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 			     lws_cache_ttl_item_heap_t *item)
@@ -57,12 +235,17 @@ _lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 	lwsl_cache("%s: %s (%s)\n", __func__, cache->cache.info.name,
 			(const char *)&item[1] + item->size);
 
-	lws_dll2_remove(&item->list_expiry);
 	lws_dll2_remove(&item->list_lru);
+	lws_dll2_remove(&item->list_hash);
+	lws_dll2_remove(&item->list_prefix);
+	lws_dll2_remove(&item->list_meta);
 
-	cache->cache.current_footprint -= item->size;
+	if (item->heap_idx >= 0) {
+		lws_cache_heap_expiry_remove(cache, item);
+		update_sul(cache);
+	}
 
-	update_sul(cache);
+	cache->cache.current_footprint -= item->size;
 
 	if (cache->cache.info.cb)
 		cache->cache.info.cb((void *)((uint8_t *)&item[1]), item->size);
@@ -74,8 +257,8 @@ static void
 lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 			    lws_cache_ttl_item_heap_t *item, int parent_too)
 {
-	struct lws_cache_ttl_lru *backing = &cache->cache;
 	const char *tag = ((const char *)&item[1]) + item->size;
+	size_t taglen = item->key_len;
 
 	/*
 	 * We're destroying a normal item?
@@ -85,9 +268,6 @@ lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 		/* no, nothing to check here then */
 		goto post;
 
-	if (backing->info.parent)
-		backing = backing->info.parent;
-
 	/*
 	 * We need to check any cached meta-results from lookups that
 	 * include this normal item, and if any, invalidate the meta-results
@@ -95,52 +275,27 @@ lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 	 */
 
 	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   cache->items_lru.head) {
+				   cache->items_meta.head) {
 		lws_cache_ttl_item_heap_t *i = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
-		const char *iname = ((const char *)&item[1]) + item->size;
-		uint8_t *pay = (uint8_t *)&item[1], *end = pay + item->size;
-
-		if (*iname == META_ITEM_LEADING) {
-			size_t taglen = strlen(iname);
+						list_meta);
+		uint8_t *pay = (uint8_t *)&i[1], *end = pay + i->size;
 
-			/*
-			 * If the item about to be destroyed makes an
-			 * appearance on the meta results list, we must kill
-			 * the meta result item to force recalc next time
-			 */
+		/*
+		 * If the item about to be destroyed makes an appearance on
+		 * the meta results list, we must kill the meta result item to
+		 * force recalc next time
+		 */
 
-			while (pay < end) {
-				uint32_t tlen = lws_ser_ru32be(pay + 4);
+		while (pay + 8 <= end) {
+			uint32_t tlen = lws_ser_ru32be(pay + 4);
 
-				if (tlen == taglen &&
-				    !strcmp((const char *)pay + 8, iname)) {
-#if defined(_DEBUG)
-					/*
-					 * Sanity check that the item tag is
-					 * really a match for that meta results
-					 * item
-					 */
-
-					assert (!backing->info.ops->tag_match(
-						 backing, iname + 1, tag, 1));
-#endif
-					_lws_cache_heap_item_destroy(cache, i);
-					break;
-				}
-				pay += 8 + tlen + 1;
+			if (tlen == taglen &&
+			    !strcmp((const char *)pay + 8, tag)) {
+				_lws_cache_heap_item_destroy(cache, i);
+				break;
 			}
-
-#if defined(_DEBUG)
-			/*
-			 * Sanity check that the item tag really isn't a match
-			 * for that meta results item
-			 */
-
-			assert (backing->info.ops->tag_match(backing, iname + 1,
-							  tag, 1));
-#endif
+			pay += 8 + tlen + 1;
 		}
 
 	} lws_end_foreach_dll_safe(d, d1);
@@ -154,93 +309,57 @@ lws_cache_item_evict_lru(lws_cache_ttl_lru_t_heap_t *cache)
 {
 	lws_cache_ttl_item_heap_t *ei;
 
-	if (!cache->items_lru.head)
+	if (!cache->items_lru.tail)
 		return;
 
-	ei = lws_container_of(cache->items_lru.head,
+	ei = lws_container_of(cache->items_lru.tail,
 			      lws_cache_ttl_item_heap_t, list_lru);
 
 	lws_cache_heap_item_destroy(cache, ei, 0);
 }
 
 /*
- * We need to weed out expired entries in the backing file
+ * Destroy any items whose expiry has passed
  */
 
 static void
-expiry_cb(lws_sorted_usec_list_t *sul)
+lws_cache_heap_weed(lws_cache_ttl_lru_t_heap_t *cache)
 {
-	lws_cache_ttl_lru_t_heap_t *cache = lws_container_of(sul,
-					lws_cache_ttl_lru_t_heap_t, cache.sul);
 	lws_usec_t now = lws_now_usecs();
 
-	lwsl_cache("%s: %s\n", __func__, cache->cache.info.name);
-
-	while (cache->items_expiry.head) {
-		lws_cache_ttl_item_heap_t *item;
-
-		item = lws_container_of(cache->items_expiry.head,
-					lws_cache_ttl_item_heap_t, list_expiry);
-
-		if (item->expiry > now)
-			return;
-
-		lws_cache_heap_item_destroy(cache, item, 1);
-	}
-}
-
-/*
- * Let's figure out what the earliest next expiry is
- */
-
-static int
-earliest_expiry(lws_cache_ttl_lru_t_heap_t *cache, lws_usec_t *pearliest)
-{
-	lws_cache_ttl_item_heap_t *item;
-
-	if (!cache->items_expiry.head)
-		return 1;
-
-	item = lws_container_of(cache->items_expiry.head,
-				lws_cache_ttl_item_heap_t, list_expiry);
-
-	*pearliest = item->expiry;
-
-	return 0;
+	while (cache->expiry_heap_count &&
+	       cache->expiry_heap[0]->expiry <= now)
+		lws_cache_heap_item_destroy(cache, cache->expiry_heap[0], 1);
 }
 
 static void
-update_sul(lws_cache_ttl_lru_t_heap_t *cache)
+expiry_cb(lws_sorted_usec_list_t *sul)
 {
-	lws_usec_t earliest;
-
-	/* weed out any newly-expired */
-	expiry_cb(&cache->cache.sul);
-
-	/* figure out the next soonest expiring item */
-	if (earliest_expiry(cache, &earliest)) {
-		lws_sul_cancel(&cache->cache.sul);
-		return;
-	}
+	lws_cache_ttl_lru_t_heap_t *cache = lws_container_of(sul,
+					lws_cache_ttl_lru_t_heap_t, cache.sul);
 
-	lwsl_debug("%s: setting exp %llu\n", __func__,
-			(unsigned long long)earliest);
+	lwsl_cache("%s: %s\n", __func__, cache->cache.info.name);
 
-	if (earliest)
-		lws_cache_schedule(&cache->cache, expiry_cb, earliest);
+	lws_cache_heap_weed(cache);
+	update_sul(cache);
 }
 
 static lws_cache_ttl_item_heap_t *
 lws_cache_heap_specific(lws_cache_ttl_lru_t_heap_t *cache,
 			const char *specific_key)
 {
-	lws_start_foreach_dll(struct lws_dll2 *, d, cache->items_lru.head) {
+	size_t kl = strlen(specific_key);
+	uint32_t h = lws_cache_heap_hash(specific_key, kl);
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+		      cache->hash_key[h & (cache->hash_elements - 1)].head) {
 		lws_cache_ttl_item_heap_t *item = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
-		const char *iname = ((const char *)&item[1]) + item->size;
+						list_hash);
 
-		if (!strcmp(specific_key, iname))
+		if (item->hash == h && item->key_len == kl &&
+		    !memcmp(specific_key, (const char *)&item[1] + item->size,
+			    kl))
 			return item;
 
 	} lws_end_foreach_dll(d);
@@ -255,65 +374,101 @@ lws_cache_heap_tag_match(struct lws_cache_ttl_lru *cache, const char *wc,
 	return lws_strcmp_wildcard(wc, strlen(wc), tag, strlen(tag));
 }
 
+static int
+lws_cache_heap_add_match(struct lws_cache_ttl_lru *_c,
+			 lws_cache_ttl_item_heap_t *item,
+			 lws_dll2_owner_t *results_owner)
+{
+	const char *iname = ((const char *)&item[1]) + item->size;
+	lws_cache_match_t *m;
+
+	/*
+	 * It musn't already be on the list from an earlier cache level
+	 */
+
+	lws_start_foreach_dll(struct lws_dll2 *, e, results_owner->head) {
+		lws_cache_match_t *i = lws_container_of(e, lws_cache_match_t,
+							list);
+		if (i->tag_size == item->key_len &&
+		    !strcmp(iname, ((const char *)&i[1])))
+			return 0;
+	} lws_end_foreach_dll(e);
+
+	/*
+	 * it's unique, instantiate a record for it
+	 */
+
+	m = lws_fi(&_c->info.cx->fic, "cache_lookup_oom") ? NULL :
+		lws_malloc(sizeof(*m) + item->key_len + 1, __func__);
+	if (!m) {
+		lws_cache_clear_matches(results_owner);
+		return 1;
+	}
+
+	memset(&m->list, 0, sizeof(m->list));
+	m->expiry = item->expiry;
+	m->payload_size = item->size;
+	m->tag_size = item->key_len;
+	memcpy(&m[1], iname, item->key_len + 1);
+
+	lws_dll2_add_tail(&m->list, results_owner);
+
+	return 0;
+}
+
 static int
 lws_cache_heap_lookup(struct lws_cache_ttl_lru *_c, const char *wildcard_key,
 		      lws_dll2_owner_t *results_owner)
 {
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
-	size_t sklen = strlen(wildcard_key);
-
-	lws_start_foreach_dll(struct lws_dll2 *, d, cache->items_lru.head) {
-		lws_cache_ttl_item_heap_t *item = lws_container_of(d,
-						lws_cache_ttl_item_heap_t,
-						list_lru);
-		const char *iname = ((const char *)&item[1]) + item->size;
+	size_t sklen = strlen(wildcard_key), pl;
+	const char *star = memchr(wildcard_key, '*', sklen);
+	lws_cache_ttl_item_heap_t *item;
+	uint32_t h = 0;
+	lws_dll2_t *d;
+	int prefix;
 
-		if (!lws_strcmp_wildcard(wildcard_key, sklen, iname,
-					 strlen(iname))) {
-			size_t ilen = strlen(iname);
-			lws_cache_match_t *m;
-			char hit = 0;
+	if (!star) {
+		/* no wildcard, it can only be an exact match */
+		item = sklen ? lws_cache_heap_specific(cache, wildcard_key) :
+			       NULL;
 
-			/*
-			 * It musn't already be on the list from an earlier
-			 * cache level
-			 */
+		return item ? lws_cache_heap_add_match(_c, item,
+						       results_owner) : 0;
+	}
 
-			lws_start_foreach_dll(struct lws_dll2 *, e,
-					results_owner->head) {
-				lws_cache_match_t *i = lws_container_of(e,
-							lws_cache_match_t, list);
-				if (i->tag_size == ilen &&
-				    !strcmp(iname, ((const char *)&i[1]))) {
-					hit = 1;
-					break;
-				}
-			} lws_end_foreach_dll(e);
-
-			if (!hit) {
-
-				/*
-				 * it's unique, instantiate a record for it
-				 */
-
-				m = lws_fi(&_c->info.cx->fic,
-					   "cache_lookup_oom") ? NULL :
-					lws_malloc(sizeof(*m) + ilen + 1,
-						   __func__);
-				if (!m) {
-					lws_cache_clear_matches(results_owner);
-					return 1;
-				}
-
-				memset(&m->list, 0, sizeof(m->list));
-				m->tag_size = ilen;
-				memcpy(&m[1], iname, ilen + 1);
-
-				lws_dll2_add_tail(&m->list, results_owner);
-			}
-		}
+	/*
+	 * If the literal part before the first * includes the first
+	 * separator, any match must have the same first section, and they are
+	 * all in the same prefix bucket (in lru order).  Otherwise we have to
+	 * look at everything.
+	 */
 
-	} lws_end_foreach_dll(d);
+	pl = lws_cache_heap_prefix_len(wildcard_key,
+				       lws_ptr_diff_size_t(star, wildcard_key));
+	prefix = pl && wildcard_key[pl - 1] == LWSCTAG_SEP;
+	if (prefix) {
+		h = lws_cache_heap_hash(wildcard_key, pl);
+		d = cache->hash_prefix[h & (cache->hash_elements - 1)].head;
+	} else
+		d = cache->items_lru.head;
+
+	while (d) {
+		const char *iname;
+
+		item = prefix ? lws_container_of(d, lws_cache_ttl_item_heap_t,
+						 list_prefix) :
+				lws_container_of(d, lws_cache_ttl_item_heap_t,
+						 list_lru);
+		iname = ((const char *)&item[1]) + item->size;
+		d = d->next;
+
+		if ((!prefix || item->prefix_hash == h) &&
+		    !lws_strcmp_wildcard(wildcard_key, sklen, iname,
+					 item->key_len) &&
+		    lws_cache_heap_add_match(_c, item, results_owner))
+			return 1;
+	}
 
 	return 0;
 }
@@ -325,12 +480,16 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 {
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
 	struct lws_cache_ttl_lru *backing = _c;
-	lws_cache_ttl_item_heap_t *item, *ei;
 	size_t kl = strlen(specific_key);
+	lws_cache_ttl_item_heap_t *item;
 	char *p;
 
 	lwsl_cache("%s: %s: len %d\n", __func__, _c->info.name, (int)size);
 
+	/* expired items shouldn't count against the limits */
+
+	lws_cache_heap_weed(cache);
+
 	/*
 	 * Is this new tag going to invalidate any existing cached meta-results?
 	 *
@@ -340,14 +499,13 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 	if (backing->info.parent)
 		backing = backing->info.parent;
 
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   cache->items_lru.head) {
-		lws_cache_ttl_item_heap_t *i = lws_container_of(d,
+	if (*specific_key != META_ITEM_LEADING)
+		lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+					   cache->items_meta.head) {
+			lws_cache_ttl_item_heap_t *i = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
-		const char *iname = ((const char *)&i[1]) + i->size;
-
-		if (*iname == META_ITEM_LEADING) {
+						list_meta);
+			const char *iname = ((const char *)&i[1]) + i->size;
 
 			/*
 			 * If the item about to be added would match any cached
@@ -356,12 +514,15 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 			 * matching rules at the backing store level
 			 */
 
-			if (!strcmp(iname + 1, specific_key))
+			if (!backing->info.ops->tag_match(backing, iname + 1,
+							  specific_key, 1))
 				_lws_cache_heap_item_destroy(cache, i);
-		}
 
-	} lws_end_foreach_dll_safe(d, d1);
+		} lws_end_foreach_dll_safe(d, d1);
 
+	/* remove any existing entry of the same key */
+
+	lws_cache_heap_invalidate(&cache->cache, specific_key);
 
 	/*
 	 * Keep us under the limit if possible... note this will always allow
@@ -375,16 +536,15 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 		cache->items_lru.count + 1 > cache->cache.info.max_items))
 		lws_cache_item_evict_lru(cache);
 
-	/* remove any existing entry of the same key */
-
-	lws_cache_heap_invalidate(&cache->cache, specific_key);
+	if (expiry && lws_cache_heap_reserve(cache))
+		return 1;
 
 	item = lws_fi(&_c->info.cx->fic, "cache_write_oom") ? NULL :
 			lws_malloc(sizeof(*item) + kl + 1u + size, __func__);
 	if (!item)
 		return 1;
 
-	cache->cache.current_footprint += item->size;
+	cache->cache.current_footprint += size;
 
 	/* only need to zero down our item object */
 	memset(item, 0, sizeof(*item));
@@ -403,20 +563,27 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 	item->expiry = expiry;
 	item->key_len = kl;
 	item->size = size;
+	item->hash = lws_cache_heap_hash(specific_key, kl);
+	item->prefix_hash = lws_cache_heap_hash(specific_key,
+				lws_cache_heap_prefix_len(specific_key, kl));
+	item->heap_idx = -1;
 
 	if (expiry) {
 		/* adding to expiry is optional, on nonzero expiry */
-		lws_dll2_add_sorted(&item->list_expiry, &cache->items_expiry,
-				    sort_expiry);
-		ei = lws_container_of(cache->items_expiry.head,
-				      lws_cache_ttl_item_heap_t, list_expiry);
-		lwsl_debug("%s: setting exp %llu\n", __func__,
-						(unsigned long long)ei->expiry);
-		lws_cache_schedule(&cache->cache, expiry_cb, ei->expiry);
+		cache->expiry_heap[cache->expiry_heap_count++] = item;
+		lws_cache_heap_up(cache, cache->expiry_heap_count - 1);
+		if (cache->expiry_heap[0] == item)
+			update_sul(cache);
 	}
 
+	if (*specific_key == META_ITEM_LEADING)
+		lws_dll2_add_tail(&item->list_meta, &cache->items_meta);
+
+	lws_cache_heap_rehash(cache);
+
 	/* always add outselves to head of lru list */
 	lws_dll2_add_head(&item->list_lru, &cache->items_lru);
+	lws_cache_heap_index_add(cache, item);
 
 	return 0;
 }
@@ -427,15 +594,20 @@ lws_cache_heap_get(struct lws_cache_ttl_lru *_c, const char *specific_key,
 {
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
 	lws_cache_ttl_item_heap_t *item;
+	lws_dll2_owner_t *owner;
 
 	item = lws_cache_heap_specific(cache, specific_key);
 	if (!item)
 		return 1;
 
-	/* we are using it, move it to lru head */
+	/* we are using it, move it to lru head, and prefix bucket head */
 	lws_dll2_remove(&item->list_lru);
 	lws_dll2_add_head(&item->list_lru, &cache->items_lru);
 
+	owner = item->list_prefix.owner;
+	lws_dll2_remove(&item->list_prefix);
+	lws_dll2_add_head(&item->list_prefix, owner);
+
 	if (pdata) {
 		*pdata = (const void *)&item[1];
 		*psize = item->size;
@@ -450,43 +622,39 @@ lws_cache_heap_invalidate(struct lws_cache_ttl_lru *_c, const char *specific_key
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
 	struct lws_cache_ttl_lru *backing = _c;
 	lws_cache_ttl_item_heap_t *item;
-	const void *user;
-	size_t size;
 
-	if (lws_cache_heap_get(_c, specific_key, &user, &size))
+	item = lws_cache_heap_specific(cache, specific_key);
+	if (!item)
 		return 0;
 
 	if (backing->info.parent)
 		backing = backing->info.parent;
 
-	item = (lws_cache_ttl_item_heap_t *)(((uint8_t *)user) - sizeof(*item));
-
 	/*
 	 * We must invalidate any cached results that would have included this
 	 */
 
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   cache->items_lru.head) {
-		lws_cache_ttl_item_heap_t *i = lws_container_of(d,
+	if (*specific_key != META_ITEM_LEADING)
+		lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+					   cache->items_meta.head) {
+			lws_cache_ttl_item_heap_t *i = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
-		const char *iname = ((const char *)&i[1]) + i->size;
-
-		if (*iname == META_ITEM_LEADING) {
+						list_meta);
+			const char *iname = ((const char *)&i[1]) + i->size;
 
 			/*
-			 * If the item about to be added would match any cached
-			 * results from before it was added, we have to
-			 * invalidate them.  To check this, we have to use the
-			 * matching rules at the backing store level
+			 * If the item about to be removed would match any
+			 * cached results, we have to invalidate them.  To
+			 * check this, we have to use the matching rules at the
+			 * backing store level
 			 */
 
-			if (!backing->info.ops->tag_match(backing, iname + 1,
+			if (i != item &&
+			    !backing->info.ops->tag_match(backing, iname + 1,
 							  specific_key, 1))
 				_lws_cache_heap_item_destroy(cache, i);
-		}
 
-	} lws_end_foreach_dll_safe(d, d1);
+		} lws_end_foreach_dll_safe(d, d1);
 
 	lws_cache_heap_item_destroy(cache, item, 0);
 
@@ -506,6 +674,19 @@ lws_cache_heap_create(const struct lws_cache_creation_info *info)
 	if (!cache)
 		return NULL;
 
+	cache->hash_elements = LWS_CACHE_HEAP_HASH_INITIAL;
+	cache->hash_key = lws_zalloc(cache->hash_elements *
+				     sizeof(*cache->hash_key), __func__);
+	cache->hash_prefix = lws_zalloc(cache->hash_elements *
+					sizeof(*cache->hash_prefix), __func__);
+	if (!cache->hash_key || !cache->hash_prefix) {
+		lws_free(cache->hash_key);
+		lws_free(cache->hash_prefix);
+		lws_free(cache);
+
+		return NULL;
+	}
+
 	cache->cache.info = *info;
 	if (info->parent)
 		info->parent->child = &cache->cache;
@@ -523,7 +704,8 @@ destroy_dll(struct lws_dll2 *d, void *user)
 	lws_cache_ttl_item_heap_t *item =
 		       lws_container_of(d, lws_cache_ttl_item_heap_t, list_lru);
 
-	lws_cache_heap_item_destroy(cache, item, 0);
+	/* the meta items are all going too, no need to look at them */
+	_lws_cache_heap_item_destroy(cache, item);
 
 	return 0;
 }
@@ -551,6 +733,10 @@ lws_cache_heap_destroy(struct lws_cache_ttl_lru **_cache)
 
 	lws_dll2_foreach_safe(&cache->items_lru, cache, destroy_dll);
 
+	lws_free(cache->expiry_heap);
+	lws_free(cache->hash_key);
+	lws_free(cache->hash_prefix);
+
 	lws_free_set_NULL(*_cache);
 }
 
@@ -574,19 +760,12 @@ static void
 lws_cache_heap_debug_dump(struct lws_cache_ttl_lru *_c)
 {
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
-#if !defined(LWS_WITH_NO_LOGS)
-	lws_cache_ttl_item_heap_t *item = NULL;
-
-	lws_dll2_t *d = cache->items_expiry.head;
-
-	if (d)
-		item = lws_container_of(d, lws_cache_ttl_item_heap_t,
-						list_expiry);
 
 	lwsl_cache("%s: %s: items %d, earliest %llu\n", __func__,
 			cache->cache.info.name, (int)cache->items_lru.count,
-			item ? (unsigned long long)item->expiry : 0ull);
-#endif
+			cache->expiry_heap_count ?
+			  (unsigned long long)cache->expiry_heap[0]->expiry :
+			  0ull);
 
 	lws_dll2_foreach_safe(&cache->items_lru, cache, dump_dll);
 }
@@ -45,11 +45,16 @@ lws_cache_clear_matches(lws_dll2_owner_t *results_owner)
 void
 lws_cache_schedule(struct lws_cache_ttl_lru *cache, sul_cb_t cb, lws_usec_t e)
 {
+	lws_usec_t us = e - lws_now_usecs();
+
 	lwsl_cache("%s: %s schedule %llu\n", __func__, cache->info.name,
 			(unsigned long long)e);
 
-	lws_sul_schedule(cache->info.cx, cache->info.tsi, &cache->sul, cb,
-			 e - lws_now_usecs());
+	/* already due... and -1 would mean LWS_SET_TIMER_USEC_CANCEL */
+	if (us < 0)
+		us = 0;
+
+	lws_sul_schedule(cache->info.cx, cache->info.tsi, &cache->sul, cb, us);
 }
 
 int
@@ -42,13 +42,19 @@
 #define META_ITEM_LEADING '!'
 
 typedef struct lws_cache_ttl_item_heap {
-	lws_dll2_t			list_expiry;
 	lws_dll2_t			list_lru;
+	lws_dll2_t			list_hash; /* same key hash bucket */
+	lws_dll2_t			list_prefix; /* same prefix hash bucket */
+	lws_dll2_t			list_meta; /* meta items only */
 
 	lws_usec_t			expiry;
 	size_t				key_len;
 	size_t				size;
 
+	uint32_t			hash; /* of the whole key */
+	uint32_t			prefix_hash; /* up to first LWSCTAG_SEP */
+	int				heap_idx; /* in expiry heap, or -1 */
+
 	/*
 	 * len + key_len + 1 bytes of data overcommitted, user object first
 	 * so it is well-aligned, then the NUL-terminated key name
@@ -66,14 +72,32 @@ typedef struct lws_cache_ttl_lru {
 
 /*
  * The heap-backed cache uses lws_dll2 linked-lists to track items that are
- * in it.
+ * in it, in lru order.
+ *
+ * Items are also listed in a hash table on the whole key, so specific gets
+ * don't have to walk the lru list, and in a second hash table on the first
+ * section of the key up to LWSCTAG_SEP, so wildcard lookups like
+ * "host|path|*" only have to look at items with the same "host|".  Buckets
+ * are kept in lru order too.
+ *
+ * Items with an expiry are kept in a binary min-heap on the expiry time.
  */
 
+#define LWS_CACHE_HEAP_HASH_INITIAL 16
+
 typedef struct lws_cache_ttl_lru_heap {
 	lws_cache_ttl_lru_t		cache;
 
-	lws_dll2_owner_t		items_expiry;
 	lws_dll2_owner_t		items_lru;
+	lws_dll2_owner_t		items_meta;
+
+	lws_dll2_owner_t		*hash_key;
+	lws_dll2_owner_t		*hash_prefix;
+	unsigned int			hash_elements; /* power of 2 */
+
+	lws_cache_ttl_item_heap_t	**expiry_heap;
+	unsigned int			expiry_heap_count;
+	unsigned int			expiry_heap_size;
 } lws_cache_ttl_lru_t_heap_t;
 
 /*
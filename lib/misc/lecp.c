@@ -116,57 +116,144 @@ ex(struct lecp_ctx *ctx, void *_start, size_t len)
 		ctx->collect_tgt = start + len - 1;
 }
 
+/*
+ * Scan the path against one match pattern, setting wild[] and wildcount.
+ * Returns 0 if it matches, 1 if it might once the path gets longer, and 2 if
+ * nothing appended to the path can make it match.  If the first ofs chars of
+ * the pattern are known to be the same as the path's without any wildcard,
+ * the scan starts after them.
+ */
+
+static int
+lecp_path_scan(struct lecp_ctx *ctx, const char *q, uint8_t ofs)
+{
+	const char *p = ctx->path + ofs;
+
+	ctx->wildcount = 0;
+	q += ofs;
+
+	while (*p && *q) {
+		if (*q != '*') {
+			if (*p != *q)
+				break;
+			p++;
+			q++;
+			continue;
+		}
+		ctx->wild[ctx->wildcount++] =
+			    (uint16_t)lws_ptr_diff_size_t(p, ctx->path);
+		q++;
+		/*
+		 * if * has something after it, match to .
+		 * if ends with *, eat everything.
+		 * This implies match sequences must be ordered like
+		 *  x.*.*
+		 *  x.*
+		 * if both options are possible
+		 */
+		while (*p && (*p != '.' || !*q))
+			p++;
+	}
+
+	if (*p)
+		return 2;
+
+	return !!*q;
+}
+
+/*
+ * Forget what we knew about path prefixes longer than len, the path is about
+ * to be changed from there
+ */
+
+static LWS_INLINE void
+lecp_path_cache_trim(struct lecp_ctx *ctx, uint8_t len)
+{
+#if LECP_MATCH_CACHE_DEPTH
+	while (ctx->mc_count && ctx->mc[ctx->mc_count - 1].len > len)
+		ctx->mc_count--;
+#endif
+}
+
 static void
 lecp_check_path_match(struct lecp_ctx *ctx)
 {
-	const char *p, *q;
+	uint8_t ppos = ctx->pst[ctx->pst_sp].ppos;
 	size_t s = sizeof(char *);
 	int n;
+#if LECP_MATCH_CACHE_DEPTH
+	struct _lecp_match_cache *mc = NULL, *nmc = NULL;
+#endif
 
 	if (ctx->path_stride)
 		s = ctx->path_stride;
 
 	/* we only need to check if a match is not active */
-	for (n = 0; !ctx->path_match &&
-	     n < ctx->pst[ctx->pst_sp].count_paths; n++) {
-		ctx->wildcount = 0;
-		p = ctx->path;
+	if (ctx->path_match)
+		return;
+
+#if LECP_MATCH_CACHE_DEPTH
+	/*
+	 * Only the paths still viable for the longest prefix of the current
+	 * path we have seen before need looking at.  If the path got longer,
+	 * also note which of those are still viable for it as it is now.
+	 */
+
+	lecp_path_cache_trim(ctx, ppos);
+	if (ctx->mc_count)
+		mc = &ctx->mc[ctx->mc_count - 1];
+	if ((!mc || mc->len < ppos) && !ctx->path[ppos] &&
+	    ctx->mc_count < LECP_MATCH_CACHE_DEPTH) {
+		nmc = &ctx->mc[ctx->mc_count];
+		memset(nmc->viable, 0, sizeof(nmc->viable));
+		memset(nmc->lit, 0, sizeof(nmc->lit));
+	}
+#endif
 
-		q = *((char **)(((char *)ctx->pst[ctx->pst_sp].paths) +
-							((unsigned int)n * s)));
+	for (n = 0; n < ctx->pst[ctx->pst_sp].count_paths; n++) {
+		uint8_t ofs = 0;
+		int r;
+#if LECP_MATCH_CACHE_DEPTH
+		uint8_t bit = (uint8_t)(1 << (n & 7));
 
-		while (*p && *q) {
-			if (*q != '*') {
-				if (*p != *q)
-					break;
-				p++;
-				q++;
+		if (mc) {
+			if (!mc->viable[n >> 3]) {
+				n |= 7; /* none in this byte */
 				continue;
 			}
-			ctx->wild[ctx->wildcount++] =
-				    (uint16_t)lws_ptr_diff_size_t(p, ctx->path);
-			q++;
-			/*
-			 * if * has something after it, match to .
-			 * if ends with *, eat everything.
-			 * This implies match sequences must be ordered like
-			 *  x.*.*
-			 *  x.*
-			 * if both options are possible
-			 */
-			while (*p && (*p != '.' || !*q))
-				p++;
+			if (!(mc->viable[n >> 3] & bit))
+				continue;
+			if (mc->lit[n >> 3] & bit)
+				ofs = mc->len;
+		}
+#endif
+
+		r = lecp_path_scan(ctx, *((char **)(((char *)ctx->pst[
+					ctx->pst_sp].paths) +
+					((unsigned int)n * s))), ofs);
+#if LECP_MATCH_CACHE_DEPTH
+		if (nmc && r < 2) {
+			nmc->viable[n >> 3] = (uint8_t)(nmc->viable[n >> 3] | bit);
+			if (!ctx->wildcount)
+				nmc->lit[n >> 3] = (uint8_t)(nmc->lit[n >> 3] | bit);
 		}
-		if (*p || *q)
+#endif
+		if (r)
 			continue;
 
 		ctx->path_match = (uint8_t)(n + 1);
-		ctx->path_match_len = ctx->pst[ctx->pst_sp].ppos;
+		ctx->path_match_len = ppos;
 		return;
 	}
 
-	if (!ctx->path_match)
-		ctx->wildcount = 0;
+#if LECP_MATCH_CACHE_DEPTH
+	if (nmc) {
+		nmc->len = ppos;
+		ctx->mc_count++;
+	}
+#endif
+
+	ctx->wildcount = 0;
 }
 
 int
@@ -505,6 +592,7 @@ i2:
 					goto reject_overflow;
 
 				st->p = pst->ppos;
+				lecp_path_cache_trim(ctx, pst->ppos);
 				ctx->path[pst->ppos++] = '[';
 				ctx->path[pst->ppos++] = ']';
 				ctx->path[pst->ppos] = '\0';
@@ -558,6 +646,7 @@ push_a:
 					goto reject_overflow;
 
 				st->p = pst->ppos;
+				lecp_path_cache_trim(ctx, pst->ppos);
 				ctx->path[pst->ppos++] = '.';
 				ctx->path[pst->ppos] = '\0';
 
@@ -785,6 +874,7 @@ push_m:
 				st->p = pst->ppos;
 				if (pst->ppos + ctx->npos > sizeof(ctx->path))
 					goto reject_overflow;
+				lecp_path_cache_trim(ctx, pst->ppos);
 				memcpy(&ctx->path[pst->ppos], ctx->buf,
 				       (size_t)(ctx->npos + 1));
 				pst->ppos = (uint8_t)(pst->ppos + ctx->npos);
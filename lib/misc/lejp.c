@@ -80,6 +80,7 @@ lejp_construct(struct lejp_ctx *ctx,
 	ctx->path_match = 0;
 	ctx->path_stride = 0;
 	ctx->path[0] = '\0';
+	ctx->mc_count = 0;
 	ctx->user = user;
 	ctx->line = 1;
 	ctx->flags = 0; /* user may set after construction */
@@ -144,55 +145,157 @@ lejp_change_callback(struct lejp_ctx *ctx,
 	ctx->pst[0].callback(ctx, LEJPCB_START);
 }
 
-void
-lejp_check_path_match(struct lejp_ctx *ctx)
+/*
+ * Scan the path against one match pattern, setting wild[] and wildcount.
+ * Returns 0 if it matches, 1 if it doesn't but it might if the path gets
+ * longer, and 2 if nothing appended to the path can make it match.
+ *
+ * Where the scan stops only depends on the path chars it already looked at,
+ * so once the pattern fails somewhere inside the path it fails for any path
+ * that starts the same way.  If the first ofs chars of the pattern are known
+ * to be the same as the path's, without any wildcard, the scan can start
+ * after them.
+ */
+
+static int
+lejp_path_scan(struct lejp_ctx *ctx, const char *q, uint8_t ofs)
+{
+	const char *p = ctx->path + ofs;
+
+	ctx->wildcount = 0;
+	q += ofs;
+
+	while (*p && *q) {
+		if (*q != '*') {
+			if (*p != *q)
+				break;
+			p++;
+			q++;
+			continue;
+		}
+		ctx->wild[ctx->wildcount++] = (uint16_t)lws_ptr_diff_size_t(p, ctx->path);
+		q++;
+		/*
+		 * if * has something after it, match to .
+		 * if ends with *, eat everything.
+		 * This implies match sequences must be ordered like
+		 *  x.*.*
+		 *  x.*
+		 * if both options are possible
+		 */
+		while (*p && ((*p != '.' && *p != '[') || !*q))
+			p++;
+	}
+
+	if (*p)
+		return 2;
+
+	return !!*q;
+}
+
+static const char *
+lejp_path(struct lejp_ctx *ctx, int n)
 {
-	const char *p, *q;
-	int n;
 	size_t s = sizeof(char *);
 
 	if (ctx->path_stride)
 		s = ctx->path_stride;
 
+	return *((char **)(((char *)ctx->pst[ctx->pst_sp].paths) +
+						((unsigned int)n * s)));
+}
+
+/*
+ * Forget what we knew about path prefixes longer than len, the path is about
+ * to be changed from there
+ */
+
+static LWS_INLINE void
+lejp_path_cache_trim(struct lejp_ctx *ctx, uint8_t len)
+{
+#if LEJP_MATCH_CACHE_DEPTH
+	while (ctx->mc_count && ctx->mc[ctx->mc_count - 1].len > len)
+		ctx->mc_count--;
+#endif
+}
+
+void
+lejp_check_path_match(struct lejp_ctx *ctx)
+{
+	uint8_t ppos = ctx->pst[ctx->pst_sp].ppos;
+	int n, last = -1, count = ctx->pst[ctx->pst_sp].count_paths;
+#if LEJP_MATCH_CACHE_DEPTH
+	struct _lejp_match_cache *mc = NULL, *nmc = NULL;
+
+	/*
+	 * Only the paths still viable for the longest prefix of the current
+	 * path we have seen before need looking at.  If the path got longer,
+	 * also note which of those are still viable for it as it is now.
+	 */
+
+	lejp_path_cache_trim(ctx, ppos);
+	if (ctx->mc_count)
+		mc = &ctx->mc[ctx->mc_count - 1];
+	if ((!mc || mc->len < ppos) && !ctx->path[ppos] &&
+	    ctx->mc_count < LEJP_MATCH_CACHE_DEPTH) {
+		nmc = &ctx->mc[ctx->mc_count];
+		memset(nmc->viable, 0, sizeof(nmc->viable));
+		memset(nmc->lit, 0, sizeof(nmc->lit));
+	}
+#endif
+
 	/* we only need to check if a match is not active */
 	for (n = 0; //!ctx->path_match &&
-	     n < ctx->pst[ctx->pst_sp].count_paths; n++) {
-		ctx->wildcount = 0;
-		p = ctx->path;
-
-		q = *((char **)(((char *)ctx->pst[ctx->pst_sp].paths) + ((unsigned int)n * s)));
-//lwsl_notice("%s: %s %s\n", __func__, p, q);
-		while (*p && *q) {
-			if (*q != '*') {
-				if (*p != *q)
-					break;
-				p++;
-				q++;
+	     n < count; n++) {
+		uint8_t ofs = 0;
+		int r;
+#if LEJP_MATCH_CACHE_DEPTH
+		uint8_t bit = (uint8_t)(1 << (n & 7));
+
+		if (mc) {
+			if (!mc->viable[n >> 3]) {
+				n |= 7; /* none in this byte */
 				continue;
 			}
-			ctx->wild[ctx->wildcount++] = (uint16_t)lws_ptr_diff_size_t(p, ctx->path);
-			q++;
-			/*
-			 * if * has something after it, match to .
-			 * if ends with *, eat everything.
-			 * This implies match sequences must be ordered like
-			 *  x.*.*
-			 *  x.*
-			 * if both options are possible
-			 */
-			while (*p && ((*p != '.' && *p != '[') || !*q))
-				p++;
+			if (!(mc->viable[n >> 3] & bit))
+				continue;
+			if (mc->lit[n >> 3] & bit)
+				ofs = mc->len;
 		}
-		if (*p || *q)
+#endif
+		last = n;
+		r = lejp_path_scan(ctx, lejp_path(ctx, n), ofs);
+#if LEJP_MATCH_CACHE_DEPTH
+		if (nmc && r < 2) {
+			nmc->viable[n >> 3] = (uint8_t)(nmc->viable[n >> 3] | bit);
+			if (!ctx->wildcount)
+				nmc->lit[n >> 3] = (uint8_t)(nmc->lit[n >> 3] | bit);
+		}
+#endif
+		if (r)
 			continue;
 
 		ctx->path_match = (uint8_t)(n + 1);
-		ctx->path_match_len = ctx->pst[ctx->pst_sp].ppos;
+		ctx->path_match_len = ppos;
 		return;
 	}
 
-	if (!ctx->path_match)
+#if LEJP_MATCH_CACHE_DEPTH
+	if (nmc) {
+		nmc->len = ppos;
+		ctx->mc_count++;
+	}
+#endif
+
+	if (!ctx->path_match) {
 		ctx->wildcount = 0;
+		return;
+	}
+
+	/* leave wild[] as it was when every path was scanned */
+
+	if (count && last != count - 1)
+		lejp_path_scan(ctx, lejp_path(ctx, count - 1), 0);
 }
 
 int
@@ -272,6 +375,7 @@ lejp_parse(struct lejp_ctx *ctx, const unsigned char *json, int len)
 				ctx->outer_array = 1;
 				ctx->st[ctx->sp].s = LEJP_MP_ARRAY_END;
 				c = LEJP_MP_VALUE;
+				lejp_path_cache_trim(ctx, ctx->pst[ctx->pst_sp].ppos);
 				ctx->path[ctx->pst[ctx->pst_sp].ppos++] = '[';
 				ctx->path[ctx->pst[ctx->pst_sp].ppos++] = ']';
 				ctx->path[ctx->pst[ctx->pst_sp].ppos] = '\0';
@@ -492,6 +596,7 @@ lejp_parse(struct lejp_ctx *ctx, const unsigned char *json, int len)
 				if (ctx->pst[ctx->pst_sp].ppos + 3u >=
 							sizeof(ctx->path))
 					goto reject;
+				lejp_path_cache_trim(ctx, ctx->pst[ctx->pst_sp].ppos);
 				ctx->path[ctx->pst[ctx->pst_sp].ppos++] = '[';
 				ctx->path[ctx->pst[ctx->pst_sp].ppos++] = ']';
 				ctx->path[ctx->pst[ctx->pst_sp].ppos] = '\0';
@@ -848,6 +953,7 @@ emit_string_char:
 			continue;
 		}
 		/* name part of name:value pair */
+		lejp_path_cache_trim(ctx, ctx->pst[ctx->pst_sp].ppos);
 		ctx->path[ctx->pst[ctx->pst_sp].ppos++] = (char)c;
 		continue;
 
@@ -855,8 +961,10 @@ add_stack_level:
 		/* push on to the object stack */
 		if (ctx->pst[ctx->pst_sp].ppos &&
 		    ctx->st[ctx->sp].s != LEJP_MP_COMMA_OR_END &&
-		    ctx->st[ctx->sp].s != LEJP_MP_ARRAY_END)
+		    ctx->st[ctx->sp].s != LEJP_MP_ARRAY_END) {
+			lejp_path_cache_trim(ctx, ctx->pst[ctx->pst_sp].ppos);
 			ctx->path[ctx->pst[ctx->pst_sp].ppos++] = '.';
+		}
 
 		ctx->st[ctx->sp].p = (char)ctx->pst[ctx->pst_sp].ppos;
 		ctx->st[ctx->sp].i = (char)ctx->ipos;
@@ -915,6 +1023,7 @@ lejp_parser_push(struct lejp_ctx *ctx, void *user, const char * const *paths,
 	p->ppos = 0;
 
 	ctx->path_match = 0;
+	ctx->mc_count = 0; /* different paths */
 	lejp_check_path_match(ctx);
 
 	lwsl_debug("%s: pushed parser stack to %d (path %s)\n", __func__,
@@ -933,6 +1042,7 @@ lejp_parser_pop(struct lejp_ctx *ctx)
 	lwsl_debug("%s: popped parser stack to %d\n", __func__, ctx->pst_sp);
 
 	ctx->path_match = 0; /* force it to check */
+	ctx->mc_count = 0; /* different paths */
 	lejp_check_path_match(ctx);
 
 	return 0;
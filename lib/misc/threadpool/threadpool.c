@@ -38,17 +38,41 @@
 
 #include <string.h>
 #include <stdio.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Workers hand finished tasks back with these, without taking any lock that
+ * the service thread or other workers are waiting on
+ */
+
+#if defined(_MSC_VER)
+#define tp_atomic_add(_p, _v) \
+	(InterlockedExchangeAdd((volatile LONG *)(_p), (LONG)(_v)) + (_v))
+#define tp_cas_ptr(_p, _o, _n) \
+	(InterlockedCompareExchangePointer((PVOID volatile *)(_p), \
+					   (_n), (_o)) == (_o))
+#define tp_xchg_ptr(_p, _n) \
+	InterlockedExchangePointer((PVOID volatile *)(_p), (_n))
+#else
+#define tp_atomic_add(_p, _v)	__sync_add_and_fetch(_p, _v)
+#define tp_cas_ptr(_p, _o, _n)	__sync_bool_compare_and_swap(_p, _o, _n)
+#define tp_xchg_ptr(_p, _n)	__sync_lock_test_and_set(_p, _n)
+#endif
 
 struct lws_threadpool;
 
 struct lws_threadpool_task {
-	struct lws_threadpool_task	*task_queue_next;
+	struct lws_threadpool_task	*task_queue_next; /* done list */
 
 	struct lws_threadpool		*tp;
 	char				name[32];
 	struct lws_threadpool_task_args args;
 
-	lws_dll2_t			list;
+	lws_dll2_t			list;  /* on wsi tp_task_owner */
+	lws_dll2_t			queue; /* on a worker's pending queue */
 
 	lws_usec_t			created;
 	lws_usec_t			acquired;
@@ -66,37 +90,44 @@ struct lws_threadpool_task {
 
 	char				wanted_writeable_cb;
 	char				outlive;
+	char				on_done; /* drained on to done list */
 };
 
 struct lws_pool {
 	struct lws_threadpool		*tp;
 	pthread_t			thread;
 	pthread_mutex_t			lock; /* part of task wake_idle */
+	pthread_mutex_t			qlock; /* protects queue and task */
+	lws_dll2_owner_t		queue; /* pending tasks */
 	struct lws_threadpool_task	*task;
 	lws_usec_t			acquired;
 	int				worker_index;
+	int				cpu; /* -1 = not pinned */
 };
 
 struct lws_threadpool {
-	pthread_mutex_t			lock; /* protects all pool lists */
+	pthread_mutex_t			lock; /* done list and wsi bindings */
+	pthread_mutex_t			idle_lock; /* part of wake_idle */
 	pthread_cond_t			wake_idle;
 	struct lws_pool			*pool_list;
 
 	struct lws_context		*context;
 	struct lws_threadpool		*tp_list; /* context list of threadpools */
 
-	struct lws_threadpool_task	*task_queue_head;
 	struct lws_threadpool_task	*task_done_head;
+	struct lws_threadpool_task * volatile done_posted; /* from workers */
 
 	char				name[32];
 
 	int				threads_in_pool;
-	int				queue_depth;
+	volatile int			queue_depth;
 	int				done_queue_depth;
 	int				max_queue_depth;
-	int				running_tasks;
+	volatile int			running_tasks;
+	volatile int			idle;
+	unsigned int			rr;
 
-	unsigned int			destroying:1;
+	volatile char			destroying;
 };
 
 static int
@@ -121,6 +152,41 @@ pc_delta(lws_usec_t now, lws_usec_t then, lws_usec_t us)
 	return (int)((us * 100) / delta);
 }
 
+/*
+ * Workers push finished tasks on to done_posted, a lockless stack that any
+ * number of them may push to at once.  The service side swaps the whole
+ * stack out and moves it on to the done list under tp->lock, so the workers
+ * never wait for the service thread, or each other, to finish a task.
+ */
+
+static void
+lws_threadpool_post_done(struct lws_threadpool_task *task)
+{
+	struct lws_threadpool *tp = task->tp;
+	struct lws_threadpool_task *head;
+
+	do {
+		head = tp->done_posted;
+		task->task_queue_next = head;
+	} while (!tp_cas_ptr(&tp->done_posted, head, task));
+}
+
+static void
+__lws_threadpool_drain_done(struct lws_threadpool *tp)
+{
+	struct lws_threadpool_task *task, *next;
+
+	task = tp_xchg_ptr(&tp->done_posted, NULL);
+	while (task) {
+		next = task->task_queue_next;
+		task->task_queue_next = tp->task_done_head;
+		tp->task_done_head = task;
+		task->on_done = 1;
+		tp->done_queue_depth++;
+		task = next;
+	}
+}
+
 static void
 __lws_threadpool_task_dump(struct lws_threadpool_task *task, char *buf, int len)
 {
@@ -184,14 +250,19 @@ lws_threadpool_dump(struct lws_threadpool *tp)
 		    tp->done_queue_depth);
 
 	count = 0;
-	c = &tp->task_queue_head;
-	while (*c) {
-		struct lws_threadpool_task *task = *c;
-		__lws_threadpool_task_dump(task, buf, sizeof(buf));
-		lwsl_thread("  - %s\n", buf);
-		count++;
+	for (n = 0; n < tp->threads_in_pool; n++) {
+		struct lws_pool *pool = &tp->pool_list[n];
 
-		c = &(*c)->task_queue_next;
+		pthread_mutex_lock(&pool->qlock);
+		lws_start_foreach_dll(struct lws_dll2 *, d, pool->queue.head) {
+			struct lws_threadpool_task *task = lws_container_of(d,
+					struct lws_threadpool_task, queue);
+
+			__lws_threadpool_task_dump(task, buf, sizeof(buf));
+			lwsl_thread("  - worker %d queue: %s\n", n, buf);
+			count++;
+		} lws_end_foreach_dll(d);
+		pthread_mutex_unlock(&pool->qlock);
 	}
 
 	if (count != tp->queue_depth)
@@ -215,6 +286,7 @@ lws_threadpool_dump(struct lws_threadpool *tp)
 			 __func__, tp->running_tasks, count);
 
 	count = 0;
+	__lws_threadpool_drain_done(tp);
 	c = &tp->task_done_head;
 	while (*c) {
 		struct lws_threadpool_task *task = *c;
@@ -331,32 +403,37 @@ lws_threadpool_tsi_context(struct lws_context *context, int tsi)
 		for (n = 0; n < tp->threads_in_pool; n++) {
 			struct lws_pool *pool = &tp->pool_list[n];
 
-			task = pool->task;
-			if (!task)
+			if (!pool->task)
 				continue;
 
-			wsi = task_to_wsi(task);
-			if (!wsi || wsi->tsi != tsi ||
-			    (!task->wanted_writeable_cb &&
-			     task->status != LWS_TP_STATUS_SYNCING))
-				continue;
+			pthread_mutex_lock(&pool->qlock); /* ========= queue lock */
 
-			task->wanted_writeable_cb = 0;
-			lws_memory_barrier();
+			task = pool->task;
+			wsi = task ? task_to_wsi(task) : NULL;
+			if (wsi && wsi->tsi == tsi &&
+			    (task->wanted_writeable_cb ||
+			     task->status == LWS_TP_STATUS_SYNCING)) {
 
-			/*
-			 * finally... we can ask for the callback on
-			 * writable from the correct service thread
-			 * context
-			 */
+				task->wanted_writeable_cb = 0;
+				lws_memory_barrier();
+
+				/*
+				 * finally... we can ask for the callback on
+				 * writable from the correct service thread
+				 * context
+				 */
+
+				lws_callback_on_writable(wsi);
+			}
 
-			lws_callback_on_writable(wsi);
+			pthread_mutex_unlock(&pool->qlock); /* ----- queue unlock */
 		}
 
 		/* for the done tasks... */
 
 		pthread_mutex_lock(&tp->lock); /* ======================== tpool lock */
 
+		__lws_threadpool_drain_done(tp);
 		c = &tp->task_done_head;
 
 		while (*c) {
@@ -491,78 +568,141 @@ done:
 static int dummy;
 #endif
 
-static void *
-lws_threadpool_worker(void *d)
+static void
+lws_threadpool_lock_pair(struct lws_pool *a, struct lws_pool *b)
 {
-	struct lws_threadpool_task **c, **c2, *task;
-	struct lws_pool *pool = d;
-	struct lws_threadpool *tp = pool->tp;
-	char buf[160], tpd = 0;
+	/* always in pool_list order, so two thieves can't deadlock */
 
-	while (!tpd) {
+	if (a > b) {
+		struct lws_pool *t = a;
 
-		/* we have no running task... wait and get one from the queue */
+		a = b;
+		b = t;
+	}
 
-		pthread_mutex_lock(&tp->lock); /* =================== tp lock */
+	pthread_mutex_lock(&a->qlock);
+	if (b != a)
+		pthread_mutex_lock(&b->qlock);
+}
 
-		tpd = tp->destroying;
-		if (tpd) {
-			pthread_mutex_unlock(&tp->lock); /* --------------- tp unlock */
+static void
+lws_threadpool_unlock_pair(struct lws_pool *a, struct lws_pool *b)
+{
+	if (b != a)
+		pthread_mutex_unlock(&b->qlock);
+	pthread_mutex_unlock(&a->qlock);
+}
 
-			continue;
-		}
-		/*
-		 * if there's no task already waiting in the queue, wait for
-		 * the wake_idle condition to signal us that might have changed
-		 */
-		while (!tp->task_queue_head && !tp->destroying)
-			pthread_cond_wait(&tp->wake_idle, &tp->lock);
+/*
+ * Take the oldest task from our own queue, or if that's empty, steal the
+ * oldest one from another worker's queue.  The tasks are long-lived jobs, so
+ * it's how long they have been waiting that matters, not cache warmth.
+ *
+ * The task comes off the queue and becomes pool->task with both queue locks
+ * held.  That's enough for lws_threadpool_dequeue_task() when we take from our
+ * own queue, since the queue and pool->task are under the one queue lock it
+ * holds while it looks at them.  But it looks at one pool at a time, so a
+ * steal could move the task from a pool it didn't look at yet to one it
+ * already looked at, and it'd find it nowhere... so we also hold tp->lock,
+ * which it holds for the whole search, while we steal.
+ */
 
-		if (tp->destroying) {
-			lwsl_notice("%s: bailing\n", __func__);
-			goto doneski;
-		}
+static struct lws_threadpool_task *
+lws_threadpool_take(struct lws_pool *pool)
+{
+	struct lws_threadpool *tp = pool->tp;
+	struct lws_threadpool_task *task = NULL;
+	int n;
 
-		c = &tp->task_queue_head;
-		c2 = NULL;
-		task = NULL;
-		pool->task = NULL;
+	for (n = 0; n < tp->threads_in_pool && !task; n++) {
+		struct lws_pool *victim = &tp->pool_list[
+				(pool->worker_index + n) % tp->threads_in_pool];
 
-		/* look at the queue tail */
-		while (*c) {
-			c2 = c;
-			c = &(*c)->task_queue_next;
-		}
+		if (!victim->queue.count)
+			continue;
+
+		if (n)
+			pthread_mutex_lock(&tp->lock); /* ========= tpool lock */
+		lws_threadpool_lock_pair(pool, victim); /* ======= queue locks */
 
-		/* is there a task at the queue tail? */
-		if (c2 && *c2) {
-			pool->task = task = *c2;
+		if (victim->queue.head && !tp->destroying) {
+			task = lws_container_of(victim->queue.head,
+					struct lws_threadpool_task, queue);
+			lws_dll2_remove(&task->queue);
+			tp_atomic_add(&tp->queue_depth, -1);
+
+			pool->task = task;
 			task->acquired = pool->acquired = lws_now_usecs();
-			/* remove it from the queue */
-			*c2 = task->task_queue_next;
-			task->task_queue_next = NULL;
-			tp->queue_depth--;
+			task->wanted_writeable_cb = 0;
 			/* mark it as running */
 			state_transition(task, LWS_TP_STATUS_RUNNING);
 		}
 
-		/* someone else got it first... wait and try again */
+		lws_threadpool_unlock_pair(pool, victim); /* --- queue unlocks */
+		if (n)
+			pthread_mutex_unlock(&tp->lock); /* ---- tpool unlock */
+
+		if (task && n)
+			lwsl_thread("%s: %s: worker %d stole from worker %d\n",
+				    __func__, tp->name, pool->worker_index,
+				    victim->worker_index);
+	}
+
+	return task;
+}
+
+static void *
+lws_threadpool_worker(void *d)
+{
+	struct lws_pool *pool = d;
+	struct lws_threadpool *tp = pool->tp;
+	struct lws_threadpool_task *task;
+	char buf[160];
+	struct lws *wsi;
+
+#if defined(__linux__)
+	if (pool->cpu >= 0) {
+		cpu_set_t cs;
+
+		CPU_ZERO(&cs);
+		CPU_SET((unsigned int)pool->cpu, &cs);
+		if (sched_setaffinity(0, sizeof(cs), &cs))
+			lwsl_warn("%s: %s: worker %d unable to pin to cpu %d\n",
+				  __func__, tp->name, pool->worker_index,
+				  pool->cpu);
+	}
+#endif
+
+	while (!tp->destroying) {
+
+		task = lws_threadpool_take(pool);
 		if (!task) {
-			pthread_mutex_unlock(&tp->lock);  /* ------ tp unlock */
+
+			/*
+			 * Nothing anywhere... sleep until something is queued.
+			 * We show we're idle before we look at the depth one
+			 * last time, and enqueue bumps the depth before it
+			 * looks for idle workers, so one of us sees the other.
+			 */
+
+			pthread_mutex_lock(&tp->idle_lock); /* ===== idle lock */
+			tp->idle++;
+			lws_memory_barrier();
+			if (!tp->queue_depth && !tp->destroying)
+				pthread_cond_wait(&tp->wake_idle, &tp->idle_lock);
+			tp->idle--;
+			pthread_mutex_unlock(&tp->idle_lock); /* - idle unlock */
+
 			continue;
 		}
 
-		task->wanted_writeable_cb = 0;
-
 		/* we have acquired a new task */
 
 		__lws_threadpool_task_dump(task, buf, sizeof(buf));
 
 		lwsl_thread("%s: %s: worker %d ACQUIRING: %s\n",
 			    __func__, tp->name, pool->worker_index, buf);
-		tp->running_tasks++;
-
-		pthread_mutex_unlock(&tp->lock); /* --------------- tp unlock */
+		tp_atomic_add(&tp->running_tasks, 1);
 
 		/*
 		 * 1) The task can return with LWS_TP_RETURN_CHECKING_IN to
@@ -591,14 +731,14 @@ lws_threadpool_worker(void *d)
 			lws_usec_t then;
 			int n;
 
-			pthread_mutex_lock(&tp->lock); /* =================== tp lock */
+			pthread_mutex_lock(&pool->qlock); /* ====== queue lock */
 
 			if (tp->destroying || !task_to_wsi(task)) { /* cov */
 				lwsl_info("%s: stopping on wsi gone\n", __func__);
 				state_transition(task, LWS_TP_STATUS_STOPPING);
 			}
 
-			pthread_mutex_unlock(&tp->lock); /* --------------- tp unlock */
+			pthread_mutex_unlock(&pool->qlock); /* -- queue unlock */
 
 			then = lws_now_usecs();
 			n = (int)task->args.task(task->args.user, task->status);
@@ -622,7 +762,10 @@ lws_threadpool_worker(void *d)
 				then = lws_now_usecs();
 				if (lws_threadpool_worker_sync(pool, task)) {
 					lwsl_notice("%s: Sync failed\n", __func__);
-					goto doneski;
+					/* it's been decoupled from its wsi */
+					state_transition(task,
+							 LWS_TP_STATUS_STOPPING);
+					break;
 				}
 				us_accrue(&task->acc_syncing, then);
 				break;
@@ -635,56 +778,53 @@ lws_threadpool_worker(void *d)
 			}
 		} while (task->status == LWS_TP_STATUS_RUNNING);
 
-		pthread_mutex_lock(&tp->lock); /* =================== tp lock */
+		tp_atomic_add(&tp->running_tasks, -1);
 
-		tp->running_tasks--;
+		pthread_mutex_lock(&pool->qlock); /* ============== queue lock */
 
-		if (pool->task->status == LWS_TP_STATUS_STOPPING)
+		if (task->status == LWS_TP_STATUS_STOPPING)
 			state_transition(task, LWS_TP_STATUS_STOPPED);
 
-		/* move the task to the done queue */
-
-		pool->task->task_queue_next = tp->task_done_head;
-		tp->task_done_head = task;
-		tp->done_queue_depth++;
-		pool->task->done = lws_now_usecs();
+		task->done = lws_now_usecs();
+		__lws_threadpool_task_dump(task, buf, sizeof(buf));
 
-		if (!pool->task->args.wsi &&
-		    (pool->task->status == LWS_TP_STATUS_STOPPED ||
-		     pool->task->status == LWS_TP_STATUS_FINISHED)) {
+		/*
+		 * If there's a wsi, the task goes on the done stack for its
+		 * service thread to reap, and may be gone as soon as it's
+		 * there, so we must not touch it afterwards.  We do that
+		 * before we stop being its pool->task, so dequeue always
+		 * finds it in one place or the other.
+		 */
 
-			__lws_threadpool_task_dump(pool->task, buf, sizeof(buf));
-			lwsl_thread("%s: %s: worker %d REAPING: %s\n",
-				    __func__, tp->name, pool->worker_index,
-				    buf);
+		wsi = task_to_wsi(task);
+		if (wsi) {
+			/* signal the associated wsi to take a fresh look at
+			 * task status */
+			task->wanted_writeable_cb = 1;
+			lws_threadpool_post_done(task);
+		}
+		pool->task = NULL;
 
-			/*
-			 * there is no longer any wsi attached, so nothing is
-			 * going to take care of reaping us.  So we must take
-			 * care of it ourselves.
-			 */
-			__lws_threadpool_reap(pool->task);
-		} else {
+		pthread_mutex_unlock(&pool->qlock); /* ---------- queue unlock */
 
-			__lws_threadpool_task_dump(pool->task, buf, sizeof(buf));
+		if (wsi) {
 			lwsl_thread("%s: %s: worker %d DONE: %s\n",
-				    __func__, tp->name, pool->worker_index,
-				    buf);
+				    __func__, tp->name, pool->worker_index, buf);
 
-			/* signal the associated wsi to take a fresh look at
-			 * task status */
+			lws_cancel_service(tp->context);
 
-			if (task_to_wsi(pool->task)) {
-				task->wanted_writeable_cb = 1;
-
-				lws_cancel_service(
-					lws_get_context(task_to_wsi(pool->task)));
-			}
+			continue;
 		}
 
-doneski:
-		pool->task = NULL;
-		pthread_mutex_unlock(&tp->lock); /* --------------- tp unlock */
+		lwsl_thread("%s: %s: worker %d REAPING: %s\n",
+			    __func__, tp->name, pool->worker_index, buf);
+
+		/*
+		 * there is no longer any wsi attached, so nothing is
+		 * going to take care of reaping us.  So we must take
+		 * care of it ourselves.
+		 */
+		lws_threadpool_task_cleanup_destroy(task);
 	}
 
 	lwsl_notice("%s: Exiting\n", __func__);
@@ -703,8 +843,8 @@ lws_threadpool_create(struct lws_context *context,
 		      const char *format, ...)
 {
 	struct lws_threadpool *tp;
+	int n, cpus = 0;
 	va_list ap;
-	int n;
 
 	tp = lws_malloc(sizeof(*tp) + (sizeof(struct lws_pool) * (unsigned int)args->threads),
 			"threadpool alloc");
@@ -728,34 +868,68 @@ lws_threadpool_create(struct lws_context *context,
 	lws_context_unlock(context);
 
 	pthread_mutex_init(&tp->lock, NULL);
+	pthread_mutex_init(&tp->idle_lock, NULL);
 	pthread_cond_init(&tp->wake_idle, NULL);
 
+#if defined(__linux__)
+	if (args->pin_cpus)
+		cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
 	for (n = 0; n < args->threads; n++) {
+		struct lws_pool *pool = &tp->pool_list[n];
 #if defined(LWS_HAS_PTHREAD_SETNAME_NP)
 		char name[16];
 #endif
-		tp->pool_list[n].tp = tp;
-		tp->pool_list[n].worker_index = n;
-		pthread_mutex_init(&tp->pool_list[n].lock, NULL);
-		if (pthread_create(&tp->pool_list[n].thread, NULL,
-				   lws_threadpool_worker, &tp->pool_list[n])) {
+		pool->tp = tp;
+		pool->worker_index = n;
+		pool->cpu = cpus > 0 ? (args->cpu_base + n) % cpus : -1;
+		pthread_mutex_init(&pool->lock, NULL);
+		pthread_mutex_init(&pool->qlock, NULL);
+
+		/*
+		 * Workers steal from pool_list[0 .. threads_in_pool - 1], so
+		 * we stop at the first one we can't start
+		 */
+
+		if (pthread_create(&pool->thread, NULL,
+				   lws_threadpool_worker, pool)) {
 			lwsl_err("thread creation failed\n");
-		} else {
+			pthread_mutex_destroy(&pool->qlock);
+			pthread_mutex_destroy(&pool->lock);
+			break;
+		}
 #if defined(LWS_HAS_PTHREAD_SETNAME_NP)
-			lws_snprintf(name, sizeof(name), "%s-%d", tp->name, n);
-			pthread_setname_np(tp->pool_list[n].thread, name);
+		lws_snprintf(name, sizeof(name), "%s-%d", tp->name, n);
+		pthread_setname_np(pool->thread, name);
 #endif
-			tp->threads_in_pool++;
-		}
+		tp->threads_in_pool++;
 	}
 
 	return tp;
 }
 
+/* tp->lock and the pool qlock must be held */
+
+static void
+__lws_threadpool_queued_to_done(struct lws_threadpool *tp,
+				struct lws_threadpool_task *task)
+{
+	lws_dll2_remove(&task->queue);
+	tp_atomic_add(&tp->queue_depth, -1);
+
+	task->task_queue_next = tp->task_done_head;
+	tp->task_done_head = task;
+	task->on_done = 1;
+	state_transition(task, LWS_TP_STATUS_STOPPED);
+	tp->done_queue_depth++;
+	task->done = lws_now_usecs();
+}
+
 void
 lws_threadpool_finish(struct lws_threadpool *tp)
 {
-	struct lws_threadpool_task **c, *task;
+	int n;
 
 	pthread_mutex_lock(&tp->lock); /* ======================== tpool lock */
 
@@ -763,24 +937,24 @@ lws_threadpool_finish(struct lws_threadpool *tp)
 	 * pool threads will exit ASAP (they are joined in destroy) */
 	tp->destroying = 1;
 
-	/* stop everyone in the pending queue and move to the done queue */
+	/* stop everyone in the pending queues and move to the done queue */
 
-	c = &tp->task_queue_head;
-	while (*c) {
-		task = *c;
-		*c = task->task_queue_next;
-		task->task_queue_next = tp->task_done_head;
-		tp->task_done_head = task;
-		state_transition(task, LWS_TP_STATUS_STOPPED);
-		tp->queue_depth--;
-		tp->done_queue_depth++;
-		task->done = lws_now_usecs();
+	for (n = 0; n < tp->threads_in_pool; n++) {
+		struct lws_pool *pool = &tp->pool_list[n];
 
-		c = &task->task_queue_next;
+		pthread_mutex_lock(&pool->qlock); /* ============= queue lock */
+		while (pool->queue.head)
+			__lws_threadpool_queued_to_done(tp,
+				lws_container_of(pool->queue.head,
+					struct lws_threadpool_task, queue));
+		pthread_mutex_unlock(&pool->qlock); /* --------- queue unlock */
 	}
 
-	pthread_cond_broadcast(&tp->wake_idle);
 	pthread_mutex_unlock(&tp->lock); /* -------------------- tpool unlock */
+
+	pthread_mutex_lock(&tp->idle_lock); /* ==================== idle lock */
+	pthread_cond_broadcast(&tp->wake_idle);
+	pthread_mutex_unlock(&tp->idle_lock); /* ---------------- idle unlock */
 }
 
 void
@@ -810,10 +984,10 @@ lws_threadpool_destroy(struct lws_threadpool *tp)
 	 * Wake up the threadpool guys and tell them to exit
 	 */
 
-	pthread_mutex_lock(&tp->lock); /* ======================== tpool lock */
+	pthread_mutex_lock(&tp->idle_lock); /* ==================== idle lock */
 	tp->destroying = 1;
 	pthread_cond_broadcast(&tp->wake_idle);
-	pthread_mutex_unlock(&tp->lock); /* -------------------- tpool unlock */
+	pthread_mutex_unlock(&tp->idle_lock); /* ---------------- idle unlock */
 
 	lws_threadpool_dump(tp);
 
@@ -822,16 +996,30 @@ lws_threadpool_destroy(struct lws_threadpool *tp)
 	Sleep(1000);
 #endif
 
-	for (n = 0; n < tp->threads_in_pool; n++) {
+	for (n = 0; n < tp->threads_in_pool; n++)
 		pthread_join(tp->pool_list[n].thread, &retval);
-		pthread_mutex_destroy(&tp->pool_list[n].lock);
-	}
+
 	lwsl_info("%s: all threadpools exited\n", __func__);
 #if defined(WIN32)
 	Sleep(1000);
 #endif
 	pthread_mutex_lock(&tp->lock); /* ======================== tpool lock */
 
+	/* anything still queued if we weren't finished first */
+
+	for (n = 0; n < tp->threads_in_pool; n++) {
+		struct lws_pool *pool = &tp->pool_list[n];
+
+		while (pool->queue.head)
+			__lws_threadpool_queued_to_done(tp,
+				lws_container_of(pool->queue.head,
+					struct lws_threadpool_task, queue));
+		pthread_mutex_destroy(&pool->qlock);
+		pthread_mutex_destroy(&pool->lock);
+	}
+
+	__lws_threadpool_drain_done(tp);
+
 	task = tp->task_done_head;
 	while (task) {
 		next = task->task_queue_next;
@@ -843,6 +1031,8 @@ lws_threadpool_destroy(struct lws_threadpool *tp)
 	pthread_mutex_unlock(&tp->lock); /* -------------------- tpool unlock */
 
 	pthread_mutex_destroy(&tp->lock);
+	pthread_mutex_destroy(&tp->idle_lock);
+	pthread_cond_destroy(&tp->wake_idle);
 
 	memset(tp, 0xdd, sizeof(*tp));
 	lws_free(tp);
@@ -875,55 +1065,44 @@ lws_threadpool_dequeue_task(struct lws_threadpool_task *task)
 		goto bail;
 	}
 
+	/*
+	 * Is he queued waiting for a chance to run?  Mark him as stopped and
+	 * move him on to the done queue.  Or is he already running on a
+	 * thread?  A worker moves him from a queue to running, or from running
+	 * to the done stack, holding the queue lock, so we see him in one of
+	 * those places.  A worker stealing him from another pool's queue also
+	 * holds tp->lock, so he can't move between pools while we search.
+	 */
 
-	c = &tp->task_queue_head;
+	for (n = 0; n < tp->threads_in_pool; n++) {
+		struct lws_pool *pool = &tp->pool_list[n];
 
-	/* is he queued waiting for a chance to run?  Mark him as stopped and
-	 * move him on to the done queue */
+		pthread_mutex_lock(&pool->qlock); /* ============= queue lock */
 
-	while (*c) {
-		if ((*c) == task) {
-			*c = task->task_queue_next;
-			task->task_queue_next = tp->task_done_head;
-			tp->task_done_head = task;
-			state_transition(task, LWS_TP_STATUS_STOPPED);
-			tp->queue_depth--;
-			tp->done_queue_depth++;
-			task->done = lws_now_usecs();
+		if (task->queue.owner == &pool->queue) {
+			__lws_threadpool_queued_to_done(tp, task);
 
 			lwsl_debug("%s: tp %p: removed queued task %s\n",
 				    __func__, tp, lws_wsi_tag(task_to_wsi(task)));
 
+			pthread_mutex_unlock(&pool->qlock); /* - queue unlock */
 			break;
 		}
-		c = &(*c)->task_queue_next;
-	}
 
-	/* is he on the done queue? */
-
-	c = &tp->task_done_head;
-	while (*c) {
-		if ((*c) == task) {
-			*c = task->task_queue_next;
-			task->task_queue_next = NULL;
-			lws_threadpool_task_cleanup_destroy(task);
-			tp->done_queue_depth--;
-			goto bail;
+		if (pool->task != task) {
+			pthread_mutex_unlock(&pool->qlock); /* - queue unlock */
+			continue;
 		}
-		c = &(*c)->task_queue_next;
-	}
-
-	/* he's not in the queue... is he already running on a thread? */
 
-	for (n = 0; n < tp->threads_in_pool; n++) {
-		if (!tp->pool_list[n].task || tp->pool_list[n].task != task)
-			continue;
+		lwsl_debug("%s: tp %p: request stop running task "
+			    "for %s\n", __func__, tp,
+			    lws_wsi_tag(task_to_wsi(task)));
 
 		/*
 		 * ensure we don't collide with tests or changes in the
 		 * worker thread
 		 */
-		pthread_mutex_lock(&tp->pool_list[n].lock);
+		pthread_mutex_lock(&pool->lock);
 
 		/*
 		 * mark him as having been requested to stop...
@@ -940,25 +1119,36 @@ lws_threadpool_dequeue_task(struct lws_threadpool_task *task)
 		task->args.ss = NULL;
 #endif
 
-		pthread_mutex_unlock(&tp->pool_list[n].lock);
+		pthread_mutex_unlock(&pool->lock);
+		/* the worker may reap him as soon as we let go */
+		pthread_mutex_unlock(&pool->qlock); /* ---------- queue unlock */
 
-		lwsl_debug("%s: tp %p: request stop running task "
-			    "for %s\n", __func__, tp,
-			    lws_wsi_tag(task_to_wsi(task)));
+		goto bail;
+	}
 
-		break;
+	/* is he on the done queue? */
+
+	__lws_threadpool_drain_done(tp);
+	c = &tp->task_done_head;
+	while (*c) {
+		if ((*c) == task) {
+			*c = task->task_queue_next;
+			task->task_queue_next = NULL;
+			lws_threadpool_task_cleanup_destroy(task);
+			tp->done_queue_depth--;
+			goto bail;
+		}
+		c = &(*c)->task_queue_next;
 	}
 
-	if (n == tp->threads_in_pool) {
-		/* can't find it */
-		lwsl_notice("%s: tp %p: no task for %s, decoupling\n",
-			    __func__, tp, lws_wsi_tag(task_to_wsi(task)));
-		lws_dll2_remove(&task->list);
-		task->args.wsi = NULL;
+	/* can't find it */
+	lwsl_notice("%s: tp %p: no task for %s, decoupling\n",
+		    __func__, tp, lws_wsi_tag(task_to_wsi(task)));
+	lws_dll2_remove(&task->list);
+	task->args.wsi = NULL;
 #if defined(LWS_WITH_SECURE_STREAMS)
-		task->args.ss = NULL;
+	task->args.ss = NULL;
 #endif
-	}
 
 bail:
 	pthread_mutex_unlock(&tp->lock); /* -------------------- tpool unlock */
@@ -987,6 +1177,7 @@ lws_threadpool_enqueue(struct lws_threadpool *tp,
 		       const char *format, ...)
 {
 	struct lws_threadpool_task *task = NULL;
+	struct lws_pool *pool;
 	va_list ap;
 
 	pthread_mutex_lock(&tp->lock); /* ======================== tpool lock */
@@ -995,15 +1186,17 @@ lws_threadpool_enqueue(struct lws_threadpool *tp,
 	assert(args->ss || args->wsi);
 #endif
 
-	if (tp->destroying)
+	if (tp->destroying || !tp->threads_in_pool)
 		goto bail;
 
 	/*
-	 * if there's room on the queue, the job always goes on the queue
-	 * first, then any free thread may pick it up after the wake_idle
+	 * if there's room on the queues, the job always goes on a worker's
+	 * queue first, then that worker, or any free thread that steals it,
+	 * may pick it up
 	 */
 
-	if (tp->queue_depth == tp->max_queue_depth) {
+	if (tp_atomic_add(&tp->queue_depth, 1) > tp->max_queue_depth) {
+		tp_atomic_add(&tp->queue_depth, -1);
 		lwsl_notice("%s: queue reached limit %d\n", __func__,
 			    tp->max_queue_depth);
 
@@ -1015,8 +1208,10 @@ lws_threadpool_enqueue(struct lws_threadpool *tp,
 	 */
 
 	task = lws_malloc(sizeof(*task), __func__);
-	if (!task)
+	if (!task) {
+		tp_atomic_add(&tp->queue_depth, -1);
 		goto bail;
+	}
 
 	memset(task, 0, sizeof(*task));
 	pthread_cond_init(&task->wake_idle, NULL);
@@ -1028,15 +1223,6 @@ lws_threadpool_enqueue(struct lws_threadpool *tp,
 	vsnprintf(task->name, sizeof(task->name) - 1, format, ap);
 	va_end(ap);
 
-	/*
-	 * add him on the tp task queue
-	 */
-
-	task->task_queue_next = tp->task_queue_head;
-	state_transition(task, LWS_TP_STATUS_QUEUED);
-	tp->task_queue_head = task;
-	tp->queue_depth++;
-
 	/*
 	 * mark the wsi itself as depending on this tp (so wsi close for
 	 * whatever reason can clean up)
@@ -1049,14 +1235,30 @@ lws_threadpool_enqueue(struct lws_threadpool *tp,
 #endif
 		lws_dll2_add_tail(&task->list, &args->wsi->tp_task_owner);
 
-	lwsl_thread("%s: tp %s: enqueued task %p (%s) for %s, depth %d\n",
-		    __func__, tp->name, task, task->name,
-		    lws_wsi_tag(task_to_wsi(task)), tp->queue_depth);
+	/*
+	 * add him on the next worker's task queue
+	 */
+
+	pool = &tp->pool_list[tp->rr++ % (unsigned int)tp->threads_in_pool];
 
-	/* alert any idle thread there's something new on the task list */
+	pthread_mutex_lock(&pool->qlock); /* ===================== queue lock */
+	state_transition(task, LWS_TP_STATUS_QUEUED);
+	lws_dll2_add_tail(&task->queue, &pool->queue);
+	pthread_mutex_unlock(&pool->qlock); /* ----------------- queue unlock */
+
+	lwsl_thread("%s: tp %s: enqueued task %p (%s) for %s, worker %d, "
+		    "depth %d\n", __func__, tp->name, task, task->name,
+		    lws_wsi_tag(task_to_wsi(task)), pool->worker_index,
+		    tp->queue_depth);
+
+	/* alert an idle thread, if any, there's something new queued */
 
 	lws_memory_barrier();
-	pthread_cond_signal(&tp->wake_idle);
+	if (tp->idle) {
+		pthread_mutex_lock(&tp->idle_lock); /* ============ idle lock */
+		pthread_cond_signal(&tp->wake_idle);
+		pthread_mutex_unlock(&tp->idle_lock); /* -------- idle unlock */
+	}
 
 bail:
 	pthread_mutex_unlock(&tp->lock); /* -------------------- tpool unlock */
@@ -1083,6 +1285,16 @@ lws_threadpool_task_status(struct lws_threadpool_task *task, void **user)
 		char buf[160];
 
 		pthread_mutex_lock(&tp->lock); /* ================ tpool lock */
+		__lws_threadpool_drain_done(tp);
+		if (!task->on_done) {
+			/*
+			 * the worker hasn't handed it over yet... it will
+			 * ask for a writeable callback again when it has
+			 */
+			pthread_mutex_unlock(&tp->lock); /* ---- tpool unlock */
+
+			return LWS_TP_STATUS_RUNNING;
+		}
 		__lws_threadpool_task_dump(task, buf, sizeof(buf));
 		lwsl_thread("%s: %s: service thread REAPING: %s\n",
 			    __func__, tp->name, buf);
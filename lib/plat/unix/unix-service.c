@@ -150,7 +150,18 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 #endif
 	vpt->inside_poll = 1;
 	lws_memory_barrier();
-	n = poll(pt->fds, pt->fds_count, (int)timeout_us /* ms now */ );
+#if defined(LWS_WITH_EPOLL)
+	if (context->event_loop_ops == &event_loop_ops_epoll)
+		n = lws_epoll_wait_pt(pt, (int)timeout_us /* ms now */);
+	else
+#endif
+#if defined(LWS_WITH_IO_URING)
+	if (context->event_loop_ops == &event_loop_ops_io_uring &&
+	    lws_io_uring_pt_active(pt))
+		n = lws_io_uring_wait_pt(pt, (int)timeout_us /* ms now */);
+	else
+#endif
+		n = poll(pt->fds, pt->fds_count, (int)timeout_us /* ms now */ );
 	vpt->inside_poll = 0;
 	lws_memory_barrier();
 
@@ -207,6 +218,21 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 		m |= pt->context->tls_ops->fake_POLLIN_for_buffered(pt);
 #endif
 
+#if defined(LWS_WITH_EPOLL)
+	if (context->event_loop_ops == &event_loop_ops_epoll) {
+		/* only the ready set and known pending guys get looked at */
+		if (lws_epoll_service_ready_pt(pt) < 0)
+			return -1;
+	} else
+#endif
+#if defined(LWS_WITH_IO_URING)
+	if (context->event_loop_ops == &event_loop_ops_io_uring &&
+	    lws_io_uring_pt_active(pt)) {
+		/* only the completions and known pending guys get looked at */
+		if (lws_io_uring_service_ready_pt(pt) < 0)
+			return -1;
+	} else
+#endif
 	if (
 #if (defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)) || defined(LWS_WITH_TLS)
 		!m &&
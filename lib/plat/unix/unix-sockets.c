@@ -81,6 +81,12 @@ lws_send_pipe_choked(struct lws *wsi)
 	    )
 		return 1;
 
+#if defined(LWS_WITH_IO_URING)
+	if (lws_io_uring_async(wsi_eff))
+		/* it's about how much we have queued on the ring */
+		return lws_io_uring_choked(wsi_eff);
+#endif
+
 	fds.fd = wsi_eff->desc.sockfd;
 	fds.events = POLLOUT;
 	fds.revents = 0;
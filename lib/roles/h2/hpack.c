@@ -274,6 +274,9 @@ static int lws_frag_append(struct lws *wsi, unsigned char c)
 {
 	struct allocated_headers *ah = wsi->http.ah;
 
+	if (_lws_header_table_spill(wsi, 1))
+		return 1;
+
 	ah->data[ah->pos++] = (char)c;
 	ah->frags[ah->nfrag].len++;
 
@@ -1389,11 +1392,377 @@ lws_h2_num(int starting_bits, unsigned long num,
 	return 0;
 }
 
+/*
+ * HPACK encoder
+ *
+ * Headers are sent as an index into the static or dynamic table if both name
+ * and value match, otherwise as a literal, using an indexed name if we can.
+ * Literals that are likely to be repeated are added to the dynamic table.
+ * Strings are Huffman-coded if that makes them shorter.
+ *
+ * Headers added to the dynamic table by the block being composed only become
+ * part of the mirror of the peer's table in lws_hpack_enc_commit(), when the
+ * block is written.  A block that was composed but never written, eg, because
+ * the stream failed, doesn't leave us out of step with the peer.
+ */
+
+#define LWS_HPACK_ENC_MAX_TABLE 4096
+#define LWS_HPACK_ENC_MAX_NAME 64
+
+typedef struct lws_hpack_enc_entry {
+	lws_dll2_t	list;
+	uint32_t	size; /* rfc7541 accounting size */
+	uint16_t	name_len;
+	uint16_t	value_len;
+	/* name then value follow */
+} lws_hpack_enc_entry_t;
+
+static const char * const enc_never_index[] = {
+	"authorization", "cookie", "set-cookie", "proxy-authorization"
+};
+
+static const char * const enc_dont_index[] = {
+	":path", "age", "content-length", "content-range", "date", "etag",
+	"expires", "if-modified-since", "if-none-match", "last-modified",
+	"location"
+};
+
+static int
+lws_hpack_enc_in_list(const char * const *list, int count,
+		      const uint8_t *name, int len)
+{
+	int n;
+
+	for (n = 0; n < count; n++)
+		if (!strncmp(list[n], (const char *)name, (unsigned int)len) &&
+		    !list[n][len])
+			return 1;
+
+	return 0;
+}
+
+static int
+lws_hpack_enc_free_entry(struct lws_dll2 *d, void *user)
+{
+	lws_dll2_remove(d);
+	lws_free(lws_container_of(d, lws_hpack_enc_entry_t, list));
+
+	return 0;
+}
+
+static struct hpack_enc_table *
+lws_hpack_enc_table(struct lws *wsi)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct hpack_enc_table *et;
+
+	if (!nwsi || !nwsi->h2.h2n)
+		return NULL;
+
+	et = &nwsi->h2.h2n->hpack_enc_table;
+	if (!et->inited) {
+		/* the peer decoder starts with the protocol default size */
+		et->max = et->blk_max = et->peer_max = et->peer_min =
+							LWS_HPACK_ENC_MAX_TABLE;
+		et->inited = 1;
+	}
+
+	return et;
+}
+
+void
+lws_hpack_enc_peer_table_size(struct lws *nwsi, uint32_t size)
+{
+	struct hpack_enc_table *et = lws_hpack_enc_table(nwsi);
+
+	if (!et || size == et->peer_max)
+		return;
+
+	et->peer_max = size;
+	if (size < et->peer_min)
+		et->peer_min = size;
+	et->update_due = 1;
+}
+
+/*
+ * For the network wsi, destroys the encoder table.  For a stream, forgets any
+ * header block it was composing.
+ */
+
+void
+lws_hpack_enc_destroy(struct lws *wsi)
+{
+	struct hpack_enc_table *et;
+
+	if (!wsi->h2.h2n) {
+		et = lws_hpack_enc_table(wsi);
+		if (et && et->blk_wsi == wsi) {
+			lws_dll2_foreach_safe(&et->pending, NULL,
+					      lws_hpack_enc_free_entry);
+			et->blk_wsi = NULL;
+		}
+
+		return;
+	}
+
+	et = &wsi->h2.h2n->hpack_enc_table;
+
+	if (et->raw)
+		lwsl_info("%s: %s: hpack tx headers %llu -> %llu (%d%%)\n", __func__,
+			  lws_wsi_tag(wsi), (unsigned long long)et->raw,
+			  (unsigned long long)et->wire,
+			  (int)((et->wire * 100) / et->raw));
+
+	lws_dll2_foreach_safe(&et->pending, NULL, lws_hpack_enc_free_entry);
+	lws_dll2_foreach_safe(&et->entries, NULL, lws_hpack_enc_free_entry);
+	et->size = 0;
+}
+
+void
+lws_hpack_enc_commit(struct lws *wsi, int end_headers)
+{
+	struct hpack_enc_table *et = lws_hpack_enc_table(wsi);
+	lws_hpack_enc_entry_t *e;
+
+	if (!et || et->blk_wsi != wsi)
+		return;
+
+	if (et->blk_update) {
+		if (et->blk_max == et->peer_min && et->peer_min < et->peer_max)
+			/* we signalled the low point, still need the rest */
+			et->peer_min = et->peer_max;
+		else
+			et->update_due = 0;
+		et->blk_update = 0;
+	}
+
+	/* the peer added them oldest first, and so do we */
+
+	while (et->pending.tail) {
+		e = lws_container_of(et->pending.tail, lws_hpack_enc_entry_t,
+				     list);
+		lws_dll2_remove(&e->list);
+		lws_dll2_add_head(&e->list, &et->entries);
+		et->size += e->size;
+	}
+
+	et->max = et->blk_max;
+	while (et->size > et->max && et->entries.tail) {
+		e = lws_container_of(et->entries.tail, lws_hpack_enc_entry_t,
+				     list);
+		et->size -= e->size;
+		lws_hpack_enc_free_entry(&e->list, NULL);
+	}
+
+	et->blk_cont = !end_headers;
+	if (end_headers)
+		et->blk_wsi = NULL;
+}
+
+int
+lws_h2_get_hpack_tx_stats(struct lws *wsi, uint64_t *raw, uint64_t *wire)
+{
+	struct hpack_enc_table *et = lws_hpack_enc_table(wsi);
+
+	if (!et)
+		return 1;
+
+	*raw = et->raw;
+	*wire = et->wire;
+
+	return 0;
+}
+
+/*
+ * Find the dynamic table index of an entry matching name and value, if any,
+ * else zero; *name_idx is set to the index of an entry matching just the name,
+ * or zero.  Entries on .pending are newer than .entries at the peer.
+ */
+
+static int
+lws_hpack_enc_find_dyn(struct hpack_enc_table *et, const uint8_t *name,
+		       int len, const uint8_t *value, int vlen, int *name_idx)
+{
+	lws_dll2_owner_t *owners[] = { &et->pending, &et->entries };
+	uint32_t acc = 0;
+	int n, idx = 62;
+
+	*name_idx = 0;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(owners); n++) {
+		lws_start_foreach_dll(struct lws_dll2 *, d,
+				      owners[n]->head) {
+			lws_hpack_enc_entry_t *e = lws_container_of(d,
+						lws_hpack_enc_entry_t, list);
+			const uint8_t *en = (const uint8_t *)&e[1];
+
+			acc += e->size;
+			if (acc > et->blk_max)
+				/* the peer will have evicted it */
+				return 0;
+
+			if (e->name_len == len && !memcmp(en, name,
+							  (unsigned int)len)) {
+				if (!*name_idx)
+					*name_idx = idx;
+				if (value && e->value_len == vlen &&
+				    !memcmp(en + len, value, (unsigned int)vlen))
+					return idx;
+			}
+			idx++;
+		} lws_end_foreach_dll(d);
+	}
+
+	return 0;
+}
+
+static int
+lws_hpack_enc_find_static(const uint8_t *name, int len, const uint8_t *value,
+			  int vlen, int *name_idx)
+{
+	const unsigned char *sn;
+	int n;
+
+	*name_idx = 0;
+
+	for (n = 1; n < (int)LWS_ARRAY_SIZE(static_hdr_len); n++) {
+		if (static_hdr_len[n] != len)
+			continue;
+		sn = lws_token_to_string((enum lws_token_indexes)
+							static_token[n]);
+		if (!sn || memcmp(sn, name, (unsigned int)len))
+			continue;
+
+		if (!*name_idx)
+			*name_idx = n;
+
+		if (value && n < (int)LWS_ARRAY_SIZE(http2_canned) &&
+		    http2_canned[n][0] &&
+		    (int)strlen(http2_canned[n]) == vlen &&
+		    !memcmp(http2_canned[n], value, (unsigned int)vlen))
+			return n;
+	}
+
+	return 0;
+}
+
+static int
+lws_hpack_enc_int(uint8_t flags, int starting_bits, unsigned long num,
+		  unsigned char **p, unsigned char *end)
+{
+	if (*p >= end)
+		return 1;
+
+	*((*p)++) = (uint8_t)(flags | lws_h2_num_start(starting_bits, num));
+
+	return lws_h2_num(starting_bits, num, p, end);
+}
+
+/*
+ * If s is NULL, len bytes are reserved for the caller to fill in later
+ */
+
+static int
+lws_hpack_enc_string(const uint8_t *s, int len, unsigned char **p,
+		     unsigned char *end)
+{
+	unsigned int bits = 0, nb = 0;
+	uint64_t acc = 0;
+	int n, hlen;
+
+	if (s)
+		for (n = 0; n < len; n++)
+			bits += huftable_enc_len[s[n]];
+
+	hlen = (int)((bits + 7) >> 3);
+
+	if (!s || hlen >= len) {
+		if (lws_hpack_enc_int(0, 7, (unsigned long)len, p, end) ||
+		    lws_ptr_diff(end, *p) < len)
+			return 1;
+		if (s)
+			memcpy(*p, s, (unsigned int)len);
+		*p += len;
+
+		return 0;
+	}
+
+	if (lws_hpack_enc_int(0x80, 7, (unsigned long)hlen, p, end) ||
+	    lws_ptr_diff(end, *p) < hlen)
+		return 1;
+
+	for (n = 0; n < len; n++) {
+		acc = (acc << huftable_enc_len[s[n]]) | huftable_enc_code[s[n]];
+		nb += huftable_enc_len[s[n]];
+		while (nb >= 8) {
+			nb -= 8;
+			*((*p)++) = (uint8_t)(acc >> nb);
+		}
+	}
+
+	if (nb) /* pad with the msbs of EOS */
+		*((*p)++) = (uint8_t)((acc << (8 - nb)) | (0xffu >> nb));
+
+	return 0;
+}
+
+/*
+ * Called when adding a header, to see if it's the first header of a new block
+ * and if so, issue any dynamic table size update we owe the peer
+ */
+
+static int
+lws_hpack_enc_block(struct hpack_enc_table *et, struct lws *wsi,
+		    unsigned char **p, unsigned char *end)
+{
+	uint32_t target;
+
+	if (et->blk_wsi == wsi && (et->blk_p == *p || et->blk_cont)) {
+		et->blk_cont = 0;
+		return 0;
+	}
+
+	/* anything pending is from a block that was never sent */
+
+	lws_dll2_foreach_safe(&et->pending, NULL, lws_hpack_enc_free_entry);
+
+	et->blk_wsi = wsi;
+	et->blk_cont = 0;
+	et->blk_update = 0;
+	et->blk_max = et->max;
+
+	if (!et->update_due)
+		return 0;
+
+	/*
+	 * If the peer reduced the size and increased it again since the last
+	 * block, we must tell it about the low point first
+	 */
+
+	target = et->peer_max;
+	if (target > LWS_HPACK_ENC_MAX_TABLE)
+		target = LWS_HPACK_ENC_MAX_TABLE;
+	if (et->peer_min < target)
+		target = et->peer_min;
+
+	if (lws_hpack_enc_int(0x20, 5, target, p, end))
+		return 1;
+
+	et->blk_max = target;
+	et->blk_update = 1;
+
+	return 0;
+}
+
 int lws_add_http2_header_by_name(struct lws *wsi, const unsigned char *name,
 				 const unsigned char *value, int length,
 				 unsigned char **p, unsigned char *end)
 {
-	int len;
+	int len, n, idx, name_idx, dyn_name_idx;
+	uint8_t lname[LWS_HPACK_ENC_MAX_NAME], *start;
+	struct hpack_enc_table *et;
+	lws_hpack_enc_entry_t *e;
+	uint8_t rep;
 
 #if defined(_DEBUG)
 	/* value does not have to be NUL-terminated... %.*s not available on
@@ -1424,25 +1793,124 @@ int lws_add_http2_header_by_name(struct lws *wsi, const unsigned char *name,
 	if (end - *p < len + length + 8)
 		return 1;
 
-	*((*p)++) = 0; /* literal hdr, literal name,  */
+	et = lws_hpack_enc_table(wsi);
+	if (!et) {
+		*((*p)++) = 0; /* literal hdr, literal name,  */
+
+		*((*p)++) = (uint8_t)(0 | (uint8_t)lws_h2_num_start(7, (unsigned long)len)); /* non-HUF */
+		if (lws_h2_num(7, (unsigned long)len, p, end))
+			return 1;
+
+		/* upper-case header names are verboten in h2, but OK on h1, so
+		 * they're not illegal per se.  Silently convert them for h2... */
+
+		while(len--)
+			*((*p)++) = (uint8_t)tolower((int)*name++);
+
+		*((*p)++) = (uint8_t)(0 | (uint8_t)lws_h2_num_start(7, (unsigned long)length)); /* non-HUF */
+		if (lws_h2_num(7, (unsigned long)length, p, end))
+			return 1;
+
+		if (value)
+			memcpy(*p, value, (unsigned int)length);
+		*p += length;
 
-	*((*p)++) = (uint8_t)(0 | (uint8_t)lws_h2_num_start(7, (unsigned long)len)); /* non-HUF */
-	if (lws_h2_num(7, (unsigned long)len, p, end))
+		return 0;
+	}
+
+	start = *p;
+	if (lws_hpack_enc_block(et, wsi, p, end))
 		return 1;
 
+	if (len > (int)sizeof(lname)) {
+		/*
+		 * Too long to look up or index, send it literal, but as part
+		 * of the block, so the next header doesn't start a new one
+		 */
+		if (lws_hpack_enc_int(0, 4, 0, p, end) ||
+		    lws_hpack_enc_int(0, 7, (unsigned long)len, p, end) ||
+		    lws_ptr_diff(end, *p) < len)
+			return 1;
+
+		for (n = 0; n < len; n++)
+			*((*p)++) = (uint8_t)tolower((int)name[n]);
+
+		if (lws_hpack_enc_string(value, length, p, end))
+			return 1;
+
+		goto done;
+	}
+
 	/* upper-case header names are verboten in h2, but OK on h1, so
 	 * they're not illegal per se.  Silently convert them for h2... */
 
-	while(len--)
-		*((*p)++) = (uint8_t)tolower((int)*name++);
+	for (n = 0; n < len; n++)
+		lname[n] = (uint8_t)tolower((int)name[n]);
+
+	idx = lws_hpack_enc_find_static(lname, len, value, length, &name_idx);
+	if (!idx) {
+		n = lws_hpack_enc_find_dyn(et, lname, len, value, length,
+					   &dyn_name_idx);
+		if (n)
+			idx = n;
+		else
+			if (!name_idx)
+				name_idx = dyn_name_idx;
+	}
+
+	if (idx) {
+		/* the whole thing is in a table */
+		if (lws_hpack_enc_int(0x80, 7, (unsigned long)idx, p, end))
+			return 1;
+
+		goto done;
+	}
+
+	if (lws_hpack_enc_in_list(enc_never_index,
+				  (int)LWS_ARRAY_SIZE(enc_never_index),
+				  lname, len))
+		rep = 0x10; /* literal, never indexed */
+	else
+		if (!value || (uint32_t)(len + length + 32) > et->blk_max / 2 ||
+		    lws_hpack_enc_in_list(enc_dont_index,
+					  (int)LWS_ARRAY_SIZE(enc_dont_index),
+					  lname, len))
+			rep = 0x00; /* literal, not indexed */
+		else
+			rep = 0x40; /* literal, add to dynamic table */
+
+	if (lws_hpack_enc_int(rep, rep == 0x40 ? 6 : 4,
+			      (unsigned long)name_idx, p, end))
+		return 1;
 
-	*((*p)++) = (uint8_t)(0 | (uint8_t)lws_h2_num_start(7, (unsigned long)length)); /* non-HUF */
-	if (lws_h2_num(7, (unsigned long)length, p, end))
+	if (!name_idx && lws_hpack_enc_string(lname, len, p, end))
 		return 1;
 
-	if (value)
-		memcpy(*p, value, (unsigned int)length);
-	*p += length;
+	if (lws_hpack_enc_string(value, length, p, end))
+		return 1;
+
+	if (rep == 0x40) {
+		e = lws_malloc(sizeof(*e) + (unsigned int)(len + length),
+			       __func__);
+		if (!e)
+			return 1;
+
+		memset(&e->list, 0, sizeof(e->list));
+		e->name_len = (uint16_t)len;
+		e->value_len = (uint16_t)length;
+		e->size = (uint32_t)(len + length + 32);
+		memcpy(&e[1], lname, (unsigned int)len);
+		memcpy((uint8_t *)&e[1] + len, value, (unsigned int)length);
+		lws_dll2_add_head(&e->list, &et->pending);
+	}
+
+done:
+	et->blk_p = *p;
+	et->wire += (uint64_t)lws_ptr_diff(*p, start);
+	/* what we used to send: literal, literal name, non-Huffman */
+	et->raw += (uint64_t)(len + length + 3) +
+		   (len >= 127) + (len >= 255) +
+		   (length >= 127) + (length >= 255);
 
 	return 0;
 }
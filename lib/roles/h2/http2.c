@@ -135,6 +135,9 @@ void lws_h2_init(struct lws *wsi)
 {
 	wsi->h2.h2n->our_set = wsi->a.vhost->h2.set;
 	wsi->h2.h2n->peer_set = lws_h2_defaults;
+	wsi->h2.h2n->rx_win = LWS_H2_RX_WIN_INITIAL;
+	if (wsi->h2.h2n->rx_win > wsi->a.vhost->h2.rx_win_max)
+		wsi->h2.h2n->rx_win = wsi->a.vhost->h2.rx_win_max;
 }
 
 void
@@ -201,13 +204,124 @@ lws_h2_get_peer_txcredit_estimate(struct lws *wsi)
 	return (int)wsi->txc.peer_tx_cr_est;
 }
 
+/*
+ * Once the peer has used half the stream's rx window, top its credit back up
+ * to the whole window
+ */
+
 static int
-lws_h2_update_peer_txcredit_thresh(struct lws *wsi, unsigned int sid, int threshold, int bump)
+lws_h2_replenish_peer_txcredit(struct lws *wsi, unsigned int sid)
 {
-	if (wsi->txc.peer_tx_cr_est > threshold)
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	int32_t win = (int32_t)nwsi->h2.h2n->rx_win;
+
+	if (wsi->txc.peer_tx_cr_est > win / 2)
 		return 0;
 
-	return lws_h2_update_peer_txcredit(wsi, sid, bump);
+	return lws_h2_update_peer_txcredit(wsi, sid,
+					   win - wsi->txc.peer_tx_cr_est);
+}
+
+/*
+ * Rx window autotuning, the way BDP estimation works for gRPC: while DATA is
+ * coming in we keep a PING in flight, and count what arrives until its ACK.
+ * That's what the link delivered in one rtt.  If it's close to the window,
+ * the window may be what limits us, so if the rate is also the best we've
+ * seen, we double the window to what we saw, up to the vhost ceiling.
+ */
+
+static const uint8_t lws_h2_bdp_payload[8] = "lws-bdp";
+
+static void
+lws_h2_bdp_rx(struct lws *nwsi, int n)
+{
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	struct lws_h2_protocol_send *pps;
+
+	if (n <= 0)
+		return;
+
+	h2n->bdp_bytes += (uint32_t)n;
+
+	if (h2n->bdp_ping || h2n->rx_win >= nwsi->a.vhost->h2.rx_win_max)
+		return;
+
+	pps = lws_h2_new_pps(LWS_H2_PPS_PING);
+	if (!pps)
+		return;
+
+	memcpy(pps->u.ping.ping_payload, lws_h2_bdp_payload, 8);
+	lws_pps_schedule(nwsi, pps);
+
+	h2n->bdp_ping = 1;
+	h2n->bdp_bytes = 0;
+	h2n->bdp_t0 = lws_now_usecs();
+}
+
+static void
+lws_h2_bdp_ack(struct lws *nwsi)
+{
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	lws_usec_t rtt = lws_now_usecs() - h2n->bdp_t0;
+	uint64_t rate, win;
+
+	h2n->bdp_ping = 0;
+	if (rtt < 1)
+		rtt = 1;
+
+	h2n->srtt = h2n->srtt ? ((h2n->srtt * 7) + rtt) / 8 : rtt;
+
+	rate = ((uint64_t)h2n->bdp_bytes * LWS_US_PER_SEC) / (uint64_t)rtt;
+	if (h2n->bdp_bytes < (h2n->rx_win / 3) * 2 || rate < h2n->bdp_rate_max)
+		return;
+
+	h2n->bdp_rate_max = rate;
+	win = (uint64_t)h2n->bdp_bytes * 2;
+	if (win > nwsi->a.vhost->h2.rx_win_max)
+		win = nwsi->a.vhost->h2.rx_win_max;
+	if (win <= h2n->rx_win)
+		return;
+
+	lwsl_info("%s: %s: rx window %u -> %u (%u in %dus)\n", __func__,
+		  lws_wsi_tag(nwsi), (unsigned int)h2n->rx_win,
+		  (unsigned int)win, (unsigned int)h2n->bdp_bytes, (int)rtt);
+
+	h2n->rx_win = (uint32_t)win;
+}
+
+/*
+ * The stream isn't consuming what it gets, so grant less from now on; the
+ * peer will have to wait on our WINDOW_UPDATEs instead of us buffering it
+ */
+
+static void
+lws_h2_rx_win_pressure(struct lws *nwsi)
+{
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+
+	if (h2n->rx_win <= LWS_H2_RX_WIN_MIN)
+		return;
+
+	h2n->rx_win /= 2;
+	if (h2n->rx_win < LWS_H2_RX_WIN_MIN)
+		h2n->rx_win = LWS_H2_RX_WIN_MIN;
+	/* let it grow again once the rate is back */
+	h2n->bdp_rate_max = 0;
+}
+
+int
+lws_h2_get_rx_window_stats(struct lws *wsi, uint32_t *window,
+			   lws_usec_t *srtt)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+
+	if (!nwsi || !nwsi->h2.h2n)
+		return 1;
+
+	*window = nwsi->h2.h2n->rx_win;
+	*srtt = nwsi->h2.h2n->srtt;
+
+	return 0;
 }
 
 /* cx + vh lock */
@@ -521,6 +635,8 @@ lws_h2_settings(struct lws *wsi, struct http2_settings *settings,
 
 		switch (a) {
 		case H2SET_HEADER_TABLE_SIZE:
+			if (nwsi->h2.h2n && settings == &nwsi->h2.h2n->peer_set)
+				lws_hpack_enc_peer_table_size(nwsi, b);
 			break;
 		case H2SET_ENABLE_PUSH:
 			if (b > 1) {
@@ -692,6 +808,8 @@ int lws_h2_frame_write(struct lws *wsi, int type, int flags,
 				 " but tx_cr only %d!\n", __func__,
 				 lws_wsi_tag(wsi), len, (int)wsi->txc.tx_cr);
 				lws_h2_tx_cr_consume(wsi, (int)len);
+		if (nwsi->h2.h2n)
+			nwsi->h2.h2n->tx_urgency[lws_h2_urgency(wsi)] += len;
 	}
 
 	n = lws_issue_raw(nwsi, &buf[-LWS_H2_FRAME_HEADER_LENGTH],
@@ -956,6 +1074,202 @@ bail:
 static int
 lws_h2_parse_end_of_frame(struct lws *wsi);
 
+/*
+ * RFC9218 priorities are a structured field dictionary (RFC8941).  We only
+ * want the "u" and "i" members, so we skip over everything else without
+ * looking at it too closely.
+ */
+
+static const char *
+lws_h2_sf_key(const char *s, const char *end)
+{
+	if (s == end || !((*s >= 'a' && *s <= 'z') || *s == '*'))
+		return NULL;
+
+	while (s < end && ((*s >= 'a' && *s <= 'z') ||
+			   (*s >= '0' && *s <= '9') ||
+			   *s == '_' || *s == '-' || *s == '.' || *s == '*'))
+		s++;
+
+	return s;
+}
+
+static const char *
+lws_h2_sf_skip_item(const char *s, const char *end)
+{
+	int depth = 0, quoted = 0;
+
+	while (s < end) {
+		if (quoted) {
+			if (*s == '\\' && s + 1 < end)
+				s++;
+			else if (*s == '"')
+				quoted = 0;
+		} else if (*s == '"')
+			quoted = 1;
+		else if (*s == '(')
+			depth++;
+		else if (*s == ')') {
+			if (depth)
+				depth--;
+		} else if (!depth && (*s == ',' || *s == ';' || *s == ' ' ||
+				      *s == '\t'))
+			break;
+		s++;
+	}
+
+	return s;
+}
+
+static const char *
+lws_h2_sf_ows(const char *s, const char *end)
+{
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+
+	return s;
+}
+
+int
+lws_h2_priority_parse(const char *s, size_t len, uint8_t *urgency,
+		      uint8_t *incremental)
+{
+	uint8_t u = LWS_H2_URGENCY_DEFAULT, inc = 0;
+	const char *end = s + len, *k, *ke, *v;
+	unsigned int n;
+
+	s = lws_h2_sf_ows(s, end);
+
+	while (s < end) {
+		k = s;
+		s = ke = lws_h2_sf_key(s, end);
+		if (!s)
+			return 1;
+
+		v = NULL;
+		if (s < end && *s == '=') {
+			v = ++s;
+			s = lws_h2_sf_skip_item(s, end);
+			if (s == v)
+				return 1;
+		}
+
+		if (ke - k == 1 && *k == 'u' && v && s - v <= 15) {
+			/* out of range or not an integer, ignore it */
+			for (n = 0; v < s && *v >= '0' && *v <= '9'; v++)
+				n = (n * 10) + (unsigned int)(*v - '0');
+			if (v == s && n < LWS_H2_URGENCY_LEVELS)
+				u = (uint8_t)n;
+		}
+
+		if (ke - k == 1 && *k == 'i') {
+			if (!v)
+				inc = 1;
+			else if (s - v == 2 && v[0] == '?' &&
+				 (v[1] == '0' || v[1] == '1'))
+				inc = v[1] == '1';
+		}
+
+		/* skip any parameters on the member */
+
+		while (s < end && *s == ';') {
+			s = lws_h2_sf_key(lws_h2_sf_ows(s + 1, end), end);
+			if (!s)
+				return 1;
+			if (s < end && *s == '=') {
+				v = ++s;
+				s = lws_h2_sf_skip_item(s, end);
+				if (s == v)
+					return 1;
+			}
+		}
+
+		s = lws_h2_sf_ows(s, end);
+		if (s == end)
+			break;
+		if (*s != ',')
+			return 1;
+		s = lws_h2_sf_ows(s + 1, end);
+		if (s == end)
+			/* trailing comma */
+			return 1;
+	}
+
+	*urgency = u;
+	*incremental = inc;
+
+	return 0;
+}
+
+/*
+ * A PRIORITY_UPDATE frame has been collected.  We don't keep them for streams
+ * that aren't open yet, the client can expect the priority header on the
+ * request to be used instead.
+ */
+
+static void
+lws_h2_priority_update(struct lws *wsi)
+{
+	struct lws_h2_netconn *h2n = wsi->h2.h2n;
+	uint32_t sid = h2n->hpack_e_dep & 0x7fffffff;
+	uint8_t u, inc;
+	struct lws *w;
+
+	h2n->prio_update = 0;
+
+	if (!sid) {
+		lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
+			      "PRIORITY_UPDATE for sid 0");
+		return;
+	}
+
+	if (h2n->prio_overflow ||
+	    lws_h2_priority_parse(h2n->prio_field, h2n->prio_len, &u, &inc))
+		/* we're allowed to ignore what we can't use */
+		return;
+
+	w = lws_wsi_mux_from_id(wsi, sid);
+	if (!w)
+		return;
+
+	lwsl_info("%s: sid %u: urgency %u, incremental %u\n", __func__,
+		  (unsigned int)sid, u, inc);
+
+	w->h2.urgency = u;
+	w->h2.incremental = inc;
+	w->h2.prio_set = 1;
+}
+
+int
+lws_h2_set_priority(struct lws *wsi, int urgency, int incremental)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+
+	if (!wsi->mux_substream || !nwsi || !nwsi->h2.h2n ||
+	    urgency < 0 || urgency >= LWS_H2_URGENCY_LEVELS)
+		return 1;
+
+	wsi->h2.urgency = (uint8_t)urgency;
+	wsi->h2.incremental = (uint8_t)!!incremental;
+	wsi->h2.prio_set = 1;
+
+	return 0;
+}
+
+int
+lws_h2_get_urgency_tx_stats(struct lws *wsi, uint64_t *counts)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+
+	if (!nwsi || !nwsi->h2.h2n)
+		return 1;
+
+	memcpy(counts, nwsi->h2.h2n->tx_urgency,
+	       sizeof(nwsi->h2.h2n->tx_urgency));
+
+	return 0;
+}
+
 /*
  * The frame header part has just completely arrived.
  * Perform actions for header completion.
@@ -1007,6 +1321,28 @@ lws_h2_parse_frame_header(struct lws *wsi)
 	if (h2n->we_told_goaway && h2n->sid > h2n->highest_sid)
 		h2n->type = LWS_H2_FRAME_TYPE_COUNT; /* ie, IGNORE */
 
+	if (h2n->type == LWS_H2_FRAME_TYPE_PRIORITY_UPDATE) {
+		/*
+		 * RFC9218: only clients send these, on sid 0, starting with the
+		 * 4-byte sid it's about.  We consume it like an unknown frame
+		 * but collect it on the way.
+		 */
+		if (h2n->sid || lwsi_role_client(wsi)) {
+			lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
+				      "Bad PRIORITY_UPDATE");
+			return 0;
+		}
+		if (h2n->length < 4) {
+			lws_h2_goaway(wsi, H2_ERR_FRAME_SIZE_ERROR,
+				      "Short PRIORITY_UPDATE");
+			return 0;
+		}
+		h2n->prio_update = 1;
+		h2n->prio_overflow = 0;
+		h2n->prio_len = 0;
+		h2n->hpack_e_dep = 0;
+	}
+
 	if (h2n->type >= LWS_H2_FRAME_TYPE_COUNT) {
 		lwsl_info("%s: ignoring unknown frame type %d (len %d)\n", __func__, h2n->type, (unsigned int)h2n->length);
 		/* we MUST ignore frames we don't understand */
@@ -1676,6 +2012,23 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 		}
 #endif
 
+		if (!lwsi_role_client(h2n->swsi) && !h2n->swsi->h2.prio_set &&
+		    lws_hdr_extant(h2n->swsi, WSI_TOKEN_HTTP_PRIORITY)) {
+			char pri[LWS_H2_PRIORITY_FIELD_MAX];
+			uint8_t u, inc;
+			int pl;
+
+			/* if it doesn't make sense, the defaults apply */
+			pl = lws_hdr_copy(h2n->swsi, pri, sizeof(pri),
+					  WSI_TOKEN_HTTP_PRIORITY);
+			if (pl >= 0 && !lws_h2_priority_parse(pri, (size_t)pl,
+							      &u, &inc)) {
+				h2n->swsi->h2.urgency = u;
+				h2n->swsi->h2.incremental = inc;
+				h2n->swsi->h2.prio_set = 1;
+			}
+		}
+
 		if (lws_hdr_extant(h2n->swsi, WSI_TOKEN_HTTP_CONTENT_LENGTH)) {
 			const char *simp = lws_hdr_simple_ptr(h2n->swsi,
 					      WSI_TOKEN_HTTP_CONTENT_LENGTH);
@@ -1885,9 +2238,12 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 		break;
 
 	case LWS_H2_FRAME_TYPE_PING:
-		if (h2n->flags & LWS_H2_FLAG_SETTINGS_ACK)
+		if (h2n->flags & LWS_H2_FLAG_SETTINGS_ACK) {
+			if (h2n->bdp_ping &&
+			    !memcmp(h2n->ping_payload, lws_h2_bdp_payload, 8))
+				lws_h2_bdp_ack(wsi);
 			lws_validity_confirmed(wsi);
-		else {
+		} else {
 			/* they're sending us a ping request */
 			struct lws_h2_protocol_send *pps =
 					lws_h2_new_pps(LWS_H2_PPS_PONG);
@@ -1924,12 +2280,13 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 
 		if (eff_wsi->a.vhost->options &
 		        LWS_SERVER_OPTION_H2_JUST_FIX_WINDOW_UPDATE_OVERFLOW &&
-		    (uint64_t)eff_wsi->txc.tx_cr + (uint64_t)h2n->hpack_e_dep >
-		    (uint64_t)0x7fffffff)
+		    (int64_t)eff_wsi->txc.tx_cr + (int64_t)h2n->hpack_e_dep >
+		    (int64_t)0x7fffffff)
 			h2n->hpack_e_dep = (uint32_t)(0x7fffffff - eff_wsi->txc.tx_cr);
 
-		if ((uint64_t)eff_wsi->txc.tx_cr + (uint64_t)h2n->hpack_e_dep >
-		    (uint64_t)0x7fffffff) {
+		/* tx_cr may be negative if we overran it */
+		if ((int64_t)eff_wsi->txc.tx_cr + (int64_t)h2n->hpack_e_dep >
+		    (int64_t)0x7fffffff) {
 			lwsl_warn("%s: WINDOW_UPDATE 0x%llx + 0x%llx = 0x%llx, too high\n",
 					__func__, (unsigned long long)eff_wsi->txc.tx_cr,
 					(unsigned long long)h2n->hpack_e_dep,
@@ -1996,6 +2353,8 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 		break;
 
 	case LWS_H2_FRAME_TYPE_COUNT: /* IGNORING FRAME */
+		if (h2n->prio_update)
+			lws_h2_priority_update(wsi);
 		break;
 	}
 
@@ -2073,6 +2432,16 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t _inlen,
 
 			if (h2n->type == LWS_H2_FRAME_TYPE_COUNT) { /* IGNORING FRAME */
 				//lwsl_debug("%s: consuming for ignored %u %u\n", __func__, (unsigned int)h2n->count, (unsigned int)h2n->length);
+				if (!h2n->prio_update)
+					goto frame_end;
+
+				if (h2n->count <= 4) {
+					h2n->hpack_e_dep <<= 8;
+					h2n->hpack_e_dep |= c;
+				} else if (h2n->prio_len < sizeof(h2n->prio_field))
+					h2n->prio_field[h2n->prio_len++] = (char)c;
+				else
+					h2n->prio_overflow = 1;
 				goto frame_end;
 			}
 
@@ -2280,7 +2649,7 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t _inlen,
 				}
 #endif
 				if (lwsi_state(h2n->swsi) == LRS_DEFERRING_ACTION) {
-					m = lws_buflist_append_segment(
+					m = lws_wsi_buflist_append(h2n->swsi,
 						&h2n->swsi->buflist, in - 1, (unsigned int)n);
 					if (m < 0)
 						return -1;
@@ -2299,6 +2668,7 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t _inlen,
 					h2n->count += (unsigned int)n - 1;
 
 					lwsl_debug("%s: deferred %d\n", __func__, n);
+					lws_h2_rx_win_pressure(wsi);
 					goto do_windows;
 				}
 
@@ -2347,6 +2717,7 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t _inlen,
 				}
 
 do_windows:
+				lws_h2_bdp_rx(wsi, n);
 
 #if defined(LWS_WITH_CLIENT)
 				if (!(h2n->swsi->flags & LCCSCF_H2_MANUAL_RXFLOW))
@@ -2356,15 +2727,14 @@ do_windows:
 					 * The default behaviour is we just keep
 					 * cranking the other side's tx credit
 					 * back up, for simple bulk transfer as
-					 * fast as we can take it
+					 * fast as we can take it, within the
+					 * autotuned window
 					 */
 
-					m = n  + 65536;
-
 					/* update both the stream and nwsi */
 
-					lws_h2_update_peer_txcredit_thresh(h2n->swsi,
-								    h2n->sid, m, m);
+					lws_h2_replenish_peer_txcredit(h2n->swsi,
+								       h2n->sid);
 				}
 #if defined(LWS_WITH_CLIENT)
 				else {
@@ -2406,12 +2776,10 @@ do_windows:
 				break;
 
 			case LWS_H2_FRAME_TYPE_PING:
-				if (h2n->flags & LWS_H2_FLAG_SETTINGS_ACK) { // ack
-				} else { /* they're sending us a ping request */
-					if (h2n->count > 8)
-						return 1;
-					h2n->ping_payload[h2n->count - 1] = c;
-				}
+				/* a request, or the ack of one of ours */
+				if (h2n->count > 8)
+					return 1;
+				h2n->ping_payload[h2n->count - 1] = c;
 				break;
 
 			case LWS_H2_FRAME_TYPE_WINDOW_UPDATE:
@@ -2462,6 +2830,7 @@ try_frame_start:
 				case 0:
 					h2n->pad_length = 0;
 					h2n->collected_priority = 0;
+					h2n->prio_update = 0;
 					h2n->padding = 0;
 					h2n->preamble = 0;
 					h2n->length = c;
@@ -2682,12 +3051,14 @@ lws_h2_client_handshake(struct lws *wsi)
 	}
 
 	/*
-	 * Normally let's charge up the peer tx credit a bit.  But if
-	 * MANUAL_REFLOW is set, just set it to the initial credit given in
-	 * the client create info
+	 * Normally let's charge up the peer tx credit to the current rx
+	 * window.  But if MANUAL_REFLOW is set, just set it to the initial
+	 * credit given in the client create info
 	 */
 
-	n = 4 * 65536;
+	n = (int)nwsi->h2.h2n->rx_win - wsi->txc.peer_tx_cr_est;
+	if (n < 0)
+		n = 0;
 	if (wsi->flags & LCCSCF_H2_MANUAL_RXFLOW) {
 		n = wsi->txc.manual_initial_tx_credit;
 		wsi->txc.manual = 1;
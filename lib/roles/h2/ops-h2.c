@@ -331,7 +331,7 @@ drain:
 			/* cov: both n and ebuf.len are int */
 			if (n > 0 && n < ebuf.len && ebuf.len > 0) {
 				// lwsl_notice("%s: h2 append seg %d\n", __func__, ebuf.len - n);
-				m = lws_buflist_append_segment(&wsi->buflist,
+				m = lws_wsi_buflist_append(wsi, &wsi->buflist,
 						ebuf.token + n,
 						(unsigned int)(ebuf.len - n));
 				if (m < 0)
@@ -526,6 +526,11 @@ rops_write_role_protocol_h2(struct lws *wsi, unsigned char *buf, size_t len,
 		wsi->h2.send_END_STREAM = 1;
 	}
 
+	if (n == LWS_H2_FRAME_TYPE_HEADERS ||
+	    n == LWS_H2_FRAME_TYPE_CONTINUATION)
+		/* the peer will see any dynamic table changes in it now */
+		lws_hpack_enc_commit(wsi, !!(flags & LWS_H2_FLAG_END_HEADERS));
+
 	n = lws_h2_frame_write(wsi, n, flags, wsi->mux.my_sid, (unsigned int)len, buf);
 	if (n < 0)
 		return n;
@@ -587,6 +592,14 @@ rops_init_vhost_h2(struct lws_vhost *vh,
 			vh->h2.set.s[n] = info->http2_settings[n];
 	}
 
+	vh->h2.rx_win_max = info->h2_rx_window_max;
+	if (!vh->h2.rx_win_max)
+		vh->h2.rx_win_max = LWS_H2_RX_WIN_MAX_DEFAULT;
+	if (vh->h2.rx_win_max > 0x7fffffff)
+		vh->h2.rx_win_max = 0x7fffffff;
+	if (vh->h2.rx_win_max < LWS_H2_RX_WIN_MIN)
+		vh->h2.rx_win_max = LWS_H2_RX_WIN_MIN;
+
 	return 0;
 }
 
@@ -608,7 +621,7 @@ rops_pt_init_destroy_h2(struct lws_context *context,
 
 		pt->sul_ah_lifecheck.cb = lws_sul_http_ah_lifecheck;
 
-		__lws_sul_insert_us(&pt->pt_sul_owner[LWSSULLI_MISS_IF_SUSPENDED],
+		__lws_sul_insert_us(pt, LWSSULLI_MISS_IF_SUSPENDED,
 				 &pt->sul_ah_lifecheck, 30 * LWS_US_PER_SEC);
 	} else
 		lws_dll2_remove(&pt->sul_ah_lifecheck.list);
@@ -683,6 +696,7 @@ rops_destroy_role_h2(struct lws *wsi)
 
 	if (wsi->upgraded_to_http2 || wsi->mux_substream) {
 		lws_hpack_destroy_dynamic_header(wsi);
+		lws_hpack_enc_destroy(wsi);
 
 		if (wsi->h2.h2n)
 			lws_free_set_NULL(wsi->h2.h2n);
@@ -943,6 +957,40 @@ lws_h2_bind_for_post_before_action(struct lws *wsi)
  * notifications, so we can't hold pointers
  */
 
+/*
+ * RFC9218: of the children waiting for POLLOUT, the ones with the lowest
+ * urgency go first.  At the same urgency, streams the peer marked as not
+ * incremental go one at a time, lowest sid first, so each response arrives
+ * whole before the next one starts.  Incremental streams, and streams we got
+ * no priority for, take turns since each one we service moves to the tail.
+ *
+ * Returns the list link pointing to the chosen child, or NULL if none waiting.
+ */
+
+static struct lws **
+lws_h2_sched_next(struct lws *nwsi)
+{
+	struct lws **pw = &nwsi->mux.child_list, **best = NULL;
+	int bu = LWS_H2_URGENCY_LEVELS, bseq = 0, u, seq;
+
+	for (; *pw; pw = &(*pw)->mux.sibling_list) {
+		if (!(*pw)->mux.requested_POLLOUT)
+			continue;
+
+		u = lws_h2_urgency(*pw);
+		seq = (*pw)->h2.prio_set && !(*pw)->h2.incremental;
+
+		if (u < bu || (u == bu && seq &&
+			       (!bseq || (*pw)->mux.my_sid < (*best)->mux.my_sid))) {
+			best = pw;
+			bu = u;
+			bseq = seq;
+		}
+	}
+
+	return best;
+}
+
 static int
 rops_perform_user_POLLOUT_h2(struct lws *wsi)
 {
@@ -950,6 +998,7 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 #if defined(LWS_ROLE_WS)
 	int write_type = LWS_WRITE_PONG;
 #endif
+	unsigned int turns;
 	int n;
 
 	wsi = lws_get_network_wsi(wsi);
@@ -962,16 +1011,22 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 
 	lws_wsi_mux_dump_waiting_children(wsi);
 
-	wsi2 = &wsi->mux.child_list;
-	if (!*wsi2)
+	if (!wsi->mux.child_list)
 		return 0;
 
-	do {
-		struct lws *w, **wa;
+	/*
+	 * Keep servicing children while the connection can take more.  We
+	 * choose again for each turn, so the order follows anything that
+	 * changed meanwhile, eg, tx credit or a PRIORITY_UPDATE.  A child that
+	 * asked again after its turn may be chosen again, but we stop after as
+	 * many turns as there are children, so one asking without writing
+	 * can't keep us here.
+	 */
 
-		wa = &(*wsi2)->mux.sibling_list;
-		if (!(*wsi2)->mux.requested_POLLOUT)
-			goto next_child;
+	turns = wsi->mux.child_count ? wsi->mux.child_count : 1;
+
+	while ((wsi2 = lws_h2_sched_next(wsi))) {
+		struct lws *w;
 
 		/*
 		 * we're going to do writable callback for this child.
@@ -981,11 +1036,8 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 		lwsl_debug("servicing child %s\n", lws_wsi_tag(*wsi2));
 
 		w = lws_wsi_mux_move_child_to_tail(wsi2);
-
-		if (!w) {
-			wa = &wsi->mux.child_list;
+		if (!w)
 			goto next_child;
-		}
 
 		lwsl_info("%s: child %s, sid %d, (wsistate 0x%x)\n",
 			  __func__, lws_wsi_tag(w), w->mux.my_sid,
@@ -999,11 +1051,9 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 				lwsl_info("%s signalling to close\n", __func__);
 				lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 						   "h2 end stream 1");
-				wa = &wsi->mux.child_list;
 				goto next_child;
 			}
 			lws_callback_on_writable(w);
-			wa = &wsi->mux.child_list;
 			goto next_child;
 		}
 
@@ -1025,7 +1075,6 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 						   "comp write fail");
 			}
 			lws_callback_on_writable(w);
-			wa = &wsi->mux.child_list;
 			goto next_child;
 		}
 #endif
@@ -1036,7 +1085,6 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 			w->socket_is_permanently_unusable = 1;
 			lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 					   "h2 end stream 1");
-			wa = &wsi->mux.child_list;
 			goto next_child;
 		}
 
@@ -1053,7 +1101,6 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 			lws_free_set_NULL(w->h2.pending_status_body);
 			lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 					   "h2 end stream 1");
-			wa = &wsi->mux.child_list;
 			goto next_child;
 		}
 
@@ -1124,12 +1171,8 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 				lwsl_info("closing stream after h2 action\n");
 				lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 						   "h2 end stream");
-				wa = &wsi->mux.child_list;
 			}
 
-			if (n < 0)
-				wa = &wsi->mux.child_list;
-
 			goto next_child;
 		}
 
@@ -1139,7 +1182,6 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 
 			if (lws_wsi_txc_check_skint(&w->txc,
 						    lws_h2_tx_cr_get(w))) {
-				wa = &wsi->mux.child_list;
 				goto next_child;
 			}
 
@@ -1163,7 +1205,6 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 						lws_wsi_tag(w));
 				lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 						   "h2 end stream file");
-				wa = &wsi->mux.child_list;
 				goto next_child;
 			}
 			if (n > 0)
@@ -1226,7 +1267,6 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 				lwsi_set_state(w, LRS_RETURNED_CLOSE);
 				lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 						   "returned close packet");
-				wa = &wsi->mux.child_list;
 				goto next_child;
 			}
 
@@ -1266,20 +1306,29 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 				  w->h2.send_END_STREAM);
 			lws_close_free_wsi(w, LWS_CLOSE_STATUS_NOSTATUS,
 					   "h2 pollout handle");
-			wa = &wsi->mux.child_list;
 		} else
 			 if (w->h2.send_END_STREAM)
 				lws_h2_state(w, LWS_H2_STATE_HALF_CLOSED_LOCAL);
 
 next_child:
-		wsi2 = wa;
-	} while (wsi2 && *wsi2 && !lws_send_pipe_choked(wsi));
+		if (!--turns || lws_send_pipe_choked(wsi))
+			break;
+	}
 
 	// lws_wsi_mux_dump_waiting_children(wsi);
 
 	if (lws_wsi_mux_action_pending_writeable_reqs(wsi))
 		return -1;
 
+	/*
+	 * A child's DATA may have only partly gone out, even if nobody wants
+	 * to write any more now (eg, because they used up their tx credit)
+	 */
+
+	if (lws_has_buffered_out(wsi) &&
+	    lws_change_pollfd(wsi, 0, LWS_POLLOUT))
+		return -1;
+
 	return 0;
 }
 
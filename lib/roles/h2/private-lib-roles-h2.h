@@ -31,6 +31,7 @@ struct http2_settings {
 
 struct lws_vhost_role_h2 {
 	struct http2_settings set;
+	uint32_t rx_win_max; /* ceiling for rx window autotuning */
 };
 
 enum lws_h2_wellknown_frame_types {
@@ -48,6 +49,20 @@ enum lws_h2_wellknown_frame_types {
 	LWS_H2_FRAME_TYPE_COUNT /* always last */
 };
 
+/*
+ * The stream rx window we keep topping the peer's credit up to starts at
+ * LWS_H2_RX_WIN_INITIAL, grows with the bandwidth-delay product we measure
+ * up to the vhost ceiling, and halves down to LWS_H2_RX_WIN_MIN when the
+ * received data isn't being consumed.
+ */
+#define LWS_H2_RX_WIN_MIN		65535
+#define LWS_H2_RX_WIN_INITIAL		(2 * 65536)
+#define LWS_H2_RX_WIN_MAX_DEFAULT	(16 * 1024 * 1024)
+
+/* RFC9218 extensible priorities */
+#define LWS_H2_FRAME_TYPE_PRIORITY_UPDATE	0x10
+#define LWS_H2_PRIORITY_FIELD_MAX		64
+
 enum lws_h2_flags {
 	LWS_H2_FLAG_END_STREAM = 1,
 	LWS_H2_FLAG_END_HEADERS = 4,
@@ -194,6 +209,30 @@ struct hpack_dynamic_table {
 	uint16_t num_entries;
 };
 
+/*
+ * Our encoder's mirror of the peer's decoder dynamic table, so we can refer
+ * to headers we sent before by index.  Entries added by the header block that
+ * is being composed are kept on .pending until the block is written.
+ */
+
+struct hpack_enc_table {
+	lws_dll2_owner_t entries; /* the peer has these, newest first */
+	lws_dll2_owner_t pending; /* added by the block being composed */
+	struct lws *blk_wsi; /* stream composing a header block, or NULL */
+	uint8_t *blk_p; /* where the stream's next header should go */
+	uint64_t raw; /* header bytes if sent as plain literals */
+	uint64_t wire; /* header bytes actually sent */
+	uint32_t size; /* rfc7541 accounting size of .entries */
+	uint32_t max; /* our max size of .entries */
+	uint32_t blk_max; /* max size in effect for the current block */
+	uint32_t peer_max; /* peer SETTINGS_HEADER_TABLE_SIZE */
+	uint32_t peer_min; /* lowest peer_max since we last signalled */
+	uint8_t inited:1;
+	uint8_t update_due:1; /* must signal a size update in next block */
+	uint8_t blk_update:1; /* current block signalled a size update */
+	uint8_t blk_cont:1; /* current block continues after a NO_FIN write */
+};
+
 enum lws_h2_protocol_send_type {
 	LWS_PPS_NONE,
 	LWS_H2_PPS_MY_SETTINGS,
@@ -252,9 +291,15 @@ struct lws_h2_netconn {
 	struct http2_settings our_set;
 	struct http2_settings peer_set;
 	struct hpack_dynamic_table hpack_dyn_table;
+	struct hpack_enc_table hpack_enc_table;
 	uint8_t	ping_payload[8];
 	uint8_t one_setting[LWS_H2_SETTINGS_LEN];
 	char goaway_str[32]; /* for rx */
+	char prio_field[LWS_H2_PRIORITY_FIELD_MAX]; /* PRIORITY_UPDATE rx */
+	uint64_t tx_urgency[LWS_H2_URGENCY_LEVELS]; /* DATA bytes sent */
+	uint64_t bdp_rate_max; /* best delivery rate seen, bytes/s */
+	lws_usec_t bdp_t0; /* when the BDP PING was sent */
+	lws_usec_t srtt; /* smoothed rtt from BDP PINGs */
 	struct lws *swsi;
 	struct lws_h2_protocol_send *pps; /* linked list */
 
@@ -273,7 +318,12 @@ struct lws_h2_netconn {
 	unsigned int zero_huff_padding:1;
 	unsigned int last_action_dyntable_resize:1;
 	unsigned int sent_preface:1;
+	unsigned int prio_update:1;
+	unsigned int prio_overflow:1;
+	unsigned int bdp_ping:1;
 
+	uint32_t rx_win; /* stream rx window we replenish to */
+	uint32_t bdp_bytes; /* DATA rx since the BDP PING was sent */
 	uint32_t hdr_idx;
 	uint32_t hpack_len;
 	uint32_t hpack_e_dep;
@@ -301,6 +351,7 @@ struct lws_h2_netconn {
 	char first_hdr_char;
 	uint8_t hpack_m;
 	uint8_t ext_count;
+	uint8_t prio_len;
 };
 
 struct _lws_h2_related {
@@ -316,8 +367,16 @@ struct _lws_h2_related {
 	uint8_t			send_END_STREAM:1;
 	uint8_t			long_poll:1;
 	uint8_t			initialized:1;
+	uint8_t			prio_set:1;
+
+	uint8_t			urgency; /* RFC9218, if prio_set */
+	uint8_t			incremental;
 };
 
+/* the urgency a stream is scheduled at if nobody said otherwise */
+#define lws_h2_urgency(_w) ((_w)->h2.prio_set ? (_w)->h2.urgency : \
+					       LWS_H2_URGENCY_DEFAULT)
+
 #define HTTP2_IS_TOPLEVEL_WSI(wsi) (!wsi->mux.parent_wsi)
 
 int
@@ -355,11 +414,20 @@ lws_add_http2_header_status(struct lws *wsi,
 			    unsigned char *end);
 void
 lws_hpack_destroy_dynamic_header(struct lws *wsi);
+void
+lws_hpack_enc_destroy(struct lws *wsi);
+void
+lws_hpack_enc_commit(struct lws *wsi, int end_headers);
+void
+lws_hpack_enc_peer_table_size(struct lws *nwsi, uint32_t size);
 int
 lws_hpack_dynamic_size(struct lws *wsi, int size);
 int
 lws_h2_goaway(struct lws *wsi, uint32_t err, const char *reason);
 int
+lws_h2_priority_parse(const char *s, size_t len, uint8_t *urgency,
+		      uint8_t *incremental);
+int
 lws_h2_tx_cr_get(struct lws *wsi);
 void
 lws_h2_tx_cr_consume(struct lws *wsi, int consumed);
@@ -130,6 +130,9 @@ static const char * const set[] = {
 
 	"x-auth-token:",
 	"x-amzn-dss-signature:",
+#if defined(LWS_ROLE_H2) || defined(LWS_HTTP_HEADERS_ALL)
+	"priority:",		/* RFC9218 */
+#endif
 
 	"", /* not matchable */
 
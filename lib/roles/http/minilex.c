@@ -133,6 +133,8 @@ unsigned char filter_array[] = {
 	0xfa, /* replay-nonce */
 	0xf0, /* protocol */
 	0xff, /* x-auth-token */
+	0xff, /* x-amzn-dss-signature */
+	0xf0, /* priority */
 	0xff /* not matchable */
 };
 
@@ -0,0 +1,169 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * http/1 header value scanner used by lws_parse()
+ *
+ * Once lws_parse() is inside a header value that needs no per-character
+ * processing, everything up to the next CR, LF or NUL can be taken in one go.
+ * This finds where that is, 16 or 32 bytes at a time.
+ *
+ * On x86 SSE2 is used if the compiler is targeting it, and AVX2 if the cpu
+ * reports it at runtime; on ARM NEON is used if the compiler is targeting it.
+ * Otherwise it looks at 64-bit words.
+ */
+
+#include "private-lib-core.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define LWS_H1_SCAN_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LWS_H1_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(LWS_H1_SCAN_SSE2)
+
+__attribute__((target("avx2"))) static size_t
+lws_h1_scan_avx2(const uint8_t *p, size_t len)
+{
+	const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n'),
+		      z = _mm256_setzero_si256();
+	size_t done = 0;
+	__m256i v;
+	uint32_t m;
+
+	while (len - done >= 32) {
+		v = _mm256_loadu_si256((const __m256i *)(p + done));
+		m = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+						_mm256_cmpeq_epi8(v, lf)),
+				_mm256_cmpeq_epi8(v, z)));
+		if (m)
+			return done + (size_t)__builtin_ctz(m);
+		done += 32;
+	}
+
+	return done;
+}
+
+static size_t
+lws_h1_scan_sse2(const uint8_t *p, size_t len)
+{
+	const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n'),
+		      z = _mm_setzero_si128();
+	size_t done = 0;
+	unsigned int m;
+	__m128i v;
+
+	while (len - done >= 16) {
+		v = _mm_loadu_si128((const __m128i *)(p + done));
+		m = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+					     _mm_cmpeq_epi8(v, lf)),
+				_mm_cmpeq_epi8(v, z)));
+		if (m)
+			return done + (size_t)__builtin_ctz(m);
+		done += 16;
+	}
+
+	return done;
+}
+
+#endif
+
+#if defined(LWS_H1_SCAN_NEON)
+
+/* stops at the start of the first 16-byte block with a match in it */
+
+static size_t
+lws_h1_scan_neon(const uint8_t *p, size_t len)
+{
+	const uint8x16_t cr = vdupq_n_u8('\r'), lf = vdupq_n_u8('\n'),
+			 z = vdupq_n_u8(0);
+	size_t done = 0;
+	uint64x2_t m64;
+	uint8x16_t v, m;
+
+	while (len - done >= 16) {
+		v = vld1q_u8(p + done);
+		m = vorrq_u8(vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf)),
+			     vceqq_u8(v, z));
+		m64 = vreinterpretq_u64_u8(m);
+		if (vgetq_lane_u64(m64, 0) | vgetq_lane_u64(m64, 1))
+			break;
+		done += 16;
+	}
+
+	return done;
+}
+
+#endif
+
+#define LWS_H1_SCAN_ONES	0x0101010101010101ull
+#define LWS_H1_SCAN_HIGHS	0x8080808080808080ull
+#define lws_h1_scan_haszero(_w) \
+		(((_w) - LWS_H1_SCAN_ONES) & ~(_w) & LWS_H1_SCAN_HIGHS)
+
+size_t
+lws_h1_scan_eol(const uint8_t *p, size_t len)
+{
+	size_t done = 0;
+	uint64_t w;
+
+	if (len >= 16) {
+		/*
+		 * Each step leaves done at the match if it found one, so the
+		 * following ones stop there straight away
+		 */
+#if defined(LWS_H1_SCAN_SSE2)
+		if (len >= 32 && __builtin_cpu_supports("avx2"))
+			done = lws_h1_scan_avx2(p, len);
+		done += lws_h1_scan_sse2(p + done, len - done);
+#endif
+#if defined(LWS_H1_SCAN_NEON)
+		done = lws_h1_scan_neon(p, len);
+#endif
+
+		/* 8 at a time until a word has one in it */
+
+		while (len - done >= 8) {
+			memcpy(&w, p + done, sizeof(w));
+			if (lws_h1_scan_haszero(w) ||
+			    lws_h1_scan_haszero(w ^ ('\r' * LWS_H1_SCAN_ONES)) ||
+			    lws_h1_scan_haszero(w ^ ('\n' * LWS_H1_SCAN_ONES)))
+				break;
+			done += 8;
+		}
+	}
+
+	/* find it in the last word, or the tail */
+
+	while (done < len && p[done] != '\r' && p[done] != '\n' && p[done])
+		done++;
+
+	return done;
+}
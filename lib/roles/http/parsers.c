@@ -39,33 +39,124 @@ static const unsigned char lextable_h1[] = {
 
 #endif
 
+/*
+ * The ah pool is per service thread.  An ah holds the first
+ * http_header_data_inline bytes of header data in storage overallocated after
+ * the struct, and only takes a spill buffer of max_http_header_data if the
+ * headers need more than that.  Detached ahs and spill buffers are kept on
+ * spare lists, up to max_http_header_pool_spare of each, so bursts of
+ * connections reuse them instead of going back to the heap.
+ */
+
 static struct allocated_headers *
-_lws_create_ah(struct lws_context_per_thread *pt, ah_data_idx_t data_size)
+_lws_create_ah(struct lws_context_per_thread *pt)
 {
-	struct allocated_headers *ah = lws_zalloc(sizeof(*ah), "ah struct");
-
-	if (!ah)
-		return NULL;
-
-	ah->data = lws_malloc(data_size, "ah data");
-	if (!ah->data) {
-		lws_free(ah);
-
-		return NULL;
+	struct lws_context *context = pt->context;
+	struct allocated_headers *ah = pt->http.ah_spare_list;
+
+	if (ah) {
+		pt->http.ah_spare_list = ah->next;
+		pt->http.ah_spare_count--;
+		/* it must look the same as a new one to the parser */
+		memset(ah, 0, sizeof(*ah));
+		ah->data = (char *)&ah[1];
+		ah->data_length = (ah_data_idx_t)context->http_header_data_inline;
+#if defined(LWS_WITH_SYS_METRICS)
+		lws_metrics_hist_bump_priv(context->mth_ah, "reuse");
+#endif
+	} else {
+		ah = lws_zalloc(sizeof(*ah) + context->http_header_data_inline,
+				"ah struct");
+		if (!ah)
+			return NULL;
+
+		ah->data = (char *)&ah[1];
+		ah->data_length = (ah_data_idx_t)context->http_header_data_inline;
+#if defined(LWS_WITH_SYS_METRICS)
+		lws_metrics_hist_bump_priv(context->mth_ah, "alloc");
+#endif
 	}
+
 	ah->next = pt->http.ah_list;
 	pt->http.ah_list = ah;
-	ah->data_length = data_size;
 	pt->http.ah_pool_length++;
 
 	lwsl_info("%s: created ah %p (size %d): pool length %u\n", __func__,
-		    ah, (int)data_size, (unsigned int)pt->http.ah_pool_length);
+		    ah, (int)ah->data_length,
+		    (unsigned int)pt->http.ah_pool_length);
 
 	return ah;
 }
 
+/* go back to the inline storage, keeping the spill buffer if we can */
+
+static void
+_lws_ah_unspill(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	if (!ah->spilled)
+		return;
+
+	if (pt->http.ah_spill_spare_count <
+				pt->context->max_http_header_pool_spare) {
+		*(char **)ah->data = pt->http.ah_spill_spare_list;
+		pt->http.ah_spill_spare_list = ah->data;
+		pt->http.ah_spill_spare_count++;
+	} else
+		lws_free(ah->data);
+
+	ah->data = (char *)&ah[1];
+	ah->data_length = (ah_data_idx_t)pt->context->http_header_data_inline;
+	ah->spilled = 0;
+}
+
+/*
+ * Make room for need more bytes of header data at ah->pos, by moving to a
+ * spill buffer if the inline storage is too small.  The ah data may move, so
+ * nothing may hold a pointer into it across this.
+ */
+
 int
-_lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+_lws_header_table_spill(struct lws *wsi, size_t need)
+{
+	struct lws_context *context = wsi->a.context;
+	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
+	struct allocated_headers *ah = wsi->http.ah;
+	char *p;
+
+	if (ah->pos + need <= ah->data_length)
+		return 0;
+
+	if (ah->spilled || ah->pos + need > context->max_http_header_data)
+		return 1;
+
+	lws_pt_lock(pt, __func__);
+	p = pt->http.ah_spill_spare_list;
+	if (p) {
+		pt->http.ah_spill_spare_list = *(char **)p;
+		pt->http.ah_spill_spare_count--;
+	}
+	lws_pt_unlock(pt);
+
+	if (!p) {
+		p = lws_malloc(context->max_http_header_data, "ah spill");
+		if (!p)
+			return 1;
+	}
+
+	memcpy(p, ah->data, ah->pos);
+	ah->data = p;
+	ah->data_length = (ah_data_idx_t)context->max_http_header_data;
+	ah->spilled = 1;
+
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_metrics_hist_bump_priv(context->mth_ah, "spill");
+#endif
+
+	return 0;
+}
+
+static int
+_lws_remove_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 {
 	lws_start_foreach_llp(struct allocated_headers **, a, pt->http.ah_list) {
 		if ((*a) == ah) {
@@ -74,9 +165,6 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 			lwsl_info("%s: freed ah %p : pool length %u\n",
 				    __func__, ah,
 				    (unsigned int)pt->http.ah_pool_length);
-			if (ah->data)
-				lws_free(ah->data);
-			lws_free(ah);
 
 			return 0;
 		}
@@ -85,6 +173,65 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 	return 1;
 }
 
+int
+_lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	if (_lws_remove_ah(pt, ah))
+		return 1;
+
+	if (ah->spilled)
+		lws_free(ah->data);
+	lws_free(ah);
+
+	return 0;
+}
+
+/* the ah is no longer needed, keep it as a spare if we are short of them */
+
+static void
+_lws_retire_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	if (_lws_remove_ah(pt, ah))
+		return;
+
+	_lws_ah_unspill(pt, ah);
+
+	if (pt->http.ah_spare_count >= pt->context->max_http_header_pool_spare) {
+		lws_free(ah);
+		return;
+	}
+
+	ah->wsi = NULL;
+	ah->in_use = 0;
+	ah->next = pt->http.ah_spare_list;
+	pt->http.ah_spare_list = ah;
+	pt->http.ah_spare_count++;
+}
+
+void
+_lws_header_table_pool_destroy(struct lws_context_per_thread *pt)
+{
+	struct allocated_headers *ah;
+	char *p;
+
+	while (pt->http.ah_list)
+		_lws_destroy_ah(pt, pt->http.ah_list);
+
+	while (pt->http.ah_spare_list) {
+		ah = pt->http.ah_spare_list;
+		pt->http.ah_spare_list = ah->next;
+		lws_free(ah);
+	}
+	pt->http.ah_spare_count = 0;
+
+	while (pt->http.ah_spill_spare_list) {
+		p = pt->http.ah_spill_spare_list;
+		pt->http.ah_spill_spare_list = *(char **)p;
+		lws_free(p);
+	}
+	pt->http.ah_spill_spare_count = 0;
+}
+
 void
 _lws_header_table_reset(struct allocated_headers *ah)
 {
@@ -100,6 +247,10 @@ _lws_header_table_reset(struct allocated_headers *ah)
 #if defined(LWS_WITH_CUSTOM_HEADERS)
 	ah->unk_ll_head = 0;
 	ah->unk_ll_tail = 0;
+	if (ah->unk_hash_count)
+		memset(ah->unk_hash, 0, sizeof(ah->unk_hash));
+	ah->unk_hash_count = 0;
+	ah->unk_hash_overflow = 0;
 #endif
 }
 
@@ -175,6 +326,11 @@ _lws_header_ensure_we_are_on_waiting_list(struct lws *wsi)
 	pt->http.ah_wait_list = wsi;
 	pt->http.ah_wait_list_length++;
 
+#if defined(LWS_WITH_SYS_METRICS)
+	wsi->http.ah_wait_since = lws_now_usecs();
+	lws_metrics_hist_bump_priv(wsi->a.context->mth_ah, "wait");
+#endif
+
 	/* we cannot accept input then */
 
 	_lws_change_pollfd(wsi, LWS_POLLIN, 0, &pa);
@@ -252,9 +408,15 @@ lws_header_table_attach(struct lws *wsi, int autoservice)
 		goto bail;
 	}
 
+#if defined(LWS_WITH_SYS_METRICS)
+	if (__lws_remove_from_ah_waiting_list(wsi))
+		lws_metric_event(context->mt_ah_wait, METRES_GO,
+			(u_mt_t)(lws_now_usecs() - wsi->http.ah_wait_since));
+#else
 	__lws_remove_from_ah_waiting_list(wsi);
+#endif
 
-	wsi->http.ah = _lws_create_ah(pt, context->max_http_header_data);
+	wsi->http.ah = _lws_create_ah(pt);
 	if (!wsi->http.ah) { /* we could not create an ah */
 		_lws_header_ensure_we_are_on_waiting_list(wsi);
 
@@ -264,6 +426,10 @@ lws_header_table_attach(struct lws *wsi, int autoservice)
 	wsi->http.ah->in_use = 1;
 	wsi->http.ah->wsi = wsi; /* mark our owner */
 	pt->http.ah_count_in_use++;
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_metric_event(context->mt_ah_use, METRES_GO,
+			 (u_mt_t)pt->http.ah_count_in_use);
+#endif
 
 #if defined(LWS_WITH_PEER_LIMITS) && (defined(LWS_ROLE_H1) || \
     defined(LWS_ROLE_H2))
@@ -383,6 +549,9 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 		  "%s (wsistate 0x%lx)\n", __func__, lws_wsi_tag(wsi),
 		  (unsigned long)wsi->wsistate);
 
+	/* the new owner starts out with the inline storage again */
+	_lws_ah_unspill(pt, ah);
+
 	wsi->http.ah = ah;
 	ah->wsi = wsi; /* new owner */
 
@@ -410,6 +579,10 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 	/* the guy who got one is out of the list */
 	wsi->http.ah_wait_list = NULL;
 	pt->http.ah_wait_list_length--;
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_metric_event(context->mt_ah_wait, METRES_GO,
+			 (u_mt_t)(lws_now_usecs() - wsi->http.ah_wait_since));
+#endif
 
 #if defined(LWS_WITH_CLIENT)
 	if (lwsi_role_client(wsi) && lwsi_state(wsi) == LRS_UNCONNECTED) {
@@ -436,7 +609,7 @@ bail:
 
 nobody_usable_waiting:
 	lwsl_info("%s: nobody usable waiting\n", __func__);
-	_lws_destroy_ah(pt, ah);
+	_lws_retire_ah(pt, ah);
 	pt->http.ah_count_in_use--;
 
 	goto bail;
@@ -594,6 +767,119 @@ int lws_hdr_copy(struct lws *wsi, char *dst, int len,
 }
 
 #if defined(LWS_WITH_CUSTOM_HEADERS)
+
+/*
+ * Custom header names are stored lowercased, so we hash and compare the name
+ * we are asked for lowercased too
+ */
+
+#define lws_hdr_custom_lc(_c) ((_c) >= 'A' && (_c) <= 'Z' ? \
+				(char)((_c) + 'a' - 'A') : (_c))
+
+static uint32_t
+lws_hdr_custom_hash(const char *name, int nlen)
+{
+	uint32_t h = 0x811c9dc5u;
+
+	while (nlen--) {
+		h = (h ^ (uint8_t)lws_hdr_custom_lc(*name)) * 0x01000193u;
+		name++;
+	}
+
+	/*
+	 * The low bits of FNV-1a only see the low bits of each char, but we
+	 * only use the low bits... fold the high ones in
+	 */
+
+	return h ^ (h >> 16);
+}
+
+static int
+lws_hdr_custom_name_eq(struct allocated_headers *ah, ah_data_idx_t ll,
+		       const char *name, int nlen)
+{
+	const char *p = &ah->data[ll + UHO_NAME];
+
+	if (nlen != lws_ser_ru16be((uint8_t *)&ah->data[ll + UHO_NLEN]))
+		return 0;
+
+	while (nlen--) {
+		if (*p++ != lws_hdr_custom_lc(*name))
+			return 0;
+		name++;
+	}
+
+	return 1;
+}
+
+/*
+ * Called by the parser when the unknown header ll entry at ll has its name
+ * complete.  If the name is already in there, the earlier one is what a
+ * lookup finds, the same as walking the ll.
+ */
+
+static void
+lws_hdr_custom_index(struct allocated_headers *ah, ah_data_idx_t ll)
+{
+	int nlen = lws_ser_ru16be((uint8_t *)&ah->data[ll + UHO_NLEN]);
+	uint32_t h;
+
+	if (ah->unk_hash_overflow)
+		return;
+
+	h = lws_hdr_custom_hash(&ah->data[ll + UHO_NAME], nlen);
+	while (ah->unk_hash[h & (LWS_AH_UNK_HASH - 1)]) {
+		if (lws_hdr_custom_name_eq(ah,
+				ah->unk_hash[h & (LWS_AH_UNK_HASH - 1)],
+				&ah->data[ll + UHO_NAME], nlen))
+			return;
+		h++;
+	}
+
+	/* keep it no more than 3/4 full, so probes stay short */
+
+	if (ah->unk_hash_count == (LWS_AH_UNK_HASH * 3) / 4) {
+		ah->unk_hash_overflow = 1;
+		return;
+	}
+
+	ah->unk_hash[h & (LWS_AH_UNK_HASH - 1)] = ll;
+	ah->unk_hash_count++;
+}
+
+/* returns the ll offset of the first custom header called name, or 0 */
+
+static ah_data_idx_t
+lws_hdr_custom_find(struct allocated_headers *ah, const char *name, int nlen)
+{
+	ah_data_idx_t ll;
+	uint32_t h;
+
+	if (!ah->unk_hash_overflow) {
+		/* there's always an empty slot to stop at */
+		h = lws_hdr_custom_hash(name, nlen);
+		while ((ll = ah->unk_hash[h & (LWS_AH_UNK_HASH - 1)])) {
+			if (lws_hdr_custom_name_eq(ah, ll, name, nlen))
+				return ll;
+			h++;
+		}
+
+		return 0;
+	}
+
+	ll = ah->unk_ll_head;
+	while (ll) {
+		if (ll >= ah->data_length)
+			return 0;
+		if (lws_hdr_custom_name_eq(ah, ll, name, nlen))
+			return ll;
+
+		ll = lws_ser_ru32be((uint8_t *)&ah->data[ll + UHO_LL]);
+	}
+
+	return 0;
+}
+
 int
 lws_hdr_custom_length(struct lws *wsi, const char *name, int nlen)
 {
@@ -602,20 +888,11 @@ lws_hdr_custom_length(struct lws *wsi, const char *name, int nlen)
 	if (!wsi->http.ah || wsi->mux_substream)
 		return -1;
 
-	ll = wsi->http.ah->unk_ll_head;
-	while (ll) {
-		if (ll >= wsi->http.ah->data_length)
-			return -1;
-		if (nlen == lws_ser_ru16be(
-			(uint8_t *)&wsi->http.ah->data[ll + UHO_NLEN]) &&
-		    !strncmp(name, &wsi->http.ah->data[ll + UHO_NAME], (unsigned int)nlen))
-			return lws_ser_ru16be(
-				(uint8_t *)&wsi->http.ah->data[ll + UHO_VLEN]);
-
-		ll = lws_ser_ru32be((uint8_t *)&wsi->http.ah->data[ll + UHO_LL]);
-	}
+	ll = lws_hdr_custom_find(wsi->http.ah, name, nlen);
+	if (!ll)
+		return -1;
 
-	return -1;
+	return lws_ser_ru16be((uint8_t *)&wsi->http.ah->data[ll + UHO_VLEN]);
 }
 
 int
@@ -630,26 +907,55 @@ lws_hdr_custom_copy(struct lws *wsi, char *dst, int len, const char *name,
 
 	*dst = '\0';
 
-	ll = wsi->http.ah->unk_ll_head;
-	while (ll) {
-		if (ll >= wsi->http.ah->data_length)
+	ll = lws_hdr_custom_find(wsi->http.ah, name, nlen);
+	if (!ll)
+		return -1;
+
+	n = lws_ser_ru16be((uint8_t *)&wsi->http.ah->data[ll + UHO_VLEN]);
+	if (n + 1 > len)
+		return -1;
+	strncpy(dst, &wsi->http.ah->data[ll + UHO_NAME + (unsigned int)nlen],
+		(unsigned int)n);
+	dst[n] = '\0';
+
+	return n;
+}
+
+int
+lws_hdr_custom_copy_multi(struct lws *wsi, struct lws_hdr_custom_get *g,
+			  int count, char *buf, int len)
+{
+	struct allocated_headers *ah = wsi->http.ah;
+	int found = 0, n, m;
+	ah_data_idx_t ll;
+
+	if (!ah || wsi->mux_substream)
+		return -1;
+
+	for (m = 0; m < count; m++) {
+		g[m].value = NULL;
+		g[m].vlen = -1;
+
+		ll = lws_hdr_custom_find(ah, g[m].name, g[m].nlen);
+		if (!ll)
+			continue;
+
+		n = lws_ser_ru16be((uint8_t *)&ah->data[ll + UHO_VLEN]);
+		if (n + 1 > len)
 			return -1;
-		if (nlen == lws_ser_ru16be(
-			(uint8_t *)&wsi->http.ah->data[ll + UHO_NLEN]) &&
-		    !strncmp(name, &wsi->http.ah->data[ll + UHO_NAME], (unsigned int)nlen)) {
-			n = lws_ser_ru16be(
-				(uint8_t *)&wsi->http.ah->data[ll + UHO_VLEN]);
-			if (n + 1 > len)
-				return -1;
-			strncpy(dst, &wsi->http.ah->data[ll + UHO_NAME + (unsigned int)nlen], (unsigned int)n);
-			dst[n] = '\0';
 
-			return n;
-		}
-		ll = lws_ser_ru32be((uint8_t *)&wsi->http.ah->data[ll + UHO_LL]);
+		strncpy(buf, &ah->data[ll + UHO_NAME + (unsigned int)g[m].nlen],
+			(unsigned int)n);
+		buf[n] = '\0';
+
+		g[m].value = buf;
+		g[m].vlen = n;
+		buf += n + 1;
+		len -= n + 1;
+		found++;
 	}
 
-	return -1;
+	return found;
 }
 
 int
@@ -698,10 +1004,18 @@ lws_pos_in_bounds(struct lws *wsi)
 	if (!wsi->http.ah)
 		return -1;
 
-	if (wsi->http.ah->pos <
-	    (unsigned int)wsi->a.context->max_http_header_data)
+	if (wsi->http.ah->pos < wsi->http.ah->data_length)
 		return 0;
 
+	if (wsi->http.ah->pos <
+	    (unsigned int)wsi->a.context->max_http_header_data) {
+		if (!_lws_header_table_spill(wsi, 1))
+			return 0;
+
+		lwsl_err("Unable to spill header data\n");
+		return 1;
+	}
+
 	if ((int)wsi->http.ah->pos >= (int)wsi->a.context->max_http_header_data - 1) {
 		lwsl_err("Ran out of header data space\n");
 		return 1;
@@ -732,6 +1046,16 @@ lws_hdr_simple_create(struct lws *wsi, enum lws_token_indexes h, const char *s)
 		return 0;
 	}
 
+	/* s may point into the ah data, which moves if the ah has to spill */
+	if (s >= wsi->http.ah->data &&
+	    s < wsi->http.ah->data + wsi->http.ah->data_length) {
+		size_t off = lws_ptr_diff_size_t(s, wsi->http.ah->data);
+
+		if (_lws_header_table_spill(wsi, strlen(s) + 1))
+			return -1;
+		s = wsi->http.ah->data + off;
+	}
+
 	wsi->http.ah->nfrag++;
 	if (wsi->http.ah->nfrag == LWS_ARRAY_SIZE(wsi->http.ah->frags)) {
 		lwsl_warn("More hdr frags than we can deal with, dropping\n");
@@ -997,6 +1321,37 @@ excessive:
 	return LPUR_EXCESSIVE;
 }
 
+/*
+ * How much of buf can be copied straight into the current header value,
+ * without the per-character parsing changing anything: up to the next CR, LF
+ * or NUL, short of the point where ah->data, or the token limit and fragment
+ * length if they apply, would need checking
+ */
+
+static size_t
+lws_h1_scan_run(struct lws *wsi, const unsigned char *buf, int len, int frag)
+{
+	struct allocated_headers *ah = wsi->http.ah;
+	size_t n = lws_h1_scan_eol(buf, (size_t)len), lim;
+
+	/* if the ah is still inline, spilling is left to the per-char code */
+	lim = (size_t)ah->data_length;
+	lim = ah->pos + 1 < lim ? lim - ah->pos - 1 : 0;
+	if (n > lim)
+		n = lim;
+
+	if (!frag)
+		return n;
+
+	lim = ah->current_token_limit ? ah->current_token_limit : 0xffff;
+	if (lim > 0xfffe)
+		lim = 0xfffe;
+	lim = ah->frags[ah->nfrag].len < lim ?
+				lim - ah->frags[ah->nfrag].len : 0;
+
+	return n > lim ? lim : n;
+}
+
 static const unsigned char methods[] = {
 	WSI_TOKEN_GET_URI,
 	WSI_TOKEN_POST_URI,
@@ -1052,6 +1407,15 @@ lws_parse(struct lws *wsi, unsigned char *buf, int *len)
 					return LPR_FAIL;
 
 				ah->data[ah->pos++] = (char)c;
+
+				/* take the rest of the value in one go */
+
+				n = (unsigned int)lws_h1_scan_run(wsi, buf,
+								  *len, 0);
+				memcpy(&ah->data[ah->pos], buf, n);
+				ah->pos += n;
+				buf += n;
+				*len -= (int)n;
 			}
 			pos = ah->lextable_pos;
 			break;
@@ -1155,6 +1519,24 @@ check_eol:
 				if (!c && ah->parser_state != WSI_TOKEN_HTTP_URI_ARGS)
 					/* don't account for safety terminator */
 					wsi->http.ah->frags[wsi->http.ah->nfrag].len--;
+
+				/*
+				 * Outside the uri, the rest of the value up to
+				 * the EOL just gets copied in... take it in one
+				 * go, as far as the limits allow
+				 */
+				if (c && m == LWS_ARRAY_SIZE(methods) &&
+				    ah->parser_state != WSI_TOKEN_CHALLENGE &&
+				    ah->frags[ah->frag_index[ah->parser_state]].len) {
+					n = (unsigned int)lws_h1_scan_run(wsi,
+								buf, *len, 1);
+					memcpy(&ah->data[ah->pos], buf, n);
+					ah->pos += n;
+					ah->frags[ah->nfrag].len = (uint16_t)
+						(ah->frags[ah->nfrag].len + n);
+					buf += n;
+					*len -= (int)n;
+				}
 			}
 
 swallow:
@@ -1245,6 +1627,7 @@ swallow:
 
 				lws_ser_wu16be((uint8_t *)&ah->data[ah->unk_pos],
 					       (uint16_t)((ah->pos - ah->unk_pos) - UHO_NAME));
+				lws_hdr_custom_index(ah, ah->unk_pos);
 
 				ah->unk_value_pos = ah->pos;
 
@@ -1472,6 +1855,14 @@ excessive:
 		case WSI_TOKEN_SKIPPING:
 			lwsl_parser("WSI_TOKEN_SKIPPING '%c'\n", c);
 
+			if (c != '\x0a' && c != '\x0d') {
+				n = (unsigned int)lws_h1_scan_eol(buf,
+							(size_t)*len);
+				buf += n;
+				*len -= (int)n;
+				break;
+			}
+
 			if (c == '\x0a') {
 				/* broken peer */
 				ah->parser_state = WSI_TOKEN_NAME_PART;
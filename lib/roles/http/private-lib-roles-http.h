@@ -59,6 +59,11 @@ typedef uint16_t ah_data_idx_t;
 typedef uint32_t ah_data_idx_t;
 #endif
 
+#if defined(LWS_WITH_CUSTOM_HEADERS)
+/* slots in the per-ah custom header name index, must be a power of 2 */
+#define LWS_AH_UNK_HASH 32
+#endif
+
 struct lws_fragments {
 	ah_data_idx_t	offset;
 	uint16_t	len;
@@ -104,7 +109,7 @@ lws_ranges_reset(struct lws_range_parsing *rp);
 struct allocated_headers {
 	struct allocated_headers *next; /* linked list */
 	struct lws *wsi; /* owner */
-	char *data; /* prepared by context init to point to dedicated storage */
+	char *data; /* our inline storage, or a spill buffer if we needed more */
 	ah_data_idx_t data_length;
 	/*
 	 * the randomly ordered fragments, indexed by frag_index and
@@ -134,11 +139,21 @@ struct allocated_headers {
 
 	ah_data_idx_t unk_ll_head;
 	ah_data_idx_t unk_ll_tail;
+
+	/*
+	 * open-addressed index of the unknown header ll entries by name, 0 is
+	 * an empty slot.  If there are too many names for it, lookups go back
+	 * to walking the ll.
+	 */
+	ah_data_idx_t unk_hash[LWS_AH_UNK_HASH];
+	uint8_t unk_hash_count;
+	uint8_t unk_hash_overflow;
 #endif
 
 	int16_t lextable_pos;
 
 	uint8_t in_use;
+	uint8_t spilled; /* data is a spill buffer, not our inline storage */
 	uint8_t nfrag;
 	char /*enum uri_path_states */ ups;
 	char /*enum uri_esc_states */ ues;
@@ -146,6 +161,8 @@ struct allocated_headers {
 	char esc_stash;
 	char post_literal_equal;
 	uint8_t /* enum lws_token_indexes */ parser_state;
+
+	/* inline header data storage is overallocated after this */
 };
 
 
@@ -177,12 +194,16 @@ lws_rewrite_parse(struct lws_rewrite *r, const unsigned char *in, int in_len);
 
 struct lws_pt_role_http {
 	struct allocated_headers *ah_list;
+	struct allocated_headers *ah_spare_list; /* detached, kept for reuse */
+	char *ah_spill_spare_list; /* linked by a char * at the start of each */
 	struct lws *ah_wait_list;
 #ifdef LWS_WITH_CGI
 	struct lws_cgi *cgi_list;
 #endif
 	int ah_wait_list_length;
 	uint32_t ah_pool_length;
+	uint32_t ah_spare_count;
+	uint32_t ah_spill_spare_count;
 
 	int ah_count_in_use;
 };
@@ -197,6 +218,9 @@ struct lws_vhost_role_http {
 	char http_proxy_address[128];
 #endif
 	const struct lws_http_mount *mount_list;
+#if defined(LWS_WITH_SERVER)
+	struct lws_mount_trie *mount_trie;
+#endif
 	const char *error_document_404;
 #if defined(LWS_CLIENT_HTTP_PROXYING)
 	unsigned int http_proxy_port;
@@ -229,6 +253,9 @@ struct _lws_http_mode_related {
 #endif
 	struct allocated_headers *ah;
 	struct lws *ah_wait_list;
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_usec_t ah_wait_since;
+#endif
 
 	unsigned long		writeable_len;
 
@@ -281,6 +308,7 @@ struct _lws_http_mode_related {
 	unsigned int multipart:1;
 	unsigned int cgi_transaction_complete:1;
 	unsigned int multipart_issue_boundary:1;
+	unsigned int zero_copy:1;
 
 	char auth_username[64];
 	char auth_password[64];
@@ -328,6 +356,12 @@ _lws_header_table_reset(struct allocated_headers *ah);
 LWS_EXTERN int
 _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah);
 
+void
+_lws_header_table_pool_destroy(struct lws_context_per_thread *pt);
+
+int
+_lws_header_table_spill(struct lws *wsi, size_t need);
+
 int
 lws_http_proxy_start(struct lws *wsi, const struct lws_http_mount *hit,
 		     char *uri_ptr, char ws);
@@ -341,12 +375,23 @@ lws_http_multipart_headers(struct lws *wsi, uint8_t *p);
 int
 lws_http_string_to_known_header(const char *s, size_t slen);
 
+size_t
+lws_h1_scan_eol(const uint8_t *p, size_t len);
+
 int
 lws_http_date_render_from_unix(char *buf, size_t len, const time_t *t);
 
 int
 lws_http_date_parse_unix(const char *b, size_t len, time_t *t);
 
+#if defined(LWS_WITH_SERVER)
+int
+lws_vhost_mounts_compile(struct lws_vhost *vh);
+
+void
+lws_vhost_mounts_destroy(struct lws_vhost *vh);
+#endif
+
 enum {
 	CCTLS_RETURN_ERROR		= -1,
 	CCTLS_RETURN_DONE		= 0,
@@ -104,6 +104,7 @@ static const char * const paths_vhosts[] = {
 	"vhosts[].mounts[].headers[].*",
 	"vhosts[].mounts[].headers[]",
 	"vhosts[].mounts[].keepalive-timeout",
+	"vhosts[].mounts[].zero-copy",
 	"vhosts[].mounts[]",
 	"vhosts[].ws-protocols[].*.*",
 	"vhosts[].ws-protocols[].*",
@@ -183,6 +184,7 @@ enum lejp_vhost_paths {
 	LEJPVP_MOUNTPOINT_HEADERS_NAME,
 	LEJPVP_MOUNTPOINT_HEADERS,
 	LEJPVP_MOUNTPOINT_KEEPALIVE_TIMEOUT,
+	LEJPVP_MOUNTPOINT_ZERO_COPY,
 
 	LEJPVP_MOUNTS,
 
@@ -772,6 +774,9 @@ lejp_vhosts_cb(struct lejp_ctx *ctx, char reason)
 	case LEJPVP_MOUNTPOINT_KEEPALIVE_TIMEOUT:
 		a->m.keepalive_timeout = (unsigned int)atoi(ctx->buf);
 		return 0;
+	case LEJPVP_MOUNTPOINT_ZERO_COPY:
+		a->m.zero_copy = !!arg_to_bool(ctx->buf);
+		return 0;
 #if defined(LWS_WITH_TLS)
 #if defined(LWS_WITH_CLIENT)
 	case LEJPVP_CLIENT_CIPHERS:
@@ -0,0 +1,346 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Mount lookup
+ *
+ * When the vhost is created, or its mounts are changed, the mount list is
+ * compiled into a radix tree over the mountpoint strings.  Then finding every
+ * mount whose mountpoint is a prefix of the request uri is a single walk down
+ * the uri, instead of a strncmp() against every mount on every request.
+ *
+ * Which mount wins among the matching ones depends on the order they appear in
+ * the mount list, so the matches are put back into list order and judged
+ * exactly as when walking the list.
+ */
+
+#include "private-lib-core.h"
+
+/*
+ * If more mounts than this match one uri, we fall back to walking the list
+ */
+#define LWS_MOUNT_MAX_MATCHES 16
+
+struct lws_mount_ent {
+	const struct lws_http_mount	*m;
+	unsigned int			idx; /* position in the mount list */
+};
+
+struct lws_mount_node {
+	const char			*label; /* edge from parent */
+	unsigned int			first_child;
+	unsigned int			first_ent;
+	unsigned short			count_children;
+	unsigned short			count_ents;
+	unsigned char			label_len;
+};
+
+struct lws_mount_trie {
+	struct lws_mount_node		*nodes;
+	struct lws_mount_ent		*ents;
+	unsigned int			count_nodes;
+	/* nodes and ents follow */
+};
+
+static int
+lws_mount_ent_compare(const void *a, const void *b)
+{
+	const struct lws_mount_ent *e1 = (const struct lws_mount_ent *)a,
+				   *e2 = (const struct lws_mount_ent *)b;
+	int n = memcmp(e1->m->mountpoint, e2->m->mountpoint,
+		       e1->m->mountpoint_len < e2->m->mountpoint_len ?
+		       e1->m->mountpoint_len : e2->m->mountpoint_len);
+
+	if (n)
+		return n;
+
+	/* a shorter mountpoint sorts before one it is a prefix of */
+
+	if (e1->m->mountpoint_len != e2->m->mountpoint_len)
+		return e1->m->mountpoint_len < e2->m->mountpoint_len ? -1 : 1;
+
+	/* same mountpoint, keep them in list order */
+
+	return e1->idx < e2->idx ? -1 : 1;
+}
+
+/*
+ * Fill in node ni, which covers the sorted ents lo .. hi - 1, all sharing the
+ * first depth chars of their mountpoint
+ */
+
+static void
+lws_mount_trie_fill(struct lws_mount_trie *t, unsigned int ni,
+		    unsigned int lo, unsigned int hi, unsigned int depth)
+{
+	struct lws_mount_node *node = &t->nodes[ni];
+	unsigned int n, e, c, d;
+
+	/* the mountpoints ending here sort first */
+
+	node->first_ent = lo;
+	while (lo < hi && t->ents[lo].m->mountpoint_len == depth)
+		lo++;
+	node->count_ents = (unsigned short)(lo - node->first_ent);
+
+	/* there's a child for each distinct next char, in sorted order */
+
+	c = 0;
+	for (n = lo; n < hi; n = e, c++)
+		for (e = n + 1; e < hi &&
+			t->ents[e].m->mountpoint[depth] ==
+			t->ents[n].m->mountpoint[depth]; e++)
+			;
+
+	node->first_child = t->count_nodes;
+	node->count_children = (unsigned short)c;
+	t->count_nodes += c;
+
+	for (n = lo, c = node->first_child; n < hi; n = e, c++) {
+		const char *mp = t->ents[n].m->mountpoint;
+
+		for (e = n + 1; e < hi &&
+			t->ents[e].m->mountpoint[depth] == mp[depth]; e++)
+			;
+
+		/*
+		 * Extend the edge while the whole group agrees, which is while
+		 * the first and last agree... the first is also the shortest
+		 * if any mountpoint ends before they disagree
+		 */
+
+		d = depth + 1;
+		while (d < t->ents[n].m->mountpoint_len &&
+		       d < t->ents[e - 1].m->mountpoint_len &&
+		       mp[d] == t->ents[e - 1].m->mountpoint[d])
+			d++;
+
+		t->nodes[c].label = mp + depth;
+		t->nodes[c].label_len = (unsigned char)(d - depth);
+
+		lws_mount_trie_fill(t, c, n, e, d);
+	}
+}
+
+void
+lws_vhost_mounts_destroy(struct lws_vhost *vh)
+{
+	lws_free_set_NULL(vh->http.mount_trie);
+}
+
+int
+lws_vhost_mounts_compile(struct lws_vhost *vh)
+{
+	const struct lws_http_mount *m;
+	struct lws_mount_trie *t;
+	unsigned int n = 0;
+
+	lws_vhost_mounts_destroy(vh);
+
+	for (m = vh->http.mount_list; m; m = m->mount_next) {
+		/*
+		 * A mountpoint_len past the end of the mountpoint string can
+		 * only match a uri with a NUL inside it... leave it to the
+		 * list walk
+		 */
+		if (!m->mountpoint ||
+		    memchr(m->mountpoint, '\0', m->mountpoint_len))
+			return 0;
+		n++;
+	}
+
+	if (!n)
+		return 0;
+
+	/* a radix tree needs at most two nodes per key, plus the root */
+
+	t = lws_zalloc(sizeof(*t) + ((2 * n) + 1) * sizeof(*t->nodes) +
+		       n * sizeof(*t->ents), __func__);
+	if (!t)
+		/* we can still walk the list */
+		return 1;
+
+	t->nodes = (struct lws_mount_node *)&t[1];
+	t->ents = (struct lws_mount_ent *)&t->nodes[(2 * n) + 1];
+
+	n = 0;
+	for (m = vh->http.mount_list; m; m = m->mount_next) {
+		t->ents[n].m = m;
+		t->ents[n].idx = n;
+		n++;
+	}
+
+	qsort(t->ents, n, sizeof(*t->ents), lws_mount_ent_compare);
+
+	t->count_nodes = 1;
+	lws_mount_trie_fill(t, 0, 0, n, 0);
+
+	lwsl_vhost_info(vh, "%u mounts, %u nodes", n, t->count_nodes);
+
+	vh->http.mount_trie = t;
+
+	return 0;
+}
+
+/*
+ * Collect the mounts matching the uri into ents[], in mount list order.
+ * Returns the count of matches, or -1 if there were too many to hold.
+ */
+
+static int
+lws_mount_trie_match(const struct lws_mount_trie *t, const char *uri,
+		     int uri_len, struct lws_mount_ent *ents)
+{
+	const struct lws_mount_node *node = &t->nodes[0], *ch;
+	unsigned int lo, hi, mid;
+	int pos = 0, count = 0, n, m;
+	unsigned char c;
+
+	while (1) {
+		if (node->count_ents &&
+		    (uri[pos] == '\0' || uri[pos] == '/' || pos == 1)) {
+			if (count + node->count_ents > LWS_MOUNT_MAX_MATCHES)
+				return -1;
+
+			for (n = 0; n < node->count_ents; n++) {
+				const struct lws_mount_ent *e =
+						&t->ents[node->first_ent +
+							 (unsigned int)n];
+
+				/* insert in list order */
+				m = count++;
+				while (m && ents[m - 1].idx > e->idx) {
+					ents[m] = ents[m - 1];
+					m--;
+				}
+				ents[m] = *e;
+			}
+		}
+
+		if (pos >= uri_len || !node->count_children)
+			break;
+
+		/* the children are sorted by the first char of their label */
+
+		c = (unsigned char)uri[pos];
+		ch = NULL;
+		lo = node->first_child;
+		hi = lo + node->count_children;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if ((unsigned char)t->nodes[mid].label[0] == c) {
+				ch = &t->nodes[mid];
+				break;
+			}
+			if ((unsigned char)t->nodes[mid].label[0] < c)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (!ch || uri_len - pos < ch->label_len ||
+		    memcmp(uri + pos, ch->label, ch->label_len))
+			break;
+
+		pos += ch->label_len;
+		node = ch;
+	}
+
+	return count;
+}
+
+/*
+ * Returns nonzero if the mount stops the search with no mount, otherwise
+ * updates the hit if this mount is better
+ */
+
+static int
+lws_mount_consider(struct lws *wsi, const struct lws_http_mount *hm,
+		   const struct lws_http_mount **hit, int *best)
+{
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_metrics_tag_wsi_add(wsi, "mnt", hm->mountpoint);
+#endif
+
+	if (hm->origin_protocol == LWSMPRO_NO_MOUNT)
+		return 1;
+
+	if (hm->origin_protocol == LWSMPRO_CALLBACK ||
+	    ((hm->origin_protocol == LWSMPRO_CGI ||
+	     lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI) ||
+	     lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI) ||
+#if defined(LWS_WITH_HTTP_UNCOMMON_HEADERS)
+	     lws_hdr_total_length(wsi, WSI_TOKEN_PUT_URI) ||
+	     lws_hdr_total_length(wsi, WSI_TOKEN_PATCH_URI) ||
+	     lws_hdr_total_length(wsi, WSI_TOKEN_DELETE_URI) ||
+#endif
+	     lws_hdr_total_length(wsi, WSI_TOKEN_HEAD_URI) ||
+#if defined(LWS_ROLE_H2)
+	     (wsi->mux_substream &&
+		lws_hdr_total_length(wsi,
+				WSI_TOKEN_HTTP_COLON_PATH)) ||
+#endif
+	     hm->protocol) &&
+	    hm->mountpoint_len > *best)) {
+		*best = hm->mountpoint_len;
+		*hit = hm;
+	}
+
+	return 0;
+}
+
+const struct lws_http_mount *
+lws_find_mount(struct lws *wsi, const char *uri_ptr, int uri_len)
+{
+	const struct lws_mount_trie *t = wsi->a.vhost->http.mount_trie;
+	struct lws_mount_ent ents[LWS_MOUNT_MAX_MATCHES];
+	const struct lws_http_mount *hm, *hit = NULL;
+	int best = 0, n, m = -1;
+
+	if (t)
+		m = lws_mount_trie_match(t, uri_ptr, uri_len, ents);
+
+	if (m >= 0) {
+		for (n = 0; n < m; n++)
+			if (lws_mount_consider(wsi, ents[n].m, &hit, &best))
+				return NULL;
+
+		return hit;
+	}
+
+	/* no tree, or too many matches for it... walk the list */
+
+	hm = wsi->a.vhost->http.mount_list;
+	while (hm) {
+		if (uri_len >= hm->mountpoint_len &&
+		    !strncmp(uri_ptr, hm->mountpoint, hm->mountpoint_len) &&
+		    (uri_ptr[hm->mountpoint_len] == '\0' ||
+		     uri_ptr[hm->mountpoint_len] == '/' ||
+		     hm->mountpoint_len == 1) &&
+		    lws_mount_consider(wsi, hm, &hit, &best))
+			return NULL;
+
+		hm = hm->mount_next;
+	}
+
+	return hit;
+}
@@ -24,6 +24,14 @@
 
 #include "private-lib-core.h"
 
+#if defined(LWS_HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
 #if !defined(SOL_TCP) && defined(IPPROTO_TCP)
 #define SOL_TCP IPPROTO_TCP
 #endif
@@ -81,6 +89,35 @@ check_extant(struct lws_dll2 *d, void *user)
 	return 1;
 }
 
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+/*
+ * The kernel picks the socket in the SO_REUSEPORT group with the index the
+ * program returns.  Our listen sockets joined the group in tsi order, so
+ * returning the cpu the connection is being handled on, mod the number of
+ * threads, steers it to the matching service thread.
+ */
+
+static void
+lws_listen_steer_by_cpu(lws_sockfd_type fd, int count)
+{
+	struct sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0,
+				(uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)count },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog;
+
+	prog.len = (unsigned short)LWS_ARRAY_SIZE(code);
+	prog.filter = code;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       (const void *)&prog, sizeof(prog)) < 0)
+		lwsl_warn("%s: attaching steering failed, errno %d\n",
+			  __func__, LWS_ERRNO);
+}
+#endif
+
 /*
  * Creates a single listen socket of a specific AF
  */
@@ -209,6 +246,10 @@ done_list:
 		limit = cx->count_threads;
 #endif
 
+	if (limit > 1 && lws_check_opt(a->vhost->options,
+				       LWS_SERVER_OPTION_LISTEN_PER_THREAD))
+		a->vhost->listen_per_thread = 1;
+
 	for (m = 0; m < limit; m++) {
 
 		if (a->info && a->info->vh_listen_sockfd)
@@ -408,6 +449,14 @@ done_list:
 			goto bail;
 		}
 
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+		if (!m && a->vhost->listen_per_thread &&
+		    (!a->info || !a->info->vh_listen_sockfd) &&
+		    lws_check_opt(a->vhost->options,
+				  LWS_SERVER_OPTION_LISTEN_CPU_STEERING))
+			lws_listen_steer_by_cpu(wsi->desc.sockfd, limit);
+#endif
+
 		if (wsi) {
 			if (a->info && a->info->vh_listen_sockfd)
 				a->vhost->listen_port = a->info->port;
@@ -551,7 +600,7 @@ single:
 struct lws_vhost *
 lws_select_vhost(struct lws_context *context, int port, const char *servername)
 {
-	struct lws_vhost *vhost = context->vhost_list;
+	struct lws_vhost *vhost, *v;
 	const char *p;
 	int n, colon;
 
@@ -561,53 +610,69 @@ lws_select_vhost(struct lws_context *context, int port, const char *servername)
 	if (p)
 		colon = lws_ptr_diff(p, servername);
 
+	/*
+	 * Another thread creating a vhost may grow the hash table and free the
+	 * old one, so we must hold the context lock while we look in it
+	 */
+
+	lws_context_lock(context, __func__); /* ------------------- context { */
+
 	/* Priotity 1: first try exact matches */
 
-	while (vhost) {
-		if (port == vhost->listen_port &&
-		    !strncmp(vhost->name, servername, (unsigned int)colon)) {
-			lwsl_info("SNI: Found: %s\n", servername);
-			return vhost;
-		}
-		vhost = vhost->vhost_next;
+	vhost = __lws_vhost_hash_find(context, servername, (size_t)colon, port);
+	if (vhost) {
+		lwsl_info("SNI: Found: %s\n", servername);
+		goto bail;
 	}
 
+	if (!port)
+		goto bail;
+
 	/*
 	 * Priority 2: if no exact matches, try matching *.vhost-name
 	 * unintentional matches are possible but resolve to x.com for *.x.com
 	 * which is reasonable.  If exact match exists we already chose it and
 	 * never reach here.  SSL will still fail it if the cert doesn't allow
 	 * *.x.com.
+	 *
+	 * Look up each suffix after a '.' in the servername, and take the
+	 * vhost that comes first in the list.
 	 */
-	vhost = context->vhost_list;
-	while (vhost) {
-		int m = (int)strlen(vhost->name);
-		if (port && port == vhost->listen_port &&
-		    m <= (colon - 2) &&
-		    servername[colon - m - 1] == '.' &&
-		    !strncmp(vhost->name, servername + colon - m, (unsigned int)m)) {
-			lwsl_info("SNI: Found %s on wildcard: %s\n",
-				    servername, vhost->name);
-			return vhost;
-		}
-		vhost = vhost->vhost_next;
+
+	for (n = 1; n < colon; n++) {
+		if (servername[n] != '.')
+			continue;
+
+		v = __lws_vhost_hash_find(context, servername + n + 1,
+					  (size_t)(colon - n - 1), port);
+		if (v && (!vhost || v->list_seq < vhost->list_seq))
+			vhost = v;
+	}
+
+	if (vhost) {
+		lwsl_info("SNI: Found %s on wildcard: %s\n",
+			    servername, vhost->name);
+		goto bail;
 	}
 
 	/* Priority 3: match the first vhost on our port */
 
 	vhost = context->vhost_list;
 	while (vhost) {
-		if (port && port == vhost->listen_port) {
+		if (port == vhost->listen_port) {
 			lwsl_info("%s: vhost match to %s based on port %d\n",
 					__func__, vhost->name, port);
-			return vhost;
+			break;
 		}
 		vhost = vhost->vhost_next;
 	}
 
-	/* no match */
+	/* vhost is NULL if no match */
 
-	return NULL;
+bail:
+	lws_context_unlock(context); /* ---------------------------- context } */
+
+	return vhost;
 }
 
 static const struct lws_mimetype {
@@ -985,56 +1050,6 @@ notfound:
 }
 #endif
 
-#if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
-const struct lws_http_mount *
-lws_find_mount(struct lws *wsi, const char *uri_ptr, int uri_len)
-{
-	const struct lws_http_mount *hm, *hit = NULL;
-	int best = 0;
-
-	hm = wsi->a.vhost->http.mount_list;
-	while (hm) {
-		if (uri_len >= hm->mountpoint_len &&
-		    !strncmp(uri_ptr, hm->mountpoint, hm->mountpoint_len) &&
-		    (uri_ptr[hm->mountpoint_len] == '\0' ||
-		     uri_ptr[hm->mountpoint_len] == '/' ||
-		     hm->mountpoint_len == 1)
-		    ) {
-#if defined(LWS_WITH_SYS_METRICS)
-			lws_metrics_tag_wsi_add(wsi, "mnt", hm->mountpoint);
-#endif
-
-			if (hm->origin_protocol == LWSMPRO_NO_MOUNT)
-				return NULL;
-
-			if (hm->origin_protocol == LWSMPRO_CALLBACK ||
-			    ((hm->origin_protocol == LWSMPRO_CGI ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI) ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI) ||
-#if defined(LWS_WITH_HTTP_UNCOMMON_HEADERS)
-			     lws_hdr_total_length(wsi, WSI_TOKEN_PUT_URI) ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_PATCH_URI) ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_DELETE_URI) ||
-#endif
-			     lws_hdr_total_length(wsi, WSI_TOKEN_HEAD_URI) ||
-#if defined(LWS_ROLE_H2)
-			     (wsi->mux_substream &&
-				lws_hdr_total_length(wsi,
-						WSI_TOKEN_HTTP_COLON_PATH)) ||
-#endif
-			     hm->protocol) &&
-			    hm->mountpoint_len > best)) {
-				best = hm->mountpoint_len;
-				hit = hm;
-			}
-		}
-		hm = hm->mount_next;
-	}
-
-	return hit;
-}
-#endif
-
 #if defined(LWS_WITH_HTTP_BASIC_AUTH) && !defined(LWS_PLAT_FREERTOS) && defined(LWS_WITH_FILE_OPS)
 static int
 lws_find_string_in_file(const char *filename, const char *string, int stringlen)
@@ -2012,6 +2027,7 @@ lws_http_action(struct lws *wsi)
 	wsi->cache_revalidate = hit->cache_revalidate;
 	wsi->cache_no = hit->cache_no;
 	wsi->cache_intermediaries = hit->cache_intermediaries;
+	wsi->http.zero_copy = hit->zero_copy;
 
 #if defined(LWS_WITH_FILE_OPS)
 	m = 1;
@@ -2715,6 +2731,7 @@ lws_http_transaction_completed(struct lws *wsi)
 	wsi->http.tx_content_remain = 0;
 	wsi->hdr_parsing_completed = 0;
 	wsi->sending_chunked = 0;
+	wsi->http.zero_copy = 0;
 #ifdef LWS_WITH_ACCESS_LOG
 	wsi->http.access_log.sent = 0;
 #endif
@@ -3108,6 +3125,86 @@ bail:
 
 #if defined(LWS_WITH_FILE_OPS)
 
+#if defined(LWS_HAVE_SENDFILE) && defined(LWS_ROLE_H1)
+/*
+ * If the mount allowed it, and the file is going out on an h1 connection
+ * unchanged, ie, no tls, chunking, compression, interpretation or multipart
+ * ranges, have the kernel copy it from the file fd to the socket directly.
+ *
+ * Returns 1 if the caller should use the read / lws_write() path instead, -1
+ * on fatal error, or 0 with *amount set to what was sent, which is 0 if the
+ * socket is choked.
+ */
+
+static int
+lws_http_file_sendfile(struct lws *wsi, lws_filepos_t len,
+		       lws_filepos_t *amount)
+{
+	lws_fop_fd_t fop_fd = wsi->http.fop_fd;
+	ssize_t n;
+
+	if (wsi->mux_substream || !lwsi_role_h1(wsi) || lws_is_ssl(wsi) ||
+	    wsi->sending_chunked || wsi->interpreting ||
+	    fop_fd->fops != &wsi->a.context->fops_platform
+#if defined(LWS_WITH_HTTP_STREAM_COMPRESSION)
+	    || wsi->http.lcs
+#endif
+#if defined(LWS_WITH_IO_URING)
+	    /* it would overtake what's queued to go out from the ring */
+	    || lws_io_uring_async(wsi)
+#endif
+#if defined(LWS_WITH_RANGES)
+	    || wsi->http.range.count_ranges > 1
+#endif
+	)
+		return 1;
+
+	*amount = 0;
+	n = sendfile(wsi->desc.sockfd, (int)fop_fd->fd, NULL, (size_t)len);
+	if (n < 0) {
+		if (LWS_ERRNO == LWS_EAGAIN || LWS_ERRNO == LWS_EINTR)
+			return 0;
+
+		if (LWS_ERRNO == EINVAL || LWS_ERRNO == ENOSYS) {
+			/* eg, the file is on a fs that can't do it */
+			lwsl_wsi_info(wsi, "sendfile unusable, errno %d",
+				      LWS_ERRNO);
+			wsi->http.zero_copy = 0;
+
+			return 1;
+		}
+
+		lwsl_wsi_info(wsi, "sendfile failed, errno %d", LWS_ERRNO);
+
+		return -1;
+	}
+
+	if (!n) {
+		/* the file got shorter underneath us */
+		lwsl_wsi_warn(wsi, "file truncated");
+
+		return -1;
+	}
+
+	lws_set_timeout(wsi, PENDING_TIMEOUT_HTTP_CONTENT,
+			(int)wsi->a.context->timeout_secs);
+
+	fop_fd->pos += (lws_filepos_t)n;
+	*amount = (lws_filepos_t)n;
+
+#ifdef LWS_WITH_ACCESS_LOG
+	wsi->http.access_log.sent += (unsigned long)n;
+#endif
+#if defined(LWS_WITH_SYS_METRICS)
+	if (wsi->a.vhost)
+		lws_metric_event(wsi->a.vhost->mt_traffic_tx, METRES_GO,
+				 (u_mt_t)n);
+#endif
+
+	return 0;
+}
+#endif
+
 int lws_serve_http_file_fragment(struct lws *wsi)
 {
 	struct lws_context *context = wsi->a.context;
@@ -3201,6 +3298,34 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 		}
 #endif
 
+#if defined(LWS_HAVE_SENDFILE) && defined(LWS_ROLE_H1)
+		if (wsi->http.zero_copy) {
+			/*
+			 * The kernel moves the data, so we are not limited
+			 * by the size of serv_buf
+			 */
+			poss = wsi->http.filelen - wsi->http.filepos;
+			if (wsi->a.protocol->tx_packet_size &&
+			    poss > wsi->a.protocol->tx_packet_size)
+				poss = wsi->a.protocol->tx_packet_size;
+#if defined(LWS_WITH_RANGES)
+			if (wsi->http.range.count_ranges &&
+			    poss > wsi->http.range.budget)
+				poss = wsi->http.range.budget;
+#endif
+			m = lws_http_file_sendfile(wsi, poss, &amount);
+			if (m < 0)
+				goto file_had_it;
+			if (!m) {
+				if (!amount)
+					/* choked, wait for POLLOUT */
+					break;
+				n = 0;
+				goto sent;
+			}
+		}
+#endif
+
 		poss = context->pt_serv_buf_size;
 
 #if defined(LWS_ROLE_H2)
@@ -3316,6 +3441,9 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 			if (m < 0)
 				goto file_had_it;
 
+#if defined(LWS_HAVE_SENDFILE) && defined(LWS_ROLE_H1)
+sent:
+#endif
 			wsi->http.filepos += amount;
 
 #if defined(LWS_WITH_RANGES)
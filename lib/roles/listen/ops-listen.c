@@ -24,13 +24,43 @@
 
 #include <private-lib-core.h>
 
+/*
+ * With io_uring, the accepts were already done by the ring and are waiting
+ * for us on the listen wsi
+ */
+
+static lws_sockfd_type
+lws_listen_accept(struct lws *wsi, struct lws_filter_network_conn_args *filt)
+{
+#if defined(LWS_WITH_IO_URING)
+	if (lws_io_uring_async(wsi))
+		return lws_io_uring_accept(wsi,
+					   (struct sockaddr *)&filt->cli_addr,
+					   &filt->clilen);
+#endif
+
+	return accept((int)wsi->desc.sockfd, (struct sockaddr *)&filt->cli_addr,
+		      &filt->clilen);
+}
+
+static int
+lws_listen_more(struct lws *wsi, struct lws_pollfd *pfd)
+{
+#if defined(LWS_WITH_IO_URING)
+	if (lws_io_uring_async(wsi))
+		return lws_io_uring_accept_pending(wsi);
+#endif
+
+	return lws_poll_listen_fd(pfd) > 0;
+}
+
 static lws_handling_result_t
 rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 			  struct lws_pollfd *pollfd)
 {
 	struct lws_context *context = wsi->a.context;
 	struct lws_filter_network_conn_args filt;
-	lws_sock_file_fd_type fd;
+	lws_adopt_desc_t ai;
 
 	memset(&filt, 0, sizeof(filt));
 
@@ -47,7 +77,7 @@ rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 
 	do {
 		struct lws *cwsi;
-		int opts = LWS_ADOPT_SOCKET | LWS_ADOPT_ALLOW_SSL;
+		int opts = LWS_ADOPT_SOCKET | LWS_ADOPT_ALLOW_SSL, tsi;
 
 		if (!(pollfd->revents & (LWS_POLLIN | LWS_POLLOUT)) ||
 		    !(pollfd->events & LWS_POLLIN))
@@ -81,9 +111,7 @@ rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 		 * block the connect queue for other legit peers.
 		 */
 
-		filt.accept_fd = accept((int)pollfd->fd,
-					(struct sockaddr *)&filt.cli_addr,
-					&filt.clilen);
+		filt.accept_fd = lws_listen_accept(wsi, &filt);
 		if (filt.accept_fd == LWS_SOCK_INVALID) {
 			if (LWS_ERRNO == LWS_EAGAIN ||
 			    LWS_ERRNO == LWS_EWOULDBLOCK) {
@@ -143,9 +171,23 @@ rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 #endif
 			opts &= ~LWS_ADOPT_ALLOW_SSL;
 
-		fd.sockfd = filt.accept_fd;
-		cwsi = lws_adopt_descriptor_vhost(wsi->a.vhost, (lws_adoption_type)opts, fd,
-				wsi->a.vhost->listen_accept_protocol, NULL);
+		memset(&ai, 0, sizeof(ai));
+		ai.vh = wsi->a.vhost;
+		ai.type = (lws_adoption_type)opts;
+		ai.fd.sockfd = filt.accept_fd;
+		ai.vh_prot_name = wsi->a.vhost->listen_accept_protocol;
+
+		/*
+		 * With a listener per thread, we keep what we accepted unless
+		 * we're full, otherwise it goes to the least busy thread
+		 */
+
+		tsi = -1;
+		if (wsi->a.vhost->listen_per_thread &&
+		    pt->fds_count < context->fd_limit_per_thread - 1)
+			tsi = wsi->tsi;
+
+		cwsi = lws_adopt_descriptor_vhost_via_info_tsi(&ai, tsi);
 		if (!cwsi) {
 			lwsl_info("%s: vh %s: adopt failed\n", __func__,
 					wsi->a.vhost->name);
@@ -167,7 +209,7 @@ rops_handle_POLLIN_listen(struct lws_context_per_thread *pt, struct lws *wsi,
 
 	} while (pt->fds_count < context->fd_limit_per_thread - 1 &&
 		 wsi->position_in_fds_table != LWS_NO_FDS_POS &&
-		 lws_poll_listen_fd(&pt->fds[wsi->position_in_fds_table]) > 0);
+		 lws_listen_more(wsi, &pt->fds[wsi->position_in_fds_table]));
 
 	return LWS_HPI_RET_HANDLED;
 }
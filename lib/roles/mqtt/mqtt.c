@@ -364,9 +364,19 @@ lws_mqtt_create_sub(struct _lws_mqtt_related *mqtt, const char *topic)
 		return NULL;
 	}
 
+	memcpy(mysub->topic, topic, strlen(topic) + 1);
+
+	if (!mqtt->subs_trie)
+		mqtt->subs_trie = lws_mqtt_topic_trie_create();
+	if (!mqtt->subs_trie ||
+	    lws_mqtt_topic_trie_add(mqtt->subs_trie, mysub->topic, mysub)) {
+		lwsl_err("%s: Error indexing mysub\n", __func__);
+		lws_free(mysub);
+		return NULL;
+	}
+
 	mysub->next = mqtt->subs_head;
 	mqtt->subs_head = mysub;
-	memcpy(mysub->topic, topic, strlen(topic) + 1);
 	mysub->ref_count = 1;
 
 	lwsl_info("%s: Created mysub %p for wsi->mqtt %p\n",
@@ -378,28 +388,30 @@ lws_mqtt_create_sub(struct _lws_mqtt_related *mqtt, const char *topic)
 static int
 lws_mqtt_client_remove_subs(struct _lws_mqtt_related *mqtt)
 {
-	lws_mqtt_subs_t *s = mqtt->subs_head;
-	lws_mqtt_subs_t *temp = NULL;
-
+	lws_mqtt_subs_t **ps = &mqtt->subs_head, *temp;
+	int n = 1;
 
 	lwsl_info("%s: Called to remove subs from wsi->mqtt %p\n",
 		  __func__, mqtt);
 
-	while (s && s->next) {
-		if (s->next->ref_count == 0)
-			break;
-		s = s->next;
-	}
+	/* remove every sub no stream is using any more */
+
+	while (*ps) {
+		if ((*ps)->ref_count) {
+			ps = &(*ps)->next;
+			continue;
+		}
 
-	if (s && s->next) {
-		temp = s->next;
+		temp = *ps;
 		lwsl_info("%s: Removing sub %p from wsi->mqtt %p\n",
 			  __func__, temp, mqtt);
-		s->next = temp->next;
+		*ps = temp->next;
+		lws_mqtt_topic_trie_remove(mqtt->subs_trie, temp->topic, temp);
 		lws_free(temp);
-		return 0;
+		n = 0;
 	}
-	return 1;
+
+	return n;
 }
 
 /*
@@ -500,26 +512,39 @@ lws_mqtt_is_topic_matched(const char* sub, const char* pub)
 	return LMMTR_TOPIC_NOMATCH;
 }
 
-lws_mqtt_subs_t* lws_mqtt_find_sub(struct _lws_mqtt_related* mqtt,
-				   const char* ptopic) {
-	lws_mqtt_subs_t *s = mqtt->subs_head;
+static int
+lws_mqtt_find_sub_cb(void *opaque, void *user)
+{
+	*(lws_mqtt_subs_t **)user = (lws_mqtt_subs_t *)opaque;
 
-	while (s) {
-		/*  SUB topic  ==   PUB topic  ? */
-		/* foo/bar/xyz ==  foo/bar/xyz ? */
-		if (!s->wildcard) {
-			if (!strcmp((const char*)s->topic, ptopic))
-				return s;
-		} else {
-			if (lws_mqtt_is_topic_matched(
-			    s->topic, ptopic) == LMMTR_TOPIC_MATCH)
-				return s;
-		}
+	return 1; /* the first one will do */
+}
 
-		s = s->next;
-	}
+lws_mqtt_subs_t *
+lws_mqtt_find_sub(struct _lws_mqtt_related *mqtt, const char *ptopic)
+{
+	lws_mqtt_subs_t *s = NULL;
 
-	return NULL;
+	if (!mqtt->subs_trie)
+		return NULL;
+
+	/*
+	 * A topic with wildcards in is a filter we (un)subscribe with, find a
+	 * subscription to exactly that filter
+	 */
+
+	if (strpbrk(ptopic, "+#"))
+		return (lws_mqtt_subs_t *)lws_mqtt_topic_trie_find(
+						mqtt->subs_trie, ptopic);
+
+	/*  SUB topic  ==   PUB topic  ? */
+	/* foo/bar/xyz ==  foo/bar/xyz ? */
+	/* foo/+/#     ==  foo/bar/xyz ? */
+
+	lws_mqtt_topic_trie_match(mqtt->subs_trie, ptopic,
+				  lws_mqtt_find_sub_cb, &s);
+
+	return s;
 }
 
 int
@@ -2103,14 +2128,14 @@ do_write:
 		 * we must RETRY the publish
 		 */
 		wsi->mqtt->sul_qos_puback_pubrec_wait.cb = lws_mqtt_publish_resend;
-		__lws_sul_insert_us(&pt->pt_sul_owner[wsi->conn_validity_wakesuspend],
+		__lws_sul_insert_us(pt, wsi->conn_validity_wakesuspend,
 				    &wsi->mqtt->sul_qos_puback_pubrec_wait,
 				    3 * LWS_USEC_PER_SEC);
 	}
 
 	if (wsi->mqtt->inside_shadow) {
 		wsi->mqtt->sul_shadow_wait.cb = lws_mqtt_shadow_timeout;
-		__lws_sul_insert_us(&pt->pt_sul_owner[wsi->conn_validity_wakesuspend],
+		__lws_sul_insert_us(pt, wsi->conn_validity_wakesuspend,
 				    &wsi->mqtt->sul_shadow_wait,
 				    60 * LWS_USEC_PER_SEC);
 	}
@@ -2454,7 +2479,7 @@ lws_mqtt_client_send_unsubcribe(struct lws *wsi,
 	wsi->mqtt->inside_unsubscribe = 1;
 
 	wsi->mqtt->sul_unsuback_wait.cb = lws_mqtt_unsuback_timeout;
-	__lws_sul_insert_us(&pt->pt_sul_owner[wsi->conn_validity_wakesuspend],
+	__lws_sul_insert_us(pt, wsi->conn_validity_wakesuspend,
 			    &wsi->mqtt->sul_unsuback_wait,
 			    3 * LWS_USEC_PER_SEC);
 
@@ -450,6 +450,7 @@ rops_close_role_mqtt(struct lws_context_per_thread *pt, struct lws *wsi)
 {
 	struct lws *nwsi = lws_get_network_wsi(wsi);
 	lws_mqtt_subs_t	*s, *s1, *mysub;
+	lws_mqtt_topic_trie_t *t;
 	lws_mqttc_t *c;
 
 	if (!wsi->mqtt)
@@ -469,12 +470,14 @@ rops_close_role_mqtt(struct lws_context_per_thread *pt, struct lws *wsi)
 
 	s = wsi->mqtt->subs_head;
 	wsi->mqtt->subs_head = NULL;
+	t = wsi->mqtt->subs_trie;
+	wsi->mqtt->subs_trie = NULL;
 	while (s) {
 		s1 = s->next;
 		/*
 		 * Account for children no longer using nwsi subscription
 		 */
-		mysub = lws_mqtt_find_sub(nwsi->mqtt, (const char *)&s[1]);
+		mysub = lws_mqtt_find_sub(nwsi->mqtt, s->topic);
 //		assert(mysub); /* if child subscribed, nwsi must feel the same */
 		if (mysub) {
 			assert(mysub->ref_count);
@@ -483,6 +486,7 @@ rops_close_role_mqtt(struct lws_context_per_thread *pt, struct lws *wsi)
 		lws_free(s);
 		s = s1;
 	}
+	lws_mqtt_topic_trie_destroy(&t);
 
 	lws_mqtt_publish_param_t *pub =
 			(lws_mqtt_publish_param_t *)
@@ -360,6 +360,7 @@ struct _lws_mqtt_related {
 	lws_sorted_usec_list_t	sul_shadow_wait; /* Device Shadow wait TO */
 	struct lws		*wsi; /**< so sul can use lws_container_of */
 	lws_mqtt_subs_t		*subs_head; /**< Linked-list of heap-allocated subscription objects */
+	lws_mqtt_topic_trie_t	*subs_trie; /**< the subs_head subscriptions indexed by topic filter */
 	void			*rx_cpkt_param;
 	uint16_t		pkt_id;
 	uint16_t		ack_pkt_id;
@@ -439,6 +440,10 @@ lws_mqtt_fill_fixed_header(uint8_t *p, lws_mqtt_control_packet_t ctrl_pkt_type,
 struct lws *
 lws_wsi_mqtt_adopt(struct lws *parent_wsi, struct lws *wsi);
 
+/*
+ * For a topic, returns a subscription matching it.  For a topic filter with
+ * wildcards, returns a subscription to that same filter.
+ */
 lws_mqtt_subs_t *
 lws_mqtt_find_sub(struct _lws_mqtt_related *mqtt, const char *topic);
 
@@ -0,0 +1,402 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * MQTT topic filter trie
+ *
+ * Each node is one '/'-separated level of one or more topic filters.  Rather
+ * than each node keeping a list or table of its children, all the nodes are
+ * in one hash table keyed on the parent node and the level name, so finding
+ * the child for the next level of a topic is a single lookup however many
+ * siblings it has.  The '+' child of a node is in the table like the others,
+ * but the node also points to it directly since every match needs it.
+ *
+ * Filters ending in '#' don't get a node for the '#', they're listed on the
+ * node for the level before it, since "#" matches everything left, including
+ * nothing.
+ */
+
+#include "private-lib-core.h"
+
+typedef struct lws_mqtt_tt_ent {
+	struct lws_mqtt_tt_ent	*next;
+	void			*opaque;
+} lws_mqtt_tt_ent_t;
+
+typedef struct lws_mqtt_tt_node {
+	struct lws_mqtt_tt_node	*parent;
+	struct lws_mqtt_tt_node	*hnext;		/* hash table bucket chain */
+	struct lws_mqtt_tt_node	*plus;		/* our "+" child, if any */
+	lws_mqtt_tt_ent_t	*ends;		/* filters ending at us */
+	lws_mqtt_tt_ent_t	*hash;		/* filters ending "/#" after us */
+	uint32_t		children;	/* child nodes, incl "+" */
+	uint32_t		hval;
+	uint16_t		len;
+
+	/* level name overallocated here */
+} lws_mqtt_tt_node_t;
+
+struct lws_mqtt_topic_trie {
+	lws_mqtt_tt_node_t	root;
+	lws_mqtt_tt_node_t	**tab;
+	uint32_t		tab_size;	/* power of 2 */
+	uint32_t		count;		/* nodes in tab */
+};
+
+#define tt_name(_n) ((const char *)&(_n)[1])
+
+static uint32_t
+tt_hash(const lws_mqtt_tt_node_t *parent, const char *name, size_t len)
+{
+	uint32_t h = 0x811c9dc5u ^ (uint32_t)(lws_intptr_t)parent;
+
+	while (len--)
+		h = (h ^ (uint8_t)*name++) * 0x01000193u;
+
+	return h ^ (h >> 15);
+}
+
+static lws_mqtt_tt_node_t *
+tt_child(const lws_mqtt_topic_trie_t *t, const lws_mqtt_tt_node_t *parent,
+	 const char *name, size_t len)
+{
+	uint32_t h = tt_hash(parent, name, len);
+	lws_mqtt_tt_node_t *n;
+
+	if (!t->tab)
+		return NULL;
+
+	n = t->tab[h & (t->tab_size - 1)];
+	while (n) {
+		if (n->hval == h && n->parent == parent && n->len == len &&
+		    !memcmp(tt_name(n), name, len))
+			return n;
+		n = n->hnext;
+	}
+
+	return NULL;
+}
+
+static void
+tt_tab_grow(lws_mqtt_topic_trie_t *t)
+{
+	uint32_t ns = t->tab_size ? t->tab_size * 4 : 16, m;
+	lws_mqtt_tt_node_t **nt, *n, *n1;
+
+	nt = lws_zalloc(sizeof(*nt) * ns, "mqtt tt tab");
+	if (!nt)
+		/* we can keep going with longer bucket chains */
+		return;
+
+	for (m = 0; m < t->tab_size; m++) {
+		n = t->tab[m];
+		while (n) {
+			n1 = n->hnext;
+			n->hnext = nt[n->hval & (ns - 1)];
+			nt[n->hval & (ns - 1)] = n;
+			n = n1;
+		}
+	}
+
+	lws_free(t->tab);
+	t->tab = nt;
+	t->tab_size = ns;
+}
+
+static lws_mqtt_tt_node_t *
+tt_child_create(lws_mqtt_topic_trie_t *t, lws_mqtt_tt_node_t *parent,
+		const char *name, size_t len)
+{
+	lws_mqtt_tt_node_t *n;
+
+	if (len > 0xffff)
+		return NULL;
+
+	if (t->count >= t->tab_size)
+		tt_tab_grow(t);
+	if (!t->tab)
+		return NULL;
+
+	n = lws_zalloc(sizeof(*n) + len, "mqtt tt node");
+	if (!n)
+		return NULL;
+
+	memcpy(&n[1], name, len);
+	n->len = (uint16_t)len;
+	n->parent = parent;
+	n->hval = tt_hash(parent, name, len);
+	n->hnext = t->tab[n->hval & (t->tab_size - 1)];
+	t->tab[n->hval & (t->tab_size - 1)] = n;
+	t->count++;
+	parent->children++;
+
+	if (len == 1 && *name == '+')
+		parent->plus = n;
+
+	return n;
+}
+
+/* destroy nodes from n upwards that no longer lead to any filter */
+
+static void
+tt_prune(lws_mqtt_topic_trie_t *t, lws_mqtt_tt_node_t *n)
+{
+	lws_mqtt_tt_node_t *parent, **pn;
+
+	while (n != &t->root && !n->ends && !n->hash && !n->children) {
+		parent = n->parent;
+
+		pn = &t->tab[n->hval & (t->tab_size - 1)];
+		while (*pn != n)
+			pn = &(*pn)->hnext;
+		*pn = n->hnext;
+		t->count--;
+
+		if (parent->plus == n)
+			parent->plus = NULL;
+		parent->children--;
+
+		lws_free(n);
+		n = parent;
+	}
+}
+
+/*
+ * Walk the filter through the trie, optionally creating the nodes for it.
+ * Returns the node for the last level, with *phash set if the filter ends
+ * in "#", or NULL if the filter isn't in there (or is invalid).
+ */
+
+static lws_mqtt_tt_node_t *
+tt_walk(lws_mqtt_topic_trie_t *t, const char *filter, int create, char *phash)
+{
+	lws_mqtt_tt_node_t *n = &t->root, *c;
+	const char *p = filter, *q;
+
+	*phash = 0;
+
+	while (1) {
+		q = p;
+		while (*q && *q != '/')
+			q++;
+
+		if (q - p == 1 && *p == '#') {
+			if (*q)
+				/* # must be the last level */
+				return NULL;
+			*phash = 1;
+
+			return n;
+		}
+
+		c = tt_child(t, n, p, lws_ptr_diff_size_t(q, p));
+		if (!c) {
+			if (!create)
+				return NULL;
+			c = tt_child_create(t, n, p, lws_ptr_diff_size_t(q, p));
+			if (!c) {
+				tt_prune(t, n);
+				return NULL;
+			}
+		}
+		n = c;
+
+		if (!*q)
+			return n;
+		p = q + 1;
+	}
+}
+
+lws_mqtt_topic_trie_t *
+lws_mqtt_topic_trie_create(void)
+{
+	return lws_zalloc(sizeof(lws_mqtt_topic_trie_t), "mqtt tt");
+}
+
+static void
+tt_ents_free(lws_mqtt_tt_ent_t *e)
+{
+	lws_mqtt_tt_ent_t *e1;
+
+	while (e) {
+		e1 = e->next;
+		lws_free(e);
+		e = e1;
+	}
+}
+
+void
+lws_mqtt_topic_trie_destroy(lws_mqtt_topic_trie_t **pt)
+{
+	lws_mqtt_topic_trie_t *t = *pt;
+	lws_mqtt_tt_node_t *n, *n1;
+	uint32_t m;
+
+	if (!t)
+		return;
+
+	for (m = 0; m < t->tab_size; m++) {
+		n = t->tab[m];
+		while (n) {
+			n1 = n->hnext;
+			tt_ents_free(n->ends);
+			tt_ents_free(n->hash);
+			lws_free(n);
+			n = n1;
+		}
+	}
+
+	tt_ents_free(t->root.ends);
+	tt_ents_free(t->root.hash);
+	lws_free(t->tab);
+	lws_free_set_NULL(*pt);
+}
+
+int
+lws_mqtt_topic_trie_add(lws_mqtt_topic_trie_t *t, const char *filter,
+			void *opaque)
+{
+	lws_mqtt_tt_ent_t *e;
+	lws_mqtt_tt_node_t *n;
+	char hash;
+
+	n = tt_walk(t, filter, 1, &hash);
+	if (!n)
+		return 1;
+
+	e = lws_malloc(sizeof(*e), "mqtt tt ent");
+	if (!e) {
+		tt_prune(t, n);
+		return 1;
+	}
+
+	e->opaque = opaque;
+	if (hash) {
+		e->next = n->hash;
+		n->hash = e;
+	} else {
+		e->next = n->ends;
+		n->ends = e;
+	}
+
+	return 0;
+}
+
+int
+lws_mqtt_topic_trie_remove(lws_mqtt_topic_trie_t *t, const char *filter,
+			   void *opaque)
+{
+	lws_mqtt_tt_ent_t **pe, *e;
+	lws_mqtt_tt_node_t *n;
+	char hash;
+
+	n = tt_walk(t, filter, 0, &hash);
+	if (!n)
+		return 1;
+
+	pe = hash ? &n->hash : &n->ends;
+	while (*pe && (*pe)->opaque != opaque)
+		pe = &(*pe)->next;
+	if (!*pe)
+		return 1;
+
+	e = *pe;
+	*pe = e->next;
+	lws_free(e);
+	tt_prune(t, n);
+
+	return 0;
+}
+
+void *
+lws_mqtt_topic_trie_find(lws_mqtt_topic_trie_t *t, const char *filter)
+{
+	lws_mqtt_tt_node_t *n;
+	char hash;
+
+	n = tt_walk(t, filter, 0, &hash);
+	if (!n)
+		return NULL;
+
+	if (hash)
+		return n->hash ? n->hash->opaque : NULL;
+
+	return n->ends ? n->ends->opaque : NULL;
+}
+
+static int
+tt_report(lws_mqtt_tt_ent_t *e, lws_mqtt_topic_trie_cb_t cb, void *user,
+	  int *count)
+{
+	while (e) {
+		(*count)++;
+		if (cb(e->opaque, user))
+			return 1;
+		e = e->next;
+	}
+
+	return 0;
+}
+
+/*
+ * p is the start of the next level of the topic, or NULL if the topic is
+ * used up.  The recursion is only as deep as the trie, not the topic.
+ */
+
+static int
+tt_match(const lws_mqtt_topic_trie_t *t, const lws_mqtt_tt_node_t *n,
+	 const char *p, lws_mqtt_topic_trie_cb_t cb, void *user, int *count)
+{
+	const lws_mqtt_tt_node_t *c;
+	const char *q, *next;
+
+	if (tt_report(n->hash, cb, user, count))
+		return 1;
+
+	if (!p)
+		return tt_report(n->ends, cb, user, count);
+
+	if (!n->children)
+		return 0;
+
+	q = p;
+	while (*q && *q != '/')
+		q++;
+	next = *q ? q + 1 : NULL;
+
+	c = tt_child(t, n, p, lws_ptr_diff_size_t(q, p));
+	if (c && c != n->plus && tt_match(t, c, next, cb, user, count))
+		return 1;
+
+	return n->plus && tt_match(t, n->plus, next, cb, user, count);
+}
+
+int
+lws_mqtt_topic_trie_match(lws_mqtt_topic_trie_t *t, const char *topic,
+			  lws_mqtt_topic_trie_cb_t cb, void *user)
+{
+	int count = 0;
+
+	tt_match(t, &t->root, topic, cb, user, &count);
+
+	return count;
+}
@@ -59,6 +59,16 @@ _lws_ws_client_rx_payload_passthrough(struct lws *wsi, const uint8_t *buf,
 		}
 		if (n == PMDR_DID_NOTHING)
 			break;
+
+		/*
+		 * The frame's payload is all accounted for already, so only
+		 * this hides from lws_is_final_fragment() that the inflator
+		 * has more of the message to give us
+		 */
+		if (n == PMDR_HAS_PENDING)
+			lws_add_wsi_to_draining_ext_list(wsi);
+		else
+			lws_remove_wsi_from_draining_ext_list(wsi);
 #endif
 
 		if (wsi->ws->check_utf8 && !wsi->ws->defeat_check_utf8) {
@@ -68,6 +68,259 @@ lws_extension_pmdeflate_restrict_args(struct lws *wsi,
 
 static unsigned char trail[] = { 0, 0, 0xff, 0xff };
 
+/*
+ * The args are named for the server and client ends of the connection.  Which
+ * of each pair is about our compressor, and which the peer's, depends on
+ * which end we are.  Give these the PMD_SERVER_ one of the pair.
+ */
+
+static int
+pmd_ours(struct lws *wsi, int arg)
+{
+	return arg + !!lwsi_role_client(wsi);
+}
+
+static int
+pmd_peers(struct lws *wsi, int arg)
+{
+	return arg + !lwsi_role_client(wsi);
+}
+
+static size_t
+lws_pmd_zs_mem(int deflate, int wbits, int mem_level)
+{
+	/* zlib's own estimates, plus its state structs */
+
+	if (deflate)
+		return (1u << (wbits + 2)) + (1u << (mem_level + 9)) + 6144;
+
+	return (1u << wbits) + 7168;
+}
+
+/*
+ * Get a z_stream, preferably one that's idle in the pool with the same
+ * parameters, so we skip zlib allocating and initializing its state
+ */
+
+static struct lws_pmd_zs *
+lws_pmd_zs_get(struct lws *wsi, int deflate, int wbits, int level,
+	       int mem_level)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pmd_zs *z;
+	int n;
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      lws_dll2_get_head(&pt->ws.pmd_pool)) {
+		z = lws_container_of(d, struct lws_pmd_zs, list);
+
+		if (z->deflate == deflate && z->wbits == wbits &&
+		    (!deflate || (z->level == level &&
+				  z->mem_level == mem_level))) {
+			lws_dll2_remove(&z->list);
+			lws_metrics_hist_bump_priv(wsi->a.context->mth_pmd, "hit");
+			return z;
+		}
+	} lws_end_foreach_dll(d);
+
+	z = lws_zalloc(sizeof(*z), "pmd zs");
+	if (!z)
+		return NULL;
+
+	if (deflate)
+		n = deflateInit2(&z->zs, level, Z_DEFLATED, -wbits, mem_level,
+				 Z_DEFAULT_STRATEGY);
+	else
+		n = inflateInit2(&z->zs, -wbits);
+	if (n != Z_OK) {
+		lwsl_wsi_ext(wsi, "%s failed %d",
+			     deflate ? "deflateInit2" : "inflateInit2", n);
+		lws_free(z);
+		return NULL;
+	}
+
+	z->deflate	= (unsigned char)deflate;
+	z->wbits	= (unsigned char)wbits;
+	z->level	= (unsigned char)level;
+	z->mem_level	= (unsigned char)mem_level;
+	z->mem		= lws_pmd_zs_mem(deflate, wbits, mem_level);
+	pt->ws.pmd_mem	+= z->mem;
+
+	lws_metrics_hist_bump_priv(wsi->a.context->mth_pmd, "miss");
+
+	return z;
+}
+
+static void
+lws_pmd_zs_free(struct lws_context_per_thread *pt, struct lws_pmd_zs *z)
+{
+	if (z->deflate)
+		(void)deflateEnd(&z->zs);
+	else
+		(void)inflateEnd(&z->zs);
+
+	pt->ws.pmd_mem -= z->mem;
+	lws_free(z);
+}
+
+/* give back a z_stream, so the next message, on any connection, can use it */
+
+static void
+lws_pmd_zs_put(struct lws *wsi, struct lws_pmd_zs **pz)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pmd_zs *z = *pz;
+	int n;
+
+	if (!z)
+		return;
+	*pz = NULL;
+
+	if (pt->ws.pmd_pool.count >= LWS_DEF_PMD_POOL_SPARE ||
+	    (wsi->a.context->pmd_mem_budget &&
+	     pt->ws.pmd_mem > wsi->a.context->pmd_mem_budget)) {
+		lws_pmd_zs_free(pt, z);
+		return;
+	}
+
+	if (z->deflate)
+		n = deflateReset(&z->zs);
+	else
+		n = inflateReset(&z->zs);
+	if (n != Z_OK) {
+		lws_pmd_zs_free(pt, z);
+		return;
+	}
+
+	lws_dll2_add_head(&z->list, &pt->ws.pmd_pool);
+}
+
+void
+lws_pmd_pool_destroy(struct lws_context_per_thread *pt)
+{
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&pt->ws.pmd_pool)) {
+		struct lws_pmd_zs *z = lws_container_of(d, struct lws_pmd_zs,
+							list);
+
+		lws_dll2_remove(&z->list);
+		lws_pmd_zs_free(pt, z);
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
+#if defined(LWS_WITH_SYS_METRICS)
+static void
+lws_pmd_saved(struct lws *wsi, size_t plain, size_t wire)
+{
+	if (plain > wire)
+		lws_metric_event(wsi->a.context->mt_pmd_saved, METRES_GO,
+				 (u_mt_t)(plain - wire));
+}
+#endif
+
+/*
+ * Broadcast messages are deflated once per parameter set, by a fresh deflater,
+ * and the same frame sent to every connection using those parameters.  Any
+ * inflater can decode that from a message boundary, whether or not it keeps
+ * its context.  Returns 0 if no extension is active on the connection, 1 if
+ * only pmd is, setting p[] to its deflate window bits, level and mem level,
+ * or -1 if the shared frame can't be used, eg, we are partway through sending
+ * a message.
+ */
+
+int
+lws_pmd_bcast_params(struct lws *wsi, uint8_t *p)
+{
+	struct lws_ext_pm_deflate_priv *priv;
+
+	if (!wsi->ws->count_act_ext)
+		return 0;
+
+	if (wsi->ws->count_act_ext != 1 ||
+	    wsi->ws->active_extensions[0]->callback !=
+					lws_extension_callback_pm_deflate)
+		return -1;
+
+	priv = (struct lws_ext_pm_deflate_priv *)wsi->ws->act_ext_user[0];
+	if (priv->count_tx_between_fin || priv->compressed_out ||
+	    (priv->tx && priv->tx->zs.avail_in))
+		return -1;
+
+	p[0] = priv->args[pmd_ours(wsi, PMD_SERVER_MAX_WINDOW_BITS)];
+	p[1] = priv->args[PMD_COMP_LEVEL];
+	p[2] = priv->args[PMD_MEM_LEVEL];
+
+	return 1;
+}
+
+/*
+ * Deflates in to a new allocation, leaving pre bytes in front of it for the
+ * ws header, and without the sync flush trailer, which is implied on the wire
+ */
+
+uint8_t *
+lws_pmd_bcast_deflate(struct lws *wsi, const uint8_t *p, const uint8_t *in,
+		      size_t len, size_t pre, size_t *olen)
+{
+	struct lws_pmd_zs *z = lws_pmd_zs_get(wsi, 1, p[0], p[1], p[2]);
+	uint8_t *buf;
+	size_t alloc;
+	int n;
+
+	if (!z)
+		return NULL;
+
+	/* the sync flush needs a little more than deflateBound() allows */
+
+	alloc = (size_t)deflateBound(&z->zs, (uLong)len) + 16;
+	buf = lws_malloc(pre + alloc, "pmd bcast");
+	if (!buf)
+		goto bail;
+
+	z->zs.next_in = (unsigned char *)in;
+	z->zs.avail_in = (uInt)len;
+	z->zs.next_out = buf + pre;
+	z->zs.avail_out = (uInt)alloc;
+
+	n = deflate(&z->zs, Z_SYNC_FLUSH);
+	*olen = (size_t)lws_ptr_diff(z->zs.next_out, buf + pre);
+	if (n != Z_OK || z->zs.avail_in || !z->zs.avail_out || *olen < 4) {
+		lwsl_wsi_err(wsi, "deflate failed %d", n);
+		lws_free_set_NULL(buf);
+		goto bail;
+	}
+
+	*olen -= 4;
+
+bail:
+	lws_pmd_zs_put(wsi, &z);
+
+	return buf;
+}
+
+/* after a broadcast frame went on the connection instead of our own output */
+
+void
+lws_pmd_bcast_sent(struct lws *wsi, size_t plain, size_t wire)
+{
+	struct lws_ext_pm_deflate_priv *priv =
+		(struct lws_ext_pm_deflate_priv *)wsi->ws->act_ext_user[0];
+
+	/*
+	 * If we keep our context, the peer's inflater now has the broadcast
+	 * message in its window, but our deflater doesn't, so our later
+	 * matches would be wrong.  Start afresh from here.
+	 */
+	lws_pmd_zs_put(wsi, &priv->tx);
+
+#if defined(LWS_WITH_SYS_METRICS)
+	lws_pmd_saved(wsi, plain, wire);
+#else
+	(void)plain;
+	(void)wire;
+#endif
+}
+
 LWS_VISIBLE int
 lws_extension_callback_pm_deflate(struct lws_context *context,
 				  const struct lws_extension *ext,
@@ -169,16 +422,38 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		priv->args[PMD_MEM_LEVEL] = 8;
 
 		lws_extension_pmdeflate_restrict_args(wsi, priv);
+
+		/*
+		 * If this thread has used its share of the memory budget,
+		 * compress with a smaller window, and tell the client.  The
+		 * mem level is ours alone, so we can just cut that too.
+		 */
+
+		if (!lwsi_role_client(wsi) &&
+		    context->pmd_mem_budget &&
+		    context->pt[(int)wsi->tsi].ws.pmd_mem >=
+						context->pmd_mem_budget) {
+			lwsl_wsi_info(wsi, "pmd over budget, limiting");
+			priv->args[PMD_SERVER_MAX_WINDOW_BITS] =
+						LWS_PMD_BUDGET_WINDOW_BITS;
+			priv->args[PMD_MEM_LEVEL] = LWS_PMD_BUDGET_MEM_LEVEL;
+			lws_metrics_hist_bump_priv(context->mth_pmd, "limited");
+		}
 		break;
 
+	case LWS_EXT_CB_SERVER_RESPONSE_ARGS:
+		if (priv->args[PMD_SERVER_MAX_WINDOW_BITS] >= 15 || len < 2)
+			break;
+
+		return lws_snprintf((char *)in, len, "; server_max_window_bits=%d",
+				    priv->args[PMD_SERVER_MAX_WINDOW_BITS]);
+
 	case LWS_EXT_CB_DESTROY:
 		lwsl_wsi_ext(wsi, "LWS_EXT_CB_DESTROY");
 		lws_free(priv->buf_rx_inflated);
 		lws_free(priv->buf_tx_deflated);
-		if (priv->rx_init)
-			(void)inflateEnd(&priv->rx);
-		if (priv->tx_init)
-			(void)deflateEnd(&priv->tx);
+		lws_pmd_zs_put(wsi, &priv->rx);
+		lws_pmd_zs_put(wsi, &priv->tx);
 		lws_free(priv);
 
 		return ret;
@@ -189,7 +464,7 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 * ie, we are INFLATING
 		 */
 		lwsl_wsi_ext(wsi, " LWS_EXT_CB_PAYLOAD_RX: in %d, existing in %d",
-			 pmdrx->eb_in.len, priv->rx.avail_in);
+			 pmdrx->eb_in.len, priv->rx ? priv->rx->zs.avail_in : 0);
 
 		/*
 		 * If this frame is not marked as compressed,
@@ -217,17 +492,18 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 
 		lwsl_wsi_ext(wsi, "LWS_EXT_CB_PAYLOAD_RX: in %d, "
 			 "existing avail in %d, pkt fin: %d",
-			 pmdrx->eb_in.len, priv->rx.avail_in, wsi->ws->final);
+			 pmdrx->eb_in.len, priv->rx ? priv->rx->zs.avail_in : 0,
+			 wsi->ws->final);
 
 		/* if needed, initialize the inflator */
 
-		if (!priv->rx_init) {
-			if (inflateInit2(&priv->rx,
-			     -priv->args[PMD_SERVER_MAX_WINDOW_BITS]) != Z_OK) {
+		if (!priv->rx) {
+			priv->rx = lws_pmd_zs_get(wsi, 0, priv->args[pmd_peers(wsi,
+						PMD_SERVER_MAX_WINDOW_BITS)], 0, 0);
+			if (!priv->rx) {
 				lwsl_wsi_err(wsi, "iniflateInit failed");
 				return PMDR_FAILED;
 			}
-			priv->rx_init = 1;
 			if (!priv->buf_rx_inflated)
 				priv->buf_rx_inflated = lws_malloc(
 					(unsigned int)(LWS_PRE + 7 + 5 +
@@ -245,21 +521,22 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 * the last input
 		 */
 
-		if (priv->rx.avail_in && pmdrx->eb_in.token &&
+		if (priv->rx->zs.avail_in && pmdrx->eb_in.token &&
 					 pmdrx->eb_in.len) {
-			lwsl_wsi_warn(wsi, "priv->rx.avail_in %d while getting new in",
-					priv->rx.avail_in);
+			lwsl_wsi_warn(wsi, "rx avail_in %d while getting new in",
+					priv->rx->zs.avail_in);
 	//		assert(0);
 		}
 #endif
-		if (!priv->rx.avail_in && pmdrx->eb_in.token && pmdrx->eb_in.len) {
-			priv->rx.next_in = (unsigned char *)pmdrx->eb_in.token;
-			priv->rx.avail_in = (uInt)pmdrx->eb_in.len;
+		if (!priv->rx->zs.avail_in && pmdrx->eb_in.token && pmdrx->eb_in.len) {
+			priv->rx->zs.next_in = (unsigned char *)pmdrx->eb_in.token;
+			priv->rx->zs.avail_in = (uInt)pmdrx->eb_in.len;
+			priv->wire_rx += (size_t)pmdrx->eb_in.len;
 		}
 
-		priv->rx.next_out = priv->buf_rx_inflated + LWS_PRE;
-		pmdrx->eb_out.token = priv->rx.next_out;
-		priv->rx.avail_out = (uInt)(1 << priv->args[PMD_RX_BUF_PWR2]);
+		priv->rx->zs.next_out = priv->buf_rx_inflated + LWS_PRE;
+		pmdrx->eb_out.token = priv->rx->zs.next_out;
+		priv->rx->zs.avail_out = (uInt)(1 << priv->args[PMD_RX_BUF_PWR2]);
 
 		/* so... if...
 		 *
@@ -272,15 +549,15 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 * ...then put back the 00 00 FF FF the sender stripped as our
 		 * input to zlib
 		 */
-		if (!priv->rx.avail_in &&
+		if (!priv->rx->zs.avail_in &&
 		    wsi->ws->final &&
 		    !wsi->ws->rx_packet_length &&
 		    wsi->ws->pmd_trailer_application) {
 			lwsl_wsi_ext(wsi, "trailer apply 1");
 			was_fin = 1;
 			wsi->ws->pmd_trailer_application = 0;
-			priv->rx.next_in = trail;
-			priv->rx.avail_in = sizeof(trail);
+			priv->rx->zs.next_in = trail;
+			priv->rx->zs.avail_in = sizeof(trail);
 		}
 
 		/*
@@ -288,19 +565,19 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 * him right now, bail without having done anything
 		 */
 
-		if (!priv->rx.avail_in)
+		if (!priv->rx->zs.avail_in)
 			return PMDR_DID_NOTHING;
 
-		n = inflate(&priv->rx, was_fin ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+		n = inflate(&priv->rx->zs, was_fin ? Z_SYNC_FLUSH : Z_NO_FLUSH);
 		lwsl_wsi_ext(wsi, "inflate ret %d, avi %d, avo %d, wsifinal %d", n,
-			 priv->rx.avail_in, priv->rx.avail_out, wsi->ws->final);
+			 priv->rx->zs.avail_in, priv->rx->zs.avail_out, wsi->ws->final);
 		switch (n) {
 		case Z_NEED_DICT:
 		case Z_STREAM_ERROR:
 		case Z_DATA_ERROR:
 		case Z_MEM_ERROR:
 			lwsl_wsi_err(wsi, "zlib error inflate %d: \"%s\"",
-				  n, priv->rx.msg);
+				  n, priv->rx->zs.msg);
 			return PMDR_FAILED;
 		}
 
@@ -308,25 +585,37 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 * track how much input was used, and advance it
 		 */
 
-		/* COV says we can overflow if "eb_in.len == 0 and rx->avail_in == 4" */
+		/*
+		 * When we're being drained, the caller has no new input for
+		 * us and eb_in is empty, the inflator is still working on
+		 * what it was given before... only account against eb_in
+		 * when it's what the inflator is using.
+		 *
+		 * COV says we can overflow if "eb_in.len == 0 and
+		 * rx->avail_in == 4"
+		 */
 
-		if ((unsigned int)priv->rx.avail_in > (unsigned int)pmdrx->eb_in.len) {
-			lwsl_wsi_err(wsi, "rx buffer underflow");
-			return PMDR_FAILED;
-		}
+		if (pmdrx->eb_in.len) {
+			if ((unsigned int)priv->rx->zs.avail_in >
+					(unsigned int)pmdrx->eb_in.len) {
+				lwsl_wsi_err(wsi, "rx buffer underflow");
+				return PMDR_FAILED;
+			}
 
-		pmdrx->eb_in.token = pmdrx->eb_in.token +
-				         ((unsigned int)pmdrx->eb_in.len - (unsigned int)priv->rx.avail_in);
-		pmdrx->eb_in.len = (int)priv->rx.avail_in;
+			pmdrx->eb_in.token = pmdrx->eb_in.token +
+				((unsigned int)pmdrx->eb_in.len -
+				 (unsigned int)priv->rx->zs.avail_in);
+			pmdrx->eb_in.len = (int)priv->rx->zs.avail_in;
+		}
 
 		lwsl_wsi_debug(wsi, "%d %d %d %d %d",
-				priv->rx.avail_in,
+				priv->rx->zs.avail_in,
 				wsi->ws->final,
 				(int)wsi->ws->rx_packet_length,
 				was_fin,
 				wsi->ws->pmd_trailer_application);
 
-		if (!priv->rx.avail_in &&
+		if (!priv->rx->zs.avail_in &&
 		    wsi->ws->final &&
 		    !wsi->ws->rx_packet_length &&
 		    !was_fin &&
@@ -335,50 +624,62 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 
 			/* we overallocated just for this situation where
 			 * we might issue something */
-			priv->rx.avail_out += 5;
+			priv->rx->zs.avail_out += 5;
 
 			was_fin = 1;
 			wsi->ws->pmd_trailer_application = 0;
-			priv->rx.next_in = trail;
-			priv->rx.avail_in = sizeof(trail);
-			n = inflate(&priv->rx, Z_SYNC_FLUSH);
+			priv->rx->zs.next_in = trail;
+			priv->rx->zs.avail_in = sizeof(trail);
+			n = inflate(&priv->rx->zs, Z_SYNC_FLUSH);
 			lwsl_wsi_ext(wsi, "RX trailer infl ret %d, avi %d, avo %d",
-				 n, priv->rx.avail_in, priv->rx.avail_out);
+				 n, priv->rx->zs.avail_in, priv->rx->zs.avail_out);
 			switch (n) {
 			case Z_NEED_DICT:
 			case Z_STREAM_ERROR:
 			case Z_DATA_ERROR:
 			case Z_MEM_ERROR:
 				lwsl_wsi_info(wsi, "zlib error inflate %d: %s",
-					  n, priv->rx.msg);
+					  n, priv->rx->zs.msg);
 				return -1;
 			}
 
-			assert(priv->rx.avail_out);
+			assert(priv->rx->zs.avail_out);
 		}
 
-		pmdrx->eb_out.len = lws_ptr_diff(priv->rx.next_out,
+		pmdrx->eb_out.len = lws_ptr_diff(priv->rx->zs.next_out,
 						 pmdrx->eb_out.token);
 		priv->count_rx_between_fin = priv->count_rx_between_fin + (size_t)pmdrx->eb_out.len;
 
 		lwsl_wsi_ext(wsi, "  RX leaving with new effbuff len %d, "
 			 "rx.avail_in=%d, TOTAL RX since FIN %lu",
-			 pmdrx->eb_out.len, priv->rx.avail_in,
+			 pmdrx->eb_out.len, priv->rx->zs.avail_in,
 			 (unsigned long)priv->count_rx_between_fin);
 
 		if (was_fin) {
 			lwsl_wsi_ext(wsi, "was_fin");
+#if defined(LWS_WITH_SYS_METRICS)
+			lws_pmd_saved(wsi, priv->count_rx_between_fin,
+				      priv->wire_rx);
+#endif
 			priv->count_rx_between_fin = 0;
-			if (priv->args[PMD_SERVER_NO_CONTEXT_TAKEOVER]) {
-				lwsl_wsi_ext(wsi, "PMD_SERVER_NO_CONTEXT_TAKEOVER");
-				(void)inflateEnd(&priv->rx);
-				priv->rx_init = 0;
+			priv->wire_rx = 0;
+
+			/*
+			 * If the peer doesn't keep its compression context
+			 * between messages, we don't need ours either, give
+			 * it back until the next message
+			 */
+
+			if (priv->args[pmd_peers(wsi,
+					PMD_SERVER_NO_CONTEXT_TAKEOVER)]) {
+				lwsl_wsi_ext(wsi, "peer no context takeover");
+				lws_pmd_zs_put(wsi, &priv->rx);
 			}
 
 			return PMDR_EMPTY_FINAL;
 		}
 
-		if (priv->rx.avail_in)
+		if (priv->rx->zs.avail_in)
 			return PMDR_HAS_PENDING;
 
 		return PMDR_EMPTY_NONFINAL;
@@ -391,18 +692,13 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 * initialize us if needed
 		 */
 
-		if (!priv->tx_init) {
-			n = deflateInit2(&priv->tx, priv->args[PMD_COMP_LEVEL],
-					 Z_DEFLATED,
-					 -priv->args[PMD_SERVER_MAX_WINDOW_BITS +
-						(wsi->a.vhost->listen_port <= 0)],
-					 priv->args[PMD_MEM_LEVEL],
-					 Z_DEFAULT_STRATEGY);
-			if (n != Z_OK) {
-				lwsl_wsi_ext(wsi, "inflateInit2 failed %d", n);
+		if (!priv->tx) {
+			priv->tx = lws_pmd_zs_get(wsi, 1, priv->args[pmd_ours(wsi,
+						PMD_SERVER_MAX_WINDOW_BITS)],
+						priv->args[PMD_COMP_LEVEL],
+						priv->args[PMD_MEM_LEVEL]);
+			if (!priv->tx)
 				return PMDR_FAILED;
-			}
-			priv->tx_init = 1;
 		}
 
 		if (!priv->buf_tx_deflated)
@@ -418,27 +714,27 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 
 		if (pmdrx->eb_in.token) {
 
-			assert(!priv->tx.avail_in);
+			assert(!priv->tx->zs.avail_in);
 
 			priv->count_tx_between_fin = priv->count_tx_between_fin + (size_t)pmdrx->eb_in.len;
 			lwsl_wsi_ext(wsi, "TX: eb_in length %d, "
 				    "TOTAL TX since FIN: %d",
 				    pmdrx->eb_in.len,
 				    (int)priv->count_tx_between_fin);
-			priv->tx.next_in = (unsigned char *)pmdrx->eb_in.token;
-			priv->tx.avail_in = (uInt)pmdrx->eb_in.len;
+			priv->tx->zs.next_in = (unsigned char *)pmdrx->eb_in.token;
+			priv->tx->zs.avail_in = (uInt)pmdrx->eb_in.len;
 		}
 
-		priv->tx.next_out = priv->buf_tx_deflated + LWS_PRE + 5;
-		pmdrx->eb_out.token = priv->tx.next_out;
-		priv->tx.avail_out = (uInt)(1 << priv->args[PMD_TX_BUF_PWR2]);
+		priv->tx->zs.next_out = priv->buf_tx_deflated + LWS_PRE + 5;
+		pmdrx->eb_out.token = priv->tx->zs.next_out;
+		priv->tx->zs.avail_out = (uInt)(1 << priv->args[PMD_TX_BUF_PWR2]);
 
 		pen = 0;
 		penbits = 0;
-		deflatePending(&priv->tx, &pen, &penbits);
+		deflatePending(&priv->tx->zs, &pen, &penbits);
 		pen = pen | (unsigned int)penbits;
 
-		if (!priv->tx.avail_in && (len & LWS_WRITE_NO_FIN)) {
+		if (!priv->tx->zs.avail_in && (len & LWS_WRITE_NO_FIN)) {
 			lwsl_wsi_ext(wsi, "no available in, pen: %u", pen);
 
 			if (!pen)
@@ -452,13 +748,13 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 			m = Z_SYNC_FLUSH;
 		}
 
-		n = deflate(&priv->tx, m);
+		n = deflate(&priv->tx->zs, m);
 		if (n == Z_STREAM_ERROR) {
 			lwsl_wsi_notice(wsi, "Z_STREAM_ERROR");
 			return PMDR_FAILED;
 		}
 
-		pen = (!priv->tx.avail_out) && n != Z_STREAM_END;
+		pen = (!priv->tx->zs.avail_out) && n != Z_STREAM_END;
 
 		lwsl_wsi_ext(wsi, "deflate ret %d, len 0x%x", n,
 				(unsigned int)len);
@@ -468,7 +764,7 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		if ((len & 0xf) == LWS_WRITE_BINARY)
 			priv->tx_first_frame_type = LWSWSOPC_BINARY_FRAME;
 
-		pmdrx->eb_out.len = lws_ptr_diff(priv->tx.next_out,
+		pmdrx->eb_out.len = lws_ptr_diff(priv->tx->zs.next_out,
 						 pmdrx->eb_out.token);
 
 		if (m == Z_SYNC_FLUSH && !(len & LWS_WRITE_NO_FIN) && !pen &&
@@ -483,14 +779,21 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		    !pen &&
 		    pmdrx->eb_out.len >= 4) {
 			// lwsl_wsi_err(wsi, "Trimming 4 from end of write");
-			priv->tx.next_out -= 4;
-			priv->tx.avail_out += 4;
+			priv->tx->zs.next_out -= 4;
+			priv->tx->zs.avail_out += 4;
+#if defined(LWS_WITH_SYS_METRICS)
+			lws_pmd_saved(wsi, priv->count_tx_between_fin,
+				      priv->wire_tx + (size_t)
+				      lws_ptr_diff(priv->tx->zs.next_out,
+						   pmdrx->eb_out.token));
+#endif
 			priv->count_tx_between_fin = 0;
+			priv->wire_tx = 0;
 
-			assert(priv->tx.next_out[0] == 0x00 &&
-			       priv->tx.next_out[1] == 0x00 &&
-			       priv->tx.next_out[2] == 0xff &&
-			       priv->tx.next_out[3] == 0xff);
+			assert(priv->tx->zs.next_out[0] == 0x00 &&
+			       priv->tx->zs.next_out[1] == 0x00 &&
+			       priv->tx->zs.next_out[2] == 0xff &&
+			       priv->tx->zs.next_out[3] == 0xff);
 		}
 
 
@@ -499,12 +802,15 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 		 */
 
 		pmdrx->eb_in.token = pmdrx->eb_in.token +
-					((unsigned int)pmdrx->eb_in.len - (unsigned int)priv->tx.avail_in);
-		pmdrx->eb_in.len = (int)priv->tx.avail_in;
+					((unsigned int)pmdrx->eb_in.len - (unsigned int)priv->tx->zs.avail_in);
+		pmdrx->eb_in.len = (int)priv->tx->zs.avail_in;
 
 		priv->compressed_out = 1;
-		pmdrx->eb_out.len = lws_ptr_diff(priv->tx.next_out,
+		pmdrx->eb_out.len = lws_ptr_diff(priv->tx->zs.next_out,
 						 pmdrx->eb_out.token);
+		if (priv->count_tx_between_fin)
+			/* the message goes on */
+			priv->wire_tx += (size_t)pmdrx->eb_out.len;
 
 		lwsl_wsi_ext(wsi, "  TX rewritten with new eb_in len %d, "
 				"eb_out len %d, deflatePending %d",
@@ -549,10 +855,9 @@ lws_extension_callback_pm_deflate(struct lws_context *context,
 			    pmdrx->eb_in.len);
 
 		if (((*pmdrx->eb_in.token) & 0x80) &&	/* fin */
-		    priv->args[PMD_CLIENT_NO_CONTEXT_TAKEOVER]) {
-			lwsl_wsi_debug(wsi, "PMD_CLIENT_NO_CONTEXT_TAKEOVER");
-			(void)deflateEnd(&priv->tx);
-			priv->tx_init = 0;
+		    priv->args[pmd_ours(wsi, PMD_SERVER_NO_CONTEXT_TAKEOVER)]) {
+			lwsl_wsi_debug(wsi, "no context takeover");
+			lws_pmd_zs_put(wsi, &priv->tx);
 		}
 
 		break;
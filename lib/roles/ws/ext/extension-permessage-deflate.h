@@ -31,6 +31,14 @@
 #define DEFLATE_FRAME_COMPRESSION_LEVEL_SERVER 1
 #define DEFLATE_FRAME_COMPRESSION_LEVEL_CLIENT Z_DEFAULT_COMPRESSION
 
+/* what server connections get once the thread is over its memory budget */
+#define LWS_PMD_BUDGET_WINDOW_BITS 10
+#define LWS_PMD_BUDGET_MEM_LEVEL 4
+
+#ifndef LWS_DEF_PMD_POOL_SPARE
+#define LWS_DEF_PMD_POOL_SPARE 8
+#endif
+
 enum arg_indexes {
 	PMD_SERVER_NO_CONTEXT_TAKEOVER,
 	PMD_CLIENT_NO_CONTEXT_TAKEOVER,
@@ -44,9 +52,24 @@ enum arg_indexes {
 	PMD_ARG_COUNT
 };
 
+/*
+ * A z_stream on loan to a connection, or idle in its service thread's pool,
+ * after a reset, for the next one wanting the same parameters
+ */
+
+struct lws_pmd_zs {
+	lws_dll2_t list;	/* pt->ws.pmd_pool when idle */
+	z_stream zs;
+	size_t mem;		/* estimate of zlib's allocations for it */
+	unsigned char deflate;
+	unsigned char wbits;
+	unsigned char level;
+	unsigned char mem_level;
+};
+
 struct lws_ext_pm_deflate_priv {
-	z_stream rx;
-	z_stream tx;
+	struct lws_pmd_zs *rx;	/* NULL, or inflating */
+	struct lws_pmd_zs *tx;	/* NULL, or deflating */
 
 	unsigned char *buf_rx_inflated; /* RX inflated output buffer */
 	unsigned char *buf_tx_deflated; /* TX deflated output buffer */
@@ -58,12 +81,13 @@ struct lws_ext_pm_deflate_priv {
 
 	size_t len_tx_holding;
 
+	size_t wire_rx;	/* compressed bytes in the current message */
+	size_t wire_tx;
+
 	unsigned char args[PMD_ARG_COUNT];
 
 	unsigned char tx_first_frame_type;
 
-	unsigned char tx_init:1;
-	unsigned char rx_init:1;
 	unsigned char compressed_out:1;
 };
 
@@ -31,6 +31,8 @@ lws_context_init_extensions(const struct lws_context_creation_info *info,
 			    struct lws_context *context)
 {
 	lwsl_cx_info(context, " LWS_MAX_EXTENSIONS_ACTIVE: %u", LWS_MAX_EXTENSIONS_ACTIVE);
+
+	context->pmd_mem_budget = info->pmd_mem_budget / context->count_threads;
 }
 
 enum lws_ext_option_parser_states {
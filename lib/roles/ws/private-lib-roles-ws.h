@@ -84,6 +84,9 @@ struct lws_vhost_role_ws {
 struct lws_pt_role_ws {
 	struct lws *rx_draining_ext_list;
 	struct lws *tx_draining_ext_list;
+
+	lws_dll2_owner_t pmd_pool; /* idle permessage-deflate z_streams */
+	size_t pmd_mem; /* zlib state allocated on this thread, lent or idle */
 };
 #endif
 
@@ -186,6 +189,15 @@ lws_ext_cb_all_exts(struct lws_context *context, struct lws *wsi, int reason,
 		    void *arg, int len);
 LWS_EXTERN int
 lws_extension_server_handshake(struct lws *wsi, char **p, int budget);
+void
+lws_pmd_pool_destroy(struct lws_context_per_thread *pt);
+int
+lws_pmd_bcast_params(struct lws *wsi, uint8_t *p);
+uint8_t *
+lws_pmd_bcast_deflate(struct lws *wsi, const uint8_t *p, const uint8_t *in,
+		      size_t len, size_t pre, size_t *olen);
+void
+lws_pmd_bcast_sent(struct lws *wsi, size_t plain, size_t wire);
 #endif
 
 int
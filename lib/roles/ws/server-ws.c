@@ -32,7 +32,7 @@ lws_extension_server_handshake(struct lws *wsi, char **p, int budget)
 {
 	struct lws_context *context = wsi->a.context;
 	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
-	char ext_name[64], ev[64], *args, *end = (*p) + budget - 1;
+	char ext_name[64], ev[128], *args, *end = (*p) + budget - 1;
 	const struct lws_ext_options *opts, *po;
 	const struct lws_extension *ext;
 	struct lws_ext_option_arg oa;
@@ -231,6 +231,17 @@ lws_extension_server_handshake(struct lws *wsi, char **p, int budget)
 					args++;
 			}
 
+			/* let the extension add any options of its own */
+
+			m = ext->callback(lws_get_context(wsi), ext, wsi,
+					  LWS_EXT_CB_SERVER_RESPONSE_ARGS,
+					  wsi->ws->act_ext_user[
+						wsi->ws->count_act_ext],
+					  ev + ep,
+					  (size_t)((int)sizeof(ev) - 1 - ep));
+			if (m > 0 && m < (int)sizeof(ev) - 1 - ep)
+				ep += m;
+
 			wsi->ws->count_act_ext++;
 			lwsl_parser("cnt_act_ext <- %d\n",
 				    wsi->ws->count_act_ext);
@@ -818,7 +829,7 @@ lws_ws_frame_rest_is_payload(struct lws *wsi, uint8_t **buf, size_t len)
 {
 	struct lws_ext_pm_deflate_rx_ebufs pmdrx;
 	unsigned int avail = (unsigned int)len;
-	uint8_t *buffer = *buf, mask[4];
+	uint8_t *buffer = *buf;
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 	unsigned int old_packet_length = (unsigned int)wsi->ws->rx_packet_length;
 #endif
@@ -858,31 +869,10 @@ lws_ws_frame_rest_is_payload(struct lws *wsi, uint8_t **buf, size_t len)
 	pmdrx.eb_out.token = buffer;
 	pmdrx.eb_out.len = (int)avail;
 
-	if (!wsi->ws->all_zero_nonce) {
-
-		for (n = 0; n < 4; n++)
-			mask[n] = wsi->ws->mask[(wsi->ws->mask_idx + n) & 3];
-
-		/* deal with 4-byte chunks using unwrapped loop */
-		n = (int)(avail >> 2);
-		while (n--) {
-			*(buffer) = *(buffer) ^ mask[0];
-			buffer++;
-			*(buffer) = *(buffer) ^ mask[1];
-			buffer++;
-			*(buffer) = *(buffer) ^ mask[2];
-			buffer++;
-			*(buffer) = *(buffer) ^ mask[3];
-			buffer++;
-		}
-		/* and the remaining bytes bytewise */
-		for (n = 0; n < (int)(avail & 3); n++) {
-			*(buffer) = *(buffer) ^ mask[n];
-			buffer++;
-		}
-
-		wsi->ws->mask_idx = (wsi->ws->mask_idx + avail) & 3;
-	}
+	if (!wsi->ws->all_zero_nonce)
+		wsi->ws->mask_idx = (uint8_t)lws_ws_mask(buffer, avail,
+						wsi->ws->mask,
+						wsi->ws->mask_idx);
 
 	lwsl_info("%s: using %d of raw input (total %d on offer)\n", __func__,
 		    avail, (int)len);
@@ -998,6 +988,41 @@ utf8_fail:
 }
 
 
+/*
+ * Control frame payloads are collected in rx_ubuf for the state machine to
+ * act on when the frame is complete.  Copy and unmask as much of it as we
+ * have in one go, rather than feed it through the state machine bytewise.
+ */
+
+static size_t
+lws_ws_frame_rest_is_ctl(struct lws *wsi, uint8_t **buf, size_t len)
+{
+	uint8_t *p;
+
+	if (!wsi->ws->rx_ubuf ||
+	    wsi->ws->rx_ubuf_head + LWS_PRE >= wsi->ws->rx_ubuf_alloc)
+		/* let the state machine deal with it */
+		return 0;
+
+	if (len > wsi->ws->rx_packet_length)
+		len = wsi->ws->rx_packet_length;
+	if (len > wsi->ws->rx_ubuf_alloc - LWS_PRE - wsi->ws->rx_ubuf_head)
+		len = wsi->ws->rx_ubuf_alloc - LWS_PRE - wsi->ws->rx_ubuf_head;
+
+	p = &wsi->ws->rx_ubuf[LWS_PRE + wsi->ws->rx_ubuf_head];
+	memcpy(p, *buf, len);
+	if (!wsi->ws->all_zero_nonce)
+		wsi->ws->mask_idx = (uint8_t)lws_ws_mask(p, len, wsi->ws->mask,
+							 wsi->ws->mask_idx);
+
+	wsi->ws->rx_ubuf_head += (uint32_t)len;
+	wsi->ws->rx_packet_length -= len;
+	*buf += len;
+
+	return len;
+}
+
+
 int
 lws_parse_ws(struct lws *wsi, unsigned char **buf, size_t len)
 {
@@ -1009,9 +1034,17 @@ lws_parse_ws(struct lws *wsi, unsigned char **buf, size_t len)
 
 	//lwsl_hexdump_notice(*buf, len);
 
-	/* let the rx protocol state machine have as much as it needs */
+	/*
+	 * let the rx protocol state machine have as much as it needs... and
+	 * if the inflator is left with some of this input, let it finish
+	 * with it while it's still there, the buffer is reused after
+	 */
 
-	while (len) {
+	while (len
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	       || wsi->ws->rx_draining_ext
+#endif
+	) {
 		/*
 		 * we were accepting input but now we stopped doing so
 		 */
@@ -1077,7 +1110,14 @@ lws_parse_ws(struct lws *wsi, unsigned char **buf, size_t len)
 			}
 		}
 
-		if (!bulk) {
+		if (!bulk && len &&
+		    wsi->lws_rx_parse_state == LWS_RXPS_WS_FRAME_PAYLOAD &&
+		    (wsi->ws->opcode & 8) &&
+		    (m = (int)lws_ws_frame_rest_is_ctl(wsi, buf, len))) {
+			/* the payload is already in rx_ubuf */
+			len -= (size_t)m;
+			hr = lws_ws_rx_sm(wsi, ALREADY_PROCESSED_IGNORE_CHAR, 0);
+		} else if (!bulk) {
 			/* process the byte */
 			hr = lws_ws_rx_sm(wsi, 0, *(*buf)++);
 			len--;
@@ -0,0 +1,302 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ws broadcast messages, framed once and sent to many connections.
+ *
+ * Server to client frames aren't masked, so one frame, header and payload, is
+ * good for every server connection.  Connections with permessage-deflate get
+ * a frame deflated once for each set of deflate parameters in use.  Each send
+ * references the frame from the connection's buflist_out via lws_write_iov(),
+ * holding a reference on the message until the connection is done with it.
+ */
+
+#include "private-lib-core.h"
+
+#define LWS_WS_BCAST_HDR	10	/* largest unmasked ws frame header */
+#define LWS_WS_BCAST_VARIANTS	4	/* plain, and up to 3 deflated */
+
+struct lws_ws_bcast_frame {
+	uint8_t			*alloc;	/* NULL if the slot is unused */
+	const uint8_t		*buf;	/* ws header, then the payload */
+	size_t			len;
+	uint8_t			p[3];	/* deflate window bits, level, mem */
+};
+
+struct lws_ws_bcast {
+	struct lws_context		*cx;
+	struct lws_ws_bcast_frame	f[LWS_WS_BCAST_VARIANTS];
+	const uint8_t			*payload;	/* inside f[0].alloc */
+	size_t				len;
+	int				refcount;
+	enum lws_write_protocol		wp;
+};
+
+/* writes the ws header just before the payload, returns where it starts */
+
+static const uint8_t *
+lws_ws_bcast_hdr(uint8_t *payload, size_t len, uint8_t b0)
+{
+	uint8_t *p;
+	int n;
+
+	if (len < 126) {
+		p = payload - 2;
+		p[1] = (uint8_t)len;
+	} else if (len < 65536) {
+		p = payload - 4;
+		p[1] = 126;
+		p[2] = (uint8_t)(len >> 8);
+		p[3] = (uint8_t)len;
+	} else {
+		p = payload - 10;
+		p[1] = 127;
+		for (n = 0; n < 8; n++)
+			p[2 + n] = (uint8_t)((uint64_t)len >> (56 - (8 * n)));
+	}
+	p[0] = b0;
+
+	return p;
+}
+
+lws_ws_bcast_t *
+lws_ws_bcast_create(struct lws_context *cx, const uint8_t *buf, size_t len,
+		    enum lws_write_protocol wp)
+{
+	struct lws_ws_bcast *b;
+	uint8_t opc;
+
+	switch ((int)wp) {
+	case LWS_WRITE_TEXT:
+		opc = LWSWSOPC_TEXT_FRAME;
+		break;
+	case LWS_WRITE_BINARY:
+		opc = LWSWSOPC_BINARY_FRAME;
+		break;
+	default:
+		lwsl_cx_err(cx, "bcast must be TEXT or BINARY");
+		return NULL;
+	}
+
+	b = lws_zalloc(sizeof(*b), __func__);
+	if (!b)
+		return NULL;
+
+	b->f[0].alloc = lws_malloc(LWS_WS_BCAST_HDR + len + 1, "bcast frame");
+	if (!b->f[0].alloc) {
+		lws_free(b);
+		return NULL;
+	}
+
+	memcpy(b->f[0].alloc + LWS_WS_BCAST_HDR, buf, len);
+	b->payload	= b->f[0].alloc + LWS_WS_BCAST_HDR;
+	b->len		= len;
+	b->f[0].buf	= lws_ws_bcast_hdr(b->f[0].alloc + LWS_WS_BCAST_HDR,
+					   len, (uint8_t)(0x80 | opc));
+	b->f[0].len	= len + lws_ptr_diff_size_t(b->payload, b->f[0].buf);
+	b->cx		= cx;
+	b->wp		= wp;
+	b->refcount	= 1;
+
+	return b;
+}
+
+void
+lws_ws_bcast_ref(lws_ws_bcast_t *b)
+{
+	lws_context_lock(b->cx, __func__);
+	b->refcount++;
+	lws_context_unlock(b->cx);
+}
+
+void
+lws_ws_bcast_unref(lws_ws_bcast_t *b)
+{
+	int n;
+
+	lws_context_lock(b->cx, __func__);
+	n = --b->refcount;
+	lws_context_unlock(b->cx);
+
+	if (n)
+		return;
+
+	for (n = 0; n < LWS_WS_BCAST_VARIANTS; n++)
+		if (b->f[n].alloc)
+			lws_free(b->f[n].alloc);
+
+	lws_free(b);
+}
+
+static void
+lws_ws_bcast_release(void *opaque)
+{
+	lws_ws_bcast_unref((lws_ws_bcast_t *)opaque);
+}
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+
+/*
+ * The frame deflated with the parameters p, or else the first unused slot, or
+ * NULL if they're all used by others.  Called with the context lock held.
+ */
+
+static struct lws_ws_bcast_frame *
+lws_ws_bcast_find(lws_ws_bcast_t *b, const uint8_t *p)
+{
+	int n;
+
+	for (n = 1; n < LWS_WS_BCAST_VARIANTS; n++)
+		if (!b->f[n].alloc || !memcmp(b->f[n].p, p, sizeof(b->f[n].p)))
+			return &b->f[n];
+
+	return NULL;
+}
+
+/*
+ * Find, or create, the frame deflated with the parameters p.  Returns NULL if
+ * it can't be had, so the caller falls back to sending a copy.
+ *
+ * Other service threads may be sending the same message, so the deflate is
+ * done outside the context lock, and the lock only taken to look for the frame
+ * and to install ours.  If another thread installed it meanwhile, we use
+ * theirs and drop ours.  Once installed, a frame doesn't change until the
+ * message is freed.
+ */
+
+static const struct lws_ws_bcast_frame *
+lws_ws_bcast_deflated(struct lws *wsi, lws_ws_bcast_t *b, const uint8_t *p)
+{
+	struct lws_ws_bcast_frame *f, nf;
+	size_t olen;
+	int have;
+
+	lws_context_lock(b->cx, __func__);
+	f = lws_ws_bcast_find(b, p);
+	have = f && f->alloc;
+	lws_context_unlock(b->cx);
+
+	if (!f || have)
+		return f;
+
+	nf.alloc = lws_pmd_bcast_deflate(wsi, p, b->payload, b->len,
+					 LWS_WS_BCAST_HDR, &olen);
+	if (!nf.alloc)
+		return NULL;
+
+	memcpy(nf.p, p, sizeof(nf.p));
+	/* RSV1 marks it as compressed */
+	nf.buf = lws_ws_bcast_hdr(nf.alloc + LWS_WS_BCAST_HDR, olen,
+				  (uint8_t)(0xc0 | (b->f[0].buf[0] & 0xf)));
+	nf.len = olen + lws_ptr_diff_size_t(nf.alloc + LWS_WS_BCAST_HDR,
+					    nf.buf);
+
+	lws_context_lock(b->cx, __func__);
+	f = lws_ws_bcast_find(b, p);
+	if (f && !f->alloc) {
+		*f = nf;
+		nf.alloc = NULL;
+	}
+	lws_context_unlock(b->cx);
+
+	if (nf.alloc)
+		lws_free(nf.alloc);
+
+	return f;
+}
+#endif
+
+static int
+lws_ws_bcast_write_copy(struct lws *wsi, lws_ws_bcast_t *b)
+{
+	uint8_t *buf = lws_malloc(LWS_PRE + b->len + 1, __func__);
+	int n;
+
+	if (!buf)
+		return -1;
+
+	memcpy(buf + LWS_PRE, b->payload, b->len);
+	n = lws_write(wsi, buf + LWS_PRE, b->len, b->wp);
+	lws_free(buf);
+
+	return n;
+}
+
+int
+lws_ws_bcast_write(struct lws *wsi, lws_ws_bcast_t *b)
+{
+	const struct lws_ws_bcast_frame *f = &b->f[0];
+	struct lws_write_iov iov;
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	uint8_t p[3];
+	int pmd;
+#endif
+
+	if (!lwsi_role_ws(wsi)) {
+		lwsl_wsi_err(wsi, "not ws");
+		return -1;
+	}
+
+	/*
+	 * Only a server connection between messages, with nothing queued
+	 * inside lws's ws tx state, can take the shared frame
+	 */
+
+	if (lwsi_role_client(wsi) || wsi->mux_substream ||
+	    lwsi_state(wsi) != LRS_ESTABLISHED || wsi->ws->inside_frame ||
+	    wsi->ws->stashed_write_pending)
+		return lws_ws_bcast_write_copy(wsi, b);
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	if (wsi->ws->tx_draining_ext)
+		return lws_ws_bcast_write_copy(wsi, b);
+
+	pmd = lws_pmd_bcast_params(wsi, p);
+	if (pmd < 0)
+		return lws_ws_bcast_write_copy(wsi, b);
+#endif
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	if (pmd) {
+		f = lws_ws_bcast_deflated(wsi, b, p);
+		if (!f)
+			return lws_ws_bcast_write_copy(wsi, b);
+	}
+#endif
+
+	/* until this connection is done with it */
+	lws_ws_bcast_ref(b);
+
+	iov.buf = f->buf;
+	iov.len = f->len;
+
+	/* the reference is dropped by the release cb, maybe already here */
+	if (lws_write_iov(wsi, &iov, 1, lws_ws_bcast_release, b) < 0)
+		return -1;
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	if (pmd)
+		lws_pmd_bcast_sent(wsi, b->len, f->len);
+#endif
+
+	return (int)b->len;
+}
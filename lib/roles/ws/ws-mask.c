@@ -0,0 +1,173 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ws payload masking kernel, shared by server rx unmasking and client tx
+ * masking.
+ *
+ * The mask is applied bytewise until the buffer is 8-byte aligned, then
+ * in vector or 64-bit word chunks using the mask rotated by the index at that
+ * point, then bytewise again for the tail.  Every chunk is a multiple of 4
+ * bytes, so the mask index only moves during the head and tail.
+ *
+ * On x86 SSE2 is used if the compiler is targeting it, and AVX2 if the cpu
+ * reports it at runtime; on ARM NEON is used if the compiler is targeting it.
+ */
+
+#include "private-lib-core.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define LWS_WS_MASK_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LWS_WS_MASK_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(LWS_WS_MASK_SSE2)
+
+__attribute__((target("avx2"))) static size_t
+lws_ws_mask_avx2(uint8_t *buf, size_t len, const uint8_t *m8)
+{
+	__m256i m, v0, v1;
+	size_t done = 0;
+	uint64_t m64;
+
+	memcpy(&m64, m8, sizeof(m64));
+	m = _mm256_set1_epi64x((long long)m64);
+
+	while (len - done >= 64) {
+		v0 = _mm256_loadu_si256((__m256i *)(buf + done));
+		v1 = _mm256_loadu_si256((__m256i *)(buf + done + 32));
+		_mm256_storeu_si256((__m256i *)(buf + done),
+				    _mm256_xor_si256(v0, m));
+		_mm256_storeu_si256((__m256i *)(buf + done + 32),
+				    _mm256_xor_si256(v1, m));
+		done += 64;
+	}
+
+	if (len - done >= 32) {
+		v0 = _mm256_loadu_si256((__m256i *)(buf + done));
+		_mm256_storeu_si256((__m256i *)(buf + done),
+				    _mm256_xor_si256(v0, m));
+		done += 32;
+	}
+
+	return done;
+}
+
+static size_t
+lws_ws_mask_sse2(uint8_t *buf, size_t len, const uint8_t *m8)
+{
+	__m128i m = _mm_loadl_epi64((const __m128i *)m8);
+	size_t done = 0;
+
+	m = _mm_unpacklo_epi64(m, m);
+
+	while (len - done >= 16) {
+		_mm_storeu_si128((__m128i *)(buf + done), _mm_xor_si128(
+				_mm_loadu_si128((__m128i *)(buf + done)), m));
+		done += 16;
+	}
+
+	return done;
+}
+
+#endif
+
+#if defined(LWS_WS_MASK_NEON)
+
+static size_t
+lws_ws_mask_neon(uint8_t *buf, size_t len, const uint8_t *m8)
+{
+	uint8x16_t m = vcombine_u8(vld1_u8(m8), vld1_u8(m8));
+	size_t done = 0;
+
+	while (len - done >= 16) {
+		vst1q_u8(buf + done, veorq_u8(vld1q_u8(buf + done), m));
+		done += 16;
+	}
+
+	return done;
+}
+
+#endif
+
+unsigned int
+lws_ws_mask(uint8_t *buf, size_t len, const uint8_t *mask, unsigned int idx)
+{
+	uint8_t m8[8];
+	uint64_t m64, w;
+	size_t n;
+
+	idx &= 3;
+
+	/* unaligned head, bytewise */
+
+	while (len && ((uintptr_t)buf & 7)) {
+		*buf++ ^= mask[idx];
+		idx = (idx + 1) & 3;
+		len--;
+	}
+
+	if (len >= 8) {
+		for (n = 0; n < 8; n++)
+			m8[n] = mask[(idx + n) & 3];
+
+#if defined(LWS_WS_MASK_SSE2)
+		if (len >= 32 && __builtin_cpu_supports("avx2")) {
+			n = lws_ws_mask_avx2(buf, len, m8);
+			buf += n;
+			len -= n;
+		}
+		n = lws_ws_mask_sse2(buf, len, m8);
+		buf += n;
+		len -= n;
+#endif
+#if defined(LWS_WS_MASK_NEON)
+		n = lws_ws_mask_neon(buf, len, m8);
+		buf += n;
+		len -= n;
+#endif
+
+		memcpy(&m64, m8, sizeof(m64));
+		while (len >= 8) {
+			memcpy(&w, buf, sizeof(w));
+			w ^= m64;
+			memcpy(buf, &w, sizeof(w));
+			buf += 8;
+			len -= 8;
+		}
+	}
+
+	/* tail, bytewise */
+
+	while (len--) {
+		*buf++ ^= mask[idx];
+		idx = (idx + 1) & 3;
+	}
+
+	return idx;
+}
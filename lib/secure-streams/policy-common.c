@@ -33,6 +33,194 @@ const lws_ss_policy_t pol_smd = {
 };
 #endif
 
+/*
+ * Streamtypes are looked up by name for every stream creation, and metadata
+ * by name on every metadata access, with policies that may have hundreds of
+ * streamtypes.  So when a policy is set, we build an open-addressed hash index
+ * of the streamtype names, and of (policy, metadata name) pairs giving the
+ * metadata's index in the handle's metadata array.
+ *
+ * The index is dropped as soon as a new policy or overlay starts to be parsed,
+ * while there's no index, lookups walk the lists as before.
+ */
+
+typedef struct lws_ss_pidx_pol {
+	const lws_ss_policy_t	*pol;
+	uint32_t		hval;
+} lws_ss_pidx_pol_t;
+
+typedef struct lws_ss_pidx_md {
+	const lws_ss_policy_t	*pol;
+	lws_ss_metadata_t	*pmd;
+	uint32_t		hval;
+	int			index; /* in the handle's metadata[] */
+} lws_ss_pidx_md_t;
+
+struct lws_ss_pidx {
+	lws_ss_pidx_pol_t	*pol;
+	lws_ss_pidx_md_t	*md;
+	uint32_t		pol_mask;
+	uint32_t		md_mask;
+
+	/* tables overallocated here */
+};
+
+static uint32_t
+lws_ss_pidx_hash(uint32_t h, const char *s)
+{
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 0x01000193u;
+
+	return h ^ (h >> 16);
+}
+
+static uint32_t
+lws_ss_pidx_size(size_t count)
+{
+	uint32_t n = 8;
+
+	while (n < count * 2)
+		n <<= 1;
+
+	return n;
+}
+
+void
+lws_ss_policy_index_destroy(struct lws_context *context)
+{
+	lws_free_set_NULL(context->ss_pidx);
+}
+
+void
+lws_ss_policy_index(struct lws_context *context)
+{
+	size_t npol = 0, nmd = 0;
+	const lws_ss_policy_t *p;
+	struct lws_ss_pidx *ix;
+	lws_ss_metadata_t *pmd;
+	uint32_t h, m;
+	int n;
+
+	lws_ss_policy_index_destroy(context);
+
+	for (p = context->pss_policies; p; p = p->next) {
+		npol++;
+		for (pmd = p->metadata; pmd; pmd = pmd->next)
+			nmd++;
+	}
+
+	if (!npol)
+		return;
+
+	ix = lws_zalloc(sizeof(*ix) +
+			lws_ss_pidx_size(npol) * sizeof(lws_ss_pidx_pol_t) +
+			lws_ss_pidx_size(nmd) * sizeof(lws_ss_pidx_md_t),
+			__func__);
+	if (!ix) {
+		/* lookups will just be slower */
+		lwsl_cx_warn(context, "OOM");
+
+		return;
+	}
+
+	ix->pol_mask = lws_ss_pidx_size(npol) - 1;
+	ix->md_mask = lws_ss_pidx_size(nmd) - 1;
+	ix->pol = (lws_ss_pidx_pol_t *)&ix[1];
+	ix->md = (lws_ss_pidx_md_t *)&ix->pol[ix->pol_mask + 1];
+
+	for (p = context->pss_policies; p; p = p->next) {
+		if (!p->streamtype)
+			continue;
+
+		/* if the same streamtype is listed twice, the first one wins */
+
+		h = lws_ss_pidx_hash(0x811c9dc5u, p->streamtype);
+		m = h & ix->pol_mask;
+		while (ix->pol[m].pol &&
+		       (ix->pol[m].hval != h ||
+			strcmp(ix->pol[m].pol->streamtype, p->streamtype)))
+			m = (m + 1) & ix->pol_mask;
+		if (ix->pol[m].pol)
+			continue;
+
+		ix->pol[m].pol = p;
+		ix->pol[m].hval = h;
+
+		for (pmd = p->metadata, n = 0; pmd; pmd = pmd->next, n++) {
+			if (!pmd->name)
+				continue;
+
+			h = lws_ss_pidx_hash(0x811c9dc5u ^
+					     (uint32_t)(lws_intptr_t)p, pmd->name);
+			m = h & ix->md_mask;
+			while (ix->md[m].pol &&
+			       (ix->md[m].pol != p || ix->md[m].hval != h ||
+				strcmp(ix->md[m].pmd->name, pmd->name)))
+				m = (m + 1) & ix->md_mask;
+			if (ix->md[m].pol)
+				continue;
+
+			ix->md[m].pol = p;
+			ix->md[m].pmd = pmd;
+			ix->md[m].hval = h;
+			ix->md[m].index = n;
+		}
+	}
+
+	context->ss_pidx = ix;
+}
+
+static const lws_ss_policy_t *
+lws_ss_pidx_lookup(const struct lws_ss_pidx *ix, const char *streamtype)
+{
+	uint32_t h = lws_ss_pidx_hash(0x811c9dc5u, streamtype),
+		 m = h & ix->pol_mask;
+
+	while (ix->pol[m].pol) {
+		if (ix->pol[m].hval == h &&
+		    !strcmp(ix->pol[m].pol->streamtype, streamtype))
+			return ix->pol[m].pol;
+		m = (m + 1) & ix->pol_mask;
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the index of the named metadata in the handle metadata array, with
+ * *ppmd set to the policy metadata, or -1 if the policy doesn't have it, or -2
+ * if the policy isn't indexed and the caller should look for it the slow way.
+ */
+
+static int
+lws_ss_pidx_metadata(const struct lws_context *context,
+		     const lws_ss_policy_t *p, const char *name,
+		     lws_ss_metadata_t **ppmd)
+{
+	const struct lws_ss_pidx *ix = context->ss_pidx;
+	uint32_t h, m;
+
+	if (!ix || !p->streamtype)
+		return -2;
+
+	h = lws_ss_pidx_hash(0x811c9dc5u ^ (uint32_t)(lws_intptr_t)p, name);
+	m = h & ix->md_mask;
+
+	while (ix->md[m].pol) {
+		if (ix->md[m].pol == p && ix->md[m].hval == h &&
+		    !strcmp(ix->md[m].pmd->name, name)) {
+			*ppmd = ix->md[m].pmd;
+
+			return ix->md[m].index;
+		}
+		m = (m + 1) & ix->md_mask;
+	}
+
+	/* eg, a policy given directly to lws_ss_create() isn't indexed */
+
+	return lws_ss_pidx_lookup(ix, p->streamtype) == p ? -1 : -2;
+}
+
 const lws_ss_policy_t *
 lws_ss_policy_lookup(const struct lws_context *context, const char *streamtype)
 {
@@ -46,6 +234,9 @@ lws_ss_policy_lookup(const struct lws_context *context, const char *streamtype)
 		return &pol_smd;
 #endif
 
+	if (context->ss_pidx)
+		return lws_ss_pidx_lookup(context->ss_pidx, streamtype);
+
 	while (p) {
 		if (!strcmp(p->streamtype, streamtype))
 			return p;
@@ -221,10 +412,17 @@ bail:
 lws_ss_metadata_t *
 lws_ss_get_handle_metadata(struct lws_ss_handle *h, const char *name)
 {
+	lws_ss_metadata_t *pmd;
 	int n;
 
 	lws_service_assert_loop_thread(h->context, h->tsi);
 
+	n = lws_ss_pidx_metadata(h->context, h->policy, name, &pmd);
+	if (n >= 0)
+		return &h->metadata[n];
+	if (n == -1)
+		return NULL;
+
 	for (n = 0; n < h->policy->metadata_count; n++)
 		if (!strcmp(name, h->metadata[n].name))
 			return &h->metadata[n];
@@ -251,10 +449,19 @@ lws_ss_get_handle_instant_metadata(struct lws_ss_handle *h, const char *name)
 
 
 lws_ss_metadata_t *
-lws_ss_policy_metadata(const lws_ss_policy_t *p, const char *name)
+lws_ss_policy_metadata(const struct lws_context *context,
+		       const lws_ss_policy_t *p, const char *name)
 {
-	lws_ss_metadata_t *pmd = p->metadata;
+	lws_ss_metadata_t *pmd;
+	int n;
+
+	n = lws_ss_pidx_metadata(context, p, name, &pmd);
+	if (n >= 0)
+		return pmd;
+	if (n == -1)
+		return NULL;
 
+	pmd = p->metadata;
 	while (pmd) {
 		if (pmd->name && !strcmp(name, pmd->name))
 			return pmd;
@@ -589,6 +796,8 @@ lws_ss_policy_set(struct lws_context *context, const char *name)
 	lws_free_set_NULL(context->pol_args);
 #endif
 
+	lws_ss_policy_index(context);
+
 #if defined(LWS_WITH_SYS_METRICS)
 	lws_metric_rebind_policies(context);
 #endif
@@ -322,7 +322,7 @@ lws_ss_policy_parser_cb(struct lejp_ctx *ctx, char reason)
 	size_t inl, outl;
 	uint8_t *extant;
 	backoff_t *bot;
-	int n = -1;
+	int n = -1, m;
 
 	// lwsl_notice("%s: %d %d %s %s\n", __func__, reason, ctx->path_match - 1,
 	//	   ctx->path, ctx->buf);
@@ -434,10 +434,11 @@ lws_ss_policy_parser_cb(struct lejp_ctx *ctx, char reason)
 			p2 = (lws_ss_policy_t *)a->context->pss_policies;
 
 			while (p2) {
+				m = ctx->path_match_len - ctx->st[ctx->sp].p;
 				if (!strncmp(p2->streamtype,
 					     ctx->path + ctx->st[ctx->sp].p,
-					     (unsigned int)(ctx->path_match_len -
-						          ctx->st[ctx->sp].p))) {
+					     (unsigned int)m) &&
+				    !p2->streamtype[m]) {
 					lwsl_info("%s: overriding s[] %s\n",
 						  __func__, p2->streamtype);
 					break;
@@ -1167,6 +1168,9 @@ lws_ss_policy_parse_begin(struct lws_context *context, int overlay)
 
 		return 1;
 	}
+	/* the index may not be valid by the time we're finished */
+	lws_ss_policy_index_destroy(context);
+
 	if (overlay)
 		/* continue to use the existing lwsac */
 		args->ac = context->ac_policy;
@@ -1295,9 +1299,16 @@ lws_ss_policy_parse(struct lws_context *context, const uint8_t *buf, size_t len)
 int
 lws_ss_policy_overlay(struct lws_context *context, const char *overlay)
 {
+	int n;
+
 	lws_ss_policy_parse_begin(context, 1);
-	return lws_ss_policy_parse(context, (const uint8_t *)overlay,
-				   strlen(overlay));
+	n = lws_ss_policy_parse(context, (const uint8_t *)overlay,
+				strlen(overlay));
+
+	/* overlays may have changed the existing streamtypes' metadata */
+	lws_ss_policy_index(context);
+
+	return n;
 }
 
 const lws_ss_policy_t *
@@ -524,6 +524,12 @@ lws_sspc_sul_retry_cb(lws_sorted_usec_list_t *sul);
 const lws_ss_policy_t *
 lws_ss_policy_lookup(const struct lws_context *context, const char *streamtype);
 
+void
+lws_ss_policy_index(struct lws_context *context);
+
+void
+lws_ss_policy_index_destroy(struct lws_context *context);
+
 /* can be used as a cb from lws_dll2_foreach_safe() to destroy ss */
 int
 lws_ss_destroy_dll(struct lws_dll2 *d, void *user);
@@ -573,7 +579,8 @@ lws_ss_get_handle_instant_metadata(struct lws_ss_handle *h, const char *name);
 #endif
 
 lws_ss_metadata_t *
-lws_ss_policy_metadata(const lws_ss_policy_t *p, const char *name);
+lws_ss_policy_metadata(const struct lws_context *context,
+		       const lws_ss_policy_t *p, const char *name);
 
 int
 lws_ss_exp_cb_metadata(void *priv, const char *name, char *out, size_t *pos,
@@ -502,7 +502,8 @@ lws_ss_exp_cb_metadata(void *priv, const char *name, char *out, size_t *pos,
 	lws_ss_handle_t *h = (lws_ss_handle_t *)priv;
 	const char *replace = NULL;
 	size_t total, budget;
-	lws_ss_metadata_t *md = lws_ss_policy_metadata(h->policy, name),
+	lws_ss_metadata_t *md = lws_ss_policy_metadata(h->context,
+							h->policy, name),
 			  *hmd = lws_ss_get_handle_metadata(h, name);
 
 	if (!md) {
@@ -543,8 +544,7 @@ lws_ss_set_timeout_us(lws_ss_handle_t *h, lws_usec_t us)
 	struct lws_context_per_thread *pt = &h->context->pt[h->tsi];
 
 	h->sul.cb = lws_ss_timeout_sul_check_cb;
-	__lws_sul_insert_us(&pt->pt_sul_owner[
-	            !!(h->policy->flags & LWSSSPOLF_WAKE_SUSPEND__VALIDITY)],
+	__lws_sul_insert_us(pt, !!(h->policy->flags & LWSSSPOLF_WAKE_SUSPEND__VALIDITY),
 		    &h->sul, us);
 
 	return 0;
@@ -673,6 +673,7 @@ payload_ff:
 			 * name
 			 */
 			pm = lws_ss_policy_metadata(
+					proxy_pss_to_ss_h(pss)->context,
 					proxy_pss_to_ss_h(pss)->policy,
 					par->metadata_name);
 			if (!pm) {
@@ -683,10 +683,9 @@ lws_adns_parse_udp(lws_async_dns_t *dns, const uint8_t *pkt, size_t len)
 		 */
 
 		c->flags = adst.flags;
-		lws_dll2_add_head(&c->list, &dns->cached);
+		lws_adns_cache_add(dns, c);
 		lws_sul_schedule(q->context, 0, &c->sul, sul_cb_expire,
-				 lws_now_usecs() +
-				 (adst.smallest_ttl * LWS_US_PER_SEC));
+				 (lws_usec_t)adst.smallest_ttl * LWS_US_PER_SEC);
 	}
 
 	if (q->responded != q->asked)
@@ -25,6 +25,45 @@
 #include "private-lib-core.h"
 #include "private-lib-async-dns.h"
 
+#if !defined(LWS_PLAT_OPTEE) && !defined(LWS_PLAT_FREERTOS)
+
+/*
+ * /etc/hosts or similar is parsed once into a hash table of names, and only
+ * parsed again if its mtime or size changed.  We look at it at most once per
+ * LWS_ADNS_HOSTS_CHECK_US.
+ */
+
+#if defined(WIN32)
+#define LWS_ADNS_HOSTS_PATH "C:\\Windows\\System32\\Drivers\\etc\\hosts"
+#else
+#define LWS_ADNS_HOSTS_PATH "/etc/hosts"
+#endif
+
+#define LWS_ADNS_HOSTS_CHECK_US		LWS_US_PER_SEC
+#define LWS_ADNS_HOSTS_MAX_SIZE		(4 * 1024 * 1024)
+#define LWS_ADNS_HOSTS_END		0xffffffffu
+
+struct lws_adns_hosts_ent {
+	const char			*name; /* into text, not NUL-terminated */
+	uint32_t			hash;
+	uint32_t			next; /* in bucket chain */
+	int				ads_len;
+	uint16_t			name_len;
+	uint8_t				ads[16];
+};
+
+struct lws_adns_hosts {
+	char				*text;
+	struct lws_adns_hosts_ent	*ents;
+	uint32_t			*buckets;
+	lws_usec_t			checked;
+	time_t				mtime;
+	size_t				size;
+	uint32_t			count_ents;
+	uint32_t			count_buckets;
+};
+#endif
+
 static const uint32_t botable[] = { 300, 500, 700, 1250, 5000
 				/* in case everything just dog slow */ };
 static const lws_retry_bo_t retry_policy = {
@@ -524,30 +563,99 @@ lws_async_dns_init(struct lws_context *context)
 	return 0;
 }
 
+/*
+ * Cache entries are matched with strcasecmp(), so hash the lowercased name
+ */
+
+static uint32_t
+lws_adns_name_hash(const char *name)
+{
+	uint32_t h = 0x811c9dc5u;
+
+	while (*name)
+		h = (h ^ (uint8_t)tolower(*name++)) * 0x01000193u;
+
+	return h;
+}
+
+/*
+ * Keep the hash table at least as big as the cache.  If we can't get the
+ * memory, we carry on with longer buckets, or walk the lru list if there's no
+ * table at all.
+ */
+
+static void
+lws_adns_cache_rehash(lws_async_dns_t *dns)
+{
+	unsigned int n = dns->cache_hash_elements ?
+				dns->cache_hash_elements * 4 : 16;
+	lws_dll2_owner_t *h;
+
+	if (dns->cache_hash && dns->cached.count < dns->cache_hash_elements)
+		return;
+
+	h = lws_zalloc(n * sizeof(*h), "adns-hash");
+	if (!h)
+		return;
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      lws_dll2_get_head(&dns->cached)) {
+		lws_adns_cache_t *c = lws_container_of(d, lws_adns_cache_t,
+						       list);
+
+		lws_dll2_remove(&c->list_hash);
+		lws_dll2_add_head(&c->list_hash, &h[c->hash & (n - 1)]);
+	} lws_end_foreach_dll(d);
+
+	lws_free(dns->cache_hash);
+	dns->cache_hash = h;
+	dns->cache_hash_elements = n;
+}
+
+void
+lws_adns_cache_add(lws_async_dns_t *dns, lws_adns_cache_t *c)
+{
+	c->hash = lws_adns_name_hash(c->name);
+	lws_dll2_add_head(&c->list, &dns->cached);
+
+	lws_adns_cache_rehash(dns);
+	if (dns->cache_hash && !c->list_hash.owner)
+		lws_dll2_add_head(&c->list_hash, &dns->cache_hash[
+				c->hash & (dns->cache_hash_elements - 1)]);
+}
+
 lws_adns_cache_t *
 lws_adns_get_cache(lws_async_dns_t *dns, const char *name)
 {
+	lws_dll2_t *d;
 	lws_adns_cache_t *c;
+	uint32_t h;
 
 	if (!name) {
 		assert(0);
 		return NULL;
 	}
 
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   lws_dll2_get_head(&dns->cached)) {
-		c = lws_container_of(d, lws_adns_cache_t, list);
+	h = lws_adns_name_hash(name);
+	d = dns->cache_hash ? lws_dll2_get_head(&dns->cache_hash[
+					h & (dns->cache_hash_elements - 1)]) :
+			      lws_dll2_get_head(&dns->cached);
 
-		// lwsl_wsi_notice(dns->wsi, "%s vs %s (inc %d)", name, c->name, c->incomplete);
+	while (d) {
+		c = dns->cache_hash ?
+			lws_container_of(d, lws_adns_cache_t, list_hash) :
+			lws_container_of(d, lws_adns_cache_t, list);
+		d = d->next;
 
-		if (!c->incomplete && !strcasecmp(name, c->name)) {
+		if (!c->incomplete && c->hash == h &&
+		    !strcasecmp(name, c->name)) {
 			/* Keep sorted by LRU: move to the head */
 			lws_dll2_remove(&c->list);
 			lws_dll2_add_head(&c->list, &dns->cached);
 
 			return c;
 		}
-	} lws_end_foreach_dll_safe(d, d1);
+	}
 
 	return NULL;
 }
@@ -608,6 +716,7 @@ lws_adns_cache_destroy(lws_adns_cache_t *c)
 {
 	lws_dll2_remove(&c->sul.list);
 	lws_dll2_remove(&c->list);
+	lws_dll2_remove(&c->list_hash);
 	if (c->chain)
 		lws_free(c->chain);
 	lws_free(c);
@@ -681,9 +790,10 @@ lws_async_dns_freeaddrinfo(const struct addrinfo **pai)
 void
 lws_async_dns_trim_cache(lws_async_dns_t *dns)
 {
+	unsigned int max = dns->cache_max ? dns->cache_max : MAX_CACHE_ENTRIES;
 	lws_adns_cache_t *c1;
 
-	if (dns->cached.count + 1< MAX_CACHE_ENTRIES)
+	if (dns->cached.count + 1 < max)
 		return;
 
 	c1 = lws_container_of(lws_dll2_get_tail(&dns->cached),
@@ -732,6 +842,15 @@ lws_async_dns_deinit(lws_async_dns_t *dns)
 {
 	lws_dll2_foreach_safe(&dns->nameservers, NULL, ns_clean);
 	lws_dll2_foreach_safe(&dns->cached, NULL, cache_clean);
+	lws_free_set_NULL(dns->cache_hash);
+	dns->cache_hash_elements = 0;
+#if !defined(LWS_PLAT_OPTEE) && !defined(LWS_PLAT_FREERTOS)
+	if (dns->hosts) {
+		lws_free(dns->hosts->text);
+		lws_free(dns->hosts->ents);
+		lws_free_set_NULL(dns->hosts);
+	}
+#endif
 }
 
 void
@@ -841,87 +960,258 @@ lws_async_dns_get_new_tid(struct lws_context *context, lws_adns_q_t *q)
 
 #if !defined(LWS_PLAT_OPTEE) && !defined(LWS_PLAT_FREERTOS)
 
+static uint32_t
+lws_adns_hosts_hash(const char *name, size_t len)
+{
+	uint32_t h = 0x811c9dc5u;
+
+	while (len--)
+		h = (h ^ (uint8_t)*name++) * 0x01000193u;
+
+	return h;
+}
+
+static void
+lws_adns_hosts_free(struct lws_adns_hosts *h)
+{
+	lws_free_set_NULL(h->text);
+	lws_free_set_NULL(h->ents);
+	h->buckets = NULL;
+	h->count_ents = 0;
+	h->count_buckets = 0;
+}
+
 /*
- * Search /etc/hosts or similar for the DNS name
+ * Tokenize the whole file, adding an entry for every name following a numeric
+ * address on the same line, then hash them.  The first one for a name wins,
+ * as it did when scanning the file for each query.
  */
 
-int
-lws_adns_scan_hostsfile(const char *name, uint8_t *ads, size_t adslen)
+static int
+lws_adns_hosts_parse(struct lws_adns_hosts *h)
 {
-	char had_ads = 0, buf[128], finalized = 0;
-	int fd, ret = 0, l = 0, ol = -1;
-	size_t nl = strlen(name);
+	uint32_t alloc_ents = 16, n, b, *pb;
+	struct lws_adns_hosts_ent *e;
+	char had_ads = 0, *wp = h->text;
 	struct lws_tokenize ts;
+	uint8_t ads[16];
+	int l = 0, ol = -1;
+
+	h->ents = lws_malloc(alloc_ents * sizeof(*h->ents), "adns-hosts");
+	if (!h->ents)
+		return 1;
+
+	memset(&ts, 0, sizeof(ts));
+	ts.flags = LWS_TOKENIZE_F_MINUS_NONTERM |
+		   LWS_TOKENIZE_F_DOT_NONTERM | LWS_TOKENIZE_F_NO_FLOATS |
+		   LWS_TOKENIZE_F_NO_INTEGERS | LWS_TOKENIZE_F_HASH_COMMENT |
+		   LWS_TOKENIZE_F_COLON_NONTERM;
+	ts.start = h->text;
+	ts.len = h->size;
+
+	do {
+		ts.e = (int8_t)lws_tokenize(&ts);
+
+		if (ts.effline != ol) {
+			had_ads = 0;
+			ol = ts.effline;
+		}
+
+		if (ts.e != LWS_TOKZE_TOKEN)
+			continue;
 
+		if (!had_ads) {
+			if (ts.token_len < 50) {
+				/* we're getting an ipv4 or ipv6 numads */
+				l = lws_parse_numeric_address(ts.token, ads,
+							      sizeof(ads));
+				had_ads = 1;
+			}
+			continue;
+		}
+
+		if (!l || ts.token_len > 0xffff)
+			continue;
+
+		if (h->count_ents == alloc_ents) {
+			e = lws_realloc(h->ents, alloc_ents * 2 * sizeof(*e),
+					"adns-hosts");
+			if (!e)
+				return 1;
+			h->ents = e;
+			alloc_ents *= 2;
+		}
+
+		/*
+		 * The token is collected in ts, copy it down into the text
+		 * we already consumed to keep it
+		 */
+
+		memmove(wp, ts.token, ts.token_len);
+
+		e = &h->ents[h->count_ents++];
+		e->name = wp;
+		wp += ts.token_len;
+		e->name_len = (uint16_t)ts.token_len;
+		e->hash = lws_adns_hosts_hash(ts.token, ts.token_len);
+		e->ads_len = l;
+		memcpy(e->ads, ads, sizeof(e->ads));
+
+	} while (ts.e > 0);
+
+	/* the buckets live after the ents, at least as many as ents */
+
+	h->count_buckets = 16;
+	while (h->count_buckets < h->count_ents)
+		h->count_buckets <<= 1;
+
+	e = lws_realloc(h->ents, (h->count_ents ? h->count_ents : 1) *
+				 sizeof(*e) + h->count_buckets * sizeof(*pb),
+			"adns-hosts");
+	if (!e)
+		return 1;
+	h->ents = e;
+	h->buckets = (uint32_t *)&h->ents[h->count_ents ? h->count_ents : 1];
+
+	for (b = 0; b < h->count_buckets; b++)
+		h->buckets[b] = LWS_ADNS_HOSTS_END;
+
+	/* append to the bucket chains, so earlier ones are found first */
+
+	for (n = 0; n < h->count_ents; n++) {
+		pb = &h->buckets[h->ents[n].hash & (h->count_buckets - 1)];
+		while (*pb != LWS_ADNS_HOSTS_END)
+			pb = &h->ents[*pb].next;
+		*pb = n;
+		h->ents[n].next = LWS_ADNS_HOSTS_END;
+	}
+
+	return 0;
+}
+
+/*
+ * Make sure dns->hosts reflects the hosts file as it is now
+ */
+
+static void
+lws_adns_hosts_refresh(lws_async_dns_t *dns)
+{
+	const char *path = dns->hosts_path ? dns->hosts_path :
+					     LWS_ADNS_HOSTS_PATH;
+	struct lws_adns_hosts *h = dns->hosts;
+	lws_usec_t now = lws_now_usecs();
+	struct stat st;
+	int fd;
 #if defined(WIN32)
 	int s;
-
-	fd = _open("C:\\Windows\\System32\\Drivers\\etc\\hosts", LWS_O_RDONLY);
 #else
 	ssize_t s;
-
-	fd = open("/etc/hosts", LWS_O_RDONLY);
 #endif
 
-	if (fd < 0)
-		return 0;
+	if (h && now - h->checked < LWS_ADNS_HOSTS_CHECK_US)
+		return;
 
-	memset(&ts, 0, sizeof(ts));
-	ts.flags = LWS_TOKENIZE_F_EXPECT_MORE | LWS_TOKENIZE_F_MINUS_NONTERM |
-		   LWS_TOKENIZE_F_DOT_NONTERM | LWS_TOKENIZE_F_NO_FLOATS |
-		   LWS_TOKENIZE_F_NO_INTEGERS | LWS_TOKENIZE_F_HASH_COMMENT |
-		   LWS_TOKENIZE_F_COLON_NONTERM;
+	if (!h) {
+		h = lws_zalloc(sizeof(*h), "adns-hosts");
+		if (!h)
+			return;
+		dns->hosts = h;
+	}
 
-	do {
+	h->checked = now;
 
 #if defined(WIN32)
-		s = _read(fd, buf, sizeof(buf) - 1);
+	fd = _open(path, LWS_O_RDONLY);
 #else
-		s = read(fd, buf, sizeof(buf) - 1);
+	fd = open(path, LWS_O_RDONLY);
 #endif
-		if (s <= 0) {
-			finalized = 1;
-			ts.flags = (uint16_t)(ts.flags & (~LWS_TOKENIZE_F_EXPECT_MORE));
-			s = 0;
-		}
+	if (fd < 0) {
+		lws_adns_hosts_free(h);
+		h->mtime = 0;
+		return;
+	}
 
-		ts.start = (char *)buf;
-		ts.len = (size_t)s;
+	if (fstat(fd, &st) || st.st_size > LWS_ADNS_HOSTS_MAX_SIZE)
+		goto bail;
 
-		do {
-			ts.e = (int8_t)lws_tokenize(&ts);
-			if (ts.e == LWS_TOKZE_WANT_READ)
-				break;
+	if (h->text && st.st_mtime == h->mtime &&
+	    (size_t)st.st_size == h->size)
+		/* unchanged since we parsed it */
+		goto done;
 
-			if (ts.effline != ol) {
-				had_ads = 0;
-				ol = ts.effline;
-			}
+	lws_adns_hosts_free(h);
 
-			if (ts.e == LWS_TOKZE_TOKEN && had_ads && l &&
-			    nl == ts.token_len &&
-			    !memcmp(name, ts.token, ts.token_len)) {
-				/* it's a hit */
-				ret = (int)l;
-				break;
-			}
-			if (ts.e == LWS_TOKZE_TOKEN && !had_ads && ts.token_len < 50) {
-				/* we're getting an ipv4 or ipv6 numads */
-				l = lws_parse_numeric_address(ts.token, ads, adslen);
-				had_ads = 1;
-			}
+	h->text = lws_malloc((size_t)st.st_size + 1, "adns-hosts");
+	if (!h->text)
+		goto bail;
+
+	h->size = 0;
+	while (h->size < (size_t)st.st_size) {
+#if defined(WIN32)
+		s = _read(fd, h->text + h->size,
+			  (unsigned int)((size_t)st.st_size - h->size));
+#else
+		s = read(fd, h->text + h->size, (size_t)st.st_size - h->size);
+#endif
+		if (s <= 0)
+			break;
+		h->size += (size_t)s;
+	}
+	h->text[h->size] = '\0';
+
+	if (lws_adns_hosts_parse(h))
+		goto bail;
 
-		} while (ts.e > 0); /* no error yet */
+	h->mtime = st.st_mtime;
+	lwsl_info("%s: %u names in %s\n", __func__, h->count_ents, path);
 
-	} while (!ret && !finalized); /* no match yet */
+	goto done;
 
+bail:
+	lws_adns_hosts_free(h);
+	h->mtime = 0;
+done:
 #if defined(WIN32)
 	_close(fd);
 #else
 	close(fd);
 #endif
+}
 
-	return ret;
+/*
+ * Search /etc/hosts or similar for the DNS name
+ */
+
+static int
+lws_adns_scan_hostsfile(lws_async_dns_t *dns, const char *name, uint8_t *ads,
+			size_t adslen)
+{
+	const struct lws_adns_hosts_ent *e;
+	size_t nl = strlen(name);
+	uint32_t h, n;
+
+	lws_adns_hosts_refresh(dns);
+
+	if (!dns->hosts || !dns->hosts->count_buckets)
+		return 0;
+
+	h = lws_adns_hosts_hash(name, nl);
+	n = dns->hosts->buckets[h & (dns->hosts->count_buckets - 1)];
+
+	while (n != LWS_ADNS_HOSTS_END) {
+		e = &dns->hosts->ents[n];
+		if (e->hash == h && e->name_len == nl &&
+		    !memcmp(name, e->name, nl)) {
+			if ((size_t)e->ads_len > adslen)
+				return 0;
+			memcpy(ads, e->ads, (size_t)e->ads_len);
+
+			return e->ads_len;
+		}
+		n = e->next;
+	}
+
+	return 0;
 }
 #endif
 
@@ -993,6 +1283,8 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 
 #if defined(LWS_WITH_SYS_METRICS)
 		lws_metric_event(context->mt_adns_cache,  METRES_GO, 0);
+		lws_metrics_hist_bump_priv(context->mth_adns_cache,
+					   c->results ? "hit" : "neg");
 #endif
 
 		if (cb(wsi, name, c->results, m, opaque) == NULL)
@@ -1004,6 +1296,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 
 #if defined(LWS_WITH_SYS_METRICS)
 	lws_metric_event(context->mt_adns_cache, METRES_NOGO, 0);
+	lws_metrics_hist_bump_priv(context->mth_adns_cache, "miss");
 #endif
 
 	/*
@@ -1017,11 +1310,17 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 	m = lws_parse_numeric_address(name, ads, sizeof(ads));
 
 #if !defined(LWS_PLAT_OPTEE) && !defined(LWS_PLAT_FREERTOS)
-	if (m < 4)
+	if (m < 4) {
 		/*
 		 * Not directly numeric... look through /etc/hosts
 		 */
-		m = lws_adns_scan_hostsfile(name, ads, sizeof(ads));
+		m = lws_adns_scan_hostsfile(dns, name, ads, sizeof(ads));
+#if defined(LWS_WITH_SYS_METRICS)
+		if (m)
+			lws_metrics_hist_bump_priv(context->mth_adns_cache,
+						   "hosts");
+#endif
+	}
 #endif
 
 	if (m == 4
@@ -1055,7 +1354,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 			tmq.tq.standalone_cb = cb;
 		lws_strncpy(tmq.name, name, sizeof(tmq.name));
 
-		lws_dll2_add_head(&c->list, &dns->cached);
+		lws_adns_cache_add(dns, c);
 		lws_sul_schedule(context, 0, &c->sul, sul_cb_expire,
 				 3600ll * LWS_US_PER_SEC);
 
@@ -26,7 +26,7 @@
 #define DNS_MAX			128	/* Maximum host name		*/
 #define DNS_RECURSION_LIMIT	4
 #define DNS_PACKET_LEN		1400	/* Buffer size for DNS packet	*/
-#define MAX_CACHE_ENTRIES	10	/* Dont cache more than that	*/
+#define MAX_CACHE_ENTRIES	10	/* Default max cache entries	*/
 #define DNS_QUERY_TIMEOUT	30	/* Query timeout, seconds	*/
 
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
@@ -40,11 +40,13 @@
 typedef struct lws_adns_cache {
 	lws_sorted_usec_list_t	sul;	/* for cache TTL management */
 	lws_dll2_t		list;
+	lws_dll2_t		list_hash; /* in dns->cache_hash bucket */
 
 	struct lws_adns_cache	*firstcache;
 	struct lws_adns_cache	*chain;
 	struct addrinfo		*results;
 	const char		*name;
+	uint32_t		hash;	/* of the lowercased name */
 	uint8_t			flags;	/* b0 = has ipv4, b1 = has ipv6 */
 	char			refcount;
 	char			incomplete;
@@ -125,6 +127,9 @@ lws_async_dns_complete(lws_adns_q_t *q, lws_adns_cache_t *c);
 lws_adns_cache_t *
 lws_adns_get_cache(lws_async_dns_t *dns, const char *name);
 
+void
+lws_adns_cache_add(lws_async_dns_t *dns, lws_adns_cache_t *c);
+
 lws_adns_q_t *
 lws_adns_get_query(lws_async_dns_t *dns, adns_query_type_t qtype,
 		   uint16_t tid, const char *name);
@@ -0,0 +1,264 @@
+/*
+ * lws-api-test-adns-cache
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test resolves names from its own hosts file with async dns, which
+ * caches each result.  First we look up enough names to grow the cache's hash
+ * table twice, but not to fill the cache, with random earlier names looked up
+ * again on the way to shuffle the lru order.  Then we look up new names until
+ * the cache has dropped over half of the first ones.  We keep a model of what
+ * should be in the cache.
+ *
+ * lws may have cached the addresses of its nameservers before we start, but
+ * those are older than any of ours, so they are dropped first and don't change
+ * which of ours are dropped... as long as we don't look up dropped names again.
+ *
+ * Then we rewrite the hosts file with different addresses for all the names,
+ * keeping the same size but changing the mtime.  Names still cached resolve to
+ * the old address, and names that were dropped resolve to the new one, so we
+ * can see that the cache dropped exactly the lru names, and that the hosts
+ * file was parsed again because of its mtime.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define NAMES_SHUFFLE		90	/* cached past 16 and 64, not full */
+#define NAMES			150
+#define CACHE_MAX		100	/* holds CACHE_MAX - 1 */
+
+static struct lws_context	*context;
+static char			dir[64], hosts[80];
+static int			lru[NAMES], lru_count, got;
+static uint32_t			rnd;
+
+static uint32_t
+prng(void)
+{
+	rnd = rnd * 1103515245u + 12345u;
+
+	return rnd >> 8;
+}
+
+/*
+ * Write the hosts file giving each name 10.0.<gen>.x, and set its mtime... the
+ * size is the same for every gen, so only the mtime shows it changed.  The
+ * comment and blank line check the first name after them isn't lost.
+ */
+
+static int
+write_hosts(int gen)
+{
+	struct timeval tv[2];
+	FILE *f;
+	int n, r;
+
+	f = fopen(hosts, "w");
+	if (!f)
+		return 1;
+
+	r = fprintf(f, "# api-test-adns-cache gen %d\n\n", gen) < 0;
+	for (n = 0; !r && n < NAMES; n++)
+		r = fprintf(f, "10.0.%d.%d\th%d.test\n", gen, n & 0xff, n) < 0;
+
+	if (fclose(f))
+		r = 1;
+
+	tv[0].tv_sec = tv[1].tv_sec = 1000000000 + gen;
+	tv[0].tv_usec = tv[1].tv_usec = 0;
+
+	return r || utimes(hosts, tv);
+}
+
+static struct lws *
+resolved(struct lws *wsi, const char *ads, const struct addrinfo *a, int n,
+	 void *opaque)
+{
+	/* we learn which gen of hosts file it came from */
+
+	if (a && a->ai_family == AF_INET)
+		got = ((const uint8_t *)&((const struct sockaddr_in *)
+					  a->ai_addr)->sin_addr)[2];
+
+	lws_async_dns_freeaddrinfo(&a);
+
+	return NULL;
+}
+
+/* the gen of the address we got for name n, or -1 */
+
+static int
+lookup(int n)
+{
+	char name[16];
+
+	lws_snprintf(name, sizeof(name), "h%d.test", n);
+	got = -1;
+
+	lws_async_dns_query(context, 0, name, LWS_ADNS_RECORD_A, resolved,
+			    NULL, NULL, NULL);
+
+	return got;
+}
+
+/* our model of the cache, lru[0] is the most recently used */
+
+static int
+model_find(int n)
+{
+	int m;
+
+	for (m = 0; m < lru_count; m++)
+		if (lru[m] == n)
+			return m;
+
+	return -1;
+}
+
+static void
+model_use(int n)
+{
+	int m = model_find(n);
+
+	if (m < 0) {
+		/* a miss drops the lru one if the cache is full */
+		if (lru_count >= CACHE_MAX - 1)
+			lru_count--;
+		m = lru_count++;
+	}
+
+	memmove(&lru[1], &lru[0], (size_t)m * sizeof(lru[0]));
+	lru[0] = n;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, n, m, fail = 0,
+	    touched = 0, kept = 0, dropped = 0;
+	struct lws_context_creation_info info;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	rnd = (uint32_t)lws_now_usecs();
+	if ((p = lws_cmdline_option(argc, argv, "-s")))
+		rnd = (uint32_t)atol(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: async dns cache, seed %u\n", rnd);
+
+	lws_strncpy(dir, "/tmp/lws-adns-XXXXXX", sizeof(dir));
+	if (!mkdtemp(dir)) {
+		lwsl_err("%s: mkdtemp failed\n", __func__);
+		return 1;
+	}
+	lws_snprintf(hosts, sizeof(hosts), "%s/hosts", dir);
+
+	if (write_hosts(1)) {
+		lwsl_err("%s: unable to write %s\n", __func__, hosts);
+		fail = 1;
+		goto bail;
+	}
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.async_dns_cache_max = CACHE_MAX;
+	info.async_dns_hosts_path = hosts;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		fail = 1;
+		goto bail;
+	}
+
+	/*
+	 * Look up every name in turn, past 16 and 64 cached where the hash
+	 * table grows, and on past CACHE_MAX where the lru ones are dropped.
+	 * Until then, every few names, look up a random earlier one again.
+	 */
+
+	for (n = 0; !fail && n < NAMES; n++) {
+		if (lookup(n) != 1) {
+			lwsl_err("%s: h%d.test failed\n", __func__, n);
+			fail = 1;
+		}
+		model_use(n);
+
+		if (n && n < NAMES_SHUFFLE && !(n % 3)) {
+			m = (int)(prng() % (uint32_t)n);
+			if (lookup(m) != 1) {
+				lwsl_err("%s: h%d.test again failed\n",
+					 __func__, m);
+				fail = 1;
+			}
+			model_use(m);
+			touched++;
+		}
+	}
+
+	/*
+	 * Give every name a new address, and wait long enough that the hosts
+	 * file will be looked at again
+	 */
+
+	if (!fail && write_hosts(2)) {
+		lwsl_err("%s: unable to rewrite %s\n", __func__, hosts);
+		fail = 1;
+	}
+
+	usleep(1100000);
+
+	/* the ones we think are cached must still have the old address... */
+
+	for (n = 0; !fail && n < lru_count; n++)
+		if (lookup(lru[n]) != 1) {
+			lwsl_err("%s: h%d.test should have been cached\n",
+				 __func__, lru[n]);
+			fail = 1;
+		} else
+			kept++;
+
+	/*
+	 * ... and the ones that were dropped must come from the new hosts
+	 * file.  These lookups drop more from the cache, but only ones we
+	 * already checked.
+	 */
+
+	for (n = 0; !fail && n < NAMES; n++) {
+		if (model_find(n) >= 0)
+			continue;
+
+		m = lookup(n);
+		if (m != 2) {
+			lwsl_err("%s: h%d.test %s\n", __func__, n, m == 1 ?
+				 "should have been dropped from the cache" :
+				 "not in the new hosts file");
+			fail = 1;
+		} else
+			dropped++;
+	}
+
+	lws_context_destroy(context);
+
+	if (!fail)
+		lwsl_user("%s: %d names, %d looked up again, %d stayed cached, "
+			  "%d dropped\n", __func__, NAMES, touched, kept,
+			  dropped);
+
+bail:
+	unlink(hosts);
+	rmdir(dir);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,296 @@
+/*
+ * lws-api-test-buflist
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test checks where segments start and end on buflists using a
+ * segment pool, with and without coalescing, and that a byte stream pushed
+ * through one in random sized pieces comes out intact.
+ *
+ * It then benchmarks buffering bursts of small writes and draining them, as
+ * happens under backpressure, with plain segments and with a pool, counting
+ * the heap allocations with a custom allocator.
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t rnd = 0x12345678;
+static int allocs, released;
+
+static uint32_t
+prng(void)
+{
+	rnd = rnd * 1103515245u + 12345u;
+
+	return rnd >> 8;
+}
+
+static uint8_t
+pattern(size_t ofs)
+{
+	return (uint8_t)((ofs * 7) + (ofs >> 11));
+}
+
+static void *
+counting_realloc(void *ptr, size_t size, const char *reason)
+{
+	if (!size) {
+		free(ptr);
+		return NULL;
+	}
+
+	if (!ptr)
+		allocs++;
+
+	return realloc(ptr, size);
+}
+
+static void
+release_cb(void *opaque)
+{
+	released++;
+}
+
+/* consume the list one segment at a time, checking the segment lengths */
+
+static int
+expect_segs(struct lws_buflist **bl, const size_t *lens, int count)
+{
+	int n;
+
+	for (n = 0; n < count; n++) {
+		size_t l = lws_buflist_next_segment_len(bl, NULL);
+
+		if (l != lens[n]) {
+			lwsl_err("%s: seg %d len %d, expected %d\n", __func__,
+				 n, (int)l, (int)lens[n]);
+			return 1;
+		}
+		lws_buflist_use_segment(bl, l);
+	}
+
+	if (*bl) {
+		lwsl_err("%s: segments left over\n", __func__);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+test_boundaries(lws_buflist_pool_t *pool)
+{
+	static const size_t coalesced[] = { 100, 200, 100 },
+			    separate[] = { 100, 100, 100, 100 },
+			    around_ref[] = { 100, 50, 100 };
+	struct lws_buflist *bl = NULL;
+	uint8_t buf[100];
+	int n;
+
+	memset(buf, 0x55, sizeof(buf));
+
+	/*
+	 * the first segment is never grown, the second is 256 in its size
+	 * class and takes one more, the fourth needs a third segment
+	 */
+
+	for (n = 0; n < 4; n++)
+		if (lws_buflist_append_segment_pool(pool, &bl, buf, 100, 1) < 0)
+			return 1;
+	if (expect_segs(&bl, coalesced, LWS_ARRAY_SIZE(coalesced)))
+		return 1;
+
+	/* without coalescing, the boundaries are kept */
+
+	for (n = 0; n < 4; n++)
+		if (lws_buflist_append_segment_pool(pool, &bl, buf, 100, 0) < 0)
+			return 1;
+	if (expect_segs(&bl, separate, LWS_ARRAY_SIZE(separate)))
+		return 1;
+
+	/* nothing is copied on to the end of a referencing segment */
+
+	if (lws_buflist_append_segment_pool(pool, &bl, buf, 100, 1) < 0 ||
+	    lws_buflist_append_ref(&bl, buf, 50, release_cb, NULL) < 0 ||
+	    lws_buflist_append_segment_pool(pool, &bl, buf, 100, 1) < 0)
+		return 1;
+	if (expect_segs(&bl, around_ref, LWS_ARRAY_SIZE(around_ref)))
+		return 1;
+
+	if (released != 1) {
+		lwsl_err("%s: released %d\n", __func__, released);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Push a byte stream through a buflist in random sized appends, reading it
+ * back in random sized pieces as we go, with a backlog that comes and goes
+ */
+
+static int
+test_stream(lws_buflist_pool_t *pool, int coalesce)
+{
+	struct lws_buflist *bl = NULL;
+	size_t wofs = 0, rofs = 0, l, n;
+	uint8_t in[2048], out[4096];
+	int m, r;
+
+	for (m = 0; m < 20000; m++) {
+		l = 1 + prng() % sizeof(in);
+		for (n = 0; n < l; n++)
+			in[n] = pattern(wofs + n);
+		if (lws_buflist_append_segment_pool(pool, &bl, in, l,
+						    coalesce) < 0)
+			goto bail;
+		wofs += l;
+
+		if (wofs - rofs < 256 * 1024 && (prng() & 1))
+			continue;
+
+		r = lws_buflist_linear_use(&bl, out,
+					   1 + prng() % sizeof(out));
+		for (n = 0; n < (size_t)r; n++)
+			if (out[n] != pattern(rofs + n)) {
+				lwsl_err("%s: mismatch at %d\n", __func__,
+					 (int)(rofs + n));
+				goto bail;
+			}
+		rofs += (size_t)r;
+	}
+
+	while (bl) {
+		r = lws_buflist_linear_use(&bl, out, sizeof(out));
+		for (n = 0; n < (size_t)r; n++)
+			if (out[n] != pattern(rofs + n)) {
+				lwsl_err("%s: mismatch at %d\n", __func__,
+					 (int)(rofs + n));
+				goto bail;
+			}
+		rofs += (size_t)r;
+	}
+
+	if (rofs != wofs) {
+		lwsl_err("%s: read %d of %d\n", __func__, (int)rofs, (int)wofs);
+		return 1;
+	}
+
+	return 0;
+
+bail:
+	lws_buflist_destroy_all_segments(&bl);
+
+	return 1;
+}
+
+/*
+ * Buffer bursts of small writes, like a connection that can't send, and then
+ * drain them all in 16KiB reads when it becomes writeable
+ */
+
+static int
+bench(lws_buflist_pool_t *pool, int coalesce, int rounds, lws_usec_t *us)
+{
+	struct lws_buflist *bl = NULL;
+	uint8_t in[1500], out[16384];
+	lws_usec_t t0;
+	int n, m, a;
+
+	memset(in, 0xaa, sizeof(in));
+	a = allocs;
+	t0 = lws_now_usecs();
+
+	for (n = 0; n < rounds; n++) {
+		for (m = 0; m < 64; m++)
+			if (lws_buflist_append_segment_pool(pool, &bl, in,
+					64 + ((unsigned int)(n + m) * 97) % 1400,
+					coalesce) < 0)
+				return -1;
+		while (bl)
+			lws_buflist_linear_use(&bl, out, sizeof(out));
+	}
+
+	*us = lws_now_usecs() - t0;
+
+	return allocs - a;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, rounds = 2000,
+	    a_plain, a_pool, fail = 0;
+	struct lws_buflist *bl = NULL;
+	lws_usec_t us_plain, us_pool;
+	lws_buflist_pool_t *pool;
+	uint8_t buf[32];
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		rounds = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: buflist segment pool\n");
+
+	lws_set_allocator(counting_realloc);
+
+	pool = lws_buflist_pool_create(32);
+	if (!pool) {
+		lwsl_err("%s: pool creation failed\n", __func__);
+		return 1;
+	}
+
+	if (test_boundaries(pool)) {
+		lwsl_err("%s: segment boundaries\n", __func__);
+		fail = 1;
+	}
+
+	if (!fail && (test_stream(NULL, 0) || test_stream(pool, 0) ||
+		      test_stream(pool, 1))) {
+		lwsl_err("%s: stream\n", __func__);
+		fail = 1;
+	}
+
+	if (!fail && rounds > 0) {
+		a_plain = bench(NULL, 0, rounds, &us_plain);
+		a_pool = bench(pool, 1, rounds, &us_pool);
+
+		lwsl_user("%s: %d bursts x 64 writes: plain %dns / write, "
+			  "%d allocs, pool %dns / write, %d allocs\n", __func__,
+			  rounds, (int)((us_plain * 1000) / (rounds * 64)),
+			  a_plain, (int)((us_pool * 1000) / (rounds * 64)),
+			  a_pool);
+
+		/* the pool should have been able to serve nearly everything */
+
+		if (a_plain < 0 || a_pool < 0 || a_pool * 100 > a_plain) {
+			lwsl_err("%s: pool allocs %d vs %d\n", __func__,
+				 a_pool, a_plain);
+			fail = 1;
+		}
+	}
+
+	/* the pool goes away with the last segment still using it */
+
+	memset(buf, 0, sizeof(buf));
+	if (lws_buflist_append_segment_pool(pool, &bl, buf, sizeof(buf), 1) < 0)
+		fail = 1;
+	lws_buflist_pool_destroy(&pool);
+	if (pool)
+		fail = 1;
+	lws_buflist_destroy_all_segments(&bl);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
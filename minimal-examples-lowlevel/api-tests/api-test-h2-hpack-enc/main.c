@@ -0,0 +1,201 @@
+/*
+ * lws-api-test-h2-hpack-enc
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test makes several requests from an h2 client to an h2 server in
+ * the same context, on one connection.  Each response carries two headers
+ * the encoder adds to its dynamic table, with a header between them whose
+ * name is too long for the encoder to look up or index.
+ *
+ * The client checks it got both headers with the right values on every
+ * response.  If the long header put the encoder's mirror of the dynamic table
+ * out of step with the client's decoder, the indexes the encoder sends on
+ * later responses point at the wrong entries, or at none.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+#define STREAMS			8
+#define PORT			7619
+
+static const char * const cc = "max-age=12345, private",
+		  * const acao = "https://origin.example.com",
+		  * const long_name = "x-this-header-name-is-longer-than-the-"
+				      "hpack-encoder-bothers-to-index:";
+
+static int			completed, fail;
+
+static int
+check_hdr(struct lws *wsi, int idx, enum lws_token_indexes tok,
+	  const char *want)
+{
+	char buf[128];
+
+	if (lws_hdr_copy(wsi, buf, sizeof(buf), tok) < 0 || strcmp(buf, want)) {
+		lwsl_err("%s: stream %d: %s: '%s'\n", __func__, idx,
+			 lws_token_to_string(tok), buf);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 1024], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	int idx = (int)(intptr_t)lws_get_opaque_user_data(wsi);
+
+	switch (reason) {
+
+	/* server side */
+
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 2, &p, end) ||
+		    lws_add_http_header_by_token(wsi,
+				WSI_TOKEN_HTTP_CACHE_CONTROL,
+				(uint8_t *)cc, (int)strlen(cc), &p, end) ||
+		    lws_add_http_header_by_name(wsi, (uint8_t *)long_name,
+				(uint8_t *)"1", 1, &p, end) ||
+		    lws_add_http_header_by_token(wsi,
+				WSI_TOKEN_HTTP_ACCESS_CONTROL_ALLOW_ORIGIN,
+				(uint8_t *)acao, (int)strlen(acao), &p, end) ||
+		    lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		memcpy(start, "ok", 2);
+		if (lws_write(wsi, start, 2, LWS_WRITE_HTTP_FINAL) != 2)
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	/* client side */
+
+	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP:
+		if (check_hdr(wsi, idx, WSI_TOKEN_HTTP_CACHE_CONTROL, cc) ||
+		    check_hdr(wsi, idx,
+			      WSI_TOKEN_HTTP_ACCESS_CONTROL_ALLOW_ORIGIN, acao))
+			fail = 1;
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char rbuf[LWS_PRE + 256], *px = rbuf + LWS_PRE;
+			int lenx = sizeof(rbuf) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		completed++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: stream %d: connection error %s\n", __func__, idx,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: %d of %d streams completed\n", __func__, completed,
+		 STREAMS);
+	fail = 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_client_connect_info i;
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	lws_sorted_usec_list_t sul_timeout;
+	char path[STREAMS][8];
+	const char *p;
+	int n;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: h2 hpack encoder\n");
+
+	memset(&info, 0, sizeof(info));
+	info.port = PORT;
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_H2_PRIOR_KNOWLEDGE;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	for (n = 0; n < STREAMS; n++) {
+		memset(&i, 0, sizeof(i));
+		lws_snprintf(path[n], sizeof(path[n]), "/%d", n);
+		i.context = cx;
+		i.address = "127.0.0.1";
+		i.port = PORT;
+		i.path = path[n];
+		i.host = i.address;
+		i.origin = i.address;
+		i.method = "GET";
+		i.alpn = "h2";
+		i.protocol = protocols[0].name;
+		i.ssl_connection = LCCSCF_H2_PRIOR_KNOWLEDGE | LCCSCF_PIPELINE;
+		i.opaque_user_data = (void *)(intptr_t)n;
+
+		if (!lws_client_connect_via_info(&i)) {
+			lwsl_err("%s: connect %d failed\n", __func__, n);
+			fail = 1;
+			break;
+		}
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 5 * LWS_US_PER_SEC);
+
+	while (!fail && completed != STREAMS)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+	lws_context_destroy(cx);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,274 @@
+/*
+ * lws-api-test-h2-priority
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test makes several requests from an h2 client to an h2 server in
+ * the same context, on one connection, each with a different RFC9218
+ * "priority" header.  The server waits until it has all of them, then sends
+ * the responses a chunk at a time, as fast as it's allowed to.  We confirm
+ * the most urgent response was sent first and the least urgent last, and the
+ * server's per-urgency DATA counts match what the requests asked for.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+#define STREAMS			5
+#define CHUNK			1024
+#define CHUNKS			8
+#define BODY_LEN		(CHUNK * CHUNKS)
+#define PORT			7616
+
+/*
+ * Bad or missing priorities get the default urgency 3.  The stream asking for
+ * urgency 0 has to go first, then the three at 3 in turn, and 5 last.
+ */
+
+static const struct {
+	const char	*priority;
+	int		urgency;
+} reqs[] = {
+	{ "u=5, i",				5 },
+	{ "u=0",				0 },
+	{ NULL,					3 },
+	{ "u=0,",				3 }, /* not a dictionary */
+	{ "u=9;a=\"x,y\", i=?0",		3 }, /* u out of range */
+};
+
+struct pss {
+	int			idx;
+	int			chunks;
+};
+
+static struct lws		*swsi[STREAMS];
+static size_t			rx[STREAMS];
+static uint64_t			tx_urgency[LWS_H2_URGENCY_LEVELS];
+static int			arrived, sent, order[STREAMS], completed, fail;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + CHUNK], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	int idx = (int)(intptr_t)lws_get_opaque_user_data(wsi), n;
+	struct pss *pss = (struct pss *)user;
+	unsigned char **pp;
+	char pri[32];
+
+	switch (reason) {
+
+	/* server side */
+
+	case LWS_CALLBACK_HTTP:
+		pss->idx = atoi((const char *)in + 1);
+		if (pss->idx < 0 || pss->idx >= STREAMS || swsi[pss->idx])
+			return 1;
+		swsi[pss->idx] = wsi;
+
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", BODY_LEN, &p, end) ||
+		    lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		/* start them all at once, so only the priorities decide */
+
+		if (++arrived == STREAMS)
+			for (n = 0; n < STREAMS; n++)
+				lws_callback_on_writable(swsi[n]);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (arrived != STREAMS || pss->chunks == CHUNKS)
+			return 0;
+
+		memset(start, 'a' + pss->idx, CHUNK);
+		n = ++pss->chunks == CHUNKS ? LWS_WRITE_HTTP_FINAL :
+					      LWS_WRITE_HTTP;
+		if (lws_write(wsi, start, CHUNK,
+			      (enum lws_write_protocol)n) != CHUNK)
+			return 1;
+
+		if (n == LWS_WRITE_HTTP) {
+			lws_callback_on_writable(wsi);
+			return 0;
+		}
+
+		order[sent++] = pss->idx;
+		if (sent == STREAMS &&
+		    lws_h2_get_urgency_tx_stats(wsi, tx_urgency))
+			fail = 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	/* client side */
+
+	case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER:
+		if (!reqs[idx].priority)
+			break;
+
+		pp = (unsigned char **)in;
+		lws_strncpy(pri, reqs[idx].priority, sizeof(pri));
+		if (lws_add_http_header_by_name(wsi, (uint8_t *)"priority:",
+				(uint8_t *)pri, (int)strlen(pri), pp, *pp + len))
+			return -1;
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		rx[idx] += len;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char rbuf[LWS_PRE + CHUNK], *px = rbuf + LWS_PRE;
+			int lenx = sizeof(rbuf) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		if (rx[idx] != BODY_LEN) {
+			lwsl_err("%s: stream %d: rx %d\n", __func__, idx,
+				 (int)rx[idx]);
+			fail = 1;
+		}
+		completed++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: stream %d: connection error %s\n", __func__, idx,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, sizeof(struct pss), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: %d of %d streams completed\n", __func__, completed,
+		 STREAMS);
+	fail = 1;
+}
+
+static int
+check(void)
+{
+	uint64_t expect[LWS_H2_URGENCY_LEVELS];
+	int n, bad = 0;
+
+	memset(expect, 0, sizeof(expect));
+	for (n = 0; n < STREAMS; n++)
+		expect[reqs[n].urgency] += BODY_LEN;
+
+	for (n = 0; n < LWS_H2_URGENCY_LEVELS; n++)
+		if (tx_urgency[n] != expect[n]) {
+			lwsl_err("%s: urgency %d: sent %llu, expected %llu\n",
+				 __func__, n, (unsigned long long)tx_urgency[n],
+				 (unsigned long long)expect[n]);
+			bad = 1;
+		}
+
+	lwsl_user("%s: completion order %d %d %d %d %d\n", __func__,
+		  order[0], order[1], order[2], order[3], order[4]);
+
+	/* the three at urgency 3 may finish in any order */
+
+	if (order[0] != 1 || order[STREAMS - 1] != 0) {
+		lwsl_err("%s: wrong order\n", __func__);
+		bad = 1;
+	}
+
+	return bad;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_client_connect_info i;
+	struct lws_context_creation_info info;
+	struct lws_context *cx;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws *cwsi[STREAMS];
+	char path[STREAMS][8];
+	const char *p;
+	int n;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: h2 priority\n");
+
+	memset(&info, 0, sizeof(info));
+	info.port = PORT;
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_H2_PRIOR_KNOWLEDGE;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	for (n = 0; n < STREAMS; n++) {
+		memset(&i, 0, sizeof(i));
+		lws_snprintf(path[n], sizeof(path[n]), "/%d", n);
+		i.context = cx;
+		i.address = "127.0.0.1";
+		i.port = PORT;
+		i.path = path[n];
+		i.host = i.address;
+		i.origin = i.address;
+		i.method = "GET";
+		i.alpn = "h2";
+		i.protocol = protocols[0].name;
+		i.ssl_connection = LCCSCF_H2_PRIOR_KNOWLEDGE | LCCSCF_PIPELINE;
+		i.opaque_user_data = (void *)(intptr_t)n;
+		i.pwsi = &cwsi[n];
+
+		if (!lws_client_connect_via_info(&i)) {
+			lwsl_err("%s: connect %d failed\n", __func__, n);
+			fail = 1;
+			break;
+		}
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 5 * LWS_US_PER_SEC);
+
+	while (!fail && completed != STREAMS)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+	lws_context_destroy(cx);
+
+	if (!fail)
+		fail = check();
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
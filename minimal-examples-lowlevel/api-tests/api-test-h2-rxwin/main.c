@@ -0,0 +1,275 @@
+/*
+ * lws-api-test-h2-rxwin
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test downloads a large body from an h2 server to an h2 client on
+ * one stream, and confirms the client's rx window grew from its initial size
+ * while the data was arriving, but not past the vhost ceiling, and that it
+ * measured an rtt on the way.  It reports the rate the body arrived at.
+ *
+ * The server runs in its own context on a thread, so it can fill whatever
+ * window it's given while the client is busy; in one context on one thread
+ * the two take turns, nothing is ever in flight, and there's no window worth
+ * growing for.
+ */
+
+#include <libwebsockets.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK			16384
+#define PORT			7617
+#define WIN_INITIAL		(2 * 65536)
+#define WIN_MAX			(1024 * 1024)
+
+struct pss {
+	size_t			sent;
+};
+
+static size_t			body_len = 64 * 1024 * 1024, rx;
+static uint32_t			window;
+static lws_usec_t		srtt, t_start, t_end;
+static struct lws_context	*cx_server;
+static volatile int		server_up, server_stop;
+static int			completed, fail;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + CHUNK], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	struct pss *pss = (struct pss *)user;
+	lws_fileofs_t allow;
+	size_t n;
+	int m;
+
+	switch (reason) {
+
+	/* server side */
+
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+				"application/octet-stream", body_len, &p, end) ||
+		    lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		/* we're told again when a WINDOW_UPDATE gives us some */
+		allow = lws_get_peer_write_allowance(wsi);
+		if (!allow)
+			return 0;
+
+		n = body_len - pss->sent;
+		if (n > CHUNK)
+			n = CHUNK;
+		if (allow > 0 && (lws_fileofs_t)n > allow)
+			n = (size_t)allow;
+
+		memset(start, 'x', n);
+		pss->sent += n;
+		m = pss->sent == body_len ? LWS_WRITE_HTTP_FINAL :
+					    LWS_WRITE_HTTP;
+		if (lws_write(wsi, start, n, (enum lws_write_protocol)m) != (int)n)
+			return 1;
+
+		if (m == LWS_WRITE_HTTP_FINAL) {
+			if (lws_http_transaction_completed(wsi))
+				return -1;
+			return 0;
+		}
+
+		if (lws_get_peer_write_allowance(wsi))
+			lws_callback_on_writable(wsi);
+
+		return 0;
+
+	/* client side */
+
+	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP:
+		t_start = lws_now_usecs();
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		rx += len;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char rbuf[LWS_PRE + CHUNK], *px = rbuf + LWS_PRE;
+			int lenx = sizeof(rbuf) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		t_end = lws_now_usecs();
+		if (lws_h2_get_rx_window_stats(wsi, &window, &srtt))
+			fail = 1;
+		completed = 1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: connection error %s\n", __func__,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, sizeof(struct pss), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void *
+thread_server(void *d)
+{
+	struct lws_context_creation_info info;
+
+	memset(&info, 0, sizeof(info));
+	info.port = PORT;
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_H2_PRIOR_KNOWLEDGE;
+
+	cx_server = lws_create_context(&info);
+	if (!cx_server) {
+		lwsl_err("%s: server init failed\n", __func__);
+		server_up = -1;
+		return NULL;
+	}
+
+	server_up = 1;
+	while (!server_stop)
+		if (lws_service(cx_server, 0) < 0)
+			break;
+
+	lws_context_destroy(cx_server);
+
+	return NULL;
+}
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out, rx %llu\n", __func__, (unsigned long long)rx);
+	fail = 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws_context *cx;
+	pthread_t pts;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		body_len = (size_t)atol(p) * 1024 * 1024;
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: h2 rx window autotuning\n");
+
+	if (pthread_create(&pts, NULL, thread_server, NULL)) {
+		lwsl_err("%s: thread creation failed\n", __func__);
+		return 1;
+	}
+	while (!server_up)
+		usleep(1000);
+	if (server_up < 0)
+		goto bail;
+
+	memset(&info, 0, sizeof(info));
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols;
+	info.h2_rx_window_max = WIN_MAX;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		goto bail;
+	}
+
+	memset(&i, 0, sizeof(i));
+	i.context = cx;
+	i.address = "127.0.0.1";
+	i.port = PORT;
+	i.path = "/";
+	i.host = i.address;
+	i.origin = i.address;
+	i.method = "GET";
+	i.alpn = "h2";
+	i.protocol = protocols[0].name;
+	i.ssl_connection = LCCSCF_H2_PRIOR_KNOWLEDGE;
+
+	if (!lws_client_connect_via_info(&i)) {
+		lwsl_err("%s: connect failed\n", __func__);
+		fail = 1;
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 10 * LWS_US_PER_SEC);
+
+	while (!fail && !completed)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+	lws_context_destroy(cx);
+
+bail:
+	server_stop = 1;
+	if (server_up > 0)
+		lws_cancel_service(cx_server);
+	pthread_join(pts, NULL);
+	if (server_up < 0)
+		fail = 1;
+
+	if (!fail && rx != body_len) {
+		lwsl_err("%s: rx %llu of %llu\n", __func__,
+			 (unsigned long long)rx, (unsigned long long)body_len);
+		fail = 1;
+	}
+
+	if (!fail) {
+		lwsl_user("%s: %lluMiB in %dms (%.1fMiB/s), rx window %u, "
+			  "srtt %dus\n", __func__,
+			  (unsigned long long)(body_len / (1024 * 1024)),
+			  (int)((t_end - t_start) / 1000),
+			  ((double)body_len / (1024 * 1024)) /
+			  ((double)(t_end - t_start + 1) / LWS_US_PER_SEC),
+			  (unsigned int)window, (int)srtt);
+
+		if (window <= WIN_INITIAL || window > WIN_MAX || !srtt) {
+			lwsl_err("%s: window didn't grow within limit\n",
+				 __func__);
+			fail = 1;
+		}
+	}
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,430 @@
+/*
+ * lws-api-test-http-sendfile
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test serves a 4MiB file from a mount with .zero_copy set, to http
+ * clients in the same context, and checks every byte that arrives.  The
+ * server's sockets get a small SO_SNDBUF, so sendfile() can only move part of
+ * what it's asked to each time and the rest has to wait for POLLOUT.
+ *
+ * We provide our own sendfile() in front of libc's, so we can see lws used it
+ * when it should, and didn't when it must fall back to reading the file into
+ * serv_buf and writing it:
+ *
+ *  - the whole file over plain http: sendfile(), with partial sends
+ *  - the whole file over tls: fallback
+ *  - a single byte range: sendfile(), limited to the range
+ *  - two byte ranges, served as multipart: fallback
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+#define TOTAL			(4 * 1024 * 1024)
+#define PORT			7624
+#define PORT_TLS		7625
+
+static const struct {
+	const char	*name;
+	const char	*range; /* Range: header, or NULL */
+	size_t		start, end; /* expected content, inclusive */
+	size_t		start2, end2; /* second part of multipart */
+	int		tls;
+	int		status;
+	char		sendfile; /* expect sendfile() to be used */
+} phases[] = {
+	{ "plain", NULL, 0, TOTAL - 1, 0, 0, 0, 200, 1 },
+#if defined(LWS_WITH_TLS)
+	{ "tls", NULL, 0, TOTAL - 1, 0, 0, 1, 200, 0 },
+#endif
+#if defined(LWS_WITH_RANGES)
+	{ "range", "bytes=1000000-2999999", 1000000, 2999999, 0, 0, 0, 206, 1 },
+	{ "multipart", "bytes=100-199,3000000-3000999",
+				100, 199, 3000000, 3000999, 0, 206, 0 },
+#endif
+};
+
+static struct lws_http_mount mount = {
+	.mountpoint		= "/",
+	.origin_protocol	= LWSMPRO_FILE,
+	.mountpoint_len		= 1,
+	.zero_copy		= 1,
+};
+
+static char			dir[64], file[96];
+static struct lws		*cwsi; /* client connection of this phase */
+static uint8_t			*rxbuf;
+static size_t			rxlen;
+static int			phase, done, status, fail;
+static unsigned int		sf_calls, sf_partial;
+
+static uint8_t
+pattern(size_t o)
+{
+	return (uint8_t)((o * 7) + (o >> 11));
+}
+
+/*
+ * lws calls this instead of libc's, since the executable is first in the
+ * symbol lookup order
+ */
+
+ssize_t
+sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	ssize_t n = (ssize_t)syscall(SYS_sendfile, out_fd, in_fd, offset,
+				     count);
+
+	sf_calls++;
+	if (n > 0 && (size_t)n < count)
+		sf_partial++;
+
+	return n;
+}
+
+static int
+check_slice(const uint8_t *p, size_t len, size_t start, size_t end)
+{
+	size_t n;
+
+	if (len != end - start + 1)
+		return 1;
+
+	for (n = 0; n < len; n++)
+		if (p[n] != pattern(start + n))
+			return 1;
+
+	return 0;
+}
+
+static const uint8_t *
+find_slice(size_t start, size_t end)
+{
+	uint8_t first[16];
+	size_t n;
+
+	for (n = 0; n < sizeof(first); n++)
+		first[n] = pattern(start + n);
+
+	for (n = 0; n + (end - start + 1) <= rxlen; n++)
+		if (!memcmp(rxbuf + n, first, sizeof(first)) &&
+		    !check_slice(rxbuf + n, end - start + 1, start, end))
+			return rxbuf + n;
+
+	return NULL;
+}
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	int sndbuf = 4096;
+
+	switch (reason) {
+
+	/* server side */
+
+	case LWS_CALLBACK_FILTER_HTTP_CONNECTION:
+		if (setsockopt(lws_get_socket_fd(wsi), SOL_SOCKET, SO_SNDBUF,
+			       (const char *)&sndbuf, sizeof(sndbuf)))
+			lwsl_warn("%s: unable to set SO_SNDBUF\n", __func__);
+		break;
+
+	/* client side */
+
+	case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER:
+		if (phases[phase].range) {
+			unsigned char **p = (unsigned char **)in,
+				      *end = (*p) + len;
+
+			if (lws_add_http_header_by_token(wsi,
+					WSI_TOKEN_HTTP_RANGE,
+					(unsigned char *)phases[phase].range,
+					(int)strlen(phases[phase].range),
+					p, end))
+				return -1;
+		}
+		break;
+
+	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP:
+		status = (int)lws_http_client_http_response(wsi);
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		if (len > TOTAL + 4096 - rxlen) {
+			lwsl_err("%s: too much rx\n", __func__);
+			fail = 1;
+			return -1;
+		}
+		memcpy(rxbuf + rxlen, in, len);
+		rxlen += len;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char rbuf[LWS_PRE + 4096], *px = rbuf + LWS_PRE;
+			int lenx = sizeof(rbuf) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		done = 1;
+		break;
+
+	case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
+		if (wsi == cwsi && !done) {
+			lwsl_err("%s: %s: closed early, rx %llu\n", __func__,
+				 phases[phase].name, (unsigned long long)rxlen);
+			fail = 1;
+		}
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: connection error %s\n", __func__,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: %s timed out, rx %llu\n", __func__, phases[phase].name,
+		 (unsigned long long)rxlen);
+	fail = 1;
+}
+
+static int
+make_file(void)
+{
+	uint8_t *b;
+	size_t n;
+	FILE *f;
+	int r;
+
+	lws_strncpy(dir, "/tmp/lws-sendfile-XXXXXX", sizeof(dir));
+	if (!mkdtemp(dir))
+		return 1;
+
+	lws_snprintf(file, sizeof(file), "%s/big.txt", dir);
+	mount.origin = dir;
+
+	b = malloc(TOTAL);
+	if (!b)
+		return 1;
+	for (n = 0; n < TOTAL; n++)
+		b[n] = pattern(n);
+
+	f = fopen(file, "wb");
+	r = !f || fwrite(b, 1, TOTAL, f) != TOTAL;
+	if (f && fclose(f))
+		r = 1;
+	free(b);
+
+	return r;
+}
+
+static int
+check_phase(unsigned int calls, unsigned int partial)
+{
+	const char *name = phases[phase].name;
+
+	if (status != phases[phase].status) {
+		lwsl_err("%s: %s: status %d\n", __func__, name, status);
+		return 1;
+	}
+
+	if (phases[phase].start2) {
+		/* multipart, the two parts are somewhere in there */
+		if (!find_slice(phases[phase].start, phases[phase].end) ||
+		    !find_slice(phases[phase].start2, phases[phase].end2)) {
+			lwsl_err("%s: %s: parts missing\n", __func__, name);
+			return 1;
+		}
+	} else
+		if (check_slice(rxbuf, rxlen, phases[phase].start,
+				phases[phase].end)) {
+			lwsl_err("%s: %s: bad content, rx %llu\n", __func__,
+				 name, (unsigned long long)rxlen);
+			return 1;
+		}
+
+	if (phases[phase].sendfile && !calls) {
+		lwsl_err("%s: %s: sendfile() not used\n", __func__, name);
+		return 1;
+	}
+
+	if (!phases[phase].sendfile && calls) {
+		lwsl_err("%s: %s: sendfile() used\n", __func__, name);
+		return 1;
+	}
+
+	if (phases[phase].sendfile && !phases[phase].range && !partial) {
+		/* 4MiB can't have gone through a 4KiB SO_SNDBUF at once */
+		lwsl_err("%s: %s: no partial sends\n", __func__, name);
+		return 1;
+	}
+
+	lwsl_user("%s: %s: %llu bytes, %u sendfile() (%u partial)\n",
+		  __func__, name, (unsigned long long)rxlen, calls, partial);
+
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	lws_sorted_usec_list_t sul_timeout;
+	unsigned int calls, partial;
+	struct lws_vhost *vh_cli;
+	struct lws_context *cx;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: http file sendfile\n");
+
+	rxbuf = malloc(TOTAL + 4096);
+	if (!rxbuf || make_file()) {
+		lwsl_err("%s: unable to create test file\n", __func__);
+		fail = 1;
+		goto bail1;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS |
+		       LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		fail = 1;
+		goto bail1;
+	}
+
+	info.port = PORT;
+	info.protocols = protocols;
+	info.mounts = &mount;
+	info.vhost_name = "plain";
+
+	if (!lws_create_vhost(cx, &info)) {
+		lwsl_err("server vhost creation failed\n");
+		goto bail2;
+	}
+
+#if defined(LWS_WITH_TLS)
+	info.port = PORT_TLS;
+	info.vhost_name = "tls";
+	info.ssl_cert_filepath = "localhost-100y.cert";
+	info.ssl_private_key_filepath = "localhost-100y.key";
+
+	if (!lws_create_vhost(cx, &info)) {
+		lwsl_err("tls server vhost creation failed\n");
+		goto bail2;
+	}
+#endif
+
+	memset(&info, 0, sizeof(info));
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols;
+	info.vhost_name = "client";
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+
+	vh_cli = lws_create_vhost(cx, &info);
+	if (!vh_cli) {
+		lwsl_err("client vhost creation failed\n");
+		goto bail2;
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+
+	for (phase = 0; !fail && phase < (int)LWS_ARRAY_SIZE(phases);
+								phase++) {
+		memset(&i, 0, sizeof(i));
+		i.context = cx;
+		i.vhost = vh_cli;
+		i.address = "localhost";
+		i.host = i.address;
+		i.origin = i.address;
+		i.port = phases[phase].tls ? PORT_TLS : PORT;
+		i.path = "/big.txt";
+		i.method = "GET";
+		i.alpn = "http/1.1";
+		i.protocol = protocols[0].name;
+		i.pwsi = &cwsi;
+		if (phases[phase].tls)
+			i.ssl_connection = LCCSCF_USE_SSL |
+					   LCCSCF_ALLOW_SELFSIGNED;
+
+		rxlen = 0;
+		status = done = 0;
+		calls = sf_calls;
+		partial = sf_partial;
+
+		if (!lws_client_connect_via_info(&i)) {
+			lwsl_err("%s: %s: connect failed\n", __func__,
+				 phases[phase].name);
+			fail = 1;
+			break;
+		}
+
+		lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb,
+				 20 * LWS_US_PER_SEC);
+
+		while (!fail && !done)
+			if (lws_service(cx, 0) < 0)
+				break;
+
+		lws_sul_cancel(&sul_timeout);
+
+		if (!fail && check_phase(sf_calls - calls,
+					 sf_partial - partial))
+			fail = 1;
+	}
+
+	lws_context_destroy(cx);
+
+	goto bail1;
+
+bail2:
+	lws_context_destroy(cx);
+	fail = 1;
+bail1:
+	if (file[0])
+		unlink(file);
+	if (dir[0])
+		rmdir(dir);
+	free(rxbuf);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
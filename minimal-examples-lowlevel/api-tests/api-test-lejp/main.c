@@ -7,6 +7,11 @@
  * Universal Public Domain Dedication.
  *
  * sanity tests for lejp
+ *
+ * Afterwards it parses a document with a couple of hundred paths of interest,
+ * checking the matches against a plain scan of every path, and measures how
+ * fast that goes with and without lejp remembering which paths can still
+ * match the path prefixes it has seen.
  */
 
 #include <libwebsockets.h>
@@ -555,9 +560,167 @@ test_cb(struct lejp_ctx *ctx, char reason)
 	return 0;
 }
 
+/*
+ * Path matching benchmark
+ */
+
+#define BENCH_SECTS	10
+#define BENCH_FIELDS	20
+#define BENCH_ITEMS	3
+#define BENCH_PATHS	(BENCH_SECTS * (BENCH_FIELDS + 1))
+
+static char bench_path_store[BENCH_PATHS][32];
+static const char *bench_paths[BENCH_PATHS];
+static char bench_doc[16384];
+static int bench_matches, bench_bad, bench_nocache, bench_verify;
+
+/* what lejp should match, found by scanning every path */
+
+static int
+bench_ref_match(const char *path)
+{
+	const char *p, *q;
+	int n;
+
+	for (n = 0; n < BENCH_PATHS; n++) {
+		p = path;
+		q = bench_paths[n];
+
+		while (*p && *q) {
+			if (*q != '*') {
+				if (*p != *q)
+					break;
+				p++;
+				q++;
+				continue;
+			}
+			q++;
+			while (*p && ((*p != '.' && *p != '[') || !*q))
+				p++;
+		}
+		if (!*p && !*q)
+			return n + 1;
+	}
+
+	return 0;
+}
+
+static signed char
+bench_cb(struct lejp_ctx *ctx, char reason)
+{
+	int r;
+
+	if (bench_nocache)
+		ctx->mc_count = 0;
+
+	if (!(reason & LEJP_FLAG_CB_IS_VALUE) || reason == LEJPCB_VAL_STR_START)
+		return 0;
+
+	if (!bench_verify) {
+		if (ctx->path_match)
+			bench_matches++;
+		return 0;
+	}
+
+	r = bench_ref_match(ctx->path);
+	if (!r)
+		return 0;
+
+	if (ctx->path_match != r) {
+		lwsl_err("%s: %s: matched %d, expected %d\n", __func__,
+			 ctx->path, ctx->path_match, r);
+		bench_bad++;
+	}
+	bench_matches++;
+
+	return 0;
+}
+
+static void
+bench_prepare(void)
+{
+	int s, f, i, n = 0;
+	size_t l = 0;
+
+	for (s = 0; s < BENCH_SECTS; s++)
+		for (f = 0; f < BENCH_FIELDS; f++) {
+			lws_snprintf(bench_path_store[n], sizeof(bench_path_store[n]),
+				     "sect%d.item[].field%d", s, f);
+			bench_paths[n] = bench_path_store[n];
+			n++;
+		}
+
+	for (s = 0; s < BENCH_SECTS; s++) {
+		lws_snprintf(bench_path_store[n], sizeof(bench_path_store[n]),
+			     "sect%d.meta.*", s);
+		bench_paths[n] = bench_path_store[n];
+		n++;
+	}
+
+	l += (size_t)lws_snprintf(bench_doc + l, sizeof(bench_doc) - l, "{");
+	for (s = 0; s < BENCH_SECTS; s++) {
+		l += (size_t)lws_snprintf(bench_doc + l, sizeof(bench_doc) - l,
+				"%s\"sect%d\":{\"item\":[", s ? "," : "", s);
+		for (i = 0; i < BENCH_ITEMS; i++) {
+			l += (size_t)lws_snprintf(bench_doc + l,
+					sizeof(bench_doc) - l, "%s{", i ? "," : "");
+			for (f = 0; f < BENCH_FIELDS; f++)
+				l += (size_t)lws_snprintf(bench_doc + l,
+					sizeof(bench_doc) - l,
+					"\"field%d\":%d,", f, f * i);
+			l += (size_t)lws_snprintf(bench_doc + l,
+					sizeof(bench_doc) - l,
+					"\"junk\":{\"x\":\"y\"}}");
+		}
+		l += (size_t)lws_snprintf(bench_doc + l, sizeof(bench_doc) - l,
+				"],\"meta\":{\"a\":1,\"b\":\"c\"}}");
+	}
+	lws_snprintf(bench_doc + l, sizeof(bench_doc) - l, "}");
+}
+
+/*
+ * returns us taken to parse the document count times, or -1.  When verifying,
+ * each match is also checked against scanning every path, which is slow.
+ */
+
+static lws_usec_t
+bench(int count, int nocache, int verify)
+{
+	int len = (int)strlen(bench_doc), n;
+	struct lejp_ctx ctx;
+	lws_usec_t t0;
+
+	bench_nocache = nocache;
+	bench_verify = verify;
+	bench_matches = 0;
+	t0 = lws_now_usecs();
+
+	for (n = 0; n < count; n++) {
+		lejp_construct(&ctx, bench_cb, NULL, bench_paths, BENCH_PATHS);
+		if (lejp_parse(&ctx, (uint8_t *)bench_doc, len) < 0) {
+			lejp_destruct(&ctx);
+			return -1;
+		}
+		lejp_destruct(&ctx);
+	}
+
+	t0 = lws_now_usecs() - t0;
+
+	if (bench_bad || bench_matches != count * BENCH_SECTS *
+					  (BENCH_ITEMS * BENCH_FIELDS + 2)) {
+		lwsl_err("%s: %d matches, %d bad\n", __func__, bench_matches,
+			 bench_bad);
+		return -1;
+	}
+
+	return t0;
+}
+
 int main(int argc, const char **argv)
 {
-	int n, e = 0, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE;
+	int n, e = 0, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE,
+	    count = 200;
+	lws_usec_t us, us_nocache;
 	struct lejp_ctx ctx;
 	const char *p;
 
@@ -566,6 +729,9 @@ int main(int argc, const char **argv)
 	if ((p = lws_cmdline_option(argc, argv, "-d")))
 		logs = atoi(p);
 
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		count = atoi(p);
+
 	lws_set_log_level(logs, NULL);
 	lwsl_user("LWS API selftest: lws_struct JSON\n");
 
@@ -623,6 +789,29 @@ int main(int argc, const char **argv)
 	if (e)
 		goto bail;
 
+	if (count > 0) {
+		bench_prepare();
+
+		us = bench(1, 0, 1);
+		if (us >= 0)
+			us = bench(1, 1, 1);
+		if (us >= 0)
+			us = bench(count, 0, 0);
+		us_nocache = bench(count, 1, 0);
+		if (us < 0 || us_nocache < 0)
+			goto bail;
+
+		lwsl_user("%s: %d paths, %d x %dB doc: %dus / doc (%dMB/s), "
+			  "without match cache %dus / doc (%dMB/s)\n", __func__,
+			  BENCH_PATHS, count, (int)strlen(bench_doc),
+			  (int)(us / count),
+			  (int)(((lws_usec_t)strlen(bench_doc) * count) /
+							(us ? us : 1)),
+			  (int)(us_nocache / count),
+			  (int)(((lws_usec_t)strlen(bench_doc) * count) /
+					(us_nocache ? us_nocache : 1)));
+	}
+
 	lwsl_user("Completed: PASS\n");
 
 	return 0;
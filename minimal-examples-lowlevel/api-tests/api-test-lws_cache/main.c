@@ -153,6 +153,105 @@ cdone:
 	return ret;
 }
 
+/*
+ * Time writes, specific gets and wildcard lookups on a heap cache holding
+ * 100, 1000 and 10000 items, with ten keys per host.  The cost per operation
+ * should stay about the same as the cache grows.
+ */
+
+static int
+test_heap_scaling(void)
+{
+	static const int counts[] = { 100, 1000, 10000 };
+	struct lws_cache_creation_info ci;
+	struct lws_cache_ttl_lru *l1;
+	lws_usec_t t0, tw, tg, tl;
+	lws_cache_results_t cr;
+	char key[64], wc[64];
+	size_t size;
+	int n, m, c;
+	char *po;
+
+	lwsl_user("%s\n", __func__);
+	tests++;
+
+	memset(&ci, 0, sizeof(ci));
+	ci.cx = cx;
+	ci.ops = &lws_cache_ops_heap;
+	ci.name = "L1_scale";
+
+	for (c = 0; c < (int)LWS_ARRAY_SIZE(counts); c++) {
+		l1 = lws_cache_create(&ci);
+		if (!l1)
+			return 1;
+
+		t0 = lws_now_usecs();
+		for (n = 0; n < counts[c]; n++) {
+			lws_snprintf(key, sizeof(key), "h%d.com|/|c%d",
+				     n / 10, n);
+			if (lws_cache_write_through(l1, key,
+					(const uint8_t *)key, strlen(key) + 1,
+					lws_now_usecs() + LWS_US_PER_SEC * 60 +
+							(n % 1000), NULL))
+				goto bail;
+		}
+		tw = lws_now_usecs() - t0;
+
+		t0 = lws_now_usecs();
+		for (n = 0; n < counts[c]; n++) {
+			lws_snprintf(key, sizeof(key), "h%d.com|/|c%d",
+				     n / 10, n);
+			if (lws_cache_item_get(l1, key, (const void **)&po,
+					       &size) || strcmp(po, key)) {
+				lwsl_err("%s: get %s failed\n", __func__, key);
+				goto bail;
+			}
+		}
+		tg = lws_now_usecs() - t0;
+
+		/*
+		 * Lookup results are cached in L1 as a meta item, so each
+		 * lookup must be for a different host
+		 */
+
+		t0 = lws_now_usecs();
+		for (n = 0; n < 10; n++) {
+			lws_snprintf(wc, sizeof(wc), "h%d.com|/|*",
+				     (n * counts[c]) / 100);
+			if (lws_cache_lookup(l1, wc, (const void **)&cr.ptr,
+					     &cr.size)) {
+				lwsl_err("%s: lookup %s failed\n", __func__, wc);
+				goto bail;
+			}
+			m = 0;
+			while (!lws_cache_results_walk(&cr))
+				m++;
+			if (m != 10) {
+				lwsl_err("%s: lookup %s gave %d\n", __func__,
+					 wc, m);
+				goto bail;
+			}
+		}
+		tl = lws_now_usecs() - t0;
+
+		lwsl_user("%s: %5d items: write %dns, get %dns, "
+			  "lookup %dns\n", __func__, counts[c],
+			  (int)((tw * 1000) / counts[c]),
+			  (int)((tg * 1000) / counts[c]),
+			  (int)((tl * 1000) / 10));
+
+		lws_cache_destroy(&l1);
+	}
+
+	return 0;
+
+bail:
+	lws_cache_destroy(&l1);
+	lwsl_warn("%s: fail\n", __func__);
+
+	return 1;
+}
+
 #if defined(LWS_WITH_CACHE_NSCOOKIEJAR)
 
 static const char
@@ -495,6 +594,8 @@ int main(int argc, const char **argv)
 		fail++;
 	if (test_just_l1_limits())
 		fail++;
+	if (test_heap_scaling())
+		fail++;
 
 #if defined(LWS_WITH_CACHE_NSCOOKIEJAR)
 	if (test_nsc1())
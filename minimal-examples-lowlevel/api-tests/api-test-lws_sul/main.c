@@ -0,0 +1,233 @@
+/*
+ * lws-api-test-lws_sul
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test confirms lws_sul fire in order and not early, after a mix of
+ * rescheduling and cancellation, and times rescheduling compared to a plain
+ * sorted list.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+#define COUNT_TEST_SUL		2000
+#define RESCHEDULES		4
+#define SPREAD_US		(600 * LWS_US_PER_MS)
+
+struct test_sul {
+	lws_sorted_usec_list_t	sul;
+	lws_usec_t		due;
+	char			cancelled;
+	char			fired;
+};
+
+static struct test_sul tsul[COUNT_TEST_SUL], tsul_far[4];
+static lws_sorted_usec_list_t sul_failsafe;
+static struct lws_context *context;
+static int expected, fired, fail, interrupted;
+static lws_usec_t last_due;
+static uint32_t rnd = 0x12345678;
+
+static uint32_t
+prng(void)
+{
+	rnd = rnd * 1103515245u + 12345u;
+
+	return rnd >> 8;
+}
+
+static void
+test_cb(lws_sorted_usec_list_t *sul)
+{
+	struct test_sul *t = lws_container_of(sul, struct test_sul, sul);
+	lws_usec_t now = lws_now_usecs();
+
+	if (t->cancelled || t->fired) {
+		lwsl_err("%s: cancelled or repeated sul fired\n", __func__);
+		fail++;
+	}
+
+	if (now < t->due) {
+		lwsl_err("%s: fired %lldus early\n", __func__,
+			 (long long)(t->due - now));
+		fail++;
+	}
+
+	if (t->due < last_due) {
+		lwsl_err("%s: out of order by %lldus\n", __func__,
+			 (long long)(last_due - t->due));
+		fail++;
+	}
+
+	last_due = t->due;
+	t->fired = 1;
+
+	if (++fired == expected)
+		lws_cancel_service(context);
+}
+
+static void
+failsafe_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: test took too long\n", __func__);
+	interrupted = 1;
+}
+
+static void
+schedule(struct test_sul *t, lws_usec_t us)
+{
+	t->due = lws_now_usecs() + us;
+
+	if (prng() & 1)
+		lws_sul_schedule_wakesuspend(context, 0, &t->sul, test_cb, us);
+	else
+		lws_sul_schedule(context, 0, &t->sul, test_cb, us);
+
+	/* the real schedule time may be later than our idea of it */
+	t->due = t->sul.us;
+}
+
+static int
+sul_compare(const lws_dll2_t *d, const lws_dll2_t *i)
+{
+	lws_usec_t a = ((lws_sorted_usec_list_t *)d)->us,
+		   b = ((lws_sorted_usec_list_t *)i)->us;
+
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+static void
+dummy_cb(lws_sorted_usec_list_t *sul)
+{
+}
+
+/*
+ * Reschedule a population of timeouts between 5s and 35s out, like
+ * connections refreshing their timeout on rx, first on lws_sul and then on a
+ * plain sorted list
+ */
+
+static int
+bench(int count)
+{
+	lws_sorted_usec_list_t *s = calloc((size_t)count, sizeof(*s));
+	lws_usec_t t0, t_sul, t_list;
+	lws_dll2_owner_t own;
+	int n, m;
+
+	if (!s)
+		return 1;
+
+	t0 = lws_now_usecs();
+	for (m = 0; m < 10; m++)
+		for (n = 0; n < count; n++)
+			lws_sul_schedule(context, 0, &s[n], dummy_cb,
+					 5 * LWS_US_PER_SEC +
+					 (lws_usec_t)(prng() % (30 * LWS_US_PER_SEC)));
+	t_sul = lws_now_usecs() - t0;
+
+	for (n = 0; n < count; n++)
+		lws_sul_cancel(&s[n]);
+
+	memset(&own, 0, sizeof(own));
+	t0 = lws_now_usecs();
+	for (m = 0; m < 10; m++)
+		for (n = 0; n < count; n++) {
+			lws_dll2_remove(&s[n].list);
+			s[n].us = lws_now_usecs() + 5 * LWS_US_PER_SEC +
+				  (lws_usec_t)(prng() % (30 * LWS_US_PER_SEC));
+			lws_dll2_add_sorted(&s[n].list, &own, sul_compare);
+		}
+	t_list = lws_now_usecs() - t0;
+
+	for (n = 0; n < count; n++)
+		lws_dll2_remove(&s[n].list);
+
+	free(s);
+
+	lwsl_user("%s: bench %d sul x 10: lws_sul %dns / resched, "
+		  "sorted list %dns / resched\n", __func__, count,
+		  (int)((t_sul * 1000) / (count * 10)),
+		  (int)((t_list * 1000) / (count * 10)));
+
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE;
+	struct lws_context_creation_info info;
+	int n, m, bench_count = 5000;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		bench_count = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_sul\n");
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.port = CONTEXT_PORT_NO_LISTEN;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	/* some that stay on the upper levels and are cancelled unfired */
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(tsul_far); n++)
+		schedule(&tsul_far[n], (lws_usec_t)(n + 1) * 3600 *
+						LWS_US_PER_SEC * (n ? 24 : 1));
+
+	for (m = 0; m < RESCHEDULES; m++)
+		for (n = 0; n < COUNT_TEST_SUL; n++)
+			schedule(&tsul[n], (lws_usec_t)(prng() % SPREAD_US));
+
+	expected = COUNT_TEST_SUL;
+	for (n = 0; n < COUNT_TEST_SUL; n += 10) {
+		lws_sul_cancel(&tsul[n].sul);
+		tsul[n].cancelled = 1;
+		expected--;
+	}
+
+	lws_sul_schedule(context, 0, &sul_failsafe, failsafe_cb,
+			 5 * LWS_US_PER_SEC);
+
+	while (!interrupted && fired < expected && !fail)
+		if (lws_service(context, 0))
+			break;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(tsul_far); n++) {
+		if (tsul_far[n].fired) {
+			lwsl_err("%s: far sul %d fired\n", __func__, n);
+			fail++;
+		}
+		lws_sul_cancel(&tsul_far[n].sul);
+	}
+	lws_sul_cancel(&sul_failsafe);
+
+	if (fired != expected) {
+		lwsl_err("%s: fired %d, expected %d\n", __func__, fired,
+			 expected);
+		fail++;
+	}
+
+	if (!fail && bench_count > 0)
+		fail = bench(bench_count);
+
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,351 @@
+/*
+ * lws-api-test-mount-lookup
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test gives a vhost random mount lists with lws_vhost_set_mounts(),
+ * and for each makes http/1 requests for random uris over socketpairs.  The
+ * mountpoints and uris are made from 'a', 'b' and '/', so there are lots of
+ * mountpoints that are prefixes of each other and of the uris, with and
+ * without a '/' at the boundary, duplicates, and the single char "/"
+ * mountpoint.  Some of the mounts are LWSMPRO_NO_MOUNT.
+ *
+ * The mounts are callback mounts that tell us their index when the server
+ * picks them, or redirect mounts whose index comes back in the Location:, or
+ * the server tells us it found none.  We compare that with what the linear
+ * mount list walk lws_find_mount() used to do, for the uri the server saw.
+ *
+ * Redirect mounts are acted on before the uri is passed to any callback, so
+ * we work out what the server will see ourselves, by collapsing "//", and
+ * check we agree with the server when it does show us the uri.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#define ROUNDS			200
+#define URIS_PER_ROUND		25
+#define MAX_MOUNTS		40
+
+static struct lws_http_mount		mounts[MAX_MOUNTS];
+static struct lws_protocol_vhost_options pvos[MAX_MOUNTS];
+static char				mps[MAX_MOUNTS][8], idxs[MAX_MOUNTS][4],
+					redirs[MAX_MOUNTS][8];
+static int				count_mounts;
+
+static struct lws_context		*context;
+static struct lws_vhost			*vh;
+static uint32_t				rnd;
+static char				seen[128];
+static int				picked, answered, stopped;
+
+static uint32_t
+prng(void)
+{
+	rnd = rnd * 1103515245u + 12345u;
+
+	return rnd >> 8;
+}
+
+/* '/' followed by up to max chars of 'a', 'b' and '/' */
+
+static void
+random_path(char *p, int max)
+{
+	static const char alpha[] = "ab/";
+	int n = (int)(prng() % (uint32_t)(max + 1));
+
+	*p++ = '/';
+	while (n--)
+		*p++ = alpha[prng() % 3];
+	*p = '\0';
+}
+
+static void
+random_mounts(void)
+{
+	int n;
+
+	count_mounts = 1 + (int)(prng() % MAX_MOUNTS);
+
+	for (n = 0; n < count_mounts; n++) {
+		/* sometimes reuse an earlier mountpoint */
+		if (n && !(prng() % 6))
+			lws_strncpy(mps[n], mps[prng() % (uint32_t)n],
+				    sizeof(mps[n]));
+		else
+			random_path(mps[n], 5);
+
+		lws_snprintf(idxs[n], sizeof(idxs[n]), "%d", n);
+		memset(&pvos[n], 0, sizeof(pvos[n]));
+		pvos[n].name = "idx";
+		pvos[n].value = idxs[n];
+
+		lws_snprintf(redirs[n], sizeof(redirs[n]), "m%d", n);
+
+		memset(&mounts[n], 0, sizeof(mounts[n]));
+		mounts[n].mount_next = n + 1 < count_mounts ?
+							&mounts[n + 1] : NULL;
+		mounts[n].mountpoint = mps[n];
+		mounts[n].mountpoint_len = (unsigned char)strlen(mps[n]);
+
+		switch (prng() % 8) {
+		case 0:
+			mounts[n].origin_protocol = LWSMPRO_NO_MOUNT;
+			break;
+		case 1:
+		case 2:
+		case 3:
+			/* picking it redirects us to http://m<index> */
+			mounts[n].origin = redirs[n];
+			mounts[n].origin_protocol = LWSMPRO_REDIR_HTTP;
+			break;
+		default:
+			mounts[n].origin = "mount";
+			mounts[n].cgienv = &pvos[n];
+			mounts[n].origin_protocol = LWSMPRO_CALLBACK;
+			break;
+		}
+	}
+}
+
+/* the uri lws will match against... ours only need "//" collapsing */
+
+static void
+collapse(const char *in, char *out)
+{
+	while (*in) {
+		if (*in != '/' || in[1] != '/')
+			*out++ = *in;
+		in++;
+	}
+	*out = '\0';
+}
+
+/*
+ * The linear walk the radix tree replaced.  Our requests are all GET, so
+ * every mount is eligible... but notice a callback mount replaces any hit
+ * before it, even a longer one, it's only the others that must be longer.
+ */
+
+static int
+find_mount_linear(const char *uri, int uri_len)
+{
+	int n, hit = -1, best = 0;
+
+	for (n = 0; n < count_mounts; n++) {
+		const struct lws_http_mount *hm = &mounts[n];
+
+		if (uri_len >= hm->mountpoint_len &&
+		    !strncmp(uri, hm->mountpoint, hm->mountpoint_len) &&
+		    (uri[hm->mountpoint_len] == '\0' ||
+		     uri[hm->mountpoint_len] == '/' ||
+		     hm->mountpoint_len == 1)) {
+			if (hm->origin_protocol == LWSMPRO_NO_MOUNT) {
+				stopped++;
+				return -1;
+			}
+
+			if (hm->origin_protocol == LWSMPRO_CALLBACK ||
+			    hm->mountpoint_len > best) {
+				best = hm->mountpoint_len;
+				hit = n;
+			}
+		}
+	}
+
+	return hit;
+}
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	const struct lws_protocol_vhost_options *pvo;
+
+	switch (reason) {
+	case LWS_CALLBACK_FILTER_HTTP_CONNECTION:
+		/* the uri the mounts will be matched against */
+		lws_strnncpy(seen, (const char *)in, len, sizeof(seen));
+		return 0;
+
+	case LWS_CALLBACK_HTTP_PMO:
+		/* a mount picked us, and gives us its cgienv */
+		pvo = (const struct lws_protocol_vhost_options *)in;
+		picked = atoi(pvo->value);
+		break;
+
+	case LWS_CALLBACK_HTTP:
+		/* the server found no mount */
+		picked = -1;
+		break;
+
+	default:
+		return lws_callback_http_dummy(wsi, reason, user, in, len);
+	}
+
+	answered = 1;
+
+	/* we learned what we needed, drop the connection */
+
+	return -1;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0, 0, NULL, 0 },
+	{ "mount", callback_http, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+/*
+ * Make the request over a new socketpair, and wait for the server to close...
+ * if a redirect mount was picked, the response tells us which
+ */
+
+static int
+request(const char *uri)
+{
+	char req[256], rx[1024];
+	int sv[2], n, len, pos = 0;
+	const char *loc;
+	ssize_t r;
+
+	answered = 0;
+	seen[0] = '\0';
+	len = lws_snprintf(req, sizeof(req),
+			   "GET %s HTTP/1.1\r\nHost: x\r\n"
+			   "Connection: close\r\n\r\n", uri);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		lwsl_err("%s: socketpair failed\n", __func__);
+		return 1;
+	}
+	fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+
+	if (send(sv[1], req, (size_t)len, MSG_NOSIGNAL) != len ||
+	    !lws_adopt_socket_vhost(vh, sv[0])) {
+		lwsl_err("%s: adopt failed\n", __func__);
+		close(sv[0]);
+		close(sv[1]);
+		return 1;
+	}
+
+	for (n = 0; n < 1000; n++) {
+		if (lws_service(context, -1) < 0)
+			break;
+
+		r = recv(sv[1], rx + pos, sizeof(rx) - 1 - (size_t)pos, 0);
+		if (!r || (r < 0 && errno != EAGAIN))
+			break;
+		if (r > 0)
+			pos += (int)r;
+	}
+
+	close(sv[1]);
+
+	rx[pos] = '\0';
+	loc = strstr(rx, "\nlocation: http://m");
+	if (!answered && strstr(rx, " 301 ") && loc) {
+		picked = atoi(loc + 19);
+		answered = 1;
+	}
+
+	return !answered;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, round, u, exp, fail = 0,
+	    lookups = 0, hits = 0;
+	struct lws_context_creation_info info;
+	char uri[16], tail[8], norm[16];
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	rnd = (uint32_t)lws_now_usecs();
+	if ((p = lws_cmdline_option(argc, argv, "-s")))
+		rnd = (uint32_t)atol(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: mount lookup, seed %u\n", rnd);
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER;
+	info.protocols = protocols;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+	vh = lws_get_vhost_by_name(context, "default");
+
+	for (round = 0; !fail && round < ROUNDS; round++) {
+		random_mounts();
+		lws_vhost_set_mounts(vh, mounts);
+
+		for (u = 0; !fail && u < URIS_PER_ROUND; u++) {
+			/* mostly below a mountpoint, else anything */
+			if (prng() % 4) {
+				random_path(tail, 3);
+				lws_snprintf(uri, sizeof(uri), "%s%s",
+					     mps[prng() % (uint32_t)count_mounts],
+					     tail);
+			} else
+				random_path(uri, 7);
+
+			if (request(uri)) {
+				lwsl_err("%s: no answer for %s\n", __func__,
+					 uri);
+				fail = 1;
+				break;
+			}
+
+			collapse(uri, norm);
+			if (seen[0] && strcmp(seen, norm)) {
+				lwsl_err("%s: sent %s, server saw %s not %s\n",
+					 __func__, uri, seen, norm);
+				fail = 1;
+				break;
+			}
+
+			exp = find_mount_linear(norm, (int)strlen(norm));
+			if (exp != picked) {
+				lwsl_err("%s: round %d: %s (sent %s): "
+					 "picked %d, expected %d\n", __func__,
+					 round, norm, uri, picked, exp);
+				for (exp = 0; exp < count_mounts; exp++)
+					lwsl_err("  %d: %s%s\n", exp, mps[exp],
+						 mounts[exp].origin_protocol ==
+							LWSMPRO_NO_MOUNT ?
+							" (no mount)" : "");
+				fail = 1;
+			}
+
+			lookups++;
+			if (picked >= 0)
+				hits++;
+		}
+	}
+
+	lws_vhost_set_mounts(vh, NULL);
+	lws_context_destroy(context);
+
+	if (!fail)
+		lwsl_user("%s: %d lookups, %d hit a mount, %d stopped by a "
+			  "no-mount\n", __func__, lookups, hits, stopped);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,320 @@
+/*
+ * lws-api-test-mqtt-topic-trie
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test confirms lws_mqtt_topic_trie_match() finds the same topic
+ * filters as checking every filter against the topic one by one, for fixed
+ * cases and for random filters and topics, also after some filters are
+ * removed.  It then reports the time taken to match topics against 10k
+ * subscriptions both ways.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+#define RAND_FILTERS		400
+#define RAND_TOPICS		4000
+#define BENCH_SUBS		10000
+
+static uint32_t rnd = 0x12345678;
+
+static uint32_t
+prng(void)
+{
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+
+	return rnd;
+}
+
+/* one level at a time, the way MQTT describes it */
+
+static int
+ref_match(const char *f, const char *t)
+{
+	while (1) {
+		if (f[0] == '#' && !f[1])
+			return 1;
+
+		if (f[0] == '+' && (!f[1] || f[1] == '/')) {
+			f++;
+			while (*t && *t != '/')
+				t++;
+		} else
+			while (*f && *f != '/') {
+				if (*f++ != *t++)
+					return 0;
+			}
+
+		if (*t && *t != '/')
+			return 0;
+
+		if (!*f)
+			return !*t;
+
+		/* f is at a '/' */
+		if (!*t)
+			/* "a/#" matches "a" */
+			return !strcmp(f, "/#");
+
+		f++;
+		t++;
+	}
+}
+
+static const struct {
+	const char	*filter;
+	const char	*topic;
+	int		match;
+} fixed[] = {
+	{ "a/b/c",	"a/b/c",	1 },
+	{ "a/b/c",	"a/b",		0 },
+	{ "a/b",	"a/b/c",	0 },
+	{ "a/+/c",	"a/xyz/c",	1 },
+	{ "a/+/c",	"a//c",		1 },
+	{ "a/+/c",	"a/b/d",	0 },
+	{ "a/+",	"a/b/c",	0 },
+	{ "+/+",	"a/b",		1 },
+	{ "+",		"a",		1 },
+	{ "+",		"a/b",		0 },
+	{ "#",		"a/b/c",	1 },
+	{ "a/#",	"a",		1 },
+	{ "a/#",	"a/b/c",	1 },
+	{ "a/#",	"ab",		0 },
+	{ "a/b/#",	"a/c",		0 },
+	{ "+/b/#",	"x/b",		1 },
+	{ "ab",		"a",		0 },
+};
+
+struct hits {
+	uint8_t		*hit;
+	int		count;
+};
+
+static int
+hit_cb(void *opaque, void *user)
+{
+	struct hits *h = (struct hits *)user;
+
+	h->hit[(lws_intptr_t)opaque]++;
+	h->count++;
+
+	return 0;
+}
+
+/* topics use the first 4 kinds of level, filters also "+", and "#" last */
+
+static void
+rand_name(char *buf, int filter)
+{
+	static const char * const lv[] = { "a", "b", "cc", "", "+", "#" };
+	int levels = 1 + (int)(prng() % 4), n, k;
+	char *p = buf;
+
+	for (n = 0; n < levels; n++) {
+		if (n)
+			*p++ = '/';
+		k = (int)(prng() % (!filter ? 4u : (n == levels - 1 ? 6u : 5u)));
+		strcpy(p, lv[k]);
+		p += strlen(lv[k]);
+	}
+}
+
+static int
+compare(lws_mqtt_topic_trie_t *t, char (*filters)[32], const uint8_t *live,
+	int nf)
+{
+	uint8_t hit[RAND_FILTERS];
+	struct hits h = { hit, 0 };
+	char topic[32];
+	int n, m, c;
+
+	for (n = 0; n < RAND_TOPICS; n++) {
+		rand_name(topic, 0);
+		memset(hit, 0, sizeof(hit));
+		h.count = 0;
+		c = lws_mqtt_topic_trie_match(t, topic, hit_cb, &h);
+		if (c != h.count)
+			return 1;
+
+		for (m = 0; m < nf; m++)
+			if (hit[m] != (live[m] && ref_match(filters[m], topic))) {
+				lwsl_err("%s: '%s' vs '%s': trie %d\n",
+					 __func__, filters[m], topic, hit[m]);
+				return 1;
+			}
+	}
+
+	return 0;
+}
+
+static int
+check(void)
+{
+	static char filters[RAND_FILTERS][32];
+	uint8_t live[RAND_FILTERS], hit[2];
+	struct hits h = { hit, 0 };
+	lws_mqtt_topic_trie_t *t;
+	int n, fail = 0;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(fixed); n++) {
+		if (ref_match(fixed[n].filter, fixed[n].topic) !=
+							fixed[n].match) {
+			lwsl_err("%s: ref %d\n", __func__, n);
+			return 1;
+		}
+
+		t = lws_mqtt_topic_trie_create();
+		if (!t || lws_mqtt_topic_trie_add(t, fixed[n].filter, (void *)1))
+			return 1;
+		if (lws_mqtt_topic_trie_match(t, fixed[n].topic, hit_cb, &h) !=
+							fixed[n].match) {
+			lwsl_err("%s: '%s' vs '%s' should be %d\n", __func__,
+				 fixed[n].filter, fixed[n].topic,
+				 fixed[n].match);
+			fail++;
+		}
+		if (lws_mqtt_topic_trie_find(t, fixed[n].filter) != (void *)1 ||
+		    lws_mqtt_topic_trie_remove(t, fixed[n].filter, (void *)1))
+			fail++;
+		lws_mqtt_topic_trie_destroy(&t);
+	}
+
+	/* random filters, some the same as others */
+
+	t = lws_mqtt_topic_trie_create();
+	if (!t)
+		return 1;
+
+	for (n = 0; n < RAND_FILTERS; n++) {
+		rand_name(filters[n], 1);
+		live[n] = 1;
+		if (lws_mqtt_topic_trie_add(t, filters[n], (void *)(lws_intptr_t)n))
+			return 1;
+	}
+
+	fail += compare(t, filters, live, RAND_FILTERS);
+
+	for (n = 0; n < RAND_FILTERS; n += 2) {
+		live[n] = 0;
+		if (lws_mqtt_topic_trie_remove(t, filters[n],
+					       (void *)(lws_intptr_t)n))
+			fail++;
+	}
+	if (!lws_mqtt_topic_trie_remove(t, filters[0], (void *)(lws_intptr_t)0))
+		fail++;
+
+	for (n = 1; n < RAND_FILTERS; n += 2)
+		if (!lws_mqtt_topic_trie_find(t, filters[n]))
+			fail++;
+
+	fail += compare(t, filters, live, RAND_FILTERS);
+
+	lws_mqtt_topic_trie_destroy(&t);
+
+	return fail;
+}
+
+static char (*bsubs)[48];
+
+static int
+bench(int lookups)
+{
+	lws_usec_t t0, t_ref, t_trie;
+	lws_mqtt_topic_trie_t *t;
+	struct hits h;
+	char topic[48];
+	int n, m, c1 = 0, c2 = 0;
+
+	bsubs = malloc(sizeof(*bsubs) * BENCH_SUBS);
+	h.hit = malloc(BENCH_SUBS);
+	t = lws_mqtt_topic_trie_create();
+	if (!bsubs || !h.hit || !t)
+		return 1;
+
+	/* per-device topics plus some wildcard filters */
+
+	for (n = 0; n < BENCH_SUBS; n++) {
+		if (n % 20 == 1)
+			lws_snprintf(bsubs[n], sizeof(bsubs[n]),
+				     "site/%d/+/temp", n % 97);
+		else if (n % 20 == 2)
+			lws_snprintf(bsubs[n], sizeof(bsubs[n]),
+				     "dev/%d/#", n);
+		else if (n == 3)
+			lws_snprintf(bsubs[n], sizeof(bsubs[n]),
+				     "+/+/alarm");
+		else
+			lws_snprintf(bsubs[n], sizeof(bsubs[n]),
+				     "dev/%d/telemetry", n);
+		if (lws_mqtt_topic_trie_add(t, bsubs[n],
+					    (void *)(lws_intptr_t)n))
+			return 1;
+	}
+
+	t_ref = t_trie = 0;
+	for (n = 0; n < lookups; n++) {
+		if (n & 1)
+			lws_snprintf(topic, sizeof(topic), "dev/%d/telemetry",
+				     (int)(prng() % BENCH_SUBS));
+		else
+			lws_snprintf(topic, sizeof(topic), "site/%d/d%d/temp",
+				     (int)(prng() % 97), n);
+
+		t0 = lws_now_usecs();
+		for (m = 0; m < BENCH_SUBS; m++)
+			c1 += ref_match(bsubs[m], topic);
+		t_ref += lws_now_usecs() - t0;
+
+		h.count = 0;
+		t0 = lws_now_usecs();
+		c2 += lws_mqtt_topic_trie_match(t, topic, hit_cb, &h);
+		t_trie += lws_now_usecs() - t0;
+	}
+
+	lwsl_user("%s: %d subs, %d topics: each sub %.2fus / topic, "
+		  "trie %.3fus / topic\n", __func__, BENCH_SUBS, lookups,
+		  (double)t_ref / lookups, (double)t_trie / lookups);
+
+	lws_mqtt_topic_trie_destroy(&t);
+	free(h.hit);
+	free(bsubs);
+
+	if (c1 != c2) {
+		lwsl_err("%s: %d matches vs %d\n", __func__, c1, c2);
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, lookups = 5000;
+	const char *p;
+	int fail;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		lookups = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: mqtt topic trie\n");
+
+	fail = check();
+
+	if (!fail && lookups > 0)
+		fail = bench(lookups);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,316 @@
+/*
+ * lws-api-test-pmd-pool
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test echoes compressible messages between ws clients and a ws
+ * server in the same context, with permessage-deflate, and checks every echo
+ * comes back intact.
+ *
+ * First the clients negotiate no_context_takeover both ways, so each end only
+ * needs its z_streams while a message is in flight.  The test counts the
+ * z_streams lws allocates, and checks nearly every message reused a pooled
+ * one instead.
+ *
+ * Then the context has a pmd memory budget, and the clients keep their
+ * contexts.  The first client's connection uses up the budget, so the second
+ * client must be told a smaller server_max_window_bits, and its messages must
+ * still decompress correctly.
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PORT			7618
+#define MSG_MAX			4096
+#define BUDGET			(64 * 1024)
+
+struct pss {
+	size_t			len;
+	int			conn;
+	int			msgs;
+	uint8_t			buf[LWS_PRE + MSG_MAX];
+};
+
+static struct lws_context	*cx;
+static int			conns = 8, msgs = 50, done, limited, allocs,
+				budget, fail;
+
+static void *
+counting_realloc(void *ptr, size_t size, const char *reason)
+{
+	if (!size) {
+		free(ptr);
+		return NULL;
+	}
+
+	if (!ptr && !strcmp(reason, "pmd zs"))
+		allocs++;
+
+	return realloc(ptr, size);
+}
+
+/* a message that compresses well, but is different for each conn and msg */
+
+static size_t
+fill(uint8_t *buf, int conn, int msg)
+{
+	size_t len = 1000 + (size_t)((conn * 37 + msg * 101) % 3000), n = 0;
+
+	while (n < len)
+		n += (size_t)lws_snprintf((char *)buf + n, len - n + 1,
+			"{\"conn\":%d,\"msg\":%d,\"ofs\":%d}", conn, msg, (int)n);
+
+	return len;
+}
+
+static int
+connect_client(int conn)
+{
+	struct lws_client_connect_info i;
+
+	memset(&i, 0, sizeof(i));
+	i.context = cx;
+	i.address = "127.0.0.1";
+	i.port = PORT;
+	i.path = "/";
+	i.host = i.address;
+	i.origin = i.address;
+	i.protocol = "pmd-test";
+	i.opaque_user_data = (void *)(intptr_t)conn;
+
+	if (!lws_client_connect_via_info(&i)) {
+		lwsl_err("%s: connect %d failed\n", __func__, conn);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+callback_pmd_test(struct lws *wsi, enum lws_callback_reasons reason,
+		  void *user, void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	uint8_t cmp[MSG_MAX];
+	char ext[128];
+	size_t n;
+
+	switch (reason) {
+
+	/* server side, echo each message back when we have all of it */
+
+	case LWS_CALLBACK_RECEIVE:
+		if (pss->len + len > MSG_MAX)
+			return -1;
+		memcpy(pss->buf + LWS_PRE + pss->len, in, len);
+		pss->len += len;
+		if (lws_is_final_fragment(wsi))
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (lws_write(wsi, pss->buf + LWS_PRE, pss->len,
+			      LWS_WRITE_TEXT) < (int)pss->len)
+			return -1;
+		pss->len = 0;
+		break;
+
+	/* client side */
+
+	case LWS_CALLBACK_CLIENT_FILTER_PRE_ESTABLISH:
+		if (lws_hdr_copy(wsi, ext, sizeof(ext),
+				 WSI_TOKEN_EXTENSIONS) < 0)
+			return -1;
+		lwsl_info("%s: %s\n", __func__, ext);
+		if (strstr(ext, "server_max_window_bits=10"))
+			limited++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_ESTABLISHED:
+		pss->conn = (int)(intptr_t)lws_get_opaque_user_data(wsi);
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_WRITEABLE:
+		n = fill(pss->buf + LWS_PRE, pss->conn, pss->msgs);
+		if (lws_write(wsi, pss->buf + LWS_PRE, n, LWS_WRITE_TEXT) <
+								(int)n)
+			return -1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (pss->len + len > MSG_MAX)
+			return -1;
+		memcpy(pss->buf + LWS_PRE + pss->len, in, len);
+		pss->len += len;
+		if (!lws_is_final_fragment(wsi))
+			break;
+
+		n = fill(cmp, pss->conn, pss->msgs);
+		if (n != pss->len || memcmp(cmp, pss->buf + LWS_PRE, n)) {
+			lwsl_err("%s: conn %d msg %d echo mismatch\n",
+				 __func__, pss->conn, pss->msgs);
+			fail = 1;
+			return -1;
+		}
+		pss->len = 0;
+
+		/*
+		 * With a budget, the second client connects once the first
+		 * has had a message compressed, and so holds its z_streams
+		 */
+
+		if (budget && !pss->conn && !pss->msgs && conns > 1 &&
+		    connect_client(1)) {
+			fail = 1;
+			return -1;
+		}
+
+		if (++pss->msgs == msgs) {
+			done++;
+			return -1;
+		}
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: connection error %s\n", __func__,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "pmd-test", callback_pmd_test, sizeof(struct pss), MSG_MAX, 0,
+	  NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static const struct lws_extension ext_nct[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate"
+		 "; client_no_context_takeover"
+		 "; server_no_context_takeover"
+		 "; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+}, ext_ct[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate"
+		 "; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out, %d done\n", __func__, done);
+	fail = 1;
+}
+
+static int
+run(const struct lws_extension *exts, int count)
+{
+	struct lws_context_creation_info info;
+	lws_sorted_usec_list_t sul_timeout;
+	int n;
+
+	done = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.port = PORT;
+	info.protocols = protocols;
+	info.extensions = exts;
+	info.pmd_mem_budget = budget ? BUDGET : 0;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	for (n = 0; n < count; n++)
+		if (connect_client(n))
+			fail = 1;
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 20 * LWS_US_PER_SEC);
+
+	while (!fail && done < conns)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+	lws_context_destroy(cx);
+
+	return fail || done != conns;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		msgs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: permessage-deflate z_stream pool\n");
+
+	lws_set_allocator(counting_realloc);
+
+	/*
+	 * Each message takes a z_stream at both ends, in both directions,
+	 * and the pool should have served nearly all of them
+	 */
+
+	if (run(ext_nct, conns)) {
+		lwsl_err("%s: no context takeover\n", __func__);
+		fail = 1;
+	} else {
+		lwsl_user("%s: %d messages, %d z_streams allocated\n", __func__,
+			  conns * msgs, allocs);
+		if (allocs * 10 > conns * msgs * 4) {
+			lwsl_err("%s: z_streams not reused\n", __func__);
+			fail = 1;
+		}
+	}
+
+	/* the first connection uses up the budget, the second is limited */
+
+	budget = 1;
+	conns = 2;
+	if (!fail && run(ext_ct, 1)) {
+		lwsl_err("%s: budget\n", __func__);
+		fail = 1;
+	}
+
+	if (!fail && limited != 1) {
+		lwsl_err("%s: %d connections limited\n", __func__, limited);
+		fail = 1;
+	}
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,351 @@
+/*
+ * lws-api-test-raw-splice
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test has two "end" raw connections talking to each other through
+ * a pair of "relay" raw connections, all in one context, using two
+ * socketpairs:
+ *
+ *   left end <-> relay[0] <-> relay[1] <-> right end
+ *
+ * The relay splices each direction with lws_raw_splice(), so the data never
+ * comes up to it, and it just sends what's in the pipe on with
+ * lws_raw_splice_send(), with the same rx flow control it'd use to relay
+ * copies.  If lws can't splice, it relays copies with lws_write() instead.
+ *
+ * The right end sends 1MiB, then the left end sends 16MiB, and each end
+ * checks it got all of the other's data in order.  The left end closes as
+ * soon as it sent everything, and the relay must send the right end all of
+ * it, before it closes the right end's connection too.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHUNK			(64 * 1024)
+
+enum {
+	LEFT,
+	RIGHT
+};
+
+static const size_t		size[2] = { 16 * 1024 * 1024, 1024 * 1024 };
+
+static lws_sockfd_type		sv[2][2];
+static struct lws		*relay[2];
+static uint8_t			*stream[2];
+static size_t			sent[2], rx[2], spliced, copied;
+static lws_usec_t		t_start, t_end;
+static int			relay_closed[2], is_spliced[2], completed,
+				fail;
+
+static uint8_t
+pattern(int side, size_t ofs)
+{
+	return (uint8_t)((ofs * (side ? 13 : 7)) + (ofs >> 11));
+}
+
+static int
+which(struct lws *wsi, int end)
+{
+	return lws_get_socket_fd(wsi) == sv[RIGHT][!end];
+}
+
+/* the ends send their stream and check they get the other one */
+
+static int
+callback_end(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	     void *in, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)in;
+	int side = which(wsi, 1);
+	size_t n;
+
+	switch (reason) {
+	case LWS_CALLBACK_RAW_ADOPT:
+		/*
+		 * lws doesn't read a raw connection while it has buffered
+		 * output, so the ends mustn't both be sending at once
+		 */
+		if (side == RIGHT)
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		if (sent[side] == size[side]) {
+			/* the left end closes once it sent everything */
+			if (side == LEFT)
+				return lws_raw_transaction_completed(wsi);
+			break;
+		}
+
+		n = size[side] - sent[side];
+		if (n > CHUNK)
+			n = CHUNK;
+
+		/* anything the kernel doesn't take goes on the buflist */
+
+		if (lws_write(wsi, stream[side] + sent[side], n,
+			      LWS_WRITE_RAW) != (int)n) {
+			lwsl_err("%s: write failed\n", __func__);
+			fail = 1;
+			return -1;
+		}
+		sent[side] += n;
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_RX:
+		if (rx[side] + len > size[!side]) {
+			lwsl_err("%s: %d: too much rx\n", __func__, side);
+			fail = 1;
+			return -1;
+		}
+		for (n = 0; n < len; n++)
+			if (p[n] != pattern(!side, rx[side] + n)) {
+				lwsl_err("%s: %d: mismatch at %llu\n", __func__,
+					 side, (unsigned long long)(rx[side] + n));
+				fail = 1;
+				return -1;
+			}
+		rx[side] += len;
+		if (side == LEFT && rx[side] == size[RIGHT])
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_CLOSE:
+		if (rx[side] != size[!side] || sent[side] != size[side]) {
+			lwsl_err("%s: %d: closed early, rx %llu\n", __func__,
+				 side, (unsigned long long)rx[side]);
+			fail = 1;
+			break;
+		}
+		if (side == RIGHT) {
+			t_end = lws_now_usecs();
+			completed = 1;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* the relay passes rx from each of its connections on to the other one */
+
+static int
+callback_relay(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	       void *in, size_t len)
+{
+	int side = which(wsi, 0), n;
+
+	switch (reason) {
+	case LWS_CALLBACK_RAW_ADOPT:
+		relay[side] = wsi;
+		if (!relay[!side])
+			break;
+
+		t_start = lws_now_usecs();
+		is_spliced[LEFT] = !lws_raw_splice(relay[LEFT], relay[RIGHT]);
+		is_spliced[RIGHT] = !lws_raw_splice(relay[RIGHT], relay[LEFT]);
+		lwsl_user("%s: spliced %d %d\n", __func__, is_spliced[LEFT],
+			  is_spliced[RIGHT]);
+		break;
+
+	case LWS_CALLBACK_RAW_RX:
+		if (relay_closed[!side])
+			return -1;
+
+		if (in) {
+			/* no splicing, relay a copy */
+			copied += len;
+			if (lws_write(relay[!side], in, len, LWS_WRITE_RAW) !=
+								(int)len)
+				return -1;
+			break;
+		}
+
+		spliced += len;
+
+		/* stop rx from this side until the pipe is sent */
+
+		n = lws_raw_splice_send(relay[!side]);
+		if (n < 0)
+			return -1;
+		if (n) {
+			lws_rx_flow_control(wsi, 0);
+			lws_callback_on_writable(relay[!side]);
+		}
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		n = lws_raw_splice_send(wsi);
+		if (n < 0)
+			return -1;
+		if (n) {
+			lws_callback_on_writable(wsi);
+			break;
+		}
+
+		/* the pipe is empty, the other side can have more rx */
+
+		if (relay_closed[!side])
+			return lws_raw_transaction_completed(wsi);
+
+		lws_rx_flow_control(relay[!side], 1);
+		break;
+
+	case LWS_CALLBACK_RAW_CLOSE:
+		relay_closed[side] = 1;
+
+		/* the other side still sends on what is in our pipe */
+
+		if (!relay_closed[!side])
+			lws_callback_on_writable(relay[!side]);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "end", callback_end, 0, 0, 0, NULL, 0 },
+	{ "relay", callback_relay, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out, rx %llu %llu\n", __func__,
+		 (unsigned long long)rx[LEFT], (unsigned long long)rx[RIGHT]);
+	fail = 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws_context *cx;
+	struct lws_vhost *vh;
+	lws_sock_file_fd_type fd;
+	int n, m, adopted = 0;
+	const char *p;
+	size_t o;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: raw splice\n");
+
+	for (n = 0; n < 2; n++) {
+		stream[n] = malloc(size[n]);
+		if (!stream[n])
+			goto bail1;
+		for (o = 0; o < size[n]; o++)
+			stream[n][o] = pattern(n, o);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		goto bail1;
+	}
+
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER;
+	info.protocols = protocols;
+
+	vh = lws_create_vhost(cx, &info);
+	if (!vh) {
+		lwsl_err("lws vhost creation failed\n");
+		goto bail2;
+	}
+
+	/* [n][0] is the end's socket, [n][1] is the relay's */
+
+	for (n = 0; n < 2; n++)
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv[n])) {
+			lwsl_err("%s: socketpair failed\n", __func__);
+			if (n) {
+				close(sv[0][0]);
+				close(sv[0][1]);
+			}
+			goto bail2;
+		}
+
+	for (n = 0; n < 2; n++)
+		for (m = 0; m < 2; m++) {
+			fd.sockfd = sv[n][m];
+			if (!lws_adopt_descriptor_vhost(vh, LWS_ADOPT_SOCKET,
+					fd, protocols[m].name, NULL)) {
+				lwsl_err("%s: adoption failed\n", __func__);
+				/* the failed one was closed already */
+				for (m = adopted + 1; m < 4; m++)
+					close(sv[m >> 1][m & 1]);
+				goto bail2;
+			}
+			adopted++;
+		}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 20 * LWS_US_PER_SEC);
+
+	while (!fail && !completed)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+	lws_context_destroy(cx);
+
+#if defined(LWS_HAVE_SPLICE)
+	/* on this platform, the relay should never have seen the data */
+	if (!fail && (!is_spliced[LEFT] || !is_spliced[RIGHT] || copied ||
+		      spliced != size[LEFT] + size[RIGHT])) {
+		lwsl_err("%s: spliced %llu, copied %llu\n", __func__,
+			 (unsigned long long)spliced,
+			 (unsigned long long)copied);
+		fail = 1;
+	}
+#endif
+
+	if (!fail)
+		lwsl_user("%s: %lluKiB in %dms (%.1fMiB/s), %s\n", __func__,
+			  (unsigned long long)((size[LEFT] + size[RIGHT]) / 1024),
+			  (int)((t_end - t_start) / 1000),
+			  ((double)(size[LEFT] + size[RIGHT]) / (1024 * 1024)) /
+			  ((double)(t_end - t_start + 1) / LWS_US_PER_SEC),
+			  spliced ? "spliced" : "copied");
+
+	goto bail1;
+
+bail2:
+	lws_context_destroy(cx);
+	fail = 1;
+bail1:
+	for (n = 0; n < 2; n++) {
+		if (!stream[n])
+			fail = 1;
+		free(stream[n]);
+	}
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
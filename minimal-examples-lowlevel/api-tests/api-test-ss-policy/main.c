@@ -0,0 +1,258 @@
+/*
+ * lws-api-test-ss-policy
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test generates secure streams policies with many streamtypes, each
+ * with some metadata, and confirms streams of every type can be created and
+ * have their metadata set and read back, also after an overlay adds metadata
+ * to a streamtype.  It then reports how long it takes to create and destroy a
+ * stream with a small policy and a large one.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+#define MD_PER_STREAMTYPE	6
+
+typedef struct myss {
+	struct lws_ss_handle		*ss;
+	void				*opaque_data;
+} myss_t;
+
+static lws_ss_state_return_t
+myss_state(void *userobj, void *sh, lws_ss_constate_t state,
+	   lws_ss_tx_ordinal_t ack)
+{
+	return LWSSSSRET_OK;
+}
+
+static char *
+make_policy(int streamtypes)
+{
+	size_t len = 128 + (size_t)streamtypes * (100 + MD_PER_STREAMTYPE * 12);
+	char *buf = malloc(len), *p = buf, *end = buf + len;
+	int n, m;
+
+	if (!buf)
+		return NULL;
+
+	p += lws_snprintf(p, lws_ptr_diff_size_t(end, p),
+			  "{\"release\":\"1\",\"product\":\"test\","
+			  "\"schema-version\":1,\"s\":[");
+
+	for (n = 0; n < streamtypes; n++) {
+		p += lws_snprintf(p, lws_ptr_diff_size_t(end, p),
+				  "%s{\"st%d\":{\"endpoint\":\"127.0.0.1\","
+				  "\"port\":1,\"protocol\":\"raw\","
+				  "\"metadata\":[", n ? "," : "", n);
+		for (m = 0; m < MD_PER_STREAMTYPE; m++)
+			p += lws_snprintf(p, lws_ptr_diff_size_t(end, p),
+					  "%s{\"md%d\":\"\"}", m ? "," : "", m);
+		p += lws_snprintf(p, lws_ptr_diff_size_t(end, p), "]}}");
+	}
+
+	lws_snprintf(p, lws_ptr_diff_size_t(end, p), "]}");
+
+	return buf;
+}
+
+static struct lws_context *
+make_context(const char *policy)
+{
+	struct lws_context_creation_info info;
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.pss_policies_json = policy;
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	return lws_create_context(&info);
+}
+
+static struct lws_ss_handle *
+create_ss(struct lws_context *cx, const char *streamtype)
+{
+	struct lws_ss_handle *h = NULL;
+	lws_ss_info_t ssi;
+
+	memset(&ssi, 0, sizeof(ssi));
+	ssi.handle_offset = offsetof(myss_t, ss);
+	ssi.opaque_user_data_offset = offsetof(myss_t, opaque_data);
+	ssi.state = myss_state;
+	ssi.user_alloc = sizeof(myss_t);
+	ssi.streamtype = streamtype;
+
+	if (lws_ss_create(cx, 0, &ssi, NULL, &h, NULL, NULL))
+		return NULL;
+
+	return h;
+}
+
+/* set every metadata on a stream of the streamtype, and read them back */
+
+static int
+check_streamtype(struct lws_context *cx, const char *streamtype, int mds)
+{
+	struct lws_ss_handle *h = create_ss(cx, streamtype);
+	char name[16], val[32];
+	const void *v;
+	size_t len;
+	int m;
+
+	if (!h) {
+		lwsl_err("%s: failed to create %s\n", __func__, streamtype);
+		return 1;
+	}
+
+	for (m = 0; m < mds; m++) {
+		lws_snprintf(name, sizeof(name), "md%d", m);
+		lws_snprintf(val, sizeof(val), "%s.%d", streamtype, m);
+		if (lws_ss_set_metadata(h, name, val, strlen(val)))
+			goto bail;
+	}
+
+	for (m = 0; m < mds; m++) {
+		lws_snprintf(name, sizeof(name), "md%d", m);
+		lws_snprintf(val, sizeof(val), "%s.%d", streamtype, m);
+		if (lws_ss_get_metadata(h, name, &v, &len) ||
+		    len != strlen(val) || memcmp(v, val, len))
+			goto bail;
+	}
+
+	if (!lws_ss_get_metadata(h, "nonexistent", &v, &len))
+		goto bail;
+
+	lws_ss_destroy(&h);
+
+	return 0;
+
+bail:
+	lwsl_err("%s: %s metadata %s failed\n", __func__, streamtype, name);
+	lws_ss_destroy(&h);
+
+	return 1;
+}
+
+static int
+check(int streamtypes)
+{
+	struct lws_context *cx;
+	char *policy, st[16];
+	int n, fail = 0;
+
+	policy = make_policy(streamtypes);
+	if (!policy)
+		return 1;
+
+	cx = make_context(policy);
+	if (!cx) {
+		free(policy);
+		return 1;
+	}
+
+	for (n = 0; n < streamtypes && !fail; n++) {
+		lws_snprintf(st, sizeof(st), "st%d", n);
+		fail |= check_streamtype(cx, st, MD_PER_STREAMTYPE);
+	}
+
+	if (!fail && create_ss(cx, "st-nonexistent")) {
+		lwsl_err("%s: created unknown streamtype\n", __func__);
+		fail = 1;
+	}
+
+	/* add a metadata to one streamtype, everything must still work */
+
+	if (!fail && lws_ss_policy_overlay(cx, "{\"s\":[{\"st1\":"
+			"{\"metadata\":[{\"md6\":\"\"}]}}]}") < 0)
+		fail = 1;
+
+	if (!fail)
+		fail = check_streamtype(cx, "st1", MD_PER_STREAMTYPE + 1) ||
+		       check_streamtype(cx, "st2", MD_PER_STREAMTYPE);
+
+	lws_context_destroy(cx);
+	free(policy);
+
+	return fail;
+}
+
+static int
+bench(int streamtypes, int creates, double *us)
+{
+	struct lws_ss_handle *h;
+	struct lws_context *cx;
+	lws_usec_t t0, t = 0;
+	char *policy, st[16];
+	const void *v;
+	size_t len;
+	int n, fail = 0;
+
+	policy = make_policy(streamtypes);
+	if (!policy)
+		return 1;
+
+	cx = make_context(policy);
+	if (!cx) {
+		free(policy);
+		return 1;
+	}
+
+	for (n = 0; n < creates && !fail; n++) {
+		lws_snprintf(st, sizeof(st), "st%d",
+			     (int)(((unsigned int)n * 7919u) %
+					     (unsigned int)streamtypes));
+		t0 = lws_now_usecs();
+		h = create_ss(cx, st);
+		if (!h || lws_ss_set_metadata(h, "md5", "x", 1) ||
+		    lws_ss_get_metadata(h, "md5", &v, &len))
+			fail = 1;
+		lws_ss_destroy(&h);
+		t += lws_now_usecs() - t0;
+	}
+
+	*us = (double)t / creates;
+
+	lws_context_destroy(cx);
+	free(policy);
+
+	return fail;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, creates = 20000, n;
+	double us_small, us_large;
+	const char *p;
+	int fail;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		creates = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: ss policy lookup\n");
+
+	fail = check(8) || check(500);
+
+	if (!fail && creates > 0) {
+		n = bench(8, creates, &us_small) ||
+		    bench(1000, creates, &us_large);
+		if (n)
+			fail = 1;
+		else
+			lwsl_user("%s: create + destroy: 8 streamtypes %.2fus, "
+				  "1000 streamtypes %.2fus\n", __func__,
+				  us_small, us_large);
+	}
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,381 @@
+/*
+ * lws-api-test-threadpool
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test runs thousands of short tasks through a threadpool, keeping
+ * its queues full from the service thread and reaping them as they finish,
+ * and checks each ran to completion exactly once, on more than one worker.
+ *
+ * It then dequeues a mix of queued and running tasks, and finishes the pool
+ * with more of both in it, and checks every task is cleaned up exactly once.
+ *
+ * The tasks are all bound to one wsi, a raw file wsi on a pipe that nothing
+ * is ever written to.
+ */
+
+#include <libwebsockets.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WORKERS			4
+#define DEPTH			64
+#define INFLIGHT		(DEPTH + WORKERS)
+#define STOPPERS		32
+
+struct job {
+	struct lws_threadpool_task	*task;
+	pthread_t			thread;
+	int				iterations; /* -1 = until stopped */
+	int				ran;
+	int				cleaned;
+};
+
+static pthread_mutex_t		lock = PTHREAD_MUTEX_INITIALIZER;
+static struct job		*jobs;
+static struct lws_context	*cx;
+static struct lws		*wsi_bound;
+static int			count = 4000, cleanups, fail;
+
+static enum lws_threadpool_task_return
+task_function(void *user, enum lws_threadpool_task_status s)
+{
+	struct job *j = (struct job *)user;
+
+	if (s == LWS_TP_STATUS_STOPPING)
+		return LWS_TP_RETURN_STOPPED;
+
+	if (!j->ran++)
+		j->thread = pthread_self();
+
+	if (j->iterations < 0) {
+		usleep(1000);
+		return LWS_TP_RETURN_CHECKING_IN;
+	}
+
+	if (j->ran < j->iterations)
+		return LWS_TP_RETURN_CHECKING_IN;
+
+	return LWS_TP_RETURN_FINISHED;
+}
+
+static void
+cleanup_job(struct lws *wsi, void *user)
+{
+	struct job *j = (struct job *)user;
+
+	pthread_mutex_lock(&lock);
+	j->cleaned++;
+	cleanups++;
+	pthread_mutex_unlock(&lock);
+}
+
+static struct lws_threadpool_task *
+enqueue(struct lws_threadpool *tp, int n)
+{
+	struct lws_threadpool_task_args args;
+
+	memset(&args, 0, sizeof(args));
+	args.wsi = wsi_bound;
+	args.user = &jobs[n];
+	args.task = task_function;
+	args.cleanup = cleanup_job;
+
+	jobs[n].task = lws_threadpool_enqueue(tp, &args, "job %d", n);
+
+	return jobs[n].task;
+}
+
+/* reap whatever has finished, returns how many did */
+
+static int
+reap(int *inflight, int *count_inflight, enum lws_threadpool_task_status want)
+{
+	enum lws_threadpool_task_status s;
+	int n = 0, reaped = 0;
+	void *user;
+
+	while (n < *count_inflight) {
+		struct job *j = &jobs[inflight[n]];
+
+		s = lws_threadpool_task_status(j->task, &user);
+		if (s != LWS_TP_STATUS_FINISHED && s != LWS_TP_STATUS_STOPPED) {
+			n++;
+			continue;
+		}
+
+		if (s != want) {
+			lwsl_err("%s: job %d ended %d\n", __func__,
+				 inflight[n], s);
+			fail = 1;
+		}
+
+		j->task = NULL;
+		inflight[n] = inflight[--(*count_inflight)];
+		reaped++;
+	}
+
+	return reaped;
+}
+
+static int
+test_run(struct lws_threadpool *tp)
+{
+	int inflight[INFLIGHT], count_inflight = 0, next = 0, done = 0, n, m,
+	    threads = 0;
+	pthread_t seen[WORKERS];
+	lws_usec_t t0;
+
+	t0 = lws_now_usecs();
+
+	while (done < count && !fail) {
+		while (next < count && count_inflight < INFLIGHT) {
+			jobs[next].iterations = 1 + (next % 8);
+			if (!enqueue(tp, next))
+				break; /* queues are full for now */
+			inflight[count_inflight++] = next++;
+		}
+
+		if (lws_service(cx, 0) < 0)
+			return 1;
+
+		done += reap(inflight, &count_inflight, LWS_TP_STATUS_FINISHED);
+	}
+
+	if (fail)
+		return 1;
+
+	lwsl_user("%s: %d tasks on %d workers in %dms (%dus / task)\n",
+		  __func__, count, WORKERS,
+		  (int)((lws_now_usecs() - t0) / 1000),
+		  (int)((lws_now_usecs() - t0) / count));
+
+	for (n = 0; n < count; n++) {
+		if (jobs[n].ran != jobs[n].iterations || jobs[n].cleaned != 1) {
+			lwsl_err("%s: job %d ran %d / %d, cleaned %d\n",
+				 __func__, n, jobs[n].ran, jobs[n].iterations,
+				 jobs[n].cleaned);
+			return 1;
+		}
+
+		for (m = 0; m < threads; m++)
+			if (pthread_equal(seen[m], jobs[n].thread))
+				break;
+		if (m == threads && threads < WORKERS)
+			seen[threads++] = jobs[n].thread;
+	}
+
+	if (threads < 2) {
+		lwsl_err("%s: tasks only ran on %d worker\n", __func__, threads);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* returns how many of jobs base .. base + STOPPERS - 1 have started running */
+
+static int
+started(int base)
+{
+	int n, r = 0;
+
+	for (n = base; n < base + STOPPERS; n++)
+		if (jobs[n].ran)
+			r++;
+
+	return r;
+}
+
+static int
+wait_started(int base)
+{
+	int n;
+
+	for (n = 0; n < 2000 && started(base) < WORKERS; n++)
+		usleep(1000);
+
+	return started(base) < WORKERS;
+}
+
+static int
+test_dequeue(struct lws_threadpool *tp, int base)
+{
+	int n;
+
+	for (n = base; n < base + STOPPERS; n++) {
+		jobs[n].iterations = -1;
+		if (!enqueue(tp, n)) {
+			lwsl_err("%s: enqueue failed\n", __func__);
+			return 1;
+		}
+	}
+
+	if (wait_started(base))
+		return 1;
+
+	/*
+	 * queued tasks are cleaned up immediately, running ones are told to
+	 * stop and decoupled from the wsi, then clean up on the worker
+	 */
+
+	for (n = base; n < base + STOPPERS; n++)
+		lws_threadpool_dequeue_task(jobs[n].task);
+
+	for (n = 0; n < 2000 && cleanups < base + STOPPERS; n++)
+		usleep(1000);
+
+	return cleanups != base + STOPPERS;
+}
+
+static int
+test_finish(struct lws_threadpool *tp, int base)
+{
+	int inflight[STOPPERS], count_inflight = 0, n;
+
+	for (n = base; n < base + STOPPERS; n++) {
+		jobs[n].iterations = -1;
+		if (!enqueue(tp, n)) {
+			lwsl_err("%s: enqueue failed\n", __func__);
+			return 1;
+		}
+		inflight[count_inflight++] = n;
+	}
+
+	if (wait_started(base))
+		return 1;
+
+	/* everything ends up STOPPED, whether it was queued or running */
+
+	lws_threadpool_finish(tp);
+
+	while (count_inflight && !fail) {
+		if (lws_service(cx, 0) < 0)
+			return 1;
+		reap(inflight, &count_inflight, LWS_TP_STATUS_STOPPED);
+	}
+
+	return fail;
+}
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out\n", __func__);
+	fail = 1;
+}
+
+static int
+callback_raw(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	     void *in, size_t len)
+{
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "raw", callback_raw, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, fds[2], n;
+	struct lws_threadpool_create_args cargs;
+	struct lws_context_creation_info info;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws_threadpool *tp;
+	lws_sock_file_fd_type u;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		count = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: threadpool\n");
+
+	jobs = calloc((size_t)(count + 2 * STOPPERS), sizeof(*jobs));
+	if (!jobs || pipe(fds)) {
+		lwsl_err("%s: OOM or pipe\n", __func__);
+		return 1;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER;
+	info.protocols = protocols;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	u.filefd = (lws_filefd_type)(long long)fds[0];
+	wsi_bound = lws_adopt_descriptor_vhost(lws_get_vhost_by_name(cx,
+					"default"), LWS_ADOPT_RAW_FILE_DESC, u,
+					"raw", NULL);
+	if (!wsi_bound) {
+		lwsl_err("%s: adopt failed\n", __func__);
+		goto bail;
+	}
+
+	memset(&cargs, 0, sizeof(cargs));
+	cargs.threads = WORKERS;
+	cargs.max_queue_depth = DEPTH;
+	cargs.pin_cpus = !!lws_cmdline_option(argc, argv, "-p");
+
+	tp = lws_threadpool_create(cx, &cargs, "tptest");
+	if (!tp) {
+		lwsl_err("%s: threadpool creation failed\n", __func__);
+		goto bail;
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 30 * LWS_US_PER_SEC);
+
+	if (test_run(tp)) {
+		lwsl_err("%s: run\n", __func__);
+		fail = 1;
+	}
+
+	if (!fail && test_dequeue(tp, count)) {
+		lwsl_err("%s: dequeue, %d cleanups\n", __func__, cleanups);
+		fail = 1;
+	}
+
+	if (!fail && test_finish(tp, count + STOPPERS)) {
+		lwsl_err("%s: finish, %d cleanups\n", __func__, cleanups);
+		fail = 1;
+	}
+
+	lws_sul_cancel(&sul_timeout);
+	lws_threadpool_destroy(tp);
+
+	if (!fail)
+		for (n = 0; n < count + 2 * STOPPERS; n++)
+			if (jobs[n].cleaned != 1) {
+				lwsl_err("%s: job %d cleaned %d\n", __func__,
+					 n, jobs[n].cleaned);
+				fail = 1;
+			}
+
+bail:
+	lws_context_destroy(cx);
+	close(fds[1]);
+	free(jobs);
+
+	if (!wsi_bound)
+		fail = 1;
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
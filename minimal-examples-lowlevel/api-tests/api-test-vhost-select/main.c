@@ -0,0 +1,336 @@
+/*
+ * lws-api-test-vhost-select
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test creates several vhosts sharing one listen port, and makes an
+ * http/1 request to it for each of a list of Host: headers.  The server notes
+ * which vhost each request was bound to, and we check it's the one expected
+ * by the selection priorities:
+ *
+ *  1) a vhost whose whole name matches the host
+ *  2) a vhost whose name matches the host after a '.', ie, *.name
+ *  3) the first vhost on the port
+ *
+ * A vhost whose name only starts with the host, like "example.community" for
+ * "example.com", is not an exact match.
+ *
+ * Then it adds more and more vhosts on the port, and times requests over
+ * socketpairs for exact and wildcard matches of the last vhost created, which
+ * is the worst case for a walk of the vhost list.  Other things done for each
+ * connection also take longer with more vhosts, so it times the same requests
+ * without a Host: header too.  The difference, the cost of selecting the vhost,
+ * should stay about the same however many vhosts there are.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#define PORT			7623
+#define BENCH_REQS		500
+
+static const char * const vhosts[] = {
+	"default", "example.community", "example.com", "other.org"
+};
+
+static const struct {
+	const char	*host;
+	const char	*vhost;
+} reqs[] = {
+	{ "example.com",		"example.com" },
+	{ "example.com:7623",		"example.com" },
+	{ "example.community",		"example.community" },
+	{ "www.example.com",		"example.com" },
+	{ "a.b.example.com",		"example.com" },
+	{ "www.other.org",		"other.org" },
+	{ "example.co",			"default" },
+	{ "ample.com",			"default" },
+	{ "nowhere.net",		"default" },
+};
+
+#define REQS LWS_ARRAY_SIZE(reqs)
+
+static const int bench_vhosts[] = { 16, 64, 256, 1024, 4096 };
+
+static const char		*bound[REQS], *bench_bound;
+static int			completed, fail;
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	int idx;
+
+	switch (reason) {
+
+	/* server side */
+
+	case LWS_CALLBACK_HTTP:
+		if (!strcmp((const char *)in, "/bench")) {
+			bench_bound = lws_get_vhost_name(lws_get_vhost(wsi));
+			goto reply;
+		}
+
+		/* the path is the index of the request */
+		idx = atoi((const char *)in + 1);
+		if (idx < 0 || idx >= (int)REQS)
+			return 1;
+
+		bound[idx] = lws_get_vhost_name(lws_get_vhost(wsi));
+
+reply:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+						"text/plain", 0, &p, end) ||
+		    lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	/* client side */
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char rbuf[LWS_PRE + 256], *px = rbuf + LWS_PRE;
+			int lenx = sizeof(rbuf) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		completed++;
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: connection error %s\n", __func__,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+/*
+ * Make a request with the given Host:, or none if NULL, over a new socketpair
+ * adopted by the vhost that has the listen socket, and wait for the server to
+ * close
+ */
+
+static int
+bench_request(struct lws_context *cx, struct lws_vhost *vh, const char *host)
+{
+	char req[256], buf[256];
+	int sv[2], n, len;
+	ssize_t r;
+
+	bench_bound = NULL;
+	len = lws_snprintf(req, sizeof(req), "GET /bench HTTP/1.1\r\n"
+			   "%s%s%sConnection: close\r\n\r\n",
+			   host ? "Host: " : "", host ? host : "",
+			   host ? "\r\n" : "");
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		return 1;
+	fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+
+	if (send(sv[1], req, (size_t)len, MSG_NOSIGNAL) != len ||
+	    !lws_adopt_socket_vhost(vh, sv[0])) {
+		close(sv[0]);
+		close(sv[1]);
+		return 1;
+	}
+
+	for (n = 0; n < 1000; n++) {
+		if (lws_service(cx, -1) < 0)
+			break;
+
+		r = recv(sv[1], buf, sizeof(buf), 0);
+		if (!r || (r < 0 && errno != EAGAIN))
+			break;
+	}
+
+	close(sv[1]);
+
+	return !bench_bound;
+}
+
+static int
+bench(struct lws_context *cx, struct lws_context_creation_info *info)
+{
+	struct lws_vhost *vh = lws_get_vhost_by_name(cx, vhosts[0]);
+	char name[32], host[40];
+	lws_usec_t us, us_nohost;
+	int count = 0, s, n;
+
+	for (s = 0; s < (int)LWS_ARRAY_SIZE(bench_vhosts); s++) {
+		while (count < bench_vhosts[s]) {
+			lws_snprintf(name, sizeof(name), "bench%d.example.net",
+				     count++);
+			info->vhost_name = name;
+			if (!lws_create_vhost(cx, info)) {
+				lwsl_err("%s: vhost creation failed\n",
+					 __func__);
+				return 1;
+			}
+		}
+
+		us_nohost = lws_now_usecs();
+
+		for (n = 0; n < BENCH_REQS; n++)
+			if (bench_request(cx, vh, NULL) ||
+			    strcmp(bench_bound, vhosts[0])) {
+				lwsl_err("%s: no Host: went to %s\n", __func__,
+					 bench_bound ? bench_bound : "none");
+				return 1;
+			}
+
+		us = lws_now_usecs();
+		us_nohost = us - us_nohost;
+
+		for (n = 0; n < BENCH_REQS; n++) {
+			/* alternate exact and wildcard matches */
+			lws_snprintf(host, sizeof(host), "%s%s",
+				     n & 1 ? "www." : "", name);
+
+			if (bench_request(cx, vh, host) ||
+			    strcmp(bench_bound, name)) {
+				lwsl_err("%s: Host: %s went to %s\n", __func__,
+					 host, bench_bound ? bench_bound :
+							     "none");
+				return 1;
+			}
+		}
+
+		us = lws_now_usecs() - us;
+
+		lwsl_user("%s: %5d vhosts: %dus per request, %dus without "
+			  "Host:, selection %dus\n", __func__,
+			  count + (int)LWS_ARRAY_SIZE(vhosts),
+			  (int)(us / BENCH_REQS),
+			  (int)(us_nohost / BENCH_REQS),
+			  (int)((us - us_nohost) / BENCH_REQS));
+	}
+
+	return 0;
+}
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: %d of %d requests completed\n", __func__, completed,
+		 (int)REQS);
+	fail = 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws_context *cx;
+	char path[REQS][8];
+	const char *p;
+	size_t n;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: vhost selection\n");
+
+	memset(&info, 0, sizeof(info));
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	/* they all share the one listen socket */
+
+	info.port = PORT;
+	info.protocols = protocols;
+
+	for (n = 0; n < LWS_ARRAY_SIZE(vhosts); n++) {
+		info.vhost_name = vhosts[n];
+		if (!lws_create_vhost(cx, &info)) {
+			lwsl_err("%s: vhost creation failed\n", __func__);
+			goto bail;
+		}
+	}
+
+	for (n = 0; n < REQS; n++) {
+		memset(&i, 0, sizeof(i));
+		lws_snprintf(path[n], sizeof(path[n]), "/%d", (int)n);
+		i.context = cx;
+		i.address = "127.0.0.1";
+		i.port = PORT;
+		i.path = path[n];
+		i.host = reqs[n].host;
+		i.origin = i.address;
+		i.method = "GET";
+		i.protocol = protocols[0].name;
+
+		if (!lws_client_connect_via_info(&i)) {
+			lwsl_err("%s: connect %d failed\n", __func__, (int)n);
+			fail = 1;
+			break;
+		}
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 5 * LWS_US_PER_SEC);
+
+	while (!fail && completed != (int)REQS)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+
+	for (n = 0; !fail && n < REQS; n++)
+		if (!bound[n] || strcmp(bound[n], reqs[n].vhost)) {
+			lwsl_err("%s: Host: %s went to %s, expected %s\n",
+				 __func__, reqs[n].host,
+				 bound[n] ? bound[n] : "none", reqs[n].vhost);
+			fail = 1;
+		}
+
+	if (!fail && bench(cx, &info))
+		fail = 1;
+
+	goto done;
+
+bail:
+	fail = 1;
+done:
+	lws_context_destroy(cx);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
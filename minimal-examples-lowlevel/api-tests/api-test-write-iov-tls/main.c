@@ -0,0 +1,279 @@
+/*
+ * lws-api-test-write-iov-tls
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test connects a raw tls client to a raw tls server in the same
+ * context, and the client sends a stream to the server as many small sets of
+ * header, body and trailer buffers with lws_write_iov(), with an occasional
+ * single large buffer.  The client's socket has a small SO_SNDBUF and it keeps
+ * writing without waiting for POLLOUT, so the tls library often can't write the
+ * whole record it made from the gathered buffers, and must be given exactly the
+ * same write again later.
+ *
+ * The server confirms it got every byte in order, and we confirm every set's
+ * release callback came exactly once.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define TOTAL			(4 * 1024 * 1024)
+#define PORT			7622
+
+static uint8_t			*stream;
+static size_t			ofs, rx;
+static lws_usec_t		t_start, t_end;
+static int			sets, released, completed, fail;
+
+static uint8_t
+pattern(size_t o)
+{
+	return (uint8_t)((o * 7) + (o >> 11));
+}
+
+static void
+release_cb(void *opaque)
+{
+	released++;
+}
+
+static size_t
+piece(struct lws_write_iov *iov, size_t len)
+{
+	if (len > TOTAL - ofs)
+		len = TOTAL - ofs;
+
+	iov->buf = stream + ofs;
+	iov->len = len;
+	ofs += len;
+
+	return len;
+}
+
+/* the next set, some bigger than the tls gather, some smaller */
+
+static int
+write_set(struct lws *wsi)
+{
+	struct lws_write_iov iov[3];
+	size_t t = 0;
+	int n = 0;
+
+	if ((sets & 7) == 7)
+		t += piece(&iov[n++], 20000 + (size_t)(sets % 100));
+	else {
+		t += piece(&iov[n++], 40 + (size_t)(sets % 23));
+		t += piece(&iov[n++], 1000 + (size_t)((sets * 997) % 9000));
+		t += piece(&iov[n++], 24);
+	}
+
+	sets++;
+
+	return lws_write_iov(wsi, iov, n, release_cb, NULL) != (int)t;
+}
+
+static int
+callback_raw(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	     void *in, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)in;
+	int sndbuf = 4096;
+	size_t n;
+
+	switch (reason) {
+
+	/* client side sends */
+
+	case LWS_CALLBACK_RAW_CONNECTED:
+		if (setsockopt(lws_get_socket_fd(wsi), SOL_SOCKET, SO_SNDBUF,
+			       (const char *)&sndbuf, sizeof(sndbuf)))
+			lwsl_warn("%s: unable to set SO_SNDBUF\n", __func__);
+		t_start = lws_now_usecs();
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		/*
+		 * A set that went out completely was released already, keep on
+		 * until one didn't.  We don't wait to see POLLOUT, so the
+		 * socket fills and the tls library has a record it couldn't
+		 * finish writing.
+		 */
+		while (ofs < TOTAL && released == sets)
+			if (write_set(wsi)) {
+				lwsl_err("%s: lws_write_iov failed\n",
+					 __func__);
+				fail = 1;
+				return -1;
+			}
+
+		if (ofs < TOTAL)
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: connection error %s\n", __func__,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	/* server side checks */
+
+	case LWS_CALLBACK_RAW_RX:
+		for (n = 0; n < len; n++)
+			if (p[n] != pattern(rx + n)) {
+				lwsl_err("%s: mismatch at %llu\n", __func__,
+					 (unsigned long long)(rx + n));
+				fail = 1;
+				return -1;
+			}
+		rx += len;
+		if (rx == TOTAL) {
+			t_end = lws_now_usecs();
+			completed = 1;
+		}
+		break;
+
+	case LWS_CALLBACK_RAW_CLOSE:
+		if (!completed) {
+			lwsl_err("%s: closed early, rx %llu\n", __func__,
+				 (unsigned long long)rx);
+			fail = 1;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "raw", callback_raw, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out, rx %llu\n", __func__, (unsigned long long)rx);
+	fail = 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws_vhost *vh_cli;
+	struct lws_context *cx;
+	const char *p;
+	size_t n;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_write_iov over tls\n");
+
+	stream = malloc(TOTAL);
+	if (!stream)
+		goto bail1;
+	for (n = 0; n < TOTAL; n++)
+		stream[n] = pattern(n);
+
+	memset(&info, 0, sizeof(info));
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS |
+		       LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		goto bail1;
+	}
+
+	info.port = PORT;
+	info.protocols = protocols;
+	info.vhost_name = "server";
+	info.options = LWS_SERVER_OPTION_ONLY_RAW |
+		       LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.ssl_cert_filepath = "localhost-100y.cert";
+	info.ssl_private_key_filepath = "localhost-100y.key";
+
+	if (!lws_create_vhost(cx, &info)) {
+		lwsl_err("server vhost creation failed\n");
+		goto bail2;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols;
+	info.vhost_name = "client";
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+
+	vh_cli = lws_create_vhost(cx, &info);
+	if (!vh_cli) {
+		lwsl_err("client vhost creation failed\n");
+		goto bail2;
+	}
+
+	memset(&i, 0, sizeof(i));
+	i.context = cx;
+	i.vhost = vh_cli;
+	i.method = "RAW";
+	i.address = "localhost";
+	i.host = i.address;
+	i.port = PORT;
+	i.local_protocol_name = protocols[0].name;
+	i.ssl_connection = LCCSCF_USE_SSL | LCCSCF_ALLOW_SELFSIGNED;
+
+	if (!lws_client_connect_via_info(&i)) {
+		lwsl_err("%s: connect failed\n", __func__);
+		goto bail2;
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 20 * LWS_US_PER_SEC);
+
+	while (!fail && !completed)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+	lws_context_destroy(cx);
+
+	if (!fail && released != sets) {
+		lwsl_err("%s: %d sets, %d released\n", __func__, sets,
+			 released);
+		fail = 1;
+	}
+
+	if (!fail)
+		lwsl_user("%s: %lluKiB in %d sets, %dms (%.1fMiB/s)\n", __func__,
+			  (unsigned long long)(TOTAL / 1024), sets,
+			  (int)((t_end - t_start) / 1000),
+			  ((double)TOTAL / (1024 * 1024)) /
+			  ((double)(t_end - t_start + 1) / LWS_US_PER_SEC));
+
+	goto bail1;
+
+bail2:
+	lws_context_destroy(cx);
+	fail = 1;
+bail1:
+	if (!stream)
+		fail = 1;
+	free(stream);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
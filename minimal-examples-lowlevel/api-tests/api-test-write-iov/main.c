@@ -0,0 +1,256 @@
+/*
+ * lws-api-test-write-iov
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test adopts both ends of a socketpair as raw connections, and
+ * sends two sets of separately-allocated header, body and trailer buffers
+ * from one end with lws_write_iov(), back to back.  The bodies are much
+ * bigger than the socket buffer, so most of the first set and all of the
+ * second is left referenced on the writer's buflist.
+ *
+ * The reader confirms it got every byte in order, and we confirm each set's
+ * release callback came exactly once, and in order.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BODY_A			(4 * 1024 * 1024)
+#define BODY_B			(1024 * 1024)
+
+struct piece {
+	uint8_t			*buf;
+	size_t			len;
+};
+
+static struct piece		pieces[] = {
+	{ NULL, 40 }, { NULL, BODY_A }, { NULL, 24 },	/* set A */
+	{ NULL, 40 }, { NULL, BODY_B },			/* set B */
+};
+
+static lws_sockfd_type		sv[2];
+static size_t			total, rx;
+static lws_usec_t		t_start, t_end;
+static int			released[2], sent, completed, fail;
+
+static uint8_t
+pattern(size_t ofs)
+{
+	return (uint8_t)((ofs * 7) + (ofs >> 11));
+}
+
+static void
+release_cb(void *opaque)
+{
+	int *r = (int *)opaque;
+
+	if (r == &released[1] && !released[0]) {
+		lwsl_err("%s: set B released before set A\n", __func__);
+		fail = 1;
+	}
+
+	(*r)++;
+}
+
+static int
+write_set(struct lws *wsi, int first, int count, int *rel)
+{
+	struct lws_write_iov iov[3];
+	size_t t = 0;
+	int n;
+
+	for (n = 0; n < count; n++) {
+		iov[n].buf = pieces[first + n].buf;
+		iov[n].len = pieces[first + n].len;
+		t += iov[n].len;
+	}
+
+	return lws_write_iov(wsi, iov, count, release_cb, rel) != (int)t;
+}
+
+static int
+callback_raw(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	     void *in, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)in;
+	size_t n;
+
+	switch (reason) {
+	case LWS_CALLBACK_RAW_ADOPT:
+		if (lws_get_socket_fd(wsi) == sv[0])
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		if (sent)
+			break;
+		sent = 1;
+		t_start = lws_now_usecs();
+
+		/* the second set goes behind whatever is left of the first */
+
+		if (write_set(wsi, 0, 3, &released[0]) ||
+		    write_set(wsi, 3, 2, &released[1])) {
+			lwsl_err("%s: lws_write_iov failed\n", __func__);
+			fail = 1;
+			return -1;
+		}
+		break;
+
+	case LWS_CALLBACK_RAW_RX:
+		for (n = 0; n < len; n++)
+			if (p[n] != pattern(rx + n)) {
+				lwsl_err("%s: mismatch at %llu\n", __func__,
+					 (unsigned long long)(rx + n));
+				fail = 1;
+				return -1;
+			}
+		rx += len;
+		if (rx == total) {
+			t_end = lws_now_usecs();
+			completed = 1;
+		}
+		break;
+
+	case LWS_CALLBACK_RAW_CLOSE:
+		if (!completed)
+			fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "raw", callback_raw, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out, rx %llu\n", __func__, (unsigned long long)rx);
+	fail = 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	lws_sorted_usec_list_t sul_timeout;
+	struct lws_context *cx;
+	struct lws_vhost *vh;
+	lws_sock_file_fd_type fd;
+	size_t ofs = 0, m;
+	const char *p;
+	unsigned int n;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_write_iov\n");
+
+	/* each piece is its own allocation, holding its part of the stream */
+
+	for (n = 0; n < LWS_ARRAY_SIZE(pieces); n++) {
+		pieces[n].buf = malloc(pieces[n].len);
+		if (!pieces[n].buf)
+			goto bail1;
+		for (m = 0; m < pieces[n].len; m++)
+			pieces[n].buf[m] = pattern(ofs + m);
+		ofs += pieces[n].len;
+	}
+	total = ofs;
+
+	memset(&info, 0, sizeof(info));
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		goto bail1;
+	}
+
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER;
+	info.protocols = protocols;
+
+	vh = lws_create_vhost(cx, &info);
+	if (!vh) {
+		lwsl_err("lws vhost creation failed\n");
+		goto bail2;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		lwsl_err("%s: socketpair failed\n", __func__);
+		goto bail2;
+	}
+
+	for (n = 0; n < 2; n++) {
+		fd.sockfd = sv[n];
+		if (!lws_adopt_descriptor_vhost(vh, LWS_ADOPT_SOCKET, fd,
+						protocols[0].name, NULL)) {
+			lwsl_err("%s: adoption failed\n", __func__);
+			if (!n) /* the failed one was closed already */
+				close(sv[1]);
+			goto bail2;
+		}
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 10 * LWS_US_PER_SEC);
+
+	while (!fail && !completed)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+
+	if (!fail && (released[0] != 1 || released[1] != 1)) {
+		lwsl_err("%s: released %d %d after completion\n", __func__,
+			 released[0], released[1]);
+		fail = 1;
+	}
+
+	lws_context_destroy(cx);
+
+	/* closing the connections mustn't release anything again */
+
+	if (!fail && (released[0] != 1 || released[1] != 1)) {
+		lwsl_err("%s: released %d %d after close\n", __func__,
+			 released[0], released[1]);
+		fail = 1;
+	}
+
+	if (!fail)
+		lwsl_user("%s: %lluKiB in %dms (%.1fMiB/s)\n", __func__,
+			  (unsigned long long)(total / 1024),
+			  (int)((t_end - t_start) / 1000),
+			  ((double)total / (1024 * 1024)) /
+			  ((double)(t_end - t_start + 1) / LWS_US_PER_SEC));
+
+	goto bail1;
+
+bail2:
+	lws_context_destroy(cx);
+	fail = 1;
+bail1:
+	if (!total)
+		fail = 1;
+	for (n = 0; n < LWS_ARRAY_SIZE(pieces); n++)
+		free(pieces[n].buf);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -0,0 +1,379 @@
+/*
+ * lws-api-test-ws-bcast
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test has a ws server in the same context as its ws clients, and
+ * the server sends every client the same series of messages, made into
+ * lws_ws_bcast_t once each.  The clients check every message arrives intact.
+ *
+ * The message lengths cover each kind of ws length header.  The server
+ * connections have a small socket send buffer, so the kernel can't take the
+ * bigger messages at once and the remainder is sent from the shared frame
+ * later.  The server drops its own reference on each message once it was sent
+ * to every client, and the test checks each one was freed by the time the
+ * clients have all of them.
+ *
+ * It's run without extensions, then, if lws has them, with permessage-deflate
+ * and no_context_takeover, and with clients that keep their contexts, where
+ * some messages are sent by lws_write() between the broadcast ones.
+ *
+ * The server time spent sending is reported for broadcast and for each
+ * connection sending its own copy with lws_write().
+ */
+
+#include <libwebsockets.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PORT			7621
+#define MSGS			64
+#define SPECIAL			6
+
+enum {
+	COPY,		/* each connection lws_write()s its own copy */
+	BCAST,		/* every message is broadcast */
+	MIX,		/* every fourth message is lws_write()n instead */
+};
+
+struct pss {
+	int			msg;
+	size_t			ofs;
+};
+
+static struct lws_context	*cx;
+static lws_ws_bcast_t		*bc[MSGS];
+static void			*live[MSGS];
+static uint8_t			*payload[MSGS], *copybuf;
+static size_t			size[MSGS], max;
+static lws_usec_t		us_send;
+static int			conns = 8, done, established, fail, mode,
+				wrote[MSGS];
+
+static const size_t special[SPECIAL] = { 1, 125, 126, 65535, 65536, 300000 };
+
+/* track the lws_ws_bcast_t allocations, so we can tell they were freed */
+
+static void *
+tracking_realloc(void *ptr, size_t size, const char *reason)
+{
+	void *p;
+	int n;
+
+	if (!size) {
+		for (n = 0; n < MSGS; n++)
+			if (ptr && live[n] == ptr)
+				live[n] = NULL;
+		free(ptr);
+		return NULL;
+	}
+
+	p = realloc(ptr, size);
+
+	if (p && !ptr && !strcmp(reason, "lws_ws_bcast_create"))
+		for (n = 0; n < MSGS; n++)
+			if (!live[n]) {
+				live[n] = p;
+				break;
+			}
+
+	return p;
+}
+
+static int
+live_count(void)
+{
+	int n, m = 0;
+
+	for (n = 0; n < MSGS; n++)
+		m += !!live[n];
+
+	return m;
+}
+
+/* messages that compress well, but differ from each other */
+
+static void
+fill(void)
+{
+	size_t n;
+	int m;
+
+	for (m = 0; m < MSGS; m++) {
+		size[m] = m < SPECIAL ? special[m] :
+				1 + (size_t)((m * 7919) % 20000);
+		if (size[m] > max)
+			max = size[m];
+
+		payload[m] = malloc(size[m] + 64);
+		if (!payload[m]) {
+			fail = 1;
+			return;
+		}
+
+		n = 0;
+		while (n < size[m])
+			n += (size_t)lws_snprintf((char *)payload[m] + n,
+					size[m] - n + 1,
+					"{\"msg\":%d,\"ofs\":%d}", m, (int)n);
+	}
+}
+
+static int
+callback_bcast_test(struct lws *wsi, enum lws_callback_reasons reason,
+		    void *user, void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	lws_usec_t us;
+	int n = 4096;
+
+	switch (reason) {
+
+	/* server side */
+
+	case LWS_CALLBACK_ESTABLISHED:
+		if (setsockopt(lws_get_socket_fd(wsi), SOL_SOCKET, SO_SNDBUF,
+			       &n, sizeof(n)))
+			lwsl_warn("%s: unable to set SO_SNDBUF\n", __func__);
+		if (++established == conns)
+			lws_callback_on_writable_all_protocol(lws_get_context(wsi),
+							lws_get_protocol(wsi));
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (pss->msg == MSGS)
+			break;
+
+		us = lws_now_usecs();
+		if (mode == COPY || (mode == MIX && (pss->msg & 3) == 3)) {
+			memcpy(copybuf + LWS_PRE, payload[pss->msg],
+			       size[pss->msg]);
+			n = lws_write(wsi, copybuf + LWS_PRE, size[pss->msg],
+				      LWS_WRITE_TEXT);
+		} else
+			n = lws_ws_bcast_write(wsi, bc[pss->msg]);
+		us_send += lws_now_usecs() - us;
+
+		if (n < (int)size[pss->msg]) {
+			lwsl_err("%s: write failed\n", __func__);
+			fail = 1;
+			return -1;
+		}
+
+		/* the last connection to send it drops our reference */
+
+		if (++wrote[pss->msg] == conns) {
+			lws_ws_bcast_unref(bc[pss->msg]);
+			bc[pss->msg] = NULL;
+		}
+
+		if (++pss->msg < MSGS)
+			lws_callback_on_writable(wsi);
+		break;
+
+	/* client side */
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (pss->msg == MSGS || pss->ofs + len > size[pss->msg] ||
+		    memcmp(payload[pss->msg] + pss->ofs, in, len)) {
+			lwsl_err("%s: msg %d mismatch at %d\n", __func__,
+				 pss->msg, (int)pss->ofs);
+			fail = 1;
+			return -1;
+		}
+		pss->ofs += len;
+		if (!lws_is_final_fragment(wsi))
+			break;
+
+		if (pss->ofs != size[pss->msg]) {
+			lwsl_err("%s: msg %d short, %d\n", __func__,
+				 pss->msg, (int)pss->ofs);
+			fail = 1;
+			return -1;
+		}
+		pss->ofs = 0;
+
+		if (++pss->msg == MSGS) {
+			/* every message must have been freed by now */
+			if (++done == conns && live_count()) {
+				lwsl_err("%s: %d messages not freed\n",
+					 __func__, live_count());
+				fail = 1;
+			}
+			return -1;
+		}
+		break;
+
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: connection error %s\n", __func__,
+			 in ? (const char *)in : "");
+		fail = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "bcast-test", callback_bcast_test, sizeof(struct pss), 4096, 0,
+	  NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+static const struct lws_extension ext_nct[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate"
+		 "; client_no_context_takeover"
+		 "; server_no_context_takeover"
+		 "; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+}, ext_ct[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate"
+		 "; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL /* terminator */ }
+};
+#endif
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out, %d done\n", __func__, done);
+	fail = 1;
+}
+
+static int
+run(const struct lws_extension *exts, int _mode, const char *name)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	lws_sorted_usec_list_t sul_timeout;
+	int n;
+
+	mode = _mode;
+	done = established = 0;
+	us_send = 0;
+	memset(wrote, 0, sizeof(wrote));
+
+	memset(&info, 0, sizeof(info));
+	info.port = PORT;
+	info.protocols = protocols;
+	info.extensions = exts;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	for (n = 0; n < MSGS; n++) {
+		bc[n] = lws_ws_bcast_create(cx, payload[n], size[n],
+					    LWS_WRITE_TEXT);
+		if (!bc[n])
+			fail = 1;
+	}
+
+	for (n = 0; n < conns; n++) {
+		memset(&i, 0, sizeof(i));
+		i.context = cx;
+		i.address = "127.0.0.1";
+		i.port = PORT;
+		i.path = "/";
+		i.host = i.address;
+		i.origin = i.address;
+		i.protocol = "bcast-test";
+
+		if (!lws_client_connect_via_info(&i)) {
+			lwsl_err("%s: connect %d failed\n", __func__, n);
+			fail = 1;
+		}
+	}
+
+	memset(&sul_timeout, 0, sizeof(sul_timeout));
+	lws_sul_schedule(cx, 0, &sul_timeout, timeout_cb, 30 * LWS_US_PER_SEC);
+
+	while (!fail && done < conns)
+		if (lws_service(cx, 0) < 0)
+			break;
+
+	lws_sul_cancel(&sul_timeout);
+
+	for (n = 0; n < MSGS; n++)
+		if (bc[n]) {
+			lws_ws_bcast_unref(bc[n]);
+			bc[n] = NULL;
+		}
+
+	lws_context_destroy(cx);
+
+	if (fail || done != conns) {
+		lwsl_err("%s: %s failed\n", __func__, name);
+		return 1;
+	}
+
+	lwsl_user("%s: %-12s %-6s %dus sending\n", __func__, name,
+		  mode == COPY ? "copy" : (mode == BCAST ? "bcast" : "mixed"),
+		  (int)us_send);
+
+	return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, n;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-c")))
+		conns = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: ws broadcast\n");
+
+	lws_set_allocator(tracking_realloc);
+
+	fill();
+	copybuf = malloc(LWS_PRE + max);
+	if (!copybuf)
+		fail = 1;
+
+	if (!fail)
+		fail = run(NULL, COPY, "plain") ||
+		       run(NULL, BCAST, "plain");
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	if (!fail)
+		fail = run(ext_nct, COPY, "pmd") ||
+		       run(ext_nct, BCAST, "pmd") ||
+		       run(ext_ct, MIX, "pmd takeover");
+#endif
+
+	if (!fail && live_count()) {
+		lwsl_err("%s: %d messages leaked\n", __func__, live_count());
+		fail = 1;
+	}
+
+	free(copybuf);
+	for (n = 0; n < MSGS; n++)
+		free(payload[n]);
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
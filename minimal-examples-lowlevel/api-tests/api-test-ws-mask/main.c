@@ -0,0 +1,129 @@
+/*
+ * lws-api-test-ws-mask
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test confirms lws_ws_mask() gives the same result as a bytewise
+ * reference for every alignment, length and starting mask index, including
+ * masking a payload in pieces, and reports masking throughput compared to the
+ * bytewise reference.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+#define MAX_TEST_LEN		300
+#define BENCH_LEN		(4 * 1024 * 1024)
+
+static const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+static unsigned int
+ref_mask(uint8_t *buf, size_t len, const uint8_t *m, unsigned int idx)
+{
+	while (len--)
+		*buf++ ^= m[(idx++) & 3];
+
+	return idx & 3;
+}
+
+static int
+check(void)
+{
+	uint8_t a[MAX_TEST_LEN + 16], b[MAX_TEST_LEN + 16];
+	unsigned int ia, ib, idx;
+	size_t al, len, n, split;
+
+	for (n = 0; n < sizeof(a); n++)
+		a[n] = (uint8_t)(n * 7 + 3);
+
+	for (al = 0; al < 16; al++)
+		for (len = 0; len < MAX_TEST_LEN; len++)
+			for (idx = 0; idx < 4; idx++) {
+				memcpy(b, a, sizeof(b));
+				ia = ref_mask(a + al, len, mask, idx);
+				ib = lws_ws_mask(b + al, len, mask, idx);
+				if (ia != ib || memcmp(a, b, sizeof(a))) {
+					lwsl_err("%s: mismatch al %d len %d "
+						 "idx %d\n", __func__, (int)al,
+						 (int)len, idx);
+					return 1;
+				}
+
+				/* in two pieces, with a restored idx */
+
+				split = len / 3;
+				ib = lws_ws_mask(b + al, split, mask, idx);
+				ib = lws_ws_mask(b + al + split, len - split,
+						 mask, ib);
+				ia = ref_mask(a + al, len, mask, idx);
+				if (ia != ib || memcmp(a, b, sizeof(a))) {
+					lwsl_err("%s: split mismatch al %d "
+						 "len %d idx %d\n", __func__,
+						 (int)al, (int)len, idx);
+					return 1;
+				}
+			}
+
+	return 0;
+}
+
+static lws_usec_t
+bench(unsigned int (*f)(uint8_t *, size_t, const uint8_t *, unsigned int),
+      uint8_t *buf, int loops)
+{
+	unsigned int idx = 1;
+	lws_usec_t t0 = lws_now_usecs();
+	int n;
+
+	for (n = 0; n < loops; n++)
+		/* odd start, like payload after a ws header */
+		idx = f(buf + 3, BENCH_LEN - 3, mask, idx);
+
+	return lws_now_usecs() - t0 + 1;
+}
+
+int
+main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, loops = 64;
+	lws_usec_t t_ref, t_ws;
+	uint8_t *buf;
+	const char *p;
+	int fail;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		loops = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_ws_mask\n");
+
+	fail = check();
+
+	if (!fail && loops > 0) {
+		buf = malloc(BENCH_LEN);
+		if (!buf)
+			return 1;
+		memset(buf, 0x5a, BENCH_LEN);
+
+		t_ref = bench(ref_mask, buf, loops);
+		t_ws = bench(lws_ws_mask, buf, loops);
+
+		lwsl_user("%s: %d x %dMiB: bytewise %.2fGB/s, "
+			  "lws_ws_mask %.2fGB/s\n", __func__, loops,
+			  BENCH_LEN / (1024 * 1024),
+			  ((double)BENCH_LEN * loops) / ((double)t_ref * 1000),
+			  ((double)BENCH_LEN * loops) / ((double)t_ws * 1000));
+
+		free(buf);
+	}
+
+	lwsl_user("Completed: %s\n", fail ? "FAIL" : "PASS");
+
+	return !!fail;
+}
@@ -102,6 +102,13 @@ int main(int argc, const char **argv)
 	}
 #endif
 
+	/* keep connections on the thread whose listen socket accepted them */
+	if (lws_cmdline_option(argc, argv, "--per-thread"))
+		info.options |= LWS_SERVER_OPTION_LISTEN_PER_THREAD;
+	if (lws_cmdline_option(argc, argv, "--cpu-steer"))
+		info.options |= LWS_SERVER_OPTION_LISTEN_PER_THREAD |
+				LWS_SERVER_OPTION_LISTEN_CPU_STEERING;
+
 	context = lws_create_context(&info);
 	if (!context) {
 		lwsl_err("lws init failed\n");
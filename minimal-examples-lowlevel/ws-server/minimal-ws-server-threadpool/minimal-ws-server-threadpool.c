@@ -21,6 +21,9 @@
 #include <libwebsockets.h>
 #include <string.h>
 #include <signal.h>
+#if !defined(WIN32)
+#include <unistd.h>
+#endif
 #if defined(WIN32)
 #define HAVE_STRUCT_TIMESPEC
 #if defined(pid_t)
@@ -76,10 +79,127 @@ void sigint_handler(int sig)
 	interrupted = 1;
 }
 
+#if !defined(WIN32)
+/*
+ * --bench: instead of serving, push lots of tiny tasks through threadpools
+ * of 1, 2, 4 ... -t workers, queueing them and reaping them on the service
+ * thread, to see what the pool itself costs per task as more workers contend
+ * for it.  The tasks are bound to a raw file wsi on a pipe.
+ */
+
+#define BENCH_DEPTH 256
+
+static enum lws_threadpool_task_return
+bench_task(void *user, enum lws_threadpool_task_status s)
+{
+	return LWS_TP_RETURN_FINISHED;
+}
+
+static int
+bench_run(struct lws_context *context, struct lws *wsi, int threads,
+	  int pin, int count)
+{
+	struct lws_threadpool_task *inflight[BENCH_DEPTH + 64];
+	int count_inflight = 0, queued = 0, done = 0, n;
+	struct lws_threadpool_create_args cargs;
+	struct lws_threadpool_task_args args;
+	enum lws_threadpool_task_status s;
+	struct lws_threadpool *tp;
+	lws_usec_t t0, us;
+	void *user;
+
+	memset(&cargs, 0, sizeof(cargs));
+	cargs.threads = threads;
+	cargs.max_queue_depth = BENCH_DEPTH;
+	cargs.pin_cpus = (char)pin;
+
+	tp = lws_threadpool_create(context, &cargs, "bench");
+	if (!tp)
+		return 1;
+
+	memset(&args, 0, sizeof(args));
+	args.wsi = wsi;
+	args.task = bench_task;
+
+	t0 = lws_now_usecs();
+
+	while (done < count && !interrupted) {
+		while (queued < count &&
+		       count_inflight < (int)LWS_ARRAY_SIZE(inflight) &&
+		       (inflight[count_inflight] =
+				lws_threadpool_enqueue(tp, &args, "b%d", queued))) {
+			count_inflight++;
+			queued++;
+		}
+
+		if (lws_service(context, 0) < 0)
+			break;
+
+		n = 0;
+		while (n < count_inflight) {
+			s = lws_threadpool_task_status(inflight[n], &user);
+			if (s != LWS_TP_STATUS_FINISHED &&
+			    s != LWS_TP_STATUS_STOPPED) {
+				n++;
+				continue;
+			}
+			inflight[n] = inflight[--count_inflight];
+			done++;
+		}
+	}
+
+	us = lws_now_usecs() - t0;
+
+	lws_threadpool_finish(tp);
+	lws_threadpool_destroy(tp);
+
+	lwsl_user("%2d workers: %d tasks in %dms, %dk tasks/s, %dns / task\n",
+		  threads, done, (int)(us / 1000),
+		  (int)(((lws_usec_t)done * 1000) / (us + 1)),
+		  (int)((us * 1000) / (done + 1)));
+
+	return done != count;
+}
+
+static int
+bench(struct lws_context *context, int max_threads, int pin, int count)
+{
+	lws_sock_file_fd_type u;
+	int fds[2], n, r = 0;
+	struct lws *wsi;
+
+	if (pipe(fds))
+		return 1;
+
+	u.filefd = (lws_filefd_type)(long long)fds[0];
+	wsi = lws_adopt_descriptor_vhost(lws_get_vhost_by_name(context,
+				"default"), LWS_ADOPT_RAW_FILE_DESC, u,
+				"http", NULL);
+	if (!wsi) {
+		close(fds[0]);
+		close(fds[1]);
+		return 1;
+	}
+
+	for (n = 1; !r && !interrupted; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+		r = bench_run(context, wsi, n, pin, count);
+		if (n == max_threads)
+			break;
+	}
+
+	close(fds[1]);
+
+	return r;
+}
+#endif
+
 int main(int argc, const char **argv)
 {
 	struct lws_context_creation_info info;
 	struct lws_context *context;
+	int bench_threads = 0, n;
 	const char *p;
 	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE
 			/* for LLL_ verbosity above NOTICE to be built into lws,
@@ -94,6 +214,16 @@ int main(int argc, const char **argv)
 	if ((p = lws_cmdline_option(argc, argv, "-d")))
 		logs = atoi(p);
 
+#if !defined(WIN32)
+	if (lws_cmdline_option(argc, argv, "--bench")) {
+		bench_threads = 8;
+		if ((p = lws_cmdline_option(argc, argv, "-t")))
+			bench_threads = atoi(p);
+		if (bench_threads < 1)
+			bench_threads = 1;
+	}
+#endif
+
 	lws_set_log_level(logs, NULL);
 	lwsl_user("LWS minimal ws server + threadpool | visit http://localhost:7681\n");
 
@@ -111,6 +241,18 @@ int main(int argc, const char **argv)
 		return 1;
 	}
 
+#if !defined(WIN32)
+	if (bench_threads) {
+		p = lws_cmdline_option(argc, argv, "-n");
+		n = bench(context, bench_threads,
+			  !!lws_cmdline_option(argc, argv, "--pin"),
+			  p ? atoi(p) : 200000);
+		lws_context_destroy(context);
+
+		return n;
+	}
+#endif
+
 	/* start the threads that create content */
 
 	while (!interrupted)
@@ -53,10 +53,12 @@ struct per_session_data__lws_mirror {
 	uint32_t tail;
 };
 
-/* this is the element in the ring */
+/*
+ * this is the element in the ring, framed (and compressed, for pmd) once and
+ * shared by all the connections it's sent on
+ */
 struct a_message {
-	void *payload;
-	size_t len;
+	lws_ws_bcast_t *bc;
 };
 
 struct mirror_instance {
@@ -185,9 +187,9 @@ __mirror_destroy_message(void *_msg)
 {
 	struct a_message *msg = _msg;
 
-	free(msg->payload);
-	msg->payload = NULL;
-	msg->len = 0;
+	if (msg->bc)
+		lws_ws_bcast_unref(msg->bc);
+	msg->bc = NULL;
 }
 
 static int
@@ -373,7 +375,7 @@ bail1:
 			if (!msg)
 				break;
 
-			if (!msg->payload) {
+			if (!msg->bc) {
 				lwsl_err("%s: NULL payload: worst = %d,"
 					 " pss->tail = %d\n", __func__,
 					 oldest_tail, pss->tail);
@@ -383,8 +385,7 @@ bail1:
 				break;
 			}
 
-			n = lws_write(wsi, (unsigned char *)msg->payload +
-				      LWS_PRE, msg->len, LWS_WRITE_TEXT);
+			n = lws_ws_bcast_write(wsi, msg->bc);
 			if (n < 0) {
 				lwsl_info("%s: WRITEABLE: %d\n", __func__, n);
 
@@ -435,14 +436,13 @@ bail2:
 			goto req_writable;
 		}
 
-		amsg.payload = malloc(LWS_PRE + len);
-		amsg.len = len;
-		if (!amsg.payload) {
+		amsg.bc = lws_ws_bcast_create(lws_get_context(wsi), in, len,
+					      LWS_WRITE_TEXT);
+		if (!amsg.bc) {
 			lwsl_notice("OOM: dropping\n");
 			goto done2;
 		}
 
-		memcpy((char *)amsg.payload + LWS_PRE, in, len);
 		if (!lws_ring_insert(pss->mi->ring, &amsg, 1)) {
 			__mirror_destroy_message(&amsg);
 			lwsl_notice("dropping!\n");
@@ -72,6 +72,7 @@ struct conn {
 	char rx_enabled[2];
 	char closed[2];
 	char established[2];
+	char spliced[2]; /* rx from this side goes to the other via a pipe */
 };
 
 struct raw_pss {
@@ -169,6 +170,35 @@ flow_control(struct conn *conn, int side, int enable)
 	return 0;
 }
 
+/*
+ * Send on what the kernel moved into the pipe from side's rx, to the other
+ * side.  Side's rx stays flow controlled until the pipe is empty again.
+ */
+
+static int
+splice_send(struct conn *conn, int side)
+{
+	struct lws *wsi = conn->wsi[!side];
+	int n;
+
+	n = lws_raw_splice_send(wsi);
+	if (n < 0)
+		return -1;
+
+	if (n) {
+		flow_control(conn, side, 0);
+		lws_callback_on_writable(wsi);
+
+		return 0;
+	}
+
+	if (conn->closed[side])
+		/* there is never going to be any more */
+		return lws_raw_transaction_completed(wsi);
+
+	return flow_control(conn, side, 1);
+}
+
 static int
 callback_raw_proxy(struct lws *wsi, enum lws_callback_reasons reason,
 		   void *user, void *in, size_t len)
@@ -259,8 +289,23 @@ bad_onward:
 
         case LWS_CALLBACK_RAW_PROXY_CLI_ADOPT:
 		lwsl_debug("%s: %p: LWS_CALLBACK_RAW_CLI_ADOPT: pss %p\n", __func__, wsi, pss);
-		if (conn || !pss)
+		if (!pss)
 			break;
+		if (conn) {
+			/*
+			 * It comes again when the onward connection is up.
+			 * If neither side has tls, the kernel can pass the
+			 * data between the sockets without us copying it.
+			 * Otherwise rx is relayed using the rings as before.
+			 */
+			if (!conn->closed[ACC]) {
+				conn->spliced[ACC] = !lws_raw_splice(
+						conn->wsi[ACC], wsi);
+				conn->spliced[ONW] = !lws_raw_splice(wsi,
+						conn->wsi[ACC]);
+			}
+			break;
+		}
 		conn = pss->conn = lws_get_opaque_user_data(wsi);
 		if (!conn)
 			break;
@@ -283,8 +328,14 @@ bad_onward:
 
 		conn->closed[ONW] = 1;
 
-		if (conn->closed[ACC])
+		if (conn->closed[ACC]) {
 			destroy_conn(vhd, pss);
+			break;
+		}
+
+		/* accepted side must still send what's left in the pipe */
+		if (conn->spliced[ONW])
+			lws_callback_on_writable(conn->wsi[ACC]);
 
 		break;
 
@@ -299,6 +350,15 @@ bad_onward:
 				  pss, conn->wsi[ACC], conn->closed[ACC]);
 			return -1;
 		}
+
+		if (!in) {
+			/* it was spliced, it goes after anything in the ring */
+			if (lws_ring_get_element(conn->r[ONW], &conn->t[ONW]))
+				return flow_control(conn, ONW, 0);
+
+			return splice_send(conn, ONW);
+		}
+
 		pkt.payload = malloc(len);
 		if (!pkt.payload) {
 			lwsl_notice("OOM: dropping\n");
@@ -332,6 +392,8 @@ bad_onward:
 			break;
 
 		ppkt = lws_ring_get_element(conn->r[ACC], &conn->t[ACC]);
+		if (!ppkt && conn->spliced[ACC])
+			return splice_send(conn, ACC);
 		if (!ppkt) {
 			lwsl_info("%s: CLI_WRITABLE had nothing in acc ring\n",
 				  __func__);
@@ -371,6 +433,10 @@ bad_onward:
 		if (ppkt && ppkt->ticket == conn->ticket_retired + 1)
 			lws_callback_on_writable(wsi);
 		else {
+			/* what's in the pipe can go now the ring is empty */
+			if (!ppkt && conn->spliced[ACC])
+				return splice_send(conn, ACC);
+
 			/*
 			 * defer checking for accepted side closing until we
 			 * sent everything in the ring to onward
@@ -436,8 +502,14 @@ bad_onward:
 			break;
 
 		conn->closed[ACC] = 1;
-		if (conn->closed[ONW])
+		if (conn->closed[ONW]) {
 			destroy_conn(vhd, pss);
+			break;
+		}
+
+		/* onward side must still send what's left in the pipe */
+		if (conn->spliced[ACC])
+			lws_callback_on_writable(conn->wsi[ONW]);
 		break;
 
 	case LWS_CALLBACK_RAW_PROXY_SRV_RX:
@@ -456,6 +528,14 @@ bad_onward:
 		if (!len)
 			return 0;
 
+		if (!in) {
+			/* it was spliced, it goes after anything in the ring */
+			if (lws_ring_get_element(conn->r[ACC], &conn->t[ACC]))
+				return flow_control(conn, ACC, 0);
+
+			return splice_send(conn, ACC);
+		}
+
 		pkt.payload = malloc(len);
 		if (!pkt.payload) {
 			lwsl_notice("OOM: dropping\n");
@@ -485,10 +565,17 @@ bad_onward:
 	case LWS_CALLBACK_RAW_PROXY_SRV_WRITEABLE:
 		lwsl_debug("LWS_CALLBACK_RAW_PROXY_SRV_WRITEABLE\n");
 
-		if (!conn || !conn->established[ONW] || conn->closed[ONW])
+		if (!conn || !conn->established[ONW])
 			break;
 
 		ppkt = lws_ring_get_element(conn->r[ONW], &conn->t[ONW]);
+		if (!ppkt && conn->spliced[ONW])
+			/* the pipe outlives the onward side closing */
+			return splice_send(conn, ONW);
+
+		if (conn->closed[ONW])
+			break;
+
 		if (!ppkt) {
 			lwsl_info("%s: SRV_WRITABLE nothing in onw ring\n",
 				  __func__);
@@ -530,6 +617,10 @@ bad_onward:
 		if (ppkt && ppkt->ticket == conn->ticket_retired + 1)
 			lws_callback_on_writable(wsi);
 		else {
+			/* what's in the pipe can go now the ring is empty */
+			if (!ppkt && conn->spliced[ONW])
+				return splice_send(conn, ONW);
+
 			/*
 			 * defer checking for onward side closing until we
 			 * sent everything in the ring to accepted side